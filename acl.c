@@ -27,6 +27,9 @@
 #include "access.h"
 #include "mem.h"
 #include "filetype.h"
+#include "hash.h"
+#include "ip_trie.h"
+#include "ci_regex.h"
 #include <ctype.h>
 #include <time.h>
 
@@ -88,24 +91,15 @@ void *get_icap_response_header(ci_request_t *req, char *param);
 void *get_http_req_header(ci_request_t *req, char *param);
 void *get_http_resp_header(ci_request_t *req, char *param);
 
-void free_icap_header(ci_request_t *req,void *param);
-void free_icap_response_header(ci_request_t *req, void *param);
-void free_http_req_header(ci_request_t *req, void *param);
-void free_http_resp_header(ci_request_t *req, void *param);
 
 void *get_http_req_url(ci_request_t *req, char *param);
-void free_http_req_url(ci_request_t *req, void *data);
 void *get_http_req_line(ci_request_t *req, char *param);
-void free_http_req_line(ci_request_t *req, void *data);
 void *get_http_resp_line(ci_request_t *req, char *param);
-void free_http_resp_line(ci_request_t *req, void *data);
 #endif
 
 void *get_http_req_method(ci_request_t *req, char *param);
-void free_http_req_method(ci_request_t *req, void *param);
 
 void *get_data_type(ci_request_t *req, char *param);
-void free_data_type(ci_request_t *req,void *param);
 
 ci_acl_type_t acl_user = {
     "user",
@@ -167,49 +161,49 @@ ci_acl_type_t acl_tcp_xclientip = {
 ci_acl_type_t acl_icap_header = {
     "icap_header",
     get_icap_header,
-    free_icap_header,
+    NULL,
     &ci_regex_ops
 };
 
 ci_acl_type_t acl_icap_resp_header = {
     "icap_resp_header",
     get_icap_response_header,
-    free_icap_response_header,
+    NULL,
     &ci_regex_ops
 };
 
 ci_acl_type_t acl_http_req_header = {
     "http_req_header",
     get_http_req_header,
-    free_http_req_header,
+    NULL,
     &ci_regex_ops
 };
 
 ci_acl_type_t acl_http_resp_header = {
     "http_resp_header",
     get_http_resp_header,
-    free_http_resp_header,
+    NULL,
     &ci_regex_ops
 };
 
 ci_acl_type_t acl_http_req_url = {
     "http_req_url",
     get_http_req_url,
-    free_http_req_url,
+    NULL,
     &ci_regex_ops
 };
 
 ci_acl_type_t acl_http_req_line = {
     "http_req_line",
     get_http_req_line,
-    free_http_req_line,
+    NULL,
     &ci_regex_ops
 };
 
 ci_acl_type_t acl_http_resp_line = {
     "http_resp_line",
     get_http_resp_line,
-    free_http_resp_line,
+    NULL,
     &ci_regex_ops
 };
 #endif
@@ -217,14 +211,14 @@ ci_acl_type_t acl_http_resp_line = {
 ci_acl_type_t acl_http_req_method = {
     "http_req_method",
     get_http_req_method,
-    free_http_req_method,
+    NULL,
     &ci_str_ops
 };
 
 ci_acl_type_t acl_data_type = {
     "data_type",
     get_data_type,
-    free_data_type,
+    NULL,
     &ci_datatype_ops
 };
 
@@ -268,12 +262,11 @@ static const ci_type_ops_t acl_cmp_uint64_ops = {
     acl_cmp_uint64_equal
 };
 
-void free_cmp_uint64_data(ci_request_t *req,void *param);
 void *get_content_length(ci_request_t *req, char *param);
 static ci_acl_type_t acl_content_length = {
     "content_length",
     get_content_length,
-    free_cmp_uint64_data,
+    NULL,
     &acl_cmp_uint64_ops
 };
 
@@ -308,12 +301,11 @@ static const ci_type_ops_t acl_time_ops = {
 };
 
 /*The acl type*/
-void free_time_data(ci_request_t *req,void *param);
 void *get_time_data(ci_request_t *req, char *param);
 static ci_acl_type_t acl_time = {
     "time",
     get_time_data,
-    free_time_data,
+    NULL,
     &acl_time_ops
 };
 
@@ -461,18 +453,14 @@ void acl_time_free(void *tmd, ci_mem_allocator_t *allocator)
     allocator->free(allocator, (void *)tmd);
 }
 
-void free_time_data(ci_request_t *req,void *param)
-{
-    /*Nothing to do*/
-    ci_debug_printf(5, "free_time_data(req=%p, param=%p)", req, param);
-    ci_buffer_free(param);
-}
 
 void *get_time_data(ci_request_t *req, char *param)
 {
-    struct acl_time_data *tmd_req = ci_buffer_alloc(sizeof(struct acl_time_data));
+    struct acl_time_data *tmd_req;
     struct tm br_tm;
     time_t tm;
+    if (!(tmd_req = ci_request_mem_alloc(req, sizeof(struct acl_time_data))))
+        return NULL;
     time(&tm);
     localtime_r(&tm, &br_tm);
     tmd_req->days = 0;
@@ -550,12 +538,18 @@ void ci_access_entry_release(ci_access_entry_t *list)
 
 }
 
+static void acl_index_compile(struct ci_acl_index *idx);
+
 const ci_acl_spec_t *ci_access_entry_add_acl(ci_access_entry_t *access_entry, const ci_acl_spec_t *acl, int negate)
 {
     struct ci_specs_list *spec_list,*spec_entry;
     if (access_entry == NULL)
         return NULL;
 
+    /*Normally the acl data are already added, finish their index*/
+    if (acl->index)
+        acl_index_compile(acl->index);
+
     spec_entry = malloc(sizeof(struct ci_specs_list));
     if (spec_entry == NULL)
         return NULL;
@@ -667,9 +661,269 @@ int ci_acl_typelist_reset(struct ci_acl_type_list *list)
     return 1;
 }
 
+/*********************************************************************************/
+/* ci_acl_index functions                                                        */
+
+/*
+  The acl data of the str and int32 types (user, service, port, ...) are
+  indexed using a hash table, of the ip acls (src, srvip, ...) using an
+  ip trie, of the content_length acls using a sorted array, of the
+  time acls using a minutes bitmap per week day and of the regex acls
+  (http_req_url, http_req_header, ...) using a regex set. The
+  indexes are built while the acl data are added, on configuration load.
+  The regex sets are recompiled when their size doubles and when the
+  acl is added to an access entry.
+  The acls of the other types are checked walking the acl data list.
+*/
+
+enum {ACL_INDEX_HASH, ACL_INDEX_IP, ACL_INDEX_SOCKADDR, ACL_INDEX_UINT64, ACL_INDEX_TIME, ACL_INDEX_REGEX};
+
+/*Small acls are faster to check walking the acl data list*/
+#define ACL_INDEX_HASH_MIN 4
+#define ACL_INDEX_REGEX_MIN 4
+#define ACL_DAY_MINUTES (24 * 60 + 1)
+#define ACL_DAY_WORDS ((ACL_DAY_MINUTES + 31) / 32)
+
+struct ci_acl_index {
+    int kind;
+    int items;
+    /*ACL_INDEX_HASH*/
+    struct ci_hash_table *hash;
+    /*ACL_INDEX_IP and ACL_INDEX_SOCKADDR*/
+    ci_ip_trie_t *ip_trie;
+    /*ACL_INDEX_UINT64*/
+    uint64_t *values;
+    int values_size;
+    /*ACL_INDEX_TIME*/
+    uint32_t (*minutes)[ACL_DAY_WORDS];
+    /*ACL_INDEX_REGEX*/
+    ci_regex_set_t *regex_set;
+    int regex_compiled;
+};
+
+static int acl_index_kind(const ci_type_ops_t *ops)
+{
+    if (ops == &ci_str_ops || ops == &ci_int32_ops)
+        return ACL_INDEX_HASH;
+    if (ops == &ci_ip_ops)
+        return ACL_INDEX_IP;
+    if (ops == &ci_ip_sockaddr_ops)
+        return ACL_INDEX_SOCKADDR;
+    if (ops == &acl_cmp_uint64_ops)
+        return ACL_INDEX_UINT64;
+    if (ops == &acl_time_ops)
+        return ACL_INDEX_TIME;
+#if defined(USE_REGEX)
+    if (ops == &ci_regex_ops)
+        return ACL_INDEX_REGEX;
+#endif
+    return -1;
+}
+
+static void acl_index_release(struct ci_acl_index *idx)
+{
+    if (idx->hash)
+        ci_hash_destroy(idx->hash);
+    if (idx->ip_trie)
+        ci_ip_trie_destroy(idx->ip_trie);
+    if (idx->regex_set)
+        ci_regex_set_destroy(idx->regex_set);
+    free(idx->values);
+    free(idx->minutes);
+    free(idx);
+}
+
+static struct ci_acl_index *acl_index_new(int kind)
+{
+    struct ci_acl_index *idx;
+    if (!(idx = calloc(1, sizeof(struct ci_acl_index))))
+        return NULL;
+    idx->kind = kind;
+    if (kind == ACL_INDEX_TIME && !(idx->minutes = calloc(7, sizeof(*idx->minutes)))) {
+        free(idx);
+        return NULL;
+    }
+    return idx;
+}
+
+/*Builds the hash table from the acl data list, up to the "last" data*/
+static int acl_index_hash_build(const ci_acl_spec_t *spec, struct ci_acl_index *idx, const void *last)
+{
+    const ci_acl_data_t *d;
+    if (idx->hash)
+        ci_hash_destroy(idx->hash);
+    if (!(idx->hash = ci_hash_build(2 * idx->items, spec->type->type, ci_os_allocator)))
+        return 0;
+    for (d = spec->data; d != NULL; d = d->next) {
+        if (!ci_hash_add(idx->hash, d->data, d->data))
+            return 0;
+        if (d->data == last)
+            break;
+    }
+    return 1;
+}
+
+/*Compiles the regex set, if there are regexes added after the last compile*/
+static void acl_index_compile(struct ci_acl_index *idx)
+{
+    if (idx->kind != ACL_INDEX_REGEX || idx->items < ACL_INDEX_REGEX_MIN || idx->regex_compiled == idx->items)
+        return;
+    if (ci_regex_set_compile(idx->regex_set))
+        idx->regex_compiled = idx->items;
+}
+
+static int acl_index_add_item(const ci_acl_spec_t *spec, struct ci_acl_index *idx, const void *data)
+{
+    const struct ci_acl_regex *reg;
+    const struct acl_time_data *tmd;
+    uint64_t value, *values;
+    unsigned int day, minute, end;
+    int i;
+
+    idx->items++;
+    switch (idx->kind) {
+    case ACL_INDEX_HASH:
+        if (idx->items < ACL_INDEX_HASH_MIN)
+            return 1;
+        /*The hash table grows as the items are added*/
+        if (!idx->hash)
+            return acl_index_hash_build(spec, idx, data);
+        return ci_hash_add(idx->hash, data, data) != NULL;
+    case ACL_INDEX_IP:
+    case ACL_INDEX_SOCKADDR:
+        if (!idx->ip_trie && !(idx->ip_trie = ci_ip_trie_create()))
+            return 0;
+        /*Fails for not contiguous netmasks*/
+        return ci_ip_trie_add(idx->ip_trie, (const ci_ip_t *)data, data);
+    case ACL_INDEX_UINT64:
+        if (idx->items > idx->values_size) {
+            if (!(values = realloc(idx->values, 2 * idx->items * sizeof(uint64_t))))
+                return 0;
+            idx->values = values;
+            idx->values_size = 2 * idx->items;
+        }
+        /*Keep the values sorted*/
+        value = *(const uint64_t *)data;
+        for (i = idx->items - 1; i > 0 && idx->values[i - 1] > value; i--)
+            idx->values[i] = idx->values[i - 1];
+        idx->values[i] = value;
+        return 1;
+    case ACL_INDEX_TIME:
+        tmd = (const struct acl_time_data *)data;
+        end = tmd->end_time < ACL_DAY_MINUTES ? tmd->end_time : ACL_DAY_MINUTES - 1;
+        for (day = 0; day < 7; day++) {
+            if (!(tmd->days & (1 << day)))
+                continue;
+            for (minute = tmd->start_time; minute <= end; minute++)
+                idx->minutes[day][minute / 32] |= (uint32_t)1 << (minute % 32);
+        }
+        return 1;
+    case ACL_INDEX_REGEX:
+        reg = (const struct ci_acl_regex *)data;
+        if (!idx->regex_set && !(idx->regex_set = ci_regex_set_create()))
+            return 0;
+        if (ci_regex_set_add(idx->regex_set, reg->str, reg->flags, reg->preg) < 0)
+            return 0;
+        if (idx->items >= 2 * idx->regex_compiled)
+            acl_index_compile(idx);
+        return 1;
+    }
+    return 0;
+}
+
+/*Adds the new_data to the index of the spec, building it if required*/
+static void acl_index_add(ci_acl_spec_t *spec, const ci_acl_data_t *new_data)
+{
+    const ci_acl_data_t *d;
+    int kind = acl_index_kind(spec->type->type);
+    if (kind < 0)
+        return;
+
+    if (!spec->index) {
+        if (!(spec->index = acl_index_new(kind)))
+            return;
+        d = spec->data;
+    } else
+        d = new_data;
+
+    for (; d != NULL; d = d->next) {
+        if (!acl_index_add_item(spec, spec->index, d->data)) {
+            ci_debug_printf(1, "Failed to index the data of the acl %s, will check them sequentially\n", spec->name);
+            acl_index_release(spec->index);
+            spec->index = NULL;
+            return;
+        }
+    }
+}
+
+/*Returns 1 if the test data matches, 0 if not, and -1 if it is not indexed*/
+static int acl_index_match(const struct ci_acl_index *idx, const void *test_data)
+{
+    const struct acl_cmp_uint64_data *clen;
+    const struct acl_time_data *tmd;
+    unsigned int day, minute;
+    int low, high, mid, id;
+
+    switch (idx->kind) {
+    case ACL_INDEX_HASH:
+        if (!idx->hash)
+            return -1;
+        return ci_hash_search(idx->hash, test_data) != NULL;
+    case ACL_INDEX_IP:
+        return ci_ip_trie_search_ip(idx->ip_trie, (const ci_ip_t *)test_data) != NULL;
+    case ACL_INDEX_SOCKADDR:
+        return ci_ip_trie_search_sockaddr(idx->ip_trie, (const ci_sockaddr_t *)test_data) != NULL;
+    case ACL_INDEX_UINT64:
+        clen = (const struct acl_cmp_uint64_data *)test_data;
+        if (idx->items == 0)
+            return 0;
+        if (clen->operator == 1) /* > */
+            return clen->data > idx->values[0];
+        if (clen->operator == 2) /* < */
+            return clen->data < idx->values[idx->items - 1];
+        low = 0;
+        high = idx->items - 1;
+        while (low <= high) {
+            mid = (low + high) / 2;
+            if (idx->values[mid] == clen->data)
+                return 1;
+            if (idx->values[mid] < clen->data)
+                low = mid + 1;
+            else
+                high = mid - 1;
+        }
+        return 0;
+    case ACL_INDEX_TIME:
+        tmd = (const struct acl_time_data *)test_data;
+        minute = tmd->start_time;
+        if (minute >= ACL_DAY_MINUTES)
+            return 0;
+        for (day = 0; day < 7; day++) {
+            if ((tmd->days & (1 << day)) && (idx->minutes[day][minute / 32] & ((uint32_t)1 << (minute % 32))))
+                return 1;
+        }
+        return 0;
+    case ACL_INDEX_REGEX:
+        if (idx->items < ACL_INDEX_REGEX_MIN)
+            return -1;
+        return ci_regex_set_match(idx->regex_set, (const char *)test_data, -1, &id, 1);
+    }
+    return -1;
+}
+
 /*********************************************************************************/
 /*ci_acl_spec functions                                                          */
 
+/*The number of the per request memo slots used by the acl specs*/
+static int AclMemoSlots = 0;
+
+static int acl_param_equal(const char *param1, const char *param2)
+{
+    if (!param1 || !param2)
+        return param1 == param2;
+    return strcmp(param1, param2) == 0;
+}
+
 ci_acl_spec_t *  ci_acl_spec_new(const char *name, const char *type, const char *param, struct ci_acl_type_list *list, ci_acl_spec_t **spec_list)
 {
     ci_acl_spec_t *spec,*cur;
@@ -693,6 +947,20 @@ ci_acl_spec_t *  ci_acl_spec_new(const char *name, const char *type, const char
     spec->type = acl_type;
     spec->data = NULL;
     spec->next = NULL;
+    spec->index = NULL;
+
+    spec->id = AclMemoSlots++;
+    spec->test_data_id = -1;
+    if (spec_list != NULL) {
+        for (cur = *spec_list; cur != NULL; cur = cur->next) {
+            if (cur->type == acl_type && acl_param_equal(cur->parameter, param)) {
+                spec->test_data_id = cur->test_data_id;
+                break;
+            }
+        }
+    }
+    if (spec->test_data_id < 0)
+        spec->test_data_id = AclMemoSlots++;
 
     if (spec_list != NULL) {
         if (*spec_list != NULL) {
@@ -733,6 +1001,7 @@ ci_acl_data_t *ci_acl_spec_new_data(ci_acl_spec_t *spec, const char *val)
         list->next = new_data;
     } else
         spec->data = new_data;
+    acl_index_add(spec, new_data);
     return new_data;
 }
 
@@ -766,6 +1035,10 @@ void ci_acl_spec_release(ci_acl_spec_t *cur)
         ops->free(dtmp->data, ci_os_allocator);
         free(dtmp);
     }
+    cur->data = NULL;
+    if (cur->index)
+        acl_index_release(cur->index);
+    cur->index = NULL;
 }
 
 void ci_acl_spec_list_release(ci_acl_spec_t *spec)
@@ -785,8 +1058,13 @@ int spec_data_check(const ci_acl_spec_t *spec, const void *req_raw_data)
 //    int (*comp)(void *req_spec, void *acl_spec);
     struct ci_acl_data *spec_data = spec->data;
     const ci_type_ops_t *ops = spec->type->type;
+    int ret;
 
     ci_debug_printf(9,"Check request with ci_acl_spec_t:%s\n", spec->name);
+    if (spec->index && (ret = acl_index_match(spec->index, req_raw_data)) >= 0) {
+        ci_debug_printf(9,"The ci_acl_spec_t:%s %s\n", spec->name, ret ? "matches" : "does not match");
+        return ret;
+    }
     while (spec_data != NULL) {
         if (ops->equal(spec_data->data, (void *)req_raw_data)) {
             ci_debug_printf(9,"The ci_acl_spec_t:%s matches\n", spec->name);
@@ -797,52 +1075,125 @@ int spec_data_check(const ci_acl_spec_t *spec, const void *req_raw_data)
     return 0;
 }
 
-int request_match_specslist(ci_request_t *req, const struct ci_specs_list *spec_list)
+/*
+  Keeps the test data and the results of the acl specs checked while an
+  access list is matched against a request, so each test data retrieved
+  and each acl spec checked only once even if it is used by many access
+  entries. It is valid for one ci_access_entry_match_request call, the
+  test data may change while the request is processed.
+*/
+struct acl_memo_slot {
+    unsigned int generation;
+    int result;
+    void *data;
+};
+
+struct ci_acl_memo {
+    unsigned int generation;
+    int slots_num;
+    struct acl_memo_slot *slots;
+};
+
+static struct ci_acl_memo *acl_memo_begin(ci_request_t *req)
+{
+    struct ci_acl_memo *memo = req->acl_memo;
+    size_t size;
+
+    if (!memo || memo->slots_num < AclMemoSlots) {
+        size = sizeof(struct ci_acl_memo) + AclMemoSlots * sizeof(struct acl_memo_slot);
+        if (!(memo = ci_request_mem_alloc(req, size)))
+            return NULL;
+        memset(memo, 0, size);
+        memo->slots = (struct acl_memo_slot *)(memo + 1);
+        memo->slots_num = AclMemoSlots;
+        req->acl_memo = memo;
+    }
+    if (++memo->generation == 0) {
+        memset(memo->slots, 0, memo->slots_num * sizeof(struct acl_memo_slot));
+        memo->generation = 1;
+    }
+    return memo;
+}
+
+/*Returns 1 if the spec matches, 0 if not and -1 if there is not test data*/
+static int acl_spec_check(ci_request_t *req, struct ci_acl_memo *memo, const ci_acl_spec_t *spec)
 {
-    const ci_acl_spec_t *spec;
-    const ci_acl_type_t *type;
-    int ret, negate, check_result;
+    const ci_acl_type_t *type = spec->type;
+    struct acl_memo_slot *result_slot = NULL, *data_slot = NULL;
     void *test_data;
+    int result;
 
-    ret = 1;
-    while (spec_list != NULL) {
-        spec = spec_list->spec;
-        negate = spec_list->negate;
-        type = spec->type;
+    if (memo && spec->id >= 0 && spec->id < memo->slots_num) {
+        result_slot = &memo->slots[spec->id];
+        if (result_slot->generation == memo->generation)
+            return result_slot->result;
+    }
+
+    /*The test data which must be released can not be shared*/
+    if (memo && !type->free_test_data && spec->test_data_id >= 0 && spec->test_data_id < memo->slots_num)
+        data_slot = &memo->slots[spec->test_data_id];
+
+    if (data_slot && data_slot->generation == memo->generation)
+        test_data = data_slot->data;
+    else {
         test_data = type->get_test_data(req, spec->parameter);
-        if (!test_data) {
-            ci_debug_printf(3, "No data to test for %s/%s, ignore\n", type->name, spec->parameter);
-            return 0;
+        if (data_slot) {
+            data_slot->generation = memo->generation;
+            data_slot->data = test_data;
         }
-        ci_debug_printf(9, "Will check spec_list:%p acl %s of type '%s{%s}', against data %p\n", spec_list, spec->name, type->name, spec->parameter, test_data);
-        check_result = spec_data_check(spec, test_data);
-        if (check_result == 0 && negate == 0)
-            ret = 0;
-        else if (check_result != 0 && negate != 0)
-            ret = 0;
+    }
 
+    if (!test_data) {
+        ci_debug_printf(3, "No data to test for %s/%s, ignore\n", type->name, spec->parameter);
+        result = -1;
+    } else {
+        ci_debug_printf(9, "Will check acl %s of type '%s{%s}', against data %p\n", spec->name, type->name, spec->parameter, test_data);
+        result = spec_data_check(spec, test_data);
         if (type->free_test_data)
             type->free_test_data(req, test_data);
+    }
 
-        if (ret == 0)
-            return 0;
+    if (result_slot) {
+        result_slot->generation = memo->generation;
+        result_slot->result = result;
+    }
+    return result;
+}
 
+static int acl_match_specslist(ci_request_t *req, struct ci_acl_memo *memo, const struct ci_specs_list *spec_list)
+{
+    int check_result;
+
+    while (spec_list != NULL) {
+        check_result = acl_spec_check(req, memo, spec_list->spec);
+        if (check_result < 0)
+            return 0;
+        if ((check_result == 0 && spec_list->negate == 0) ||
+                (check_result != 0 && spec_list->negate != 0))
+            return 0;
         spec_list = spec_list->next;
     }
     return 1;
 }
 
+int request_match_specslist(ci_request_t *req, const struct ci_specs_list *spec_list)
+{
+    return acl_match_specslist(req, acl_memo_begin(req), spec_list);
+}
+
 int ci_access_entry_match_request(ci_access_entry_t *access_entry, ci_request_t *req)
 {
     struct ci_specs_list *spec_list;
+    struct ci_acl_memo *memo;
 
     if (!access_entry)
         return CI_ACCESS_ALLOW;
 
+    memo = acl_memo_begin(req);
     while (access_entry) {
         ci_debug_printf(9, "Check request with the access entry %p/%s\n", access_entry, ci_access_string(access_entry->type));
         spec_list = access_entry->spec_list;
-        if (spec_list && spec_list->spec && request_match_specslist(req, spec_list)) {
+        if (spec_list && spec_list->spec && acl_match_specslist(req, memo, spec_list)) {
             ci_debug_printf(9, "Check access entry %p, spec_list %p result: %s\n", access_entry, spec_list, ci_access_string(access_entry->type));
             return access_entry->type;
         }
@@ -897,6 +1248,7 @@ void ci_acl_reset()
 {
     ci_acl_spec_list_release(specs_list);
     specs_list = NULL;
+    AclMemoSlots = 0;
     ci_acl_typelist_reset(&types_list);
     acl_load_defaults();
 }
@@ -966,12 +1318,23 @@ int ci_acl_add_data(const char *name, const char *type, const char *data)
 
 /******************************************************/
 /* Some acl_type methods implementation               */
+
+/*Copy a not NULL terminated string to the request memory*/
+static char *acl_req_strndup(ci_request_t *req, const char *str, size_t len)
+{
+    char *buf;
+    if ((buf = ci_request_mem_alloc(req, len + 1))) {
+        memcpy(buf, str, len);
+        buf[len] = '\0';
+    }
+    return buf;
+}
+
 #if defined(USE_REGEX)
 
-const char *get_header(ci_headers_list_t *headers, char *head)
+const char *get_header(ci_request_t *req, ci_headers_list_t *headers, char *head)
 {
     const char *val;
-    char *buf;
     size_t value_size = 0;
 
     if (!headers || !head)
@@ -983,20 +1346,7 @@ const char *get_header(ci_headers_list_t *headers, char *head)
     if (!headers->packed) /*The headers are not packed, so it is NULL terminated*/
         return val;
 
-    /*assume that an 8k buffer is enough for a header value*/
-    if (!(buf = ci_buffer_alloc(value_size + 1)))
-        return NULL;
-
-    memcpy(buf, val, value_size);
-    buf[value_size] = '\0';
-
-    return buf;
-}
-
-void release_header_value(ci_headers_list_t *headers, char *head)
-{
-    if (headers && headers->packed && head) /*The headers are packed, we have allocated buffer*/
-        ci_buffer_free(head);
+    return acl_req_strndup(req, val, value_size);
 }
 
 void *get_icap_header(ci_request_t *req, char *param)
@@ -1005,14 +1355,7 @@ void *get_icap_header(ci_request_t *req, char *param)
     if (req->protocol == CI_PROTO_HTTP)
         return NULL;
     heads = req->request_header;
-    return (void *)get_header(heads, param);
-}
-
-void free_icap_header(ci_request_t *req, void *param)
-{
-    ci_headers_list_t *heads;
-    heads = req->request_header;
-    release_header_value(heads, param);
+    return (void *)get_header(req, heads, param);
 }
 
 void *get_icap_response_header(ci_request_t *req, char *param)
@@ -1021,14 +1364,7 @@ void *get_icap_response_header(ci_request_t *req, char *param)
     if (req->protocol == CI_PROTO_HTTP)
         return NULL;
     heads = req->response_header;
-    return (void *)get_header(heads, param);
-}
-
-void free_icap_response_header(ci_request_t *req, void *param)
-{
-    ci_headers_list_t *heads;
-    heads = req->response_header;
-    release_header_value(heads, param);
+    return (void *)get_header(req, heads, param);
 }
 
 void *get_http_req_header(ci_request_t *req, char *param)
@@ -1038,13 +1374,7 @@ void *get_http_req_header(ci_request_t *req, char *param)
         heads = req->request_header;
     else
         heads = ci_http_request_headers(req);
-    return (void *)get_header(heads, param);
-}
-void free_http_req_header(ci_request_t *req, void *param)
-{
-    ci_headers_list_t *heads;
-    heads = ci_http_request_headers(req);
-    release_header_value(heads, param);
+    return (void *)get_header(req, heads, param);
 }
 
 void *get_http_resp_header(ci_request_t *req, char *param)
@@ -1054,14 +1384,7 @@ void *get_http_resp_header(ci_request_t *req, char *param)
         heads = req->response_header;
     else
         heads = ci_http_response_headers(req);
-    return (void *)get_header(heads, param);
-}
-
-void free_http_resp_header(ci_request_t *req, void *param)
-{
-    ci_headers_list_t *heads;
-    heads = ci_http_response_headers(req);
-    release_header_value(heads, param);
+    return (void *)get_header(req, heads, param);
 }
 
 void *get_http_req_url(ci_request_t *req, char *param)
@@ -1074,21 +1397,17 @@ void *get_http_req_url(ci_request_t *req, char *param)
         heads = ci_http_request_headers(req);
     if (!heads)
         return NULL;
-    buf = ci_buffer_alloc(8192);
-    ci_http_request_url(req, buf, 8192);
+    buf = ci_request_mem_alloc(req, 8192);
+    if (buf)
+        ci_http_request_url(req, buf, 8192);
     return buf;
 }
-void free_http_req_url(ci_request_t *req, void *data)
-{
-    ci_buffer_free((char *)data);
-}
 
 void *get_http_req_line(ci_request_t *req, char *param)
 {
     ci_headers_list_t *heads;
     size_t first_line_size;
     const char *first_line;
-    char *buf;
     if (req->protocol == CI_PROTO_HTTP)
         heads = req->request_header;
     else
@@ -1104,25 +1423,14 @@ void *get_http_req_line(ci_request_t *req, char *param)
     if (!heads->packed) /*The headers are not packed, so it is NULL terminated*/
         return (void *)first_line;
 
-    buf = ci_buffer_alloc(first_line_size + 1);
-    memcpy(buf, first_line, first_line_size);
-    buf[first_line_size] = '\0';
-    return buf;
+    return acl_req_strndup(req, first_line, first_line_size);
 }
 
-void free_http_req_line(ci_request_t *req, void *data)
-{
-    ci_headers_list_t *heads;
-    heads = ci_http_request_headers(req);
-    if (heads->packed)
-        ci_buffer_free(data);
-}
 
 void *get_http_resp_line(ci_request_t *req, char *param)
 {
     size_t first_line_size;
     const char *first_line;
-    char *buf;
     ci_headers_list_t *heads;
     if (req->protocol == CI_PROTO_HTTP)
         heads = req->response_header;
@@ -1139,19 +1447,9 @@ void *get_http_resp_line(ci_request_t *req, char *param)
     if (!heads->packed) /*The headers are not packed, so it is NULL terminated*/
         return (void *)first_line;
 
-    buf = ci_buffer_alloc(first_line_size + 1);
-    memcpy(buf, first_line, first_line_size);
-    buf[first_line_size] = '\0';
-    return buf;
+    return acl_req_strndup(req, first_line, first_line_size);
 }
 
-void free_http_resp_line(ci_request_t *req, void *data)
-{
-    ci_headers_list_t *heads;
-    heads = ci_http_response_headers(req);
-    if (heads->packed)
-        ci_buffer_free(data);
-}
 #endif
 
 void *get_http_req_method(ci_request_t *req, char *param)
@@ -1159,7 +1457,6 @@ void *get_http_req_method(ci_request_t *req, char *param)
     ci_headers_list_t *heads;
     size_t found_size;
     const char *first_line, *e, *eol;
-    char *buf;
     if (req->protocol == CI_PROTO_HTTP)
         return (void *)ci_http_method_string(req->type);
 
@@ -1176,21 +1473,9 @@ void *get_http_req_method(ci_request_t *req, char *param)
     if (e == eol) /*No method found*/
         return NULL;
     found_size = e - first_line;
-    if ((buf = ci_buffer_alloc(found_size + 1))) {
-        memcpy(buf, first_line, found_size);
-        buf[found_size] = '\0';
-    }
-    return buf;
+    return acl_req_strndup(req, first_line, found_size);
 }
 
-void free_http_req_method(ci_request_t *req, void *data)
-{
-    if (req->protocol == CI_PROTO_HTTP)
-        return; /*No memory is allocated in this case*/
-
-    if (data)
-        ci_buffer_free(data);
-}
 
 void *get_data_type(ci_request_t *req, char *param)
 {
@@ -1200,7 +1485,7 @@ void *get_data_type(ci_request_t *req, char *param)
     if (type < 0)
         return NULL;
 
-    ret_type = malloc(sizeof(int));
+    ret_type = ci_request_mem_alloc(req, sizeof(int));
     if (!ret_type)
         return NULL;
 
@@ -1208,17 +1493,15 @@ void *get_data_type(ci_request_t *req, char *param)
     return (void *)ret_type;
 }
 
-void free_data_type(ci_request_t *req,void *param)
-{
-    free(param);
-}
 
 void *get_content_length(ci_request_t *req, char *param)
 {
-    struct acl_cmp_uint64_data *clen_p = (struct acl_cmp_uint64_data *)ci_buffer_alloc(sizeof(struct acl_cmp_uint64_data));
+    struct acl_cmp_uint64_data *clen_p;
     ci_off_t clen = ci_http_content_length(req);
     if (clen < 0)
         return NULL;
+    if (!(clen_p = ci_request_mem_alloc(req, sizeof(struct acl_cmp_uint64_data))))
+        return NULL;
     clen_p->data = (uint64_t)clen;
     if (!param)
         clen_p->operator = 0; // by default equal
@@ -1235,8 +1518,4 @@ void *get_content_length(ci_request_t *req, char *param)
     return clen_p;
 }
 
-void free_cmp_uint64_data(ci_request_t *req, void *param)
-{
-    ci_buffer_free(param);
-}
 
@@ -60,6 +60,7 @@ int clear_pid(char *pidfile);
 int is_icap_running(char *pidfile);
 int set_running_permissions(char *user, char *group);
 void init_internal_lookup_tables();
+void init_internal_cache_types();
 void request_stats_init();
 void http_server_init();
 void init_http_auth();
@@ -170,6 +171,7 @@ int main(int argc, char **argv)
     ci_mem_init();
     ci_atomics_init();
     init_internal_lookup_tables();
+    init_internal_cache_types();
     ci_acl_init();
     init_http_auth();
     if (init_body_system() != CI_OK) {
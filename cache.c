@@ -25,6 +25,7 @@
 #include "array.h"
 #include "cache.h"
 #include "registry.h"
+#include "stats.h"
 #include "proc_mutex.h"
 #include "ci_threads.h"
 #include <assert.h>
@@ -384,6 +385,336 @@ int ci_local_cache_update(struct ci_cache *cache, const void *key, const void *v
     return 1;
 }
 
+/*****************************************/
+/*Sharded local cache implementation     */
+
+/*
+  A process local cache split to a number of shards, each one with its
+  own mutex, hash table and entries, so threads looking up different
+  keys rarely wait each other. The entries are preallocated per shard
+  as fixed size slots able to hold max_object_size bytes of key and
+  value data. When a shard is full the CLOCK algorithm selects the entry
+  to replace: a successful lookup marks the entry as referenced and the
+  clock hand gives a second chance to referenced entries, replacing the
+  first expired or not recently used entry.
+*/
+
+int ci_sharded_cache_init(struct ci_cache *cache, const char *name);
+const void *ci_sharded_cache_search(struct ci_cache *cache, const void *key, void **val, void *data, void *(*dup_from_cache)(const void *stored_val, size_t stored_val_size, void *data));
+int ci_sharded_cache_update(struct ci_cache *cache, const void *key, const void *val, size_t val_size, void *(*copy_to_cache)(void *buf, const void *val, size_t buf_size));
+void ci_sharded_cache_destroy(struct ci_cache *cache);
+
+struct ci_cache_type ci_sharded_cache = {
+    ci_sharded_cache_init,
+    ci_sharded_cache_search,
+    ci_sharded_cache_update,
+    ci_sharded_cache_destroy,
+    "local_sharded"
+};
+
+#define SHARDED_CACHE_MAX_SHARDS 16
+#define SHARDED_CACHE_MIN_SHARD_ITEMS 16
+/*Per shard operations before publishing the shard statistics*/
+#define SHARDED_CACHE_STATS_SYNC 64
+#define SHARDED_CACHE_ALIGN(size) (((size) + 7) & ~((size_t)7))
+#define SHARDED_CACHE_LINE 64
+
+struct ci_sharded_cache_entry {
+    struct ci_sharded_cache_entry *hnext;
+    time_t time;
+    unsigned int hash;
+    unsigned int key_size; /*0 for unused entries*/
+    unsigned int val_size;
+    int referenced;
+};
+
+#define SHARDED_CACHE_ENTRY_HEAD SHARDED_CACHE_ALIGN(sizeof(struct ci_sharded_cache_entry))
+#define SHARDED_CACHE_ENTRY_KEY(e) ((char *)(e) + SHARDED_CACHE_ENTRY_HEAD)
+#define SHARDED_CACHE_ENTRY_VAL(e) (SHARDED_CACHE_ENTRY_KEY(e) + SHARDED_CACHE_ALIGN((e)->key_size))
+
+struct ci_sharded_cache_shard {
+    /*The lock and the counters do not share cache lines with the
+      neighbour memory blocks or with the shard hash table*/
+    char pad1[SHARDED_CACHE_LINE];
+    ci_thread_mutex_t mtx;
+    struct ci_sharded_cache_entry **hash_table;
+    char *slab;
+    unsigned int slots;
+    unsigned int used;
+    unsigned int hand;
+    int ops;
+    int64_t hits;
+    int64_t misses;
+    int64_t updates;
+    int64_t evictions;
+    char pad2[SHARDED_CACHE_LINE];
+};
+
+struct ci_sharded_cache_data {
+    struct ci_sharded_cache_shard **shards;
+    unsigned int shards_num;
+    unsigned int shard_bits;
+    unsigned int hash_mask;
+    size_t slot_size;
+    int stat_hits;
+    int stat_misses;
+    int stat_updates;
+    int stat_evictions;
+};
+
+static unsigned int sharded_cache_hash(const void *key, int key_size)
+{
+    unsigned int hash = ci_hash_compute(0xFFFFFFFF, key, key_size);
+    /*The low bits select the shard, mix the higher bits into them*/
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3b;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static void sharded_cache_shard_stats(struct ci_sharded_cache_data *cache_data, struct ci_sharded_cache_shard *shard, int force)
+{
+    if (++shard->ops < SHARDED_CACHE_STATS_SYNC && !force)
+        return;
+    if (shard->hits)
+        ci_stat_uint64_inc(cache_data->stat_hits, shard->hits);
+    if (shard->misses)
+        ci_stat_uint64_inc(cache_data->stat_misses, shard->misses);
+    if (shard->updates)
+        ci_stat_uint64_inc(cache_data->stat_updates, shard->updates);
+    if (shard->evictions)
+        ci_stat_uint64_inc(cache_data->stat_evictions, shard->evictions);
+    shard->hits = shard->misses = shard->updates = shard->evictions = 0;
+    shard->ops = 0;
+}
+
+int ci_sharded_cache_init(struct ci_cache *cache, const char *name)
+{
+    struct ci_sharded_cache_data *cache_data;
+    struct ci_sharded_cache_shard *shard;
+    unsigned int cache_items, shard_items, hash_size, i;
+    char buf[512];
+
+    if (cache->max_object_size == 0) {
+        ci_debug_printf(1, "Cache %s: the maximum object size should be set for local_sharded caches\n", name);
+        return 0;
+    }
+
+    cache_data = malloc(sizeof(struct ci_sharded_cache_data));
+    if (!cache_data)
+        return 0;
+
+    cache_data->slot_size = SHARDED_CACHE_ENTRY_HEAD + SHARDED_CACHE_ALIGN(cache->max_object_size);
+    cache_items = cache->mem_size / cache_data->slot_size;
+    if (cache_items == 0) {
+        free(cache_data);
+        return 0;
+    }
+
+    cache_data->shards_num = SHARDED_CACHE_MAX_SHARDS;
+    while (cache_data->shards_num > 1 && cache_items / cache_data->shards_num < SHARDED_CACHE_MIN_SHARD_ITEMS)
+        cache_data->shards_num >>= 1;
+    for (cache_data->shard_bits = 0; (1U << cache_data->shard_bits) < cache_data->shards_num; cache_data->shard_bits++);
+    shard_items = cache_items / cache_data->shards_num;
+
+    for (hash_size = 64; hash_size < shard_items && hash_size < 0x1000000; hash_size <<= 1);
+    cache_data->hash_mask = hash_size - 1;
+    ci_debug_printf(7, "Cache %s: %u shards of %u items, hash size: %u\n", name, cache_data->shards_num, shard_items, hash_size);
+
+    cache_data->shards = calloc(cache_data->shards_num, sizeof(struct ci_sharded_cache_shard *));
+    if (!cache_data->shards) {
+        free(cache_data);
+        return 0;
+    }
+    for (i = 0; i < cache_data->shards_num; i++) {
+        /*The shard, its hash table and its entries in one memory block*/
+        shard = malloc(sizeof(struct ci_sharded_cache_shard) + hash_size * sizeof(struct ci_sharded_cache_entry *) + shard_items * cache_data->slot_size);
+        if (!shard) {
+            cache->cache_data = cache_data;
+            ci_sharded_cache_destroy(cache);
+            return 0;
+        }
+        memset(shard, 0, sizeof(struct ci_sharded_cache_shard));
+        shard->hash_table = (struct ci_sharded_cache_entry **)((char *)shard + sizeof(struct ci_sharded_cache_shard));
+        memset(shard->hash_table, 0, hash_size * sizeof(struct ci_sharded_cache_entry *));
+        shard->slab = (char *)shard->hash_table + hash_size * sizeof(struct ci_sharded_cache_entry *);
+        shard->slots = shard_items;
+        ci_thread_mutex_init(&shard->mtx);
+        cache_data->shards[i] = shard;
+    }
+
+    snprintf(buf, sizeof(buf), "local_sharded(%s)_hits", name);
+    cache_data->stat_hits = ci_stat_entry_register(buf, CI_STAT_INT64_T, "local_sharded_cache");
+    snprintf(buf, sizeof(buf), "local_sharded(%s)_miss", name);
+    cache_data->stat_misses = ci_stat_entry_register(buf, CI_STAT_INT64_T, "local_sharded_cache");
+    snprintf(buf, sizeof(buf), "local_sharded(%s)_updates", name);
+    cache_data->stat_updates = ci_stat_entry_register(buf, CI_STAT_INT64_T, "local_sharded_cache");
+    snprintf(buf, sizeof(buf), "local_sharded(%s)_evictions", name);
+    cache_data->stat_evictions = ci_stat_entry_register(buf, CI_STAT_INT64_T, "local_sharded_cache");
+
+    cache->cache_data = cache_data;
+    return 1;
+}
+
+void ci_sharded_cache_destroy(struct ci_cache *cache)
+{
+    unsigned int i;
+    struct ci_sharded_cache_data *cache_data = (struct ci_sharded_cache_data *)cache->cache_data;
+    for (i = 0; i < cache_data->shards_num; i++) {
+        if (!cache_data->shards[i])
+            continue;
+        sharded_cache_shard_stats(cache_data, cache_data->shards[i], 1);
+        ci_thread_mutex_destroy(&cache_data->shards[i]->mtx);
+        free(cache_data->shards[i]);
+    }
+    free(cache_data->shards);
+    free(cache_data);
+}
+
+static struct ci_sharded_cache_entry *sharded_cache_shard_find(struct ci_cache *cache, struct ci_sharded_cache_shard *shard, unsigned int bucket, const void *key, unsigned int hash)
+{
+    struct ci_sharded_cache_entry *e;
+    for (e = shard->hash_table[bucket]; e != NULL; e = e->hnext) {
+        if (e->hash == hash && cache->key_ops->compare(SHARDED_CACHE_ENTRY_KEY(e), key) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+static void sharded_cache_shard_unlink(struct ci_sharded_cache_data *cache_data, struct ci_sharded_cache_shard *shard, struct ci_sharded_cache_entry *e)
+{
+    struct ci_sharded_cache_entry **pe;
+    pe = &shard->hash_table[(e->hash >> cache_data->shard_bits) & cache_data->hash_mask];
+    while (*pe && *pe != e)
+        pe = &(*pe)->hnext;
+    if (*pe)
+        *pe = e->hnext;
+    e->hnext = NULL;
+    e->key_size = 0;
+}
+
+/*Returns an unused entry, replacing an existing one if the shard is full*/
+static struct ci_sharded_cache_entry *sharded_cache_shard_evict(struct ci_cache *cache, struct ci_sharded_cache_data *cache_data, struct ci_sharded_cache_shard *shard, time_t current_time)
+{
+    struct ci_sharded_cache_entry *e;
+
+    if (shard->used < shard->slots) {
+        e = (struct ci_sharded_cache_entry *)(shard->slab + (shard->used++) * cache_data->slot_size);
+        e->key_size = 0;
+        return e;
+    }
+
+    /*Terminates in at most two rounds, the first one clears the referenced flags*/
+    while (1) {
+        e = (struct ci_sharded_cache_entry *)(shard->slab + shard->hand * cache_data->slot_size);
+        if (++shard->hand == shard->slots)
+            shard->hand = 0;
+        if (e->key_size == 0)
+            return e;
+        if ((current_time - e->time) <= cache->ttl) {
+            if (e->referenced) {
+                e->referenced = 0;
+                continue;
+            }
+            shard->evictions++;
+        }
+        sharded_cache_shard_unlink(cache_data, shard, e);
+        return e;
+    }
+}
+
+const void *ci_sharded_cache_search(struct ci_cache *cache, const void *key, void **val, void *data, void *(*dup_from_cache)(const void *stored_val, size_t stored_val_size, void *data))
+{
+    struct ci_sharded_cache_entry *e;
+    struct ci_sharded_cache_shard *shard;
+    struct ci_sharded_cache_data *cache_data = (struct ci_sharded_cache_data *)cache->cache_data;
+    unsigned int hash = sharded_cache_hash(key, cache->key_ops->size(key));
+    time_t current_time = ci_internal_time();
+
+    shard = cache_data->shards[hash & (cache_data->shards_num - 1)];
+    *val = NULL;
+    ci_thread_mutex_lock(&shard->mtx);
+    e = sharded_cache_shard_find(cache, shard, (hash >> cache_data->shard_bits) & cache_data->hash_mask, key, hash);
+    if (e && (current_time - e->time) > cache->ttl)
+        e = NULL;
+    if (e && e->val_size) {
+        if (dup_from_cache)
+            *val = dup_from_cache(SHARDED_CACHE_ENTRY_VAL(e), e->val_size, data);
+        else if ((*val = ci_buffer_alloc(e->val_size)))
+            memcpy(*val, SHARDED_CACHE_ENTRY_VAL(e), e->val_size);
+        else
+            e = NULL; /*Can not copy the value, report a miss*/
+    }
+    if (e) {
+        e->referenced = 1;
+        shard->hits++;
+    } else {
+        key = NULL;
+        shard->misses++;
+    }
+    sharded_cache_shard_stats(cache_data, shard, 0);
+    ci_thread_mutex_unlock(&shard->mtx);
+    return key;
+}
+
+int ci_sharded_cache_update(struct ci_cache *cache, const void *key, const void *val, size_t val_size, void *(*copy_to_cache)(void *buf, const void *val, size_t buf_size))
+{
+    struct ci_sharded_cache_entry *e;
+    struct ci_sharded_cache_shard *shard;
+    struct ci_sharded_cache_data *cache_data = (struct ci_sharded_cache_data *)cache->cache_data;
+    unsigned int hash, bucket;
+    time_t current_time;
+    int key_size = cache->key_ops->size(key);
+
+    if (val == NULL)
+        val_size = 0;
+    if (SHARDED_CACHE_ALIGN(key_size) + val_size > cache->max_object_size) {
+        ci_debug_printf(6, "ci_cache_update: object of size %d is too big for the cache\n", (int)(key_size + val_size));
+        return 0;
+    }
+
+    hash = sharded_cache_hash(key, key_size);
+    bucket = (hash >> cache_data->shard_bits) & cache_data->hash_mask;
+    shard = cache_data->shards[hash & (cache_data->shards_num - 1)];
+    current_time = ci_internal_time();
+
+    ci_thread_mutex_lock(&shard->mtx);
+    e = sharded_cache_shard_find(cache, shard, bucket, key, hash);
+    if (!e) {
+        e = sharded_cache_shard_evict(cache, cache_data, shard, current_time);
+        e->hash = hash;
+        e->key_size = key_size;
+        e->referenced = 0;
+        memcpy(SHARDED_CACHE_ENTRY_KEY(e), key, key_size);
+        e->hnext = shard->hash_table[bucket];
+        shard->hash_table[bucket] = e;
+    }
+
+    e->val_size = val_size;
+    if (val_size > 0) {
+        if (copy_to_cache) {
+            if (!copy_to_cache(SHARDED_CACHE_ENTRY_VAL(e), val, val_size)) {
+                sharded_cache_shard_unlink(cache_data, shard, e);
+                ci_thread_mutex_unlock(&shard->mtx);
+                ci_debug_printf(6, "ci_cache_update: failed to copy data to cache.\n");
+                return 0;
+            }
+        } else
+            memcpy(SHARDED_CACHE_ENTRY_VAL(e), val, val_size);
+    }
+    e->time = current_time;
+    shard->updates++;
+    sharded_cache_shard_stats(cache_data, shard, 0);
+    ci_thread_mutex_unlock(&shard->mtx);
+    return 1;
+}
+
+CI_DECLARE_FUNC(void) init_internal_cache_types()
+{
+    ci_cache_type_register(&ci_local_cache);
+    ci_cache_type_register(&ci_sharded_cache);
+}
+
 struct ci_cache *ci_cache_build( const char *name,
                                  const char *cache_type,
                                  unsigned int cache_size,
@@ -36,6 +36,9 @@
 #include "port.h"
 #include "registry.h"
 #include "shared_mem.h"
+#include "mem.h"
+#include "ci_regex.h"
+#include "lookup_table.h"
 #ifdef USE_OPENSSL
 #include "net_io_ssl.h"
 #endif
@@ -98,6 +101,12 @@ int ALLOW204_AS_200OK_ZERO_ENCAPS = 0;
 int FAKE_ALLOW204 = 1;
 int UMASK = 0;
 int SINGLE_SERVER = 0;
+#ifdef HAVE_EPOLL
+int EVENT_DRIVEN_CONNECTIONS = 0;
+#endif
+#if defined(SO_REUSEPORT)
+int REUSE_PORT = 0;
+#endif
 
 #ifdef HAVE_BROTLI
 int BROTLI_QUALITY = -1;
@@ -115,6 +124,11 @@ int ZSTD_LEVEL = -1;
 extern char *SERVER_LOG_FILE;
 extern char *ACCESS_LOG_FILE;
 extern char *ACCESS_LOG_FORMAT;
+extern int ASYNC_ACCESS_LOG;
+extern size_t ASYNC_ACCESS_LOG_BUFFER_SIZE;
+extern char *ASYNC_ACCESS_LOG_OVERFLOW;
+extern int ASYNC_ACCESS_LOG_FLUSH_INTERVAL;
+static const char *ASYNC_ACCESS_LOG_OVERFLOW_POLICIES[] = {"block", "drop"};
 /*extern char *LOGS_DIR;*/
 
 extern access_control_module_t **used_access_controllers;
@@ -141,6 +155,7 @@ int cfg_set_accesslog(const char *directive, const char **argv, void *setdata);
 int cfg_set_debug_level(const char *directive, const char **argv, void *setdata);
 int cfg_set_debug_stdout(const char *directive, const char **argv, void *setdata);
 int cfg_set_body_maxmem(const char *directive, const char **argv, void *setdata);
+int cfg_set_request_buffer_size(const char *directive, const char **argv, void *setdata);
 int cfg_set_tmp_dir(const char *directive, const char **argv, void *setdata);
 int cfg_set_acl_controllers(const char *directive, const char **argv, void *setdata);
 int cfg_set_auth_method(const char *directive, const char **argv, void *setdata);
@@ -203,6 +218,10 @@ static struct ci_conf_entry conf_variables[] = {
     {"ServerLog", &SERVER_LOG_FILE, intl_cfg_set_str, NULL},
     {"AccessLog", NULL, cfg_set_accesslog, NULL},
     {"LogFormat", NULL, cfg_set_logformat, NULL},
+    {"AsyncAccessLog", &ASYNC_ACCESS_LOG, intl_cfg_onoff, NULL},
+    {"AsyncAccessLogBufferSize", &ASYNC_ACCESS_LOG_BUFFER_SIZE, intl_cfg_size_size_t, NULL},
+    {"AsyncAccessLogOverflow", CI_CFG_STRING_LIST(ASYNC_ACCESS_LOG_OVERFLOW, ASYNC_ACCESS_LOG_OVERFLOW_POLICIES), intl_cfg_set_str_set, NULL},
+    {"AsyncAccessLogFlushInterval", CI_CFG_INT_RANGE(ASYNC_ACCESS_LOG_FLUSH_INTERVAL, 1, 10000), intl_cfg_set_int_range, NULL},
     {"DebugLevel", NULL, cfg_set_debug_level, NULL},   /*Set library's debug level */
     {"ServicesDir", &CI_CONF.SERVICES_DIR, intl_cfg_set_str, NULL},
     {"ModulesDir", &CI_CONF.MODULES_DIR, intl_cfg_set_str, NULL},
@@ -211,6 +230,11 @@ static struct ci_conf_entry conf_variables[] = {
     {"Module", NULL, cfg_load_module, NULL},
     {"TmpDir", NULL, cfg_set_tmp_dir, NULL},
     {"MaxMemObject", NULL, cfg_set_body_maxmem, NULL}, /*Set library's body max mem */
+    {"RequestBufferSize", NULL, cfg_set_request_buffer_size, NULL},
+    {"MemPoolsThreadCache", CI_CFG_INT_RANGE(CI_MEM_POOLS_THREAD_CACHE, 0, 1024), intl_cfg_set_int_range, NULL},
+    {"StatisticsThreadShards", &CI_STAT_THREAD_SHARDS, intl_cfg_onoff, NULL},
+    {"RegexJit", &CI_REGEX_JIT, intl_cfg_onoff, NULL},
+    {"LookupTablesArena", &CI_LOOKUP_TABLES_ARENA, intl_cfg_onoff, NULL},
     {"AclControllers", NULL, cfg_set_acl_controllers, NULL},
     {"acl", NULL, cfg_acl_add, NULL},
     {"icap_access", NULL, cfg_default_acl_access, NULL},
@@ -234,6 +258,12 @@ static struct ci_conf_entry conf_variables[] = {
     {"SupportBuggyClients", &CHECK_FOR_BUGGY_CLIENT, intl_cfg_onoff, NULL},
     {"Allow204As200okZeroEncaps", &ALLOW204_AS_200OK_ZERO_ENCAPS, intl_cfg_enable, NULL},
     {"FakeAllow204", &FAKE_ALLOW204, intl_cfg_onoff, NULL},
+#ifdef HAVE_EPOLL
+    {"EventDrivenConnections", &EVENT_DRIVEN_CONNECTIONS, intl_cfg_onoff, NULL},
+#endif
+#if defined(SO_REUSEPORT)
+    {"ReusePort", &REUSE_PORT, intl_cfg_onoff, NULL},
+#endif
 #ifdef HAVE_BROTLI
     {"BrotliQuality", CI_CFG_INT_RANGE(BROTLI_QUALITY, 0, 11), intl_cfg_set_int_range, NULL},
     {"BrotliMaxInputBlock", CI_CFG_INT_RANGE(BROTLI_MAX_INPUT_BLOCK, 16, 24), intl_cfg_set_int_range, NULL},
@@ -510,6 +540,19 @@ int cfg_set_body_maxmem(const char *directive, const char **argv, void *setdata)
     return intl_cfg_size_long(directive, argv, &CI_BODY_MAX_MEM);
 }
 
+int cfg_set_request_buffer_size(const char *directive, const char **argv, void *setdata)
+{
+    long int size = 0;
+    if (!ci_cfg_size_long(directive, argv, &size))
+        return 0;
+    if (size < CI_REQUEST_MIN_BUFFER_SIZE || size > CI_REQUEST_MAX_BUFFER_SIZE) {
+        ci_debug_printf(1, "%s: the buffer size must be between %d and %d bytes\n", directive, CI_REQUEST_MIN_BUFFER_SIZE, CI_REQUEST_MAX_BUFFER_SIZE);
+        return 0;
+    }
+    CI_REQUEST_BUFFER_SIZE = (int)size;
+    return 1;
+}
+
 int cfg_load_service(const char *directive, const char **argv, void *setdata)
 {
     ci_service_module_t *service = NULL;
@@ -174,8 +174,16 @@ static int client_create_request(ci_request_t * req, char *servername, char *ser
 static int get_request_options(ci_request_t * req, ci_headers_list_t * h)
 {
     const char *pstr;
+    enum {OPT_PREVIEW, OPT_ALLOW, OPT_CONNECTION, OPT_TRANSFER_PREVIEW,
+          OPT_TRANSFER_IGNORE, OPT_TRANSFER_COMPLETE, OPT_HEADERS_NUM};
+    const char *names[OPT_HEADERS_NUM] = {"Preview", "Allow", "Connection",
+                                          "Transfer-Preview", "Transfer-Ignore",
+                                          "Transfer-Complete"};
+    const char *values[OPT_HEADERS_NUM];
 
-    if ((pstr = ci_headers_value(h, "Preview")) != NULL) {
+    ci_headers_values(h, names, values, OPT_HEADERS_NUM);
+
+    if ((pstr = values[OPT_PREVIEW]) != NULL) {
         req->preview = strtol(pstr, NULL, 10);
     } else
         req->preview = -1;
@@ -183,28 +191,28 @@ static int get_request_options(ci_request_t * req, ci_headers_list_t * h)
 
     req->allow204 = 0;
     req->allow206 = 0;
-    if ((pstr = ci_headers_value(h, "Allow")) != NULL) {
+    if ((pstr = values[OPT_ALLOW]) != NULL) {
          if (strstr(pstr, "204"))
              req->allow204 = 1;
          if (strstr(pstr, "206"))
              req->allow206 = 1;
     }
 
-    if ((pstr = ci_headers_value(h, "Connection")) != NULL
+    if ((pstr = values[OPT_CONNECTION]) != NULL
             && strncmp(pstr, "close", 5) == 0) {
         req->keepalive = 0;
     }
 
     /*Moreover we are interested for the followings */
-    if ((pstr = ci_headers_value(h, "Transfer-Preview")) != NULL) {
+    if ((pstr = values[OPT_TRANSFER_PREVIEW]) != NULL) {
         /*Not implemented yet */
     }
 
-    if ((pstr = ci_headers_value(h, "Transfer-Ignore")) != NULL) {
+    if ((pstr = values[OPT_TRANSFER_IGNORE]) != NULL) {
         /*Not implemented yet */
     }
 
-    if ((pstr = ci_headers_value(h, "Transfer-Complete")) != NULL) {
+    if ((pstr = values[OPT_TRANSFER_COMPLETE]) != NULL) {
         /*Not implemented yet */
     }
 
@@ -286,18 +294,17 @@ static int client_send_request_headers(ci_request_t * req, int has_eof)
         }
     }
 
-    static const size_t REQ_WBUF_SIZE = sizeof(((ci_request_t *)0)->wbuf);
     if (req->status == CLIENT_SEND_HEADERS_WRITE_RES_HEADERS) {
         if (req->preview > 0 && req->preview_data.used > 0) {
-            int bytes = snprintf(req->wbuf, REQ_WBUF_SIZE, "%x\r\n", req->preview);
-            assert(bytes < REQ_WBUF_SIZE);
+            int bytes = snprintf(req->wbuf, req->wbuf_size, "%x\r\n", req->preview);
+            assert(bytes < req->wbuf_size);
             req->status = CLIENT_SEND_HEADERS_WRITE_PREVIEW_INFO;
             req->pstrblock_responce = req->wbuf;
             req->remain_send_block_bytes = bytes;
             return CI_NEEDS_MORE;
         } else if (req->preview == 0) {
-            int bytes = snprintf(req->wbuf, REQ_WBUF_SIZE, "0%s\r\n\r\n", has_eof ? "; ieof" : "");
-            assert(bytes < REQ_WBUF_SIZE);
+            int bytes = snprintf(req->wbuf, req->wbuf_size, "0%s\r\n\r\n", has_eof ? "; ieof" : "");
+            assert(bytes < req->wbuf_size);
             req->status = CLIENT_SEND_HEADERS_WRITE_EOF_INFO;
             req->pstrblock_responce = req->wbuf;
             req->remain_send_block_bytes = bytes;
@@ -317,8 +324,8 @@ static int client_send_request_headers(ci_request_t * req, int has_eof)
 
     if (req->status == CLIENT_SEND_HEADERS_WRITE_PREVIEW) {
         req->status = CLIENT_SEND_HEADERS_WRITE_EOF_INFO;
-        int bytes = snprintf(req->wbuf, REQ_WBUF_SIZE, "\r\n0%s\r\n\r\n", has_eof ? "; ieof" : "");
-        assert(bytes < REQ_WBUF_SIZE);
+        int bytes = snprintf(req->wbuf, req->wbuf_size, "\r\n0%s\r\n\r\n", has_eof ? "; ieof" : "");
+        assert(bytes < req->wbuf_size);
         req->pstrblock_responce = req->wbuf;
         req->remain_send_block_bytes = bytes;
         return CI_NEEDS_MORE;
@@ -517,7 +524,7 @@ static int client_prepere_body_chunk(ci_request_t * req, void *data,
 
 
     wbuf = req->wbuf + EXTRA_CHUNK_SIZE;       /*Let size of EXTRA_CHUNK_SIZE space in the beggining of chunk */
-    chunksize = (*readdata) (data, wbuf, MAX_CHUNK_SIZE);
+    chunksize = (*readdata) (data, wbuf, CI_REQUEST_MAX_CHUNK_SIZE(req));
     if (chunksize == CI_EOF || chunksize == 0) {
         req->remain_send_block_bytes = 0;
         return chunksize == CI_EOF ? CI_EOF : CI_NEEDS_MORE;
@@ -276,30 +276,6 @@ static int write_simple_file_func(void *obj, const char *buf, size_t len)
     return ci_simple_file_write((ci_simple_file_t *)obj, buf, len, 0);
 }
 
-struct unzipBuf {
-    char *buf;
-    size_t buf_size;
-    size_t out_len;
-};
-
-static char *get_buf_outbuf(void *obj, unsigned int *len)
-{
-    struct unzipBuf *ab = (struct unzipBuf *)obj;
-    *len = ab->buf_size;
-    return ab->buf;
-}
-
-static int write_once_to_outbuf(void *obj, const char *buf, size_t len)
-{
-    struct unzipBuf *ab = (struct unzipBuf *)obj;
-    ab->out_len = ab->buf_size < len ? ab->buf_size : len;
-    memcpy(ab->buf, buf, ab->out_len);
-    /*Return 0 to abort immediately uncompressing.
-      We are interesting only for the first bytes*/
-    return 0;
-}
-
-
 /*return CI_INFLATE_ERRORS
  */
 int ci_decompress_to_membuf(int encoding_format, const char *inbuf, size_t inlen, ci_membuf_t *outbuf, ci_off_t max_size)
@@ -489,20 +465,6 @@ int ci_brinflate_to_simple_file(const char *inbuf, size_t inlen, struct ci_simpl
     return ret;
 }
 
-static int brotli_inflate_step(const char *buf, int len, char *unzipped_buf, int *unzipped_buf_len)
-{
-    struct unzipBuf ub;
-    ub.buf = unzipped_buf;
-    ub.buf_size = *unzipped_buf_len;
-    ub.out_len = 0;
-    int ret = ci_mem_brinflate(buf, len,  &ub, get_buf_outbuf, write_once_to_outbuf, len);
-    ci_debug_printf(5, "brotli_inflate_step: retcode %d, unzipped data: %d\n", ret, (int)ub.out_len);
-    if (ub.out_len > 0) { /* there are output data even if there are errors*/
-        *unzipped_buf_len = ub.out_len;
-        return CI_OK;
-    }
-    return CI_ERROR;
-}
 #else
 int ci_brinflate_to_membuf(const char *inbuf, size_t inlen, ci_membuf_t *outbuf, ci_off_t max_size)
 {
@@ -644,21 +606,6 @@ int ci_inflate_to_simple_file(const char *inbuf, size_t inlen, struct ci_simple_
     return ret;
 }
 
-static int zlib_inflate_step(const char *buf, int len, char *unzipped_buf, int *unzipped_buf_len)
-{
-    struct unzipBuf ub;
-    ub.buf = unzipped_buf;
-    ub.buf_size = *unzipped_buf_len;
-    ub.out_len = 0;
-    int ret = ci_mem_inflate(buf, len,  &ub, get_buf_outbuf, write_once_to_outbuf, len);
-    ci_debug_printf(5, "zlib_inflate_step: retcode %d, unzipped data: %d\n", ret, (int)ub.out_len);
-    if (ub.out_len > 0) {
-        *unzipped_buf_len = ub.out_len;
-        return CI_OK;
-    }
-    return CI_ERROR;
-}
-
 #else
 int ci_inflate_to_membuf(const char *inbuf, size_t inlen, ci_membuf_t *outbuf, ci_off_t max_size)
 {
@@ -775,21 +722,6 @@ int ci_bzunzip_to_simple_file(const char *inbuf, size_t inlen, struct ci_simple_
     return ret;
 }
 
-static int bzlib_uncompress_step(const char *buf, int len, char *unzipped_buf, int *unzipped_buf_len)
-{
-    struct unzipBuf ub;
-    ub.buf = unzipped_buf;
-    ub.buf_size = *unzipped_buf_len;
-    ub.out_len = 0;
-    int ret = ci_mem_bzunzip(buf, len,  &ub, get_buf_outbuf, write_once_to_outbuf, len);
-    ci_debug_printf(5, "bzlib_uncompress_step: retcode %d, unzipped data: %d\n", ret, (int)ub.out_len);
-    if (ub.out_len > 0) {
-        *unzipped_buf_len = ub.out_len;
-        return CI_OK;
-    }
-    return CI_ERROR;
-}
-
 #else
 int ci_bzunzip_to_membuf(const char *inbuf, size_t inlen, ci_membuf_t *outbuf, ci_off_t max_size)
 {
@@ -880,21 +812,6 @@ int ci_zstd_uncompress_to_simple_file(const char *inbuf, size_t inlen, struct ci
     return ret;
 }
 
-static int zstd_uncompress_step(const char *buf, int len, char *unzipped_buf, int *unzipped_buf_len)
-{
-    struct unzipBuf ub;
-    ub.buf = unzipped_buf;
-    ub.buf_size = *unzipped_buf_len;
-    ub.out_len = 0;
-    int ret = ci_mem_zstd_uncompress(buf, len,  &ub, get_buf_outbuf, write_once_to_outbuf, len);
-    ci_debug_printf(5, "zstd_uncompress_step: retcode %d, unzipped data: %d\n", ret, (int)ub.out_len);
-    if (ub.out_len > 0) {
-        *unzipped_buf_len = ub.out_len;
-        return CI_OK;
-    }
-    return CI_ERROR;
-}
-
 #else
 int ci_zstd_uncompress_to_membuf(const char *inbuf, size_t inlen, ci_membuf_t *outbuf, ci_off_t max_size)
 {
@@ -913,24 +830,468 @@ int ci_zstd_uncompress_to_simple_file(const char *inbuf, size_t inlen, struct ci
 int ci_uncompress_preview(int compress_method, const char *buf, int len, char *unzipped_buf,
                           int *unzipped_buf_len)
 {
+    int ret;
+    size_t produced, out_len = 0;
+    ci_decompressor_t *dec;
+
+    /*The gzip and deflate decoder detects the headers of unknown methods*/
+    if (compress_method != CI_ENCODE_BZIP2 && compress_method != CI_ENCODE_BROTLI && compress_method != CI_ENCODE_ZSTD)
+        compress_method = CI_ENCODE_GZIP;
+    if (!(dec = ci_decompressor_create(compress_method, *unzipped_buf_len)))
+        return CI_ERROR;
+    /*The preview data are only the first part of the compressed object*/
+    ret = ci_decompressor_feed(dec, buf, len, 0);
+    while (ret == CI_UNCOMP_HAVE_OUTPUT && out_len < (size_t)*unzipped_buf_len) {
+        ret = ci_decompressor_drain(dec, unzipped_buf + out_len, *unzipped_buf_len - out_len, &produced);
+        out_len += produced;
+    }
+    ci_decompressor_destroy(dec);
+    ci_debug_printf(5, "ci_uncompress_preview: retcode %d, unzipped data: %d\n", ret, (int)out_len);
+    if (out_len > 0) { /* there are output data even if there are errors*/
+        *unzipped_buf_len = out_len;
+        return CI_OK;
+    }
+    return CI_ERROR;
+}
+
+/* Streaming decompression */
+
+enum {
+    DEC_STEP_CONTINUE = 0,
+    DEC_STEP_END
+};
+
+struct ci_decompressor {
+    int encoding;
+    ci_off_t max_size;
+    const char *in;
+    size_t in_len;
+    int in_eof;
+    ci_off_t in_total;      /* compressed bytes fed so far */
+    ci_off_t out_total;     /* decompressed bytes returned so far */
+    int status;
+    int frame_end;          /* the input may stop here (zstd) */
+    int retriable;          /* raw deflate retry is still possible (zlib) */
+    const char *first_in;
+    size_t first_in_len;
+    unsigned char zhead;    /* a lone first byte, waiting for the next block (zlib) */
+    int zhead_len;
+    union {
+#ifdef HAVE_ZLIB
+        z_stream z;
+#endif
 #ifdef HAVE_BZLIB
-    if (compress_method == CI_ENCODE_BZIP2)
-        return  bzlib_uncompress_step(buf, len, unzipped_buf, unzipped_buf_len);
-    else
+        bz_stream bz;
 #endif
 #ifdef HAVE_BROTLI
-        if (compress_method == CI_ENCODE_BROTLI)
-            return  brotli_inflate_step(buf, len, unzipped_buf, unzipped_buf_len);
-        else
+        BrotliDecoderState *br;
 #endif
 #ifdef HAVE_ZSTD
-            if (compress_method == CI_ENCODE_ZSTD)
-                return zstd_uncompress_step(buf, len, unzipped_buf, unzipped_buf_len);
-            else
+        ZSTD_DCtx *zstd;
 #endif
+        void *none;
+    } strm;
+};
 
 #ifdef HAVE_ZLIB
-                return zlib_inflate_step(buf, len, unzipped_buf, unzipped_buf_len);
+static int zlib_decompressor_init(ci_decompressor_t *dec)
+{
+    z_stream *strm = &dec->strm.z;
+    strm->zalloc = alloc_a_buffer;
+    strm->zfree = free_a_buffer;
+    strm->opaque = Z_NULL;
+    strm->avail_in = 0;
+    strm->next_in = Z_NULL;
+    /* Detect gzip or deflate compressed objects from headers (windowBits = 32+15): */
+    if (inflateInit2(strm, 32 + 15) != Z_OK)
+        return 0;
+    dec->retriable = 1;
+    return 1;
+}
+
+static int zlib_decompressor_step(ci_decompressor_t *dec, char *out, size_t outsize, size_t *produced)
+{
+    int ret, wrapped;
+    z_stream *strm = &dec->strm.z;
+    uInt avail_in;
+
+    if (dec->retriable && strm->total_in == 0 && !dec->zhead_len && dec->in_len == 1 && !dec->in_eof) {
+        /* Two bytes are required to detect the zlib or gzip headers */
+        dec->zhead = (unsigned char)dec->in[0];
+        dec->zhead_len = 1;
+        dec->in++;
+        dec->in_len = 0;
+        *produced = 0;
+        return DEC_STEP_CONTINUE;
+    }
+    if (dec->zhead_len && dec->in_len) {
+        const unsigned char b0 = dec->zhead, b1 = (unsigned char)dec->in[0];
+        wrapped = (b0 == 0x1f && b1 == 0x8b) || ((b0 & 0x0f) == 8 && ((b0 << 8) | b1) % 31 == 0);
+        dec->zhead_len = 0;
+        dec->retriable = 0;
+        if (!wrapped && inflateReset2(strm, -15) != Z_OK)
+            return CI_UNCOMP_ERR_ERROR;
+        /* A single byte is not enough to produce any output */
+        strm->next_in = &dec->zhead;
+        strm->avail_in = 1;
+        strm->next_out = (Bytef *)out;
+        strm->avail_out = outsize > UINT_MAX ? UINT_MAX : (uInt)outsize;
+        if (inflate(strm, Z_NO_FLUSH) != Z_OK)
+            return CI_UNCOMP_ERR_CORRUPT;
+    }
+
+    avail_in = dec->in_len > UINT_MAX ? UINT_MAX : (uInt)dec->in_len;
+    strm->next_in = (Bytef *)dec->in;
+    strm->avail_in = avail_in;
+    strm->next_out = (Bytef *)out;
+    strm->avail_out = outsize > UINT_MAX ? UINT_MAX : (uInt)outsize;
+    ret = inflate(strm, Z_NO_FLUSH);
+    *produced = (char *)strm->next_out - out;
+    dec->in += (avail_in - strm->avail_in);
+    dec->in_len -= (avail_in - strm->avail_in);
+    switch (ret) {
+    case Z_NEED_DICT:
+    case Z_DATA_ERROR:
+        if (dec->retriable && *produced == 0) {
+            /* Retry raw inflate without headers, from the first input byte */
+            dec->retriable = 0;
+            if (inflateReset2(strm, -15) == Z_OK) {
+                dec->in = dec->first_in;
+                dec->in_len = dec->first_in_len;
+                return zlib_decompressor_step(dec, out, outsize, produced);
+            }
+        }
+        return CI_UNCOMP_ERR_CORRUPT;
+    case Z_STREAM_ERROR:
+        ci_debug_printf(1, "Zlib/Z_STREAM_ERROR, corrupted input data to inflate?\n");
+        return CI_UNCOMP_ERR_CORRUPT;
+    case Z_MEM_ERROR:
+        return CI_UNCOMP_ERR_ERROR;
+    case Z_STREAM_END:
+        return DEC_STEP_END;
+    }
+    if (*produced)
+        dec->retriable = 0;
+    /* Z_OK or Z_BUF_ERROR (no progress possible) */
+    return DEC_STEP_CONTINUE;
+}
+
+static void zlib_decompressor_release(ci_decompressor_t *dec)
+{
+    inflateEnd(&dec->strm.z);
+}
 #endif
-    return CI_ERROR;
+
+#ifdef HAVE_BZLIB
+static int bzlib_decompressor_init(ci_decompressor_t *dec)
+{
+    bz_stream *strm = &dec->strm.bz;
+    strm->bzalloc = bzalloc_a_buffer;
+    strm->bzfree = bzfree_a_buffer;
+    strm->opaque = NULL;
+    strm->avail_in = 0;
+    strm->next_in = NULL;
+    return BZ2_bzDecompressInit(strm, 0, 0) == BZ_OK;
+}
+
+static int bzlib_decompressor_step(ci_decompressor_t *dec, char *out, size_t outsize, size_t *produced)
+{
+    int ret;
+    bz_stream *strm = &dec->strm.bz;
+    unsigned int avail_in = dec->in_len > UINT_MAX ? UINT_MAX : (unsigned int)dec->in_len;
+    strm->next_in = (char *)dec->in;
+    strm->avail_in = avail_in;
+    strm->next_out = out;
+    strm->avail_out = outsize > UINT_MAX ? UINT_MAX : (unsigned int)outsize;
+    ret = BZ2_bzDecompress(strm);
+    *produced = strm->next_out - out;
+    dec->in += (avail_in - strm->avail_in);
+    dec->in_len -= (avail_in - strm->avail_in);
+    switch (ret) {
+    case BZ_STREAM_END:
+        return DEC_STEP_END;
+    case BZ_OK:
+        return DEC_STEP_CONTINUE;
+    case BZ_MEM_ERROR:
+        return CI_UNCOMP_ERR_ERROR;
+    default:
+        return CI_UNCOMP_ERR_CORRUPT;
+    }
+}
+
+static void bzlib_decompressor_release(ci_decompressor_t *dec)
+{
+    BZ2_bzDecompressEnd(&dec->strm.bz);
+}
+#endif
+
+#ifdef HAVE_BROTLI
+static int brotli_decompressor_init(ci_decompressor_t *dec)
+{
+    dec->strm.br = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+    return dec->strm.br != NULL;
+}
+
+static int brotli_decompressor_step(ci_decompressor_t *dec, char *out, size_t outsize, size_t *produced)
+{
+    BrotliDecoderResult result;
+    size_t available_in = dec->in_len;
+    const uint8_t *next_in = (const uint8_t *)dec->in;
+    size_t available_out = outsize;
+    uint8_t *next_out = (uint8_t *)out;
+    result = BrotliDecoderDecompressStream(dec->strm.br,
+                                           &available_in, &next_in,
+                                           &available_out, &next_out, NULL);
+    *produced = outsize - available_out;
+    dec->in = (const char *)next_in;
+    dec->in_len = available_in;
+    switch (result) {
+    case BROTLI_DECODER_RESULT_SUCCESS:
+        if (available_in != 0) {
+            ci_debug_printf(4, "data-compression: brotli finished but available_in != 0\n");
+            return CI_UNCOMP_ERR_CORRUPT;
+        }
+        return DEC_STEP_END;
+    case BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT:
+    case BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT:
+        return DEC_STEP_CONTINUE;
+    default:
+        ci_debug_printf(2, "data-compression: brotli corrupt input: %s\n",
+                        BrotliDecoderErrorString(BrotliDecoderGetErrorCode(dec->strm.br)));
+        return CI_UNCOMP_ERR_CORRUPT;
+    }
+}
+
+static void brotli_decompressor_release(ci_decompressor_t *dec)
+{
+    BrotliDecoderDestroyInstance(dec->strm.br);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static int zstd_decompressor_init(ci_decompressor_t *dec)
+{
+    dec->strm.zstd = ZSTD_createDCtx();
+    return dec->strm.zstd != NULL;
+}
+
+static int zstd_decompressor_step(ci_decompressor_t *dec, char *out, size_t outsize, size_t *produced)
+{
+    ZSTD_inBuffer input = { dec->in, dec->in_len, 0 };
+    ZSTD_outBuffer output = { out, outsize, 0 };
+    size_t const ret = ZSTD_decompressStream(dec->strm.zstd, &output, &input);
+    *produced = output.pos;
+    dec->in += input.pos;
+    dec->in_len -= input.pos;
+    if (ZSTD_isError(ret)) {
+        ci_debug_printf(2, "zstd data decompression error: %s\n", ZSTD_getErrorName(ret));
+        return CI_UNCOMP_ERR_CORRUPT;
+    }
+    /* A zero return means a frame is completely decoded and flushed.
+       More frames may follow, so the stream ends only with the input. */
+    dec->frame_end = (ret == 0 && output.pos < outsize);
+    return DEC_STEP_CONTINUE;
+}
+
+static void zstd_decompressor_release(ci_decompressor_t *dec)
+{
+    ZSTD_freeDCtx(dec->strm.zstd);
+}
+#endif
+
+static int decompressor_backend_init(ci_decompressor_t *dec)
+{
+    switch (dec->encoding) {
+#ifdef HAVE_ZLIB
+    case CI_ENCODE_GZIP:
+    case CI_ENCODE_DEFLATE:
+        return zlib_decompressor_init(dec);
+#endif
+#ifdef HAVE_BZLIB
+    case CI_ENCODE_BZIP2:
+        return bzlib_decompressor_init(dec);
+#endif
+#ifdef HAVE_BROTLI
+    case CI_ENCODE_BROTLI:
+        return brotli_decompressor_init(dec);
+#endif
+#ifdef HAVE_ZSTD
+    case CI_ENCODE_ZSTD:
+        return zstd_decompressor_init(dec);
+#endif
+    default:
+        ci_debug_printf(1, "Streaming decompression for '%s' encoding is not supported\n", ci_encoding_method_str(dec->encoding));
+        return 0;
+    }
+}
+
+static int decompressor_backend_step(ci_decompressor_t *dec, char *out, size_t outsize, size_t *produced)
+{
+    switch (dec->encoding) {
+#ifdef HAVE_ZLIB
+    case CI_ENCODE_GZIP:
+    case CI_ENCODE_DEFLATE:
+        return zlib_decompressor_step(dec, out, outsize, produced);
+#endif
+#ifdef HAVE_BZLIB
+    case CI_ENCODE_BZIP2:
+        return bzlib_decompressor_step(dec, out, outsize, produced);
+#endif
+#ifdef HAVE_BROTLI
+    case CI_ENCODE_BROTLI:
+        return brotli_decompressor_step(dec, out, outsize, produced);
+#endif
+#ifdef HAVE_ZSTD
+    case CI_ENCODE_ZSTD:
+        return zstd_decompressor_step(dec, out, outsize, produced);
+#endif
+    default:
+        *produced = 0;
+        return CI_UNCOMP_ERR_ERROR;
+    }
+}
+
+static void decompressor_backend_release(ci_decompressor_t *dec)
+{
+    switch (dec->encoding) {
+#ifdef HAVE_ZLIB
+    case CI_ENCODE_GZIP:
+    case CI_ENCODE_DEFLATE:
+        zlib_decompressor_release(dec);
+        break;
+#endif
+#ifdef HAVE_BZLIB
+    case CI_ENCODE_BZIP2:
+        bzlib_decompressor_release(dec);
+        break;
+#endif
+#ifdef HAVE_BROTLI
+    case CI_ENCODE_BROTLI:
+        brotli_decompressor_release(dec);
+        break;
+#endif
+#ifdef HAVE_ZSTD
+    case CI_ENCODE_ZSTD:
+        zstd_decompressor_release(dec);
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+ci_decompressor_t *ci_decompressor_create(int encoding, ci_off_t max_size)
+{
+    ci_decompressor_t *dec = malloc(sizeof(ci_decompressor_t));
+    if (!dec)
+        return NULL;
+    memset(dec, 0, sizeof(ci_decompressor_t));
+    dec->encoding = encoding;
+    dec->max_size = max_size;
+    dec->status = CI_UNCOMP_NEED_INPUT;
+    if (!decompressor_backend_init(dec)) {
+        free(dec);
+        return NULL;
+    }
+    return dec;
+}
+
+void ci_decompressor_destroy(ci_decompressor_t *dec)
+{
+    if (!dec)
+        return;
+    decompressor_backend_release(dec);
+    free(dec);
+}
+
+int ci_decompressor_feed(ci_decompressor_t *dec, const char *buf, size_t len, int iseof)
+{
+    if (dec->status != CI_UNCOMP_NEED_INPUT && dec->status != CI_UNCOMP_HAVE_OUTPUT)
+        return dec->status;
+    if (dec->in_len) {
+        ci_debug_printf(1, "ci_decompressor_feed: the previous input is not consumed yet\n");
+        return CI_UNCOMP_ERR_ERROR;
+    }
+    if (dec->in_total && len && !dec->zhead_len)
+        dec->retriable = 0; /* the first block is not available any more */
+    dec->in = buf;
+    dec->in_len = len;
+    dec->in_total += len;
+    if (!dec->first_in) {
+        dec->first_in = buf;
+        dec->first_in_len = len;
+    }
+    if (iseof)
+        dec->in_eof = 1;
+    dec->status = CI_UNCOMP_HAVE_OUTPUT;
+    return CI_UNCOMP_HAVE_OUTPUT;
+}
+
+int ci_decompressor_drain(ci_decompressor_t *dec, char *out, size_t outsize, size_t *outlen)
+{
+    int ret;
+    size_t produced, pending_in;
+    ci_off_t consumed;
+
+    *outlen = 0;
+    if (dec->status != CI_UNCOMP_HAVE_OUTPUT)
+        return dec->status;
+
+    if (!out || !outsize)
+        return CI_UNCOMP_ERR_OUTPUT;
+
+    if (dec->max_size > 0 && dec->out_total >= dec->max_size)
+        outsize = 1; /* Just check if there are more data */
+
+    do {
+        pending_in = dec->in_len;
+        ret = decompressor_backend_step(dec, out, outsize, &produced);
+    } while (ret == DEC_STEP_CONTINUE && produced == 0 && dec->in_len > 0 && dec->in_len != pending_in);
+
+    if (dec->max_size > 0 && dec->out_total + produced > dec->max_size) {
+        *outlen = dec->max_size - dec->out_total;
+        dec->out_total = dec->max_size;
+        consumed = dec->in_total - dec->in_len;
+        if (consumed > 0 && (dec->out_total / consumed) > 100) {
+            ci_debug_printf(1, "Compression ratio UncompSize/CompSize = %" PRINTF_OFF_T "/%" PRINTF_OFF_T " = %" PRINTF_OFF_T "! Is it a zip bomb? aborting!\n", (CAST_OFF_T)dec->out_total, (CAST_OFF_T)consumed, (CAST_OFF_T)(dec->out_total / consumed));
+            dec->status = CI_UNCOMP_ERR_BOMB;  /*Probably compression bomb object*/
+        } else {
+            ci_debug_printf(4, "Object is bigger than max allowed size\n");
+            dec->status = CI_UNCOMP_ERR_NONE;
+        }
+        return dec->status;
+    }
+    *outlen = produced;
+    dec->out_total += produced;
+
+    if (ret < 0)
+        dec->status = ret;
+    else if (ret == DEC_STEP_END)
+        dec->status = CI_UNCOMP_OK;
+    else if (produced == outsize)
+        dec->status = CI_UNCOMP_HAVE_OUTPUT;
+    else if (dec->in_len == 0 && !dec->in_eof)
+        dec->status = CI_UNCOMP_NEED_INPUT;
+    else if (dec->in_len == 0 && dec->frame_end)
+        dec->status = CI_UNCOMP_OK;
+    else if (dec->in_len == 0) {
+        ci_debug_printf(4, "The compressed data are truncated\n");
+        dec->status = CI_UNCOMP_ERR_CORRUPT;
+    } else if (produced)
+        dec->status = CI_UNCOMP_HAVE_OUTPUT;
+    else {
+        /* Input remains but the decoder does not make progress */
+        dec->status = CI_UNCOMP_ERR_CORRUPT;
+    }
+    return dec->status;
+}
+
+ci_off_t ci_decompressor_total_in(const ci_decompressor_t *dec)
+{
+    return dec->in_total - dec->in_len;
+}
+
+ci_off_t ci_decompressor_total_out(const ci_decompressor_t *dec)
+{
+    return dec->out_total;
 }
@@ -603,3 +603,361 @@ int ci_zstd_compress_to_simple_file(const char *inbuf, size_t inlen, struct ci_s
 }
 
 #endif
+
+/* Streaming compression */
+
+enum {
+    ENC_STEP_CONTINUE = 0,
+    ENC_STEP_END
+};
+
+struct ci_compressor {
+    int encoding;
+    int level;
+    const char *in;
+    size_t in_len;
+    int in_eof;
+    ci_off_t in_total;
+    ci_off_t out_total;
+    int status;
+    union {
+#ifdef HAVE_ZLIB
+        z_stream z;
+#endif
+#ifdef HAVE_BZLIB
+        bz_stream bz;
+#endif
+#ifdef HAVE_BROTLI
+        BrotliEncoderState *br;
+#endif
+#ifdef HAVE_ZSTD
+        ZSTD_CCtx *zstd;
+#endif
+        void *none;
+    } strm;
+};
+
+#ifdef HAVE_ZLIB
+static int zlib_compressor_init(ci_compressor_t *comp)
+{
+    z_stream *strm = &comp->strm.z;
+    int level = value_in_range(comp->level, 0, 9, Z_DEFAULT_COMPRESSION);
+    int window = value_in_range(CI_ZLIB_WINDOW_SIZE, 1, 15, 15);
+    strm->zalloc = alloc_a_buffer;
+    strm->zfree  = free_a_buffer;
+    strm->opaque = Z_NULL;
+    if (comp->encoding == CI_ENCODE_GZIP)
+        window |= GZIP_ENCODING;
+    return deflateInit2(strm, level, Z_DEFLATED, window,
+                        value_in_range(CI_ZLIB_MEMLEVEL, 1, 9, 8),
+                        Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+static int zlib_compressor_step(ci_compressor_t *comp, char *out, size_t outsize, size_t *produced)
+{
+    int ret;
+    z_stream *strm = &comp->strm.z;
+    uInt avail_in = comp->in_len > UINT_MAX ? UINT_MAX : (uInt)comp->in_len;
+    strm->next_in = (Bytef *)comp->in;
+    strm->avail_in = avail_in;
+    strm->next_out = (Bytef *)out;
+    strm->avail_out = outsize > UINT_MAX ? UINT_MAX : (uInt)outsize;
+    ret = deflate(strm, (comp->in_eof && avail_in == comp->in_len) ? Z_FINISH : Z_NO_FLUSH);
+    *produced = (char *)strm->next_out - out;
+    comp->in += (avail_in - strm->avail_in);
+    comp->in_len -= (avail_in - strm->avail_in);
+    switch (ret) {
+    case Z_STREAM_END:
+        return ENC_STEP_END;
+    case Z_OK:
+    case Z_BUF_ERROR:
+        return ENC_STEP_CONTINUE;
+    default:
+        return CI_COMP_ERR_ERROR;
+    }
+}
+
+static void zlib_compressor_release(ci_compressor_t *comp)
+{
+    deflateEnd(&comp->strm.z);
+}
+#endif
+
+#ifdef HAVE_BZLIB
+static int bzlib_compressor_init(ci_compressor_t *comp)
+{
+    bz_stream *strm = &comp->strm.bz;
+    strm->bzalloc = bzalloc_a_buffer;
+    strm->bzfree = bzfree_a_buffer;
+    strm->opaque = NULL;
+    /*The level is the number of 100k blocks, 9 is best compression (1-9)*/
+    return BZ2_bzCompressInit(strm, value_in_range(comp->level, 1, 9, 9), 0, 30) == BZ_OK;
+}
+
+static int bzlib_compressor_step(ci_compressor_t *comp, char *out, size_t outsize, size_t *produced)
+{
+    int ret;
+    bz_stream *strm = &comp->strm.bz;
+    unsigned int avail_in = comp->in_len > UINT_MAX ? UINT_MAX : (unsigned int)comp->in_len;
+    strm->next_in = (char *)comp->in;
+    strm->avail_in = avail_in;
+    strm->next_out = out;
+    strm->avail_out = outsize > UINT_MAX ? UINT_MAX : (unsigned int)outsize;
+    ret = BZ2_bzCompress(strm, (comp->in_eof && avail_in == comp->in_len) ? BZ_FINISH : BZ_RUN);
+    *produced = strm->next_out - out;
+    comp->in += (avail_in - strm->avail_in);
+    comp->in_len -= (avail_in - strm->avail_in);
+    switch (ret) {
+    case BZ_STREAM_END:
+        return ENC_STEP_END;
+    case BZ_RUN_OK:
+    case BZ_FINISH_OK:
+        return ENC_STEP_CONTINUE;
+    default:
+        return CI_COMP_ERR_ERROR;
+    }
+}
+
+static void bzlib_compressor_release(ci_compressor_t *comp)
+{
+    BZ2_bzCompressEnd(&comp->strm.bz);
+}
+#endif
+
+#ifdef HAVE_BROTLI
+static int brotli_compressor_init(ci_compressor_t *comp)
+{
+    BrotliEncoderState *s;
+    if (!(s = BrotliEncoderCreateInstance(NULL, NULL, NULL)))
+        return 0;
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_MODE, BROTLI_MODE_GENERIC);
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, value_in_range(comp->level, 0, 11, value_in_range(CI_BROTLI_QUALITY, 0, 11, 4)));
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, value_in_range(CI_BROTLI_WINDOW, 10, 24, 22));
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_LGBLOCK, value_in_range(CI_BROTLI_MAX_INPUT_BLOCK, 16, 24, 24));
+    comp->strm.br = s;
+    return 1;
+}
+
+static int brotli_compressor_step(ci_compressor_t *comp, char *out, size_t outsize, size_t *produced)
+{
+    size_t available_in = comp->in_len;
+    const uint8_t *next_in = (const uint8_t *)comp->in;
+    size_t available_out = outsize;
+    uint8_t *next_out = (uint8_t *)out;
+    if (!BrotliEncoderCompressStream(comp->strm.br,
+                                     comp->in_eof ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS,
+                                     &available_in, &next_in,
+                                     &available_out, &next_out, NULL)) {
+        ci_debug_printf(4, "data-compression: brotli failed to compress data\n");
+        return CI_COMP_ERR_ERROR;
+    }
+    *produced = outsize - available_out;
+    comp->in = (const char *)next_in;
+    comp->in_len = available_in;
+    return BrotliEncoderIsFinished(comp->strm.br) ? ENC_STEP_END : ENC_STEP_CONTINUE;
+}
+
+static void brotli_compressor_release(ci_compressor_t *comp)
+{
+    BrotliEncoderDestroyInstance(comp->strm.br);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static int zstd_compressor_init(ci_compressor_t *comp)
+{
+    ZSTD_CCtx *cctx;
+    if (!(cctx = ZSTD_createCCtx()))
+        return 0;
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, value_in_range(comp->level, 1, ZSTD_maxCLevel(), CI_ZSTD_LEVEL));
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_checksumFlag, 1);
+    comp->strm.zstd = cctx;
+    return 1;
+}
+
+static int zstd_compressor_step(ci_compressor_t *comp, char *out, size_t outsize, size_t *produced)
+{
+    ZSTD_inBuffer input = { comp->in, comp->in_len, 0 };
+    ZSTD_outBuffer output = { out, outsize, 0 };
+    size_t const remaining = ZSTD_compressStream2(comp->strm.zstd, &output, &input,
+                                                  comp->in_eof ? ZSTD_e_end : ZSTD_e_continue);
+    *produced = output.pos;
+    comp->in += input.pos;
+    comp->in_len -= input.pos;
+    if (ZSTD_isError(remaining)) {
+        ci_debug_printf(2, "zstd data compression error: %s\n", ZSTD_getErrorName(remaining));
+        return CI_COMP_ERR_ERROR;
+    }
+    return (comp->in_eof && remaining == 0) ? ENC_STEP_END : ENC_STEP_CONTINUE;
+}
+
+static void zstd_compressor_release(ci_compressor_t *comp)
+{
+    ZSTD_freeCCtx(comp->strm.zstd);
+}
+#endif
+
+static int compressor_backend_init(ci_compressor_t *comp)
+{
+    switch (comp->encoding) {
+#ifdef HAVE_ZLIB
+    case CI_ENCODE_GZIP:
+    case CI_ENCODE_DEFLATE:
+        return zlib_compressor_init(comp);
+#endif
+#ifdef HAVE_BZLIB
+    case CI_ENCODE_BZIP2:
+        return bzlib_compressor_init(comp);
+#endif
+#ifdef HAVE_BROTLI
+    case CI_ENCODE_BROTLI:
+        return brotli_compressor_init(comp);
+#endif
+#ifdef HAVE_ZSTD
+    case CI_ENCODE_ZSTD:
+        return zstd_compressor_init(comp);
+#endif
+    default:
+        ci_debug_printf(1, "Streaming compression for '%s' encoding is not supported\n", ci_encoding_method_str(comp->encoding));
+        return 0;
+    }
+}
+
+static int compressor_backend_step(ci_compressor_t *comp, char *out, size_t outsize, size_t *produced)
+{
+    switch (comp->encoding) {
+#ifdef HAVE_ZLIB
+    case CI_ENCODE_GZIP:
+    case CI_ENCODE_DEFLATE:
+        return zlib_compressor_step(comp, out, outsize, produced);
+#endif
+#ifdef HAVE_BZLIB
+    case CI_ENCODE_BZIP2:
+        return bzlib_compressor_step(comp, out, outsize, produced);
+#endif
+#ifdef HAVE_BROTLI
+    case CI_ENCODE_BROTLI:
+        return brotli_compressor_step(comp, out, outsize, produced);
+#endif
+#ifdef HAVE_ZSTD
+    case CI_ENCODE_ZSTD:
+        return zstd_compressor_step(comp, out, outsize, produced);
+#endif
+    default:
+        *produced = 0;
+        return CI_COMP_ERR_ERROR;
+    }
+}
+
+static void compressor_backend_release(ci_compressor_t *comp)
+{
+    switch (comp->encoding) {
+#ifdef HAVE_ZLIB
+    case CI_ENCODE_GZIP:
+    case CI_ENCODE_DEFLATE:
+        zlib_compressor_release(comp);
+        break;
+#endif
+#ifdef HAVE_BZLIB
+    case CI_ENCODE_BZIP2:
+        bzlib_compressor_release(comp);
+        break;
+#endif
+#ifdef HAVE_BROTLI
+    case CI_ENCODE_BROTLI:
+        brotli_compressor_release(comp);
+        break;
+#endif
+#ifdef HAVE_ZSTD
+    case CI_ENCODE_ZSTD:
+        zstd_compressor_release(comp);
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+ci_compressor_t *ci_compressor_create(int encoding, int level)
+{
+    ci_compressor_t *comp = malloc(sizeof(ci_compressor_t));
+    if (!comp)
+        return NULL;
+    memset(comp, 0, sizeof(ci_compressor_t));
+    comp->encoding = encoding;
+    comp->level = level;
+    comp->status = CI_COMP_NEED_INPUT;
+    if (!compressor_backend_init(comp)) {
+        free(comp);
+        return NULL;
+    }
+    return comp;
+}
+
+void ci_compressor_destroy(ci_compressor_t *comp)
+{
+    if (!comp)
+        return;
+    compressor_backend_release(comp);
+    free(comp);
+}
+
+int ci_compressor_feed(ci_compressor_t *comp, const char *buf, size_t len, int iseof)
+{
+    if (comp->status != CI_COMP_NEED_INPUT && comp->status != CI_COMP_HAVE_OUTPUT)
+        return comp->status;
+    if (comp->in_len || comp->in_eof) {
+        ci_debug_printf(1, "ci_compressor_feed: the previous input is not consumed yet\n");
+        return CI_COMP_ERR_ERROR;
+    }
+    comp->in = buf;
+    comp->in_len = len;
+    comp->in_total += len;
+    comp->in_eof = iseof;
+    comp->status = CI_COMP_HAVE_OUTPUT;
+    return CI_COMP_HAVE_OUTPUT;
+}
+
+int ci_compressor_drain(ci_compressor_t *comp, char *out, size_t outsize, size_t *outlen)
+{
+    int ret;
+    size_t produced = 0, pending_in;
+
+    *outlen = 0;
+    if (comp->status != CI_COMP_HAVE_OUTPUT)
+        return comp->status;
+
+    if (!out || !outsize)
+        return CI_COMP_ERR_OUTPUT;
+
+    do {
+        pending_in = comp->in_len;
+        ret = compressor_backend_step(comp, out + *outlen, outsize - *outlen, &produced);
+        *outlen += produced;
+    } while (ret == ENC_STEP_CONTINUE && *outlen < outsize &&
+             (comp->in_len > 0 || comp->in_eof) &&
+             (produced > 0 || comp->in_len != pending_in));
+    comp->out_total += *outlen;
+
+    if (ret < 0)
+        comp->status = ret;
+    else if (ret == ENC_STEP_END)
+        comp->status = CI_COMP_OK;
+    else if (*outlen == outsize)
+        comp->status = CI_COMP_HAVE_OUTPUT;
+    else if (comp->in_len == 0 && !comp->in_eof)
+        comp->status = CI_COMP_NEED_INPUT;
+    else
+        comp->status = CI_COMP_ERR_ERROR; /* no progress */
+    return comp->status;
+}
+
+ci_off_t ci_compressor_total_in(const ci_compressor_t *comp)
+{
+    return comp->in_total - comp->in_len;
+}
+
+ci_off_t ci_compressor_total_out(const ci_compressor_t *comp)
+{
+    return comp->out_total;
+}
@@ -684,6 +684,8 @@ static int extend_object_type(struct ci_magics_db *db, ci_headers_list_t *header
     const char *checkbuf = buf;
     const char *content_type = NULL;
     const char *content_encoding = NULL;
+    const char *names[] = {"Content-Encoding", "Content-Type"};
+    const char *values[2];
 
     *iscompressed = CI_ENCODE_NONE;
 
@@ -691,7 +693,9 @@ static int extend_object_type(struct ci_magics_db *db, ci_headers_list_t *header
         return -1;
 
     if (headers) {
-        content_encoding = ci_headers_value(headers, "Content-Encoding");
+        ci_headers_values(headers, names, values, 2);
+        content_encoding = values[0];
+        content_type = values[1];
         if (content_encoding) {
             ci_debug_printf(8, "Content-Encoding: %s\n", content_encoding);
             *iscompressed = ci_encoding_method(content_encoding);
@@ -720,8 +724,7 @@ static int extend_object_type(struct ci_magics_db *db, ci_headers_list_t *header
                     ci_data_type_descr(db, file_type));
     /*The following until we have an internal html recognizer ..... */
     if (ci_belongs_to_group(db, file_type, CI_TEXT_DATA)
-            && headers
-            && (content_type = ci_headers_value(headers, "Content-Type")) != NULL) {
+            && content_type != NULL) {
         if (strcasestr(content_type, "text/html")
                 || strcasestr(content_type, "text/css")
                 || strcasestr(content_type, "text/javascript"))
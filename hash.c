@@ -21,6 +21,11 @@
 #include "hash.h"
 #include "debug.h"
 #include <assert.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 unsigned int ci_hash_compute(unsigned long hash_max_value, const void *key, int len)
 {
@@ -42,91 +47,338 @@ unsigned int ci_hash_compute(unsigned long hash_max_value, const void *key, int
     return hash;
 }
 
+/*
+  The control bytes of the slots: empty, deleted, or the 7 lower bits
+  of the key hash for the used slots. The empty and deleted values are
+  the only ones with the high bit set.
+*/
+#define HASH_EMPTY 0x80
+#define HASH_DELETED 0xFE
+#define HASH_GROUP 16
+/*Keep the load factor, including the deleted slots, under 7/8*/
+#define HASH_MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+
+struct ci_hash_slot {
+    const void *key;
+    const void *val;
+};
+
+struct ci_hash_table {
+    unsigned char *ctrl;
+    struct ci_hash_slot *slots;
+    unsigned int capacity;
+    unsigned int items;
+    unsigned int deleted;
+    const ci_type_ops_t *ops;
+    ci_mem_allocator_t *allocator;
+};
+
+/*
+  The group matching functions return a mask which has a bit set for
+  every matching slot of the group. For the NEON implementation each
+  slot is represented by 4 bits.
+*/
+#if defined(__ARM_NEON) && !defined(__SSE2__)
+#define HASH_MASK_SHIFT 2
+#define HASH_MASK_LANE 0xFULL
+#else
+#define HASH_MASK_SHIFT 0
+#define HASH_MASK_LANE 0x1ULL
+#endif
+
+#if defined(__SSE2__)
+static inline uint64_t group_match(const unsigned char *ctrl, unsigned char c)
+{
+    __m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+    return (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char)c)));
+}
+
+static inline uint64_t group_match_free(const unsigned char *ctrl)
+{
+    /*The empty and deleted slots have the high bit set*/
+    return (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+}
+#elif defined(__ARM_NEON)
+static inline uint64_t group_neon_mask(uint8x16_t eq)
+{
+    /*Narrow every byte to 4 bits*/
+    uint8x8_t n = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(n), 0);
+}
+
+static inline uint64_t group_match(const unsigned char *ctrl, unsigned char c)
+{
+    return group_neon_mask(vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(c)));
+}
+
+static inline uint64_t group_match_free(const unsigned char *ctrl)
+{
+    return group_neon_mask(vcltq_s8(vreinterpretq_s8_u8(vld1q_u8(ctrl)), vdupq_n_s8(0)));
+}
+#else
+static inline uint64_t group_match(const unsigned char *ctrl, unsigned char c)
+{
+    uint64_t m = 0;
+    int i;
+    for (i = 0; i < HASH_GROUP; i++)
+        if (ctrl[i] == c)
+            m |= (1ULL << i);
+    return m;
+}
+
+static inline uint64_t group_match_free(const unsigned char *ctrl)
+{
+    uint64_t m = 0;
+    int i;
+    for (i = 0; i < HASH_GROUP; i++)
+        if (ctrl[i] & 0x80)
+            m |= (1ULL << i);
+    return m;
+}
+#endif
+
+static inline int mask_first(uint64_t m)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(m) >> HASH_MASK_SHIFT;
+#else
+    int i = 0;
+    while (!(m & 1)) {
+        m >>= 1;
+        i++;
+    }
+    return i >> HASH_MASK_SHIFT;
+#endif
+}
+
+static inline uint64_t mask_clear(uint64_t m, int i)
+{
+    return m & ~(HASH_MASK_LANE << (i << HASH_MASK_SHIFT));
+}
+
+static inline uint64_t hash_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+/*Hashes 8 bytes at a time and mixes the result (murmur3 finalizer)*/
+static uint64_t hash_key(const void *key, size_t len)
+{
+    const unsigned char *s = (const unsigned char *)key;
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ (len * 0xff51afd7ed558ccdULL);
+    uint64_t w;
+
+    for (; len >= 8; s += 8, len -= 8) {
+        memcpy(&w, s, 8);
+        h ^= w * 0x87c37b91114253d5ULL;
+        h = hash_rotl(h, 31) * 0x4cf5ad432745937fULL;
+    }
+    if (len) {
+        w = 0;
+        memcpy(&w, s, len);
+        h ^= w * 0x87c37b91114253d5ULL;
+        h = hash_rotl(h, 31) * 0x4cf5ad432745937fULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline uint64_t hash_table_key_hash(const struct ci_hash_table *htable, const void *key)
+{
+    return hash_key(key, htable->ops->size(key));
+}
+
+/*Allocates the slots and the control bytes in one block*/
+static int hash_table_alloc(struct ci_hash_table *htable, unsigned int capacity)
+{
+    void *mem;
+    mem = htable->allocator->alloc(htable->allocator, capacity * (sizeof(struct ci_hash_slot) + 1));
+    if (!mem)
+        return 0;
+    htable->slots = (struct ci_hash_slot *)mem;
+    htable->ctrl = (unsigned char *)(htable->slots + capacity);
+    memset(htable->ctrl, HASH_EMPTY, capacity);
+    htable->capacity = capacity;
+    htable->items = 0;
+    htable->deleted = 0;
+    return 1;
+}
+
+/*Returns the first empty or deleted slot of the probe sequence*/
+static unsigned int hash_table_find_free(const struct ci_hash_table *htable, uint64_t hash)
+{
+    const unsigned int groups_mask = htable->capacity / HASH_GROUP - 1;
+    unsigned int g = (unsigned int)(hash >> 7) & groups_mask;
+    unsigned int i;
+    uint64_t m;
+    /*The triangular probing visits all of the groups, and there is
+      always a free slot*/
+    for (i = 1; !(m = group_match_free(htable->ctrl + g * HASH_GROUP)); i++)
+        g = (g + i) & groups_mask;
+    return g * HASH_GROUP + mask_first(m);
+}
+
+static inline void hash_table_set_ctrl(struct ci_hash_table *htable, unsigned int slot, uint64_t hash)
+{
+    htable->ctrl[slot] = (unsigned char)(hash & 0x7F);
+}
+
+/*Returns the slot of the key or -1 if not found*/
+static int hash_table_find(const struct ci_hash_table *htable, const void *key, uint64_t hash)
+{
+    const unsigned int groups_mask = htable->capacity / HASH_GROUP - 1;
+    const unsigned char h2 = (unsigned char)(hash & 0x7F);
+    unsigned int g = (unsigned int)(hash >> 7) & groups_mask;
+    unsigned int i, slot;
+    const unsigned char *ctrl;
+    uint64_t m;
+    int k;
+
+    for (i = 1; i <= groups_mask + 1; i++) {
+        ctrl = htable->ctrl + g * HASH_GROUP;
+        for (m = group_match(ctrl, h2); m != 0; m = mask_clear(m, k)) {
+            k = mask_first(m);
+            slot = g * HASH_GROUP + k;
+            if (htable->ops->compare(htable->slots[slot].key, key) == 0)
+                return (int)slot;
+        }
+        /*The keys are never moved past a group with empty slots*/
+        if (group_match(ctrl, HASH_EMPTY))
+            return -1;
+        g = (g + i) & groups_mask;
+    }
+    return -1;
+}
+
+/*Rehashes to a table with the given capacity*/
+static int hash_table_rehash(struct ci_hash_table *htable, unsigned int capacity)
+{
+    struct ci_hash_table old = *htable;
+    unsigned int i, slot;
+    uint64_t hash;
+
+    if (!hash_table_alloc(htable, capacity)) {
+        *htable = old;
+        return 0;
+    }
+    for (i = 0; i < old.capacity; i++) {
+        if (old.ctrl[i] & 0x80)
+            continue;
+        hash = hash_table_key_hash(htable, old.slots[i].key);
+        slot = hash_table_find_free(htable, hash);
+        hash_table_set_ctrl(htable, slot, hash);
+        htable->slots[slot] = old.slots[i];
+        htable->items++;
+    }
+    ci_debug_printf(8, "Hash table rehashed, %u items, capacity %u -> %u\n", htable->items, old.capacity, capacity);
+    htable->allocator->free(htable->allocator, old.slots);
+    return 1;
+}
+
 struct ci_hash_table * ci_hash_build(unsigned int hash_size,
                                      const ci_type_ops_t *ops, ci_mem_allocator_t *allocator)
 {
     struct ci_hash_table *htable;
-    unsigned int new_hash_size;
+    unsigned int capacity;
     htable = allocator->alloc(allocator, sizeof(struct ci_hash_table));
 
     if (!htable) {
         /*a debug message ....*/
         return NULL;
     }
-    new_hash_size = 63;
-    if (hash_size > 63) {
-        while (new_hash_size<hash_size && new_hash_size < 0xFFFFFF) {
-            new_hash_size++;
-            new_hash_size = (new_hash_size << 1) -1;
-        }
-    }
-    ci_debug_printf(5, "Build hash table of size: %u, memallocated:%u\n", (unsigned int)new_hash_size, (unsigned int)((new_hash_size+1)*sizeof(struct ci_hash_entry *)));
-    htable->hash_table=allocator->alloc(allocator, (new_hash_size+1)*sizeof(struct ci_hash_entry *));
-    if (!htable->hash_table) {
+    for (capacity = HASH_GROUP; HASH_MAX_LOAD(capacity) < hash_size && capacity < 0x40000000; capacity <<= 1);
+    htable->ops = ops;
+    htable->allocator = allocator;
+    if (!hash_table_alloc(htable, capacity)) {
         allocator->free(allocator, htable);
         return NULL;
     }
-    memset(htable->hash_table, 0, (new_hash_size + 1)*sizeof(struct ci_hash_entry *));
-
-    htable->hash_table_size = new_hash_size;
-    htable->ops = ops;
-    htable->allocator = allocator;
+    ci_debug_printf(5, "Build hash table of size: %u, memallocated:%u\n", capacity, (unsigned int)(capacity * (sizeof(struct ci_hash_slot) + 1)));
     return htable;
 }
 
 void ci_hash_destroy(struct ci_hash_table *htable)
 {
-    int i;
-    struct ci_hash_entry *e;
     ci_mem_allocator_t *allocator = htable->allocator;
-    for (i=0; i<= htable->hash_table_size; i++) {
-        while (htable->hash_table[i]) {
-            e = htable->hash_table[i];
-            htable->hash_table[i] = htable->hash_table[i]->hnext;
-            allocator->free(allocator, e);
-        }
-    }
-    htable->allocator->free(allocator,htable->hash_table );
+    allocator->free(allocator, htable->slots);
     allocator->free(allocator, htable);
 }
 
 const void * ci_hash_search(struct ci_hash_table *htable,const void *key)
 {
-    struct ci_hash_entry *e;
-    unsigned int hash=ci_hash_compute(htable->hash_table_size, key, htable->ops->size(key));
-
-    assert(hash <= htable->hash_table_size); /*is it possible?*/
-
-    e = htable->hash_table[hash];
-    while (e != NULL) {
-        if (htable->ops->compare(e->key, key) == 0)
-            return e->val;
-        e = e->hnext;
-    }
-    return NULL;
+    int slot = hash_table_find(htable, key, hash_table_key_hash(htable, key));
+    return slot < 0 ? NULL : htable->slots[slot].val;
 }
 
 void * ci_hash_add(struct ci_hash_table *htable, const void *key, const void *val)
 {
-    struct ci_hash_entry *e;
-    unsigned int hash = ci_hash_compute(htable->hash_table_size, key, htable->ops->size(key));
-    assert(hash <= htable->hash_table_size);
+    uint64_t hash = hash_table_key_hash(htable, key);
+    unsigned int capacity;
+    int slot;
 
-    e = htable->allocator->alloc(htable->allocator, sizeof(struct ci_hash_entry));
+    if ((slot = hash_table_find(htable, key, hash)) >= 0) {
+        htable->slots[slot].key = key;
+        htable->slots[slot].val = val;
+        return &htable->slots[slot];
+    }
 
-    if (!e)
-        return NULL;
+    if (htable->items + htable->deleted + 1 > HASH_MAX_LOAD(htable->capacity)) {
+        /*Grow if the table is more than half full, else just drop the
+          deleted slots*/
+        capacity = htable->capacity;
+        if (htable->items + 1 > HASH_MAX_LOAD(capacity) / 2)
+            capacity <<= 1;
+        if (capacity < htable->capacity || !hash_table_rehash(htable, capacity))
+            return NULL;
+    }
 
-    e->hnext = NULL;
-    e->key = key;
-    e->val = val;
-    e->hash = hash;
+    slot = (int)hash_table_find_free(htable, hash);
+    if (htable->ctrl[slot] == HASH_DELETED)
+        htable->deleted--;
+    hash_table_set_ctrl(htable, slot, hash);
+    htable->slots[slot].key = key;
+    htable->slots[slot].val = val;
+    htable->items++;
+    return &htable->slots[slot];
+}
 
-//    if(htable->hash_table[hash])
-//  ci_debug_printf(9, "ci_hash_update:::Found %s\n", htable->hash_table[hash]->val);
+const void *ci_hash_remove(struct ci_hash_table *htable, const void *key)
+{
+    const void *val;
+    const unsigned char *group;
+    int slot = hash_table_find(htable, key, hash_table_key_hash(htable, key));
+    if (slot < 0)
+        return NULL;
+    val = htable->slots[slot].val;
+    /*If the group has empty slots no probe sequence continues past it
+      and the slot can be marked as empty*/
+    group = htable->ctrl + (slot & ~(HASH_GROUP - 1));
+    if (group_match(group, HASH_EMPTY))
+        htable->ctrl[slot] = HASH_EMPTY;
+    else {
+        htable->ctrl[slot] = HASH_DELETED;
+        htable->deleted++;
+    }
+    htable->slots[slot].key = NULL;
+    htable->slots[slot].val = NULL;
+    htable->items--;
+    return val;
+}
 
-    /*Make it the first entry in the current hash entry*/
-    e->hnext=htable->hash_table[hash];
-    htable->hash_table[hash] = e;
-    return e;
+void ci_hash_iterate(struct ci_hash_table *htable, void *data, int (*fn)(void *data, const void *key, const void *val))
+{
+    unsigned int i;
+    for (i = 0; i < htable->capacity; i++) {
+        if (!(htable->ctrl[i] & 0x80) && (*fn)(data, htable->slots[i].key, htable->slots[i].val))
+            return;
+    }
+}
+
+unsigned int ci_hash_items(const struct ci_hash_table *htable)
+{
+    return htable->items;
 }
@@ -22,6 +22,13 @@
 #include "debug.h"
 #include "header.h"
 #include <ctype.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 const char *ci_methods[] = {
     "UNKNOWN",                 /*0x00 */
@@ -96,6 +103,7 @@ ci_headers_list_t *ci_headers_create2(int num, size_t buf_size)
     }
     h->headers = NULL;
     h->buf = NULL;
+    h->index = NULL;
     assert(buf_size > 0);
     assert(num > 0);
     if (!(h->headers = malloc(num * sizeof(char *)))
@@ -129,6 +137,7 @@ void ci_headers_destroy(ci_headers_list_t * h)
         return;
     free(h->headers);
     free(h->buf);
+    free(h->index);
     free(h);
 }
 
@@ -153,9 +162,254 @@ int ci_headers_setsize(ci_headers_list_t * h, int size)
     return 1;
 }
 
+/*
+  The headers index is a small open addressing hash table which maps the
+  header names to their positions in the headers list. It is built only
+  by the ci_headers_build_index, the searches use it if it is valid and
+  never modify the list. The linear search checks only one char of most
+  of the headers, so the lists with less than HEADERS_INDEX_MIN headers
+  are not indexed. The headers added at the end of the list are added to
+  the index, any other modification drops it. The index memory is kept
+  for the next headers stored in the list.
+*/
+#define HEADERS_INDEX_MIN 24
+
+struct headers_index_slot {
+    unsigned int hash;
+    int len;
+    int pos;   /*The position in headers list plus one, 0 for empty slots*/
+};
+
+struct ci_headers_index {
+    int used; /*The h->used the index built for, -1 if invalid*/
+    unsigned int mask;
+    unsigned int slots_num;
+    struct headers_index_slot *slots;
+};
+
+static inline void headers_index_invalidate(ci_headers_list_t *h)
+{
+    if (h->index)
+        h->index->used = -1;
+}
+
+static inline int headers_index_valid(const ci_headers_list_t *h)
+{
+    return h->index && h->index->used == h->used;
+}
+
+/*The header names are hashed and compared 8 bytes at once, with the
+  ASCII upper case letters converted to lower case*/
+#define HEADER_NAME_ONES 0x0101010101010101ULL
+static inline uint64_t header_name_lower(uint64_t w)
+{
+    uint64_t heptets, upper;
+    heptets = w & (0x7F * HEADER_NAME_ONES);
+    /*The bit 7 of the bytes is set for the bytes in ['A', 'Z']*/
+    upper = (heptets + (0x80 - 'A') * HEADER_NAME_ONES) &
+            ~(heptets + (0x7F - 'Z') * HEADER_NAME_ONES) &
+            ~w & (0x80 * HEADER_NAME_ONES);
+    return w | (upper >> 2);
+}
+
+static inline uint64_t header_name_word(const char *name, size_t len)
+{
+    uint64_t w;
+    uint32_t lo, hi;
+    if (len >= 8)
+        memcpy(&w, name, 8);
+    else if (len >= 4) {
+        /*The two loads overlap for less than 8 bytes*/
+        memcpy(&lo, name, 4);
+        memcpy(&hi, name + len - 4, 4);
+        w = lo | ((uint64_t)hi << (8 * (len - 4)));
+    } else {
+        w = (uint64_t)(unsigned char)name[0] |
+            ((uint64_t)(unsigned char)name[len / 2] << (8 * (len / 2))) |
+            ((uint64_t)(unsigned char)name[len - 1] << (8 * (len - 1)));
+    }
+    return header_name_lower(w);
+}
+
+#define HEADER_NAME_MIX(hash, w) (((hash) ^ (w)) * 0x9E3779B97F4A7C15ULL)
+
+static inline unsigned int header_name_hash_final(uint64_t hash, size_t len)
+{
+    hash = HEADER_NAME_MIX(hash, len);
+    return (unsigned int)(hash ^ (hash >> 32));
+}
+
+static inline unsigned int header_name_hash(const char *name, size_t len)
+{
+    uint64_t hash = 0;
+    size_t i;
+    for (i = 0; i + 8 <= len; i += 8)
+        hash = HEADER_NAME_MIX(hash, header_name_word(name + i, 8));
+    if (i < len)
+        hash = HEADER_NAME_MIX(hash, header_name_word(name + i, len - i));
+    return header_name_hash_final(hash, len);
+}
+
+static inline int header_name_equal(const char *name, const char *header, size_t len)
+{
+    for (; len >= 8; len -= 8, name += 8, header += 8) {
+        if (header_name_word(name, 8) != header_name_word(header, 8))
+            return 0;
+    }
+    return !len || header_name_word(name, len) == header_name_word(header, len);
+}
+
+/*Returns the first ':' or '\0' char of the header, or the h_end, and
+  the hash of the header name before it*/
+static inline const char *header_name_scan(const char *name, const char *h_end, unsigned int *hash)
+{
+    const char *e = name;
+#if defined(__GNUC__) && !defined(WORDS_BIGENDIAN)
+    uint64_t w, c, m, hsh = 0;
+    for (; e + 8 <= h_end; e += 8) {
+        memcpy(&w, e, 8);
+        c = w ^ (':' * HEADER_NAME_ONES);
+        m = (((w - HEADER_NAME_ONES) & ~w) | ((c - HEADER_NAME_ONES) & ~c)) & (0x80 * HEADER_NAME_ONES);
+        if (m) {
+            m = __builtin_ctzll(m) >> 3;
+            if (m)
+                hsh = HEADER_NAME_MIX(hsh, header_name_lower(w & ((1ULL << (8 * m)) - 1)));
+            e += m;
+            *hash = header_name_hash_final(hsh, e - name);
+            return e;
+        }
+        hsh = HEADER_NAME_MIX(hsh, header_name_lower(w));
+    }
+    if (e > name) {
+        /*Not found in the last 8 bytes*/
+        for (; e < h_end && *e != ':' && *e != '\0'; e++);
+        *hash = header_name_hash(name, e - name);
+        return e;
+    }
+#endif
+    for (; e < h_end && *e != ':' && *e != '\0'; e++);
+    *hash = header_name_hash(name, e - name);
+    return e;
+}
+
+static void headers_index_insert(ci_headers_list_t *h, int i)
+{
+    struct ci_headers_index *index = h->index;
+    struct headers_index_slot *slot;
+    const char *name, *e;
+    unsigned int hash, k;
+
+    name = h->headers[i];
+    e = header_name_scan(name, h->buf + h->bufused, &hash);
+    /*The headers without name can not be found*/
+    if (e == name || e >= h->buf + h->bufused || *e != ':')
+        return;
+    /*The first of the headers with the same name occupies the first
+      slot of the probe sequence and it is found first*/
+    for (k = hash & index->mask; index->slots[k].pos; k = (k + 1) & index->mask);
+    slot = &index->slots[k];
+    slot->hash = hash;
+    slot->len = e - name;
+    slot->pos = i + 1;
+}
+
+static int headers_index_build(ci_headers_list_t *h)
+{
+    struct ci_headers_index *index;
+    unsigned int slots_num;
+    int i;
+
+    slots_num = 16;
+    while (slots_num < 2 * (unsigned int)h->used)
+        slots_num <<= 1;
+
+    if (!h->index || h->index->slots_num < slots_num) {
+        index = realloc(h->index, sizeof(struct ci_headers_index) + slots_num * sizeof(struct headers_index_slot));
+        if (!index) {
+            ci_debug_printf(1, "Error allocating memory for headers index\n");
+            return 0;
+        }
+        index->slots = (struct headers_index_slot *)(index + 1);
+        index->slots_num = slots_num;
+        h->index = index;
+    }
+    index = h->index;
+    index->mask = index->slots_num - 1;
+    memset(index->slots, 0, index->slots_num * sizeof(struct headers_index_slot));
+    for (i = 0; i < h->used; i++)
+        headers_index_insert(h, i);
+    index->used = h->used;
+    return 1;
+}
+
+int ci_headers_build_index(ci_headers_list_t *h)
+{
+    assert(h);
+    if (h->used < HEADERS_INDEX_MIN)
+        return 0;
+    if (headers_index_valid(h))
+        return 1;
+    return headers_index_build(h);
+}
+
+/*Keeps the index of the headers list valid after a header added at
+  the end of the list*/
+static void headers_index_added(ci_headers_list_t *h)
+{
+    if (!h->index)
+        return;
+    if (h->index->used == h->used - 1 && 2 * (unsigned int)h->used <= h->index->slots_num) {
+        headers_index_insert(h, h->used - 1);
+        h->index->used = h->used;
+    } else
+        headers_index_invalidate(h);
+}
+
+static int headers_index_find(const ci_headers_list_t *h, const char *header, size_t header_size)
+{
+    const struct ci_headers_index *index = h->index;
+    const struct headers_index_slot *slot;
+    unsigned int hash, k;
+
+    hash = header_name_hash(header, header_size);
+    for (k = hash & index->mask; (slot = &index->slots[k])->pos; k = (k + 1) & index->mask) {
+        if (slot->hash == hash && slot->len == header_size &&
+                header_name_equal(h->headers[slot->pos - 1], header, header_size))
+            return slot->pos - 1;
+    }
+    return -1;
+}
+
+/*Returns the position of the header in the headers list or -1*/
+static inline int header_find(const ci_headers_list_t * h, const char *header, size_t header_size)
+{
+    int i;
+    const char *h_end;
+    const char *check_head;
+
+    if (!header_size)
+        return -1;
+
+    if (headers_index_valid(h) && !memchr(header, ':', header_size))
+        return headers_index_find(h, header, header_size);
+
+    h_end = h->buf + h->bufused;
+    for (i = 0; i < h->used; i++) {
+        check_head = h->headers[i];
+        if (h_end < check_head + header_size)
+            return -1;
+        if (*(check_head + header_size) != ':')
+            continue;
+        if (strncasecmp(check_head, header, header_size) == 0)
+            return i;
+    }
+    return -1;
+}
+
 void ci_headers_reset(ci_headers_list_t * h)
 {
     assert(h);
+    headers_index_invalidate(h);
     h->packed = 0;
     h->used = 0;
     h->bufused = 0;
@@ -236,7 +490,7 @@ static int headers_terminate(ci_headers_list_t *h)
         return 1;
 
     int i = 0;
-    while((h->bufused - i) >= 0 && strchr("\r\n\0", h->buf[h->bufused - i - 1]))
+    while((h->bufused - i) > 0 && strchr("\r\n\0", h->buf[h->bufused - i - 1]))
         i++;
     if ((h->bufused - i + 4) > h->bufsize)
         return 0; // Not enough space to terminate
@@ -277,8 +531,10 @@ const char *ci_headers_add(ci_headers_list_t * h, const char *line)
     *(newhead + linelen + 3) = '\n';
     h->bufused = h->bufused + linelen + 4;
     assert(h->bufused <= h->bufsize);
-    if (newhead)
+    if (newhead) {
         h->headers[h->used++] = newhead;
+        headers_index_added(h);
+    }
 
     return newhead;
 }
@@ -300,6 +556,7 @@ int ci_headers_addheaders(ci_headers_list_t * h, const ci_headers_list_t * heade
     } else {
         assert(h->bufused == 0);
     }
+    headers_index_invalidate(h);
     char *pos = h->buf + h->bufused;
     memcpy(pos, headers->buf, headers->bufused);
     h->bufused += headers->bufused;
@@ -333,42 +590,38 @@ const char *ci_headers_first_line(const ci_headers_list_t *h)
     return h->buf;
 }
 
-static const char *do_header_search(const ci_headers_list_t * h, const char *header, const char **value, const char **end)
+static inline const char *header_result(const ci_headers_list_t * h, int i, size_t header_size, const char **value, const char **end)
 {
-    int i;
-    size_t header_size;
     const char *h_end;
     const char *check_head, *lval;
 
-    header_size = strlen(header);
-    if (!header_size)
-        return NULL;
-
-    assert(h);
     h_end = h->buf + h->bufused;
-    for (i = 0; i < h->used; i++) {
-        check_head = h->headers[i];
-        if (h_end < check_head + header_size)
+    check_head = h->headers[i];
+    lval = check_head + header_size + 1;
+    if (value) {
+        while (lval <= h_end && (*lval == ' ' || *lval == '\t'))
+            ++(lval);
+        *value = lval;
+    }
+    if (end) {
+        *end = (i < h->used -1) ? (h->headers[i + 1] - 1) : (h->buf + h->bufused - 1);
+        if (*end < lval) /*parse error in headers ?*/
             return NULL;
-        if (*(check_head + header_size) != ':')
-            continue;
-        if (strncasecmp(check_head, header, header_size) == 0) {
-            lval = check_head + header_size + 1;
-            if (value) {
-                while (lval <= h_end && (*lval == ' ' || *lval == '\t'))
-                    ++(lval);
-                *value = lval;
-            }
-            if (end) {
-                *end = (i < h->used -1) ? (h->headers[i + 1] - 1) : (h->buf + h->bufused - 1);
-                if (*end < lval) /*parse error in headers ?*/
-                    return NULL;
-                while ((*end > lval) && (**end == '\0' || **end == '\r' || **end == '\n')) --(*end);
-            }
-            return check_head;
-        }
+        while ((*end > lval) && (**end == '\0' || **end == '\r' || **end == '\n')) --(*end);
     }
-    return NULL;
+    return check_head;
+}
+
+static const char *do_header_search(const ci_headers_list_t * h, const char *header, const char **value, const char **end)
+{
+    int i;
+    size_t header_size;
+
+    assert(h);
+    header_size = strlen(header);
+    if ((i = header_find(h, header, header_size)) < 0)
+        return NULL;
+    return header_result(h, i, header_size, value, end);
 }
 
 const char *ci_headers_search(const ci_headers_list_t * h, const char *header)
@@ -407,6 +660,22 @@ const char *ci_headers_value2(const ci_headers_list_t * h, const char *header, s
     return NULL;
 }
 
+int ci_headers_values(const ci_headers_list_t * h, const char **names, const char **values, int count)
+{
+    int i, k, found = 0;
+    size_t header_size;
+
+    assert(h);
+    for (k = 0; k < count; k++) {
+        values[k] = NULL;
+        header_size = strlen(names[k]);
+        if ((i = header_find(h, names[k], header_size)) >= 0 &&
+                header_result(h, i, header_size, &values[k], NULL))
+            found++;
+    }
+    return found;
+}
+
 const char *ci_headers_copy_value(const ci_headers_list_t * h, const char *header, char *buf, size_t len)
 {
     const char *phead = NULL, *pval = NULL, *pend = NULL;
@@ -432,10 +701,8 @@ const char *ci_headers_copy_value(const ci_headers_list_t * h, const char *heade
 
 int ci_headers_remove(ci_headers_list_t * h, const char *header)
 {
-    const char *h_end;
     char *phead;
     int i, j, cur_head_size, rest_len;
-    size_t header_size;
 
     assert(h);
     if (h->packed) { /*Not in edit mode*/
@@ -447,43 +714,35 @@ int ci_headers_remove(ci_headers_list_t * h, const char *header)
     headers_check_space(h, 0, 0);
     assert(headers_terminate(h));
 
-    h_end = (h->buf + h->bufused);
-    header_size = strlen(header);
-    for (i = 0; i < h->used; i++) {
-        phead = h->headers[i];
-        if (h_end < phead + header_size)
-            return 0;
-        if (*(phead + header_size) != ':')
-            continue;
-        if (strncasecmp(phead, header, header_size) == 0) {
-            /*remove it........ */
-            if (i == h->used - 1) {
-                phead = h->headers[i];
-                *phead = '\r';
-                *(phead + 1) = '\n';
-                h->bufused = (phead - h->buf + 2);
-                assert(h->bufused <= h->bufsize);
-                (h->used)--;
-            } else {
-                cur_head_size = h->headers[i + 1] - h->headers[i];
-                rest_len =
-                    h->bufused - (h->headers[i] - h->buf) - cur_head_size;
-                assert(rest_len > 0);
-                ci_debug_printf(5, "remove_header : remain len %d\n",
-                                rest_len);
-                memmove(phead, h->headers[i + 1], rest_len);
-                /*reconstruct index..... */
-                h->bufused -= cur_head_size;
-                (h->used)--;
-                for (j = i; j < h->used; j++) {
-                    h->headers[j] = h->headers[j + 1] - cur_head_size;
-                }
-            }
-            assert(headers_terminate(h));
-            return 1;
+    if ((i = header_find(h, header, strlen(header))) < 0)
+        return 0;
+
+    /*remove it........ */
+    headers_index_invalidate(h);
+    phead = h->headers[i];
+    if (i == h->used - 1) {
+        *phead = '\r';
+        *(phead + 1) = '\n';
+        h->bufused = (phead - h->buf + 2);
+        assert(h->bufused <= h->bufsize);
+        (h->used)--;
+    } else {
+        cur_head_size = h->headers[i + 1] - h->headers[i];
+        rest_len =
+            h->bufused - (h->headers[i] - h->buf) - cur_head_size;
+        assert(rest_len > 0);
+        ci_debug_printf(5, "remove_header : remain len %d\n",
+                        rest_len);
+        memmove(phead, h->headers[i + 1], rest_len);
+        /*reconstruct index..... */
+        h->bufused -= cur_head_size;
+        (h->used)--;
+        for (j = i; j < h->used; j++) {
+            h->headers[j] = h->headers[j + 1] - cur_head_size;
         }
     }
-    return 0;
+    assert(headers_terminate(h));
+    return 1;
 }
 
 const char *ci_headers_replace(ci_headers_list_t * h, const char *header, const char *newval)
@@ -492,6 +751,7 @@ const char *ci_headers_replace(ci_headers_list_t * h, const char *header, const
     if (h->packed) /*Not in edit mode*/
         return NULL;
 
+    headers_index_invalidate(h);
     return NULL;
 }
 
@@ -558,11 +818,221 @@ void ci_headers_pack(ci_headers_list_t * h)
 }
 
 
-int ci_headers_unpack(ci_headers_list_t * h)
+/*
+  The headers scanner checks blocks of SCAN_BLOCK bytes at once for '\n'
+  and '\0' chars. The masks have a bit set for every matching char of
+  the block, or 4 bits for the NEON implementation.
+*/
+#if defined(__ARM_NEON) && !defined(__SSE2__)
+#define SCAN_MASK_SHIFT 2
+#define SCAN_MASK_LANE 0xFULL
+#else
+#define SCAN_MASK_SHIFT 0
+#define SCAN_MASK_LANE 0x1ULL
+#endif
+
+static inline uint64_t scan_bytes(const char *s, int n, uint64_t *nul)
+{
+    uint64_t nl = 0;
+    int i;
+    *nul = 0;
+    for (i = 0; i < n; i++) {
+        if (s[i] == '\n')
+            nl |= SCAN_MASK_LANE << (i << SCAN_MASK_SHIFT);
+        else if (s[i] == '\0')
+            *nul |= SCAN_MASK_LANE << (i << SCAN_MASK_SHIFT);
+    }
+    return nl;
+}
+
+#if defined(__AVX2__)
+#define SCAN_BLOCK 32
+static inline uint64_t scan_block(const char *s, uint64_t *nul)
+{
+    __m256i b = _mm256_loadu_si256((const __m256i *)s);
+    *nul = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, _mm256_setzero_si256()));
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, _mm256_set1_epi8('\n')));
+}
+#elif defined(__SSE2__)
+#define SCAN_BLOCK 16
+static inline uint64_t scan_block(const char *s, uint64_t *nul)
+{
+    __m128i b = _mm_loadu_si128((const __m128i *)s);
+    *nul = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(b, _mm_setzero_si128()));
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(b, _mm_set1_epi8('\n')));
+}
+#elif defined(__ARM_NEON)
+#define SCAN_BLOCK 16
+static inline uint64_t scan_neon_mask(uint8x16_t eq)
+{
+    /*Narrow every byte to 4 bits*/
+    uint8x8_t n = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(n), 0);
+}
+
+static inline uint64_t scan_block(const char *s, uint64_t *nul)
+{
+    uint8x16_t b = vld1q_u8((const uint8_t *)s);
+    *nul = scan_neon_mask(vceqq_u8(b, vdupq_n_u8(0)));
+    return scan_neon_mask(vceqq_u8(b, vdupq_n_u8('\n')));
+}
+#else
+#define SCAN_BLOCK 16
+static inline uint64_t scan_block(const char *s, uint64_t *nul)
+{
+    return scan_bytes(s, SCAN_BLOCK, nul);
+}
+#endif
+
+static inline int scan_mask_first(uint64_t m)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(m) >> SCAN_MASK_SHIFT;
+#else
+    int i = 0;
+    while (!(m & 1)) {
+        m >>= 1;
+        i++;
+    }
+    return i >> SCAN_MASK_SHIFT;
+#endif
+}
+
+void ci_headers_scan_init(ci_headers_scan_t *scan)
+{
+    scan->scanned = 0;
+    scan->eoh = 0;
+    scan->has_nul = 0;
+    scan->lines = 0;
+}
+
+static int headers_scan(ci_headers_scan_t *scan, const char *buf, int len, int stop_at_eoh)
+{
+    uint64_t nl, nul;
+    int pos, n, k, p;
+
+    for (pos = scan->scanned; pos < len && !scan->eoh; pos += n) {
+        n = len - pos;
+        if (n >= SCAN_BLOCK) {
+            n = SCAN_BLOCK;
+            nl = scan_block(buf + pos, &nul);
+        } else
+            nl = scan_bytes(buf + pos, n, &nul);
+
+        for (; nl; nl &= ~(SCAN_MASK_LANE << (k << SCAN_MASK_SHIFT))) {
+            k = scan_mask_first(nl);
+            p = pos + k;
+            if (scan->lines < CI_HEADERS_SCAN_LINES)
+                scan->nl[scan->lines] = p;
+            scan->lines++;
+            if (stop_at_eoh && p >= 3 && buf[p - 1] == '\r' && buf[p - 2] == '\n' && buf[p - 3] == '\r') {
+                scan->eoh = p + 1;
+                /*Ignore the data after the end of headers*/
+                nul &= (1ULL << (k << SCAN_MASK_SHIFT)) - 1;
+                break;
+            }
+        }
+        if (nul)
+            scan->has_nul = 1;
+    }
+    scan->scanned = scan->eoh ? scan->eoh : len;
+    return scan->eoh;
+}
+
+int ci_headers_scan(ci_headers_scan_t *scan, const char *buf, int len)
+{
+    return headers_scan(scan, buf, len, 1);
+}
+
+static int headers_index_grow(ci_headers_list_t * h)
 {
-    int len, eoh;
     char **newspace;
-    char *ebuf, *str;
+    int len = h->size + HEADERSTARTSIZE;
+    newspace = realloc(h->headers, len * sizeof(char *));
+    if (!newspace) {
+        ci_debug_printf(1, "Server Error: Error allocating memory \n");
+        return 0;
+    }
+    h->headers = newspace;
+    h->size = len;
+    return 1;
+}
+
+/*Construct the index of headers, char by char*/
+static int headers_index_parse(ci_headers_list_t * h, char *ebuf)
+{
+    int eoh;
+    char *str;
+
+    for (str = h->buf; str < ebuf; str++) {
+        eoh = 0;
+
+        if ((*str == '\r' && *(str + 1) == '\n')) {
+            if ((str + 2) >= ebuf
+                    || (*(str + 2) != '\t' && *(str + 2) != ' '))
+                eoh = 1;
+        } else if (*str == '\n' && *(str + 1) != '\t' && *(str + 1) != ' ') {
+            /*handle the case that headers seperated with a '\n' only */
+            eoh = 1;
+        } else if (*str == '\0')      /*Then we have a problem. This char is important for us. Yes can happen! */
+            *str = ' ';
+
+        if (eoh) {
+            *str = '\0';
+            if (h->size <= h->used && !headers_index_grow(h))
+                return EC_500;
+            str++;
+            if (*str == '\n') /* if headers seperated with a '\n' only this is false */
+                str++;
+            h->headers[h->used] = str;
+            h->used++;
+        }
+    }
+    return EC_100;
+}
+
+/*
+  Construct the index of headers using the positions of the '\n' chars
+  found by the scanner. Produces the same index as the
+  headers_index_parse: the first char of each header is not checked for
+  an end of line.
+*/
+static int headers_index_scanned(ci_headers_list_t * h, const ci_headers_scan_t *scan, char *ebuf)
+{
+    const int end = ebuf - h->buf;
+    char *buf = h->buf;
+    int i, p, start, checked = 0;
+
+    for (i = 0; i < scan->lines && (p = scan->nl[i]) < end; i++) {
+        if (p - 1 >= checked && buf[p - 1] == '\r') {
+            /*A "\r\n", the end of header if the next line is not a
+              continuation line*/
+            if (p + 1 < end && (buf[p + 1] == '\t' || buf[p + 1] == ' '))
+                continue;
+            buf[p - 1] = '\0';
+            start = p + 1;
+        } else if (p >= checked && buf[p + 1] != '\t' && buf[p + 1] != ' ') {
+            /*Headers seperated with a '\n' only*/
+            buf[p] = '\0';
+            start = p + 1;
+            if (buf[start] == '\n')
+                start++;
+        } else
+            continue;
+        if (h->size <= h->used && !headers_index_grow(h))
+            return EC_500;
+        h->headers[h->used] = buf + start;
+        h->used++;
+        checked = start + 1;
+    }
+    return EC_100;
+}
+
+static int headers_unpack(ci_headers_list_t * h, const ci_headers_scan_t *scan)
+{
+    int ret;
+    char *ebuf;
+    ci_headers_scan_t line_scan;
 
     assert(h);
     int unParsed = h->bufused > 0 && h->used == 0;
@@ -582,44 +1052,27 @@ int ci_headers_unpack(ci_headers_list_t * h)
     }
     //handle the case the empty header "\r\n\r\n" is already accounted in h->bufused
     while(ebuf - 1 > h->buf && (*(ebuf - 1) == '\r' || *(ebuf - 1) =='\n')) ebuf--;
+
+    headers_index_invalidate(h);
+    if (!scan) {
+        ci_headers_scan_init(&line_scan);
+        headers_scan(&line_scan, h->buf, ebuf - h->buf, 0);
+        scan = &line_scan;
+    }
     *ebuf = '\0';
 
     h->headers[0] = h->buf;
     h->used = 1;
 
-    for (str = h->buf; str < ebuf; str++) {    /*Construct index of headers */
-        eoh = 0;
-
-        if ((*str == '\r' && *(str + 1) == '\n')) {
-            if ((str + 2) >= ebuf
-                    || (*(str + 2) != '\t' && *(str + 2) != ' '))
-                eoh = 1;
-        } else if (*str == '\n' && *(str + 1) != '\t' && *(str + 1) != ' ') {
-            /*handle the case that headers seperated with a '\n' only */
-            eoh = 1;
-        } else if (*str == '\0')      /*Then we have a problem. This char is important for us. Yes can happen! */
-            *str = ' ';
+    /*The '\0' chars inside headers and the headers with too many lines
+      are handled by the char by char parser*/
+    if (!scan->has_nul && scan->lines <= CI_HEADERS_SCAN_LINES)
+        ret = headers_index_scanned(h, scan, ebuf);
+    else
+        ret = headers_index_parse(h, ebuf);
+    if (ret != EC_100)
+        return ret;
 
-        if (eoh) {
-            *str = '\0';
-            if (h->size <= h->used) {        /*  Resize the headers index space ........ */
-                len = h->size + HEADERSTARTSIZE;
-                newspace = realloc(h->headers, len * sizeof(char *));
-                if (!newspace) {
-                    ci_debug_printf(1,
-                                    "Server Error: Error allocating memory \n");
-                    return EC_500;
-                }
-                h->headers = newspace;
-                h->size = len;
-            }
-            str++;
-            if (*str == '\n') /* if headers separated with a '\n' only this is false */
-                str++;
-            h->headers[h->used] = str;
-            h->used++;
-        }
-    }
     h->packed = 0;
     /*OK headers index construction ...... */
     headers_check_space(h, 0, 0);
@@ -627,6 +1080,16 @@ int ci_headers_unpack(ci_headers_list_t * h)
     return EC_100;
 }
 
+int ci_headers_unpack(ci_headers_list_t * h)
+{
+    return headers_unpack(h, NULL);
+}
+
+int ci_headers_unpack_scanned(ci_headers_list_t * h, const ci_headers_scan_t *scan)
+{
+    return headers_unpack(h, scan);
+}
+
 size_t ci_headers_pack_to_buffer(const ci_headers_list_t *heads, char *buf, size_t size)
 {
     int i;
@@ -0,0 +1,477 @@
+/*
+ *  Copyright (C) 2004-2022 Christos Tsantilas
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA.
+ */
+
+#include "common.h"
+#include "c-icap.h"
+#include "debug.h"
+#include "htable.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#if defined(USE_POSIX_MAPPED_FILES)
+#include <sys/mman.h>
+#endif
+
+/*
+  The tables are mapped read-only and shared, so all the c-icap
+  children share the same pages through the page cache and opening a
+  table does not depend on its size. The rows are found using the
+  bucket which points to them, and they are not validated when the
+  table opened, but only the rows a search reaches, so a corrupted file
+  can produce wrong results but not invalid memory accesses.
+*/
+
+#define HTABLE_ALIGN(val, n) (((val) + (n) - 1) & ~((uint64_t)(n) - 1))
+
+struct ci_htable {
+    const char *data;
+    size_t size;
+    const ci_htable_header_t *header;
+    const ci_htable_bucket_t *buckets;
+    uint64_t mask;
+    int mapped;
+};
+
+uint64_t ci_htable_hash(const char *key, size_t len)
+{
+    /*FNV-1a, it is part of the file format, do not change it*/
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    const unsigned char *s = (const unsigned char *)key;
+    const unsigned char *e = s + len;
+    for (; s < e; s++) {
+        hash ^= *s;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static int htable_check_header(const ci_htable_header_t *h, size_t size, const char *path)
+{
+    if (memcmp(h->magic, CI_HTABLE_MAGIC, sizeof(h->magic)) != 0) {
+        ci_debug_printf(1, "htable %s: not an hash table file\n", path);
+        return 0;
+    }
+    if (h->byte_order != CI_HTABLE_BYTE_ORDER) {
+        ci_debug_printf(1, "htable %s: built on a machine with different byte order\n", path);
+        return 0;
+    }
+    if (h->version != CI_HTABLE_VERSION) {
+        ci_debug_printf(1, "htable %s: unsupported version %u\n", path, (unsigned)h->version);
+        return 0;
+    }
+    if (h->file_size != size ||
+            h->pool_offset < sizeof(ci_htable_header_t) ||
+            h->pool_size > size - h->pool_offset ||
+            h->buckets_offset < h->pool_offset + h->pool_size ||
+            h->buckets_offset % sizeof(uint64_t) != 0 ||
+            h->buckets_num == 0 ||
+            (h->buckets_num & (h->buckets_num - 1)) != 0 ||
+            h->buckets_offset > size ||
+            h->buckets_num > (size - h->buckets_offset) / sizeof(ci_htable_bucket_t)) {
+        ci_debug_printf(1, "htable %s: corrupted or truncated file\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+ci_htable_t *ci_htable_open(const char *path)
+{
+    ci_htable_t *table;
+    struct stat st;
+    char *data;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        ci_debug_printf(1, "htable: can not open %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ci_htable_header_t)) {
+        ci_debug_printf(1, "htable %s: not an hash table file\n", path);
+        close(fd);
+        return NULL;
+    }
+    if (!(table = calloc(1, sizeof(ci_htable_t)))) {
+        close(fd);
+        return NULL;
+    }
+    table->size = (size_t)st.st_size;
+#if defined(USE_POSIX_MAPPED_FILES)
+    data = mmap(NULL, table->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        ci_debug_printf(1, "htable %s: mmap failed: %s\n", path, strerror(errno));
+        close(fd);
+        free(table);
+        return NULL;
+    }
+    table->mapped = 1;
+#else
+    {
+        size_t pos = 0;
+        ssize_t bytes;
+        if (!(data = malloc(table->size))) {
+            close(fd);
+            free(table);
+            return NULL;
+        }
+        while (pos < table->size && (bytes = read(fd, data + pos, table->size - pos)) > 0)
+            pos += bytes;
+        if (pos < table->size) {
+            ci_debug_printf(1, "htable %s: error reading file\n", path);
+            close(fd);
+            free(data);
+            free(table);
+            return NULL;
+        }
+    }
+#endif
+    close(fd);
+    table->data = data;
+    table->header = (const ci_htable_header_t *)data;
+    if (!htable_check_header(table->header, table->size, path)) {
+        ci_htable_close(table);
+        return NULL;
+    }
+    table->buckets = (const ci_htable_bucket_t *)(data + table->header->buckets_offset);
+    table->mask = table->header->buckets_num - 1;
+    ci_debug_printf(5, "htable %s: %llu rows, %llu buckets\n", path, (unsigned long long)table->header->rows, (unsigned long long)table->header->buckets_num);
+    return table;
+}
+
+void ci_htable_close(ci_htable_t *table)
+{
+    if (!table)
+        return;
+#if defined(USE_POSIX_MAPPED_FILES)
+    if (table->mapped)
+        munmap((void *)table->data, table->size);
+#else
+    free((void *)table->data);
+#endif
+    free(table);
+}
+
+const ci_htable_header_t *ci_htable_header(const ci_htable_t *table)
+{
+    return table->header;
+}
+
+/*Returns the row at the given offset or NULL if it is not a valid row*/
+static const ci_htable_row_t *htable_row(const ci_htable_t *table, uint64_t offset, const char **vals, int *vals_num)
+{
+    const ci_htable_row_t *row;
+    const char *s, *e;
+    uint32_t i;
+    const uint64_t pool_end = table->header->pool_offset + table->header->pool_size;
+
+    if (offset < table->header->pool_offset || offset % sizeof(uint32_t) != 0 ||
+            offset + sizeof(ci_htable_row_t) > pool_end)
+        return NULL;
+    row = (const ci_htable_row_t *)(table->data + offset);
+    s = (const char *)row + sizeof(ci_htable_row_t);
+    if (row->size > pool_end - offset - sizeof(ci_htable_row_t) ||
+            row->key_size >= row->size || s[row->key_size] != '\0')
+        return NULL;
+    e = s + row->size;
+    *vals = s + row->key_size + 1;
+    *vals_num = (int)row->vals_num;
+    /*Check that all of the values are inside the row*/
+    for (s = *vals, i = 0; i < row->vals_num; i++) {
+        if (s >= e || !(s = memchr(s, '\0', e - s)))
+            return NULL;
+        s++;
+    }
+    return row;
+}
+
+const char *ci_htable_search(const ci_htable_t *table, const char *key, const char **vals, int *vals_num)
+{
+    const ci_htable_bucket_t *b;
+    const ci_htable_row_t *row;
+    const char *row_key;
+    size_t len = strlen(key);
+    uint64_t hash = ci_htable_hash(key, len);
+    uint64_t i, probes;
+
+    for (i = hash & table->mask, probes = 0; probes <= table->mask; i = (i + 1) & table->mask, probes++) {
+        b = &table->buckets[i];
+        if (b->offset == 0)
+            return NULL;
+        if (b->hash != hash)
+            continue;
+        if (!(row = htable_row(table, b->offset, vals, vals_num))) {
+            ci_debug_printf(1, "htable: corrupted row at offset %llu\n", (unsigned long long)b->offset);
+            return NULL;
+        }
+        row_key = (const char *)row + sizeof(ci_htable_row_t);
+        if (row->key_size == len && memcmp(row_key, key, len) == 0)
+            return row_key;
+    }
+    return NULL;
+}
+
+const char *ci_htable_next_row(const ci_htable_t *table, uint64_t *pos, const char **vals, int *vals_num)
+{
+    const ci_htable_row_t *row;
+    uint64_t offset = *pos ? *pos : table->header->pool_offset;
+
+    if (offset >= table->header->pool_offset + table->header->pool_size)
+        return NULL;
+    if (!(row = htable_row(table, offset, vals, vals_num))) {
+        ci_debug_printf(1, "htable: corrupted row at offset %llu\n", (unsigned long long)offset);
+        return NULL;
+    }
+    offset += sizeof(ci_htable_row_t) + row->size;
+    *pos = HTABLE_ALIGN(offset, sizeof(uint32_t));
+    return (const char *)row + sizeof(ci_htable_row_t);
+}
+
+/******************************************************/
+/* The hash table files builder                       */
+
+struct ci_htable_builder {
+    char *path;
+    char *tmp_path;
+    FILE *f;
+    uint64_t offset;
+    ci_htable_bucket_t *rows;
+    uint64_t rows_num;
+    uint64_t rows_size;
+    int finished;
+};
+
+ci_htable_builder_t *ci_htable_builder_create(const char *path)
+{
+    ci_htable_builder_t *builder;
+    ci_htable_header_t header;
+    size_t len = strlen(path);
+    int fd;
+
+    if (!(builder = calloc(1, sizeof(ci_htable_builder_t))))
+        return NULL;
+    builder->path = strdup(path);
+    builder->tmp_path = malloc(len + 8);
+    if (!builder->path || !builder->tmp_path) {
+        ci_htable_builder_destroy(builder);
+        return NULL;
+    }
+    snprintf(builder->tmp_path, len + 8, "%s.XXXXXX", path);
+    if ((fd = mkstemp(builder->tmp_path)) < 0) {
+        ci_debug_printf(1, "htable: can not create temporary file %s: %s\n", builder->tmp_path, strerror(errno));
+        free(builder->tmp_path);
+        builder->tmp_path = NULL;
+        ci_htable_builder_destroy(builder);
+        return NULL;
+    }
+    if (!(builder->f = fdopen(fd, "w+b"))) {
+        close(fd);
+        ci_htable_builder_destroy(builder);
+        return NULL;
+    }
+    /*Reserve the space for the header, it is written at the end*/
+    memset(&header, 0, sizeof(header));
+    if (fwrite(&header, sizeof(header), 1, builder->f) != 1) {
+        ci_htable_builder_destroy(builder);
+        return NULL;
+    }
+    builder->offset = sizeof(header);
+    return builder;
+}
+
+static const char htable_zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+int ci_htable_builder_add(ci_htable_builder_t *builder, const char *key, const char **vals)
+{
+    ci_htable_row_t row;
+    ci_htable_bucket_t *rows;
+    size_t key_size, size, len, pad;
+    int i;
+
+    if (builder->finished)
+        return 0;
+
+    key_size = strlen(key);
+    size = key_size + 1;
+    for (i = 0; vals && vals[i] != NULL; i++)
+        size += strlen(vals[i]) + 1;
+    if (size > UINT32_MAX) {
+        ci_debug_printf(1, "htable: too long row for key %.64s\n", key);
+        return 0;
+    }
+    row.key_size = (uint32_t)key_size;
+    row.vals_num = (uint32_t)i;
+    row.size = (uint32_t)size;
+
+    if (builder->rows_num == builder->rows_size) {
+        builder->rows_size = builder->rows_size ? 2 * builder->rows_size : 1024;
+        if (!(rows = realloc(builder->rows, builder->rows_size * sizeof(ci_htable_bucket_t)))) {
+            ci_debug_printf(1, "htable: not enough memory for %llu rows\n", (unsigned long long)builder->rows_size);
+            return 0;
+        }
+        builder->rows = rows;
+    }
+
+    if (fwrite(&row, sizeof(row), 1, builder->f) != 1 ||
+            fwrite(key, key_size + 1, 1, builder->f) != 1) {
+        ci_debug_printf(1, "htable: error writing to %s\n", builder->tmp_path);
+        return 0;
+    }
+    for (i = 0; vals && vals[i] != NULL; i++) {
+        len = strlen(vals[i]) + 1;
+        if (fwrite(vals[i], len, 1, builder->f) != 1) {
+            ci_debug_printf(1, "htable: error writing to %s\n", builder->tmp_path);
+            return 0;
+        }
+    }
+    pad = HTABLE_ALIGN(sizeof(row) + size, sizeof(uint32_t)) - (sizeof(row) + size);
+    if (pad && fwrite(htable_zeros, pad, 1, builder->f) != 1)
+        return 0;
+
+    builder->rows[builder->rows_num].hash = ci_htable_hash(key, key_size);
+    builder->rows[builder->rows_num].offset = builder->offset;
+    builder->rows_num++;
+    builder->offset += sizeof(row) + size + pad;
+    return 1;
+}
+
+/*Reads the key of the row at the given offset back from the file*/
+static char *htable_builder_read_key(ci_htable_builder_t *builder, uint64_t offset, size_t *key_size)
+{
+    ci_htable_row_t row;
+    char *key;
+    if (fseeko(builder->f, (off_t)offset, SEEK_SET) != 0 ||
+            fread(&row, sizeof(row), 1, builder->f) != 1 ||
+            !(key = malloc(row.key_size + 1)))
+        return NULL;
+    if (fread(key, row.key_size + 1, 1, builder->f) != 1) {
+        free(key);
+        return NULL;
+    }
+    *key_size = row.key_size;
+    return key;
+}
+
+static int htable_builder_same_keys(ci_htable_builder_t *builder, uint64_t offset1, uint64_t offset2, int *error)
+{
+    char *key1, *key2;
+    size_t size1 = 0, size2 = 0;
+    int same;
+    key1 = htable_builder_read_key(builder, offset1, &size1);
+    key2 = htable_builder_read_key(builder, offset2, &size2);
+    if (!key1 || !key2)
+        *error = 1;
+    same = key1 && key2 && size1 == size2 && memcmp(key1, key2, size1) == 0;
+    free(key1);
+    free(key2);
+    return same;
+}
+
+int ci_htable_builder_finish(ci_htable_builder_t *builder, uint64_t *duplicates)
+{
+    ci_htable_header_t header;
+    ci_htable_bucket_t *buckets;
+    uint64_t buckets_num, mask, i, k, dups = 0;
+    size_t pad;
+    mode_t mask_mode;
+    int error = 0, dup;
+
+    if (builder->finished)
+        return 0;
+
+    /*Keep the load factor under 80%*/
+    for (buckets_num = 1; buckets_num < builder->rows_num + builder->rows_num / 4 + 1; buckets_num <<= 1);
+    if (!(buckets = calloc(buckets_num, sizeof(ci_htable_bucket_t)))) {
+        ci_debug_printf(1, "htable: not enough memory for %llu buckets\n", (unsigned long long)buckets_num);
+        return 0;
+    }
+    mask = buckets_num - 1;
+    if (fflush(builder->f) != 0)
+        error = 1;
+    for (i = 0; i < builder->rows_num && !error; i++) {
+        dup = 0;
+        for (k = builder->rows[i].hash & mask; buckets[k].offset != 0; k = (k + 1) & mask) {
+            if (buckets[k].hash == builder->rows[i].hash &&
+                    htable_builder_same_keys(builder, buckets[k].offset, builder->rows[i].offset, &error)) {
+                dup = 1;
+                break;
+            }
+        }
+        if (dup)
+            dups++;
+        else
+            buckets[k] = builder->rows[i];
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CI_HTABLE_MAGIC, sizeof(header.magic));
+    header.version = CI_HTABLE_VERSION;
+    header.byte_order = CI_HTABLE_BYTE_ORDER;
+    header.rows = builder->rows_num - dups;
+    header.pool_offset = sizeof(header);
+    header.pool_size = builder->offset - sizeof(header);
+    header.buckets_num = buckets_num;
+    header.buckets_offset = HTABLE_ALIGN(builder->offset, sizeof(uint64_t));
+    header.file_size = header.buckets_offset + buckets_num * sizeof(ci_htable_bucket_t);
+    pad = header.buckets_offset - builder->offset;
+
+    if (error ||
+            fseeko(builder->f, (off_t)builder->offset, SEEK_SET) != 0 ||
+            (pad && fwrite(htable_zeros, pad, 1, builder->f) != 1) ||
+            fwrite(buckets, sizeof(ci_htable_bucket_t), buckets_num, builder->f) != buckets_num ||
+            fseeko(builder->f, 0, SEEK_SET) != 0 ||
+            fwrite(&header, sizeof(header), 1, builder->f) != 1 ||
+            fflush(builder->f) != 0) {
+        ci_debug_printf(1, "htable: error writing to %s\n", builder->tmp_path);
+        free(buckets);
+        return 0;
+    }
+    free(buckets);
+
+    /*The mkstemp creates the file readable only by its owner*/
+    mask_mode = umask(0);
+    umask(mask_mode);
+    fchmod(fileno(builder->f), 0666 & ~mask_mode);
+    if (fclose(builder->f) != 0) {
+        builder->f = NULL;
+        ci_debug_printf(1, "htable: error writing to %s\n", builder->tmp_path);
+        return 0;
+    }
+    builder->f = NULL;
+    if (rename(builder->tmp_path, builder->path) != 0) {
+        ci_debug_printf(1, "htable: can not rename %s to %s: %s\n", builder->tmp_path, builder->path, strerror(errno));
+        return 0;
+    }
+    builder->finished = 1;
+    if (duplicates)
+        *duplicates = dups;
+    return 1;
+}
+
+void ci_htable_builder_destroy(ci_htable_builder_t *builder)
+{
+    if (!builder)
+        return;
+    if (builder->f)
+        fclose(builder->f);
+    if (!builder->finished && builder->tmp_path)
+        unlink(builder->tmp_path);
+    free(builder->tmp_path);
+    free(builder->path);
+    free(builder->rows);
+    free(builder);
+}
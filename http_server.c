@@ -253,9 +253,6 @@ static int http_do_request(ci_request_t *req)
             return -1; /* Did not read anything */
         goto http_do_request_bad_status;
     }
-    if ((status = ci_headers_unpack(req->request_header)) != EC_100) {
-        goto http_do_request_bad_status;
-    }
     if ((status = http_server_request_parse_first_line(req)) != EC_200)
         goto http_do_request_bad_status;
 
@@ -296,20 +293,26 @@ int http_process_request(ci_request_t *req)
     if (status < 0 && req->request_header->bufused == 0) /*Did not read anything*/
         return CI_NO_STATUS;
 
-    ci_thread_mutex_lock(&STAT_MTX);
-    if (!STATS)
-        STATS = ci_stat_memblock_get();
+    /*The per-thread statistics block does not need locking*/
+    ci_stat_memblock_t *stats = ci_stat_thread_memblock_get();
+    if (!stats) {
+        ci_thread_mutex_lock(&STAT_MTX);
+        if (!STATS)
+            STATS = ci_stat_memblock_get();
+        stats = STATS;
+    }
 
-    assert(STATS);
-    STAT_INT64_INC_NL(STATS, STAT_WS_REQUESTS, 1);
+    assert(stats);
+    STAT_INT64_INC_NL(stats, STAT_WS_REQUESTS, 1);
     if (!status)
-        STAT_INT64_INC_NL(STATS, STAT_WS_FAILED_REQUESTS, 1);
-
-    STAT_KBS_INC_NL(STATS, STAT_WS_BYTES_IN, req->bytes_in);
-    STAT_KBS_INC_NL(STATS, STAT_WS_BYTES_OUT, req->bytes_out);
-    STAT_KBS_INC_NL(STATS, STAT_WS_BODY_BYTES_IN, req->body_bytes_in);
-    STAT_KBS_INC_NL(STATS, STAT_WS_BODY_BYTES_OUT, req->body_bytes_out);
-    ci_thread_mutex_unlock(&STAT_MTX);
+        STAT_INT64_INC_NL(stats, STAT_WS_FAILED_REQUESTS, 1);
+
+    STAT_KBS_INC_NL(stats, STAT_WS_BYTES_IN, req->bytes_in);
+    STAT_KBS_INC_NL(stats, STAT_WS_BYTES_OUT, req->bytes_out);
+    STAT_KBS_INC_NL(stats, STAT_WS_BODY_BYTES_IN, req->body_bytes_in);
+    STAT_KBS_INC_NL(stats, STAT_WS_BODY_BYTES_OUT, req->body_bytes_out);
+    if (stats == STATS)
+        ci_thread_mutex_unlock(&STAT_MTX);
     return status;
 }
 
@@ -99,6 +99,8 @@ struct ci_acl_data {
     ci_acl_data_t *next;
 };
 
+struct ci_acl_index;
+
 /**
    \brief This struct holds an access control list (acl).
    \ingroup ACL
@@ -116,6 +118,13 @@ struct ci_acl_spec {
     char *parameter;
     ci_acl_data_t *data;
     ci_acl_spec_t *next;
+    /*The slot of the match result in the per request memo*/
+    int id;
+    /*The slot of the test data in the per request memo. Shared with the
+      acls of the same type and parameter*/
+    int test_data_id;
+    /*Index of the acl data for fast matching, NULL if not indexed*/
+    struct ci_acl_index *index;
 };
 
 /*Specs lists and access entries structures and functions */
@@ -154,8 +154,10 @@ int intl_cfg_disable(const char *directive,const char **argv,void *setdata);
 int intl_cfg_enable(const char *directive,const char **argv,void *setdata);
 int intl_cfg_size_off(const char *directive,const char **argv,void *setdata);
 int intl_cfg_size_long(const char *directive,const char **argv,void *setdata);
+int intl_cfg_size_size_t(const char *directive, const char **argv, void *setdata);
 int intl_cfg_set_octal(const char *directive, const char **argv, void *setdata);
 int intl_cfg_set_int_range(const char *directive, const char **argv, void *setdata);
+int intl_cfg_set_str_set(const char *directive, const char **argv, void *setdata);
 #endif
 
 
@@ -81,6 +81,90 @@ CI_DECLARE_FUNC(void) ci_regex_free(ci_regex_t regex);
  */
 CI_DECLARE_FUNC(int) ci_regex_apply(const ci_regex_t regex, const char *str, int len, int recurs, ci_list_t *matches, const void *user_data);
 
+/**
+ * The object built by the dup method of the ci_regex_ops
+ \ingroup UTILITY
+ */
+struct ci_acl_regex {
+    char *str;
+    int flags;
+    ci_regex_t preg;
+};
+
+/**
+ \defgroup REGEXSET Regex sets
+ \ingroup UTILITY
+ * A set of regex expressions matched together against a string. A
+ * required literal is extracted from every regex and the literals are
+ * searched in one pass using an Aho-Corasick automaton. Only the
+ * regexes whose literal is found, or which have no such literal, are
+ * executed.
+ */
+
+typedef struct ci_regex_set ci_regex_set_t;
+
+typedef struct ci_regex_set_stats {
+    int regexes;         /**< The number of regexes */
+    int compiled;        /**< The number of the regexes in the automaton */
+    int literal_regexes; /**< The regexes prefiltered by a literal */
+    unsigned int states; /**< The automaton states */
+    size_t memory;       /**< The memory used by the automaton */
+} ci_regex_set_stats_t;
+
+/**
+ * Create an empty regex set.
+ \ingroup REGEXSET
+ */
+CI_DECLARE_FUNC(ci_regex_set_t *) ci_regex_set_create();
+
+/**
+ * Destroy a regex set. The regexes are not released.
+ \ingroup REGEXSET
+ */
+CI_DECLARE_FUNC(void) ci_regex_set_destroy(ci_regex_set_t *set);
+
+/**
+ * Add a regex to the set.
+ \param regex_str The regex string as returned by the ci_regex_parse
+ \param regex_flags The regex flags as returned by the ci_regex_parse
+ \param regex The regex compiled using the ci_regex_build
+ \return The regex id, which is the number of the regexes added before
+ *       it, or -1 on error
+ \ingroup REGEXSET
+ */
+CI_DECLARE_FUNC(int) ci_regex_set_add(ci_regex_set_t *set, const char *regex_str, int regex_flags, const ci_regex_t regex);
+
+/**
+ * Build the automaton of the regex set. The regexes added after this
+ * call are matched one by one, until the next ci_regex_set_compile call.
+ \return non zero on success, zero on memory allocation errors.
+ \ingroup REGEXSET
+ */
+CI_DECLARE_FUNC(int) ci_regex_set_compile(ci_regex_set_t *set);
+
+/**
+ * Match the regexes of the set against a string.
+ \param str The string to match against
+ \param len The str string length. For '\0' terminated strings set it to -1
+ \param ids Array to store the ids of the matching regexes, in ascending order
+ \param ids_num The size of the ids array. Set it to 1 to get the first
+ *       matching regex only
+ \return The number of the ids stored
+ \ingroup REGEXSET
+ */
+CI_DECLARE_FUNC(int) ci_regex_set_match(const ci_regex_set_t *set, const char *str, int len, int *ids, int ids_num);
+
+/**
+ * Retrieve the statistics of the set and its automaton.
+ \ingroup REGEXSET
+ */
+CI_DECLARE_FUNC(void) ci_regex_set_stats(const ci_regex_set_t *set, ci_regex_set_stats_t *stats);
+/**
+ * If it is non zero, the default, the ci_regex_build JIT compiles the
+ * regexes when the regex library supports it (PCRE2).
+ \ingroup UTILITY
+ */
+CI_DECLARE_DATA extern int CI_REGEX_JIT;
 
 CI_DECLARE_FUNC(void) ci_regex_memory_init();
 CI_DECLARE_FUNC(void) ci_regex_memory_destroy();
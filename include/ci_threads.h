@@ -31,6 +31,7 @@ extern "C"
 #ifndef _WIN32
 
 #include <pthread.h>
+#include <time.h>
 
 typedef pthread_mutex_t ci_thread_mutex_t;
 typedef pthread_cond_t ci_thread_cond_t;
@@ -111,6 +112,19 @@ static inline int ci_thread_cond_wait(ci_thread_cond_t *pcond, ci_thread_mutex_t
     return pthread_cond_wait(pcond, pmtx);
 }
 
+/*Waits at most msecs milliseconds. Returns ETIMEDOUT on timeout.*/
+static inline int ci_thread_cond_timedwait(ci_thread_cond_t *pcond, ci_thread_mutex_t *pmtx, int msecs) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += msecs / 1000;
+    ts.tv_nsec += (long)(msecs % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return pthread_cond_timedwait(pcond, pmtx, &ts);
+}
+
 static inline int ci_thread_cond_broadcast(ci_thread_cond_t *pcond) {
     return pthread_cond_broadcast(pcond);
 }
@@ -122,6 +136,22 @@ static inline int ci_thread_cond_signal(ci_thread_cond_t *pcond) {
 CI_DECLARE_FUNC(int) ci_thread_create(ci_thread_t *pthread_id, void *(*pfunc)(void *), void *parg);
 CI_DECLARE_FUNC(int) ci_thread_join(ci_thread_t thread_id);
 
+/*Thread specific data. The destructor is called with the thread's
+  non NULL value when the thread exits.*/
+typedef pthread_key_t ci_thread_key_t;
+
+static inline int ci_thread_key_create(ci_thread_key_t *key, void (*destructor)(void *)) {
+    return pthread_key_create(key, destructor);
+}
+
+static inline void *ci_thread_key_get(ci_thread_key_t key) {
+    return pthread_getspecific(key);
+}
+
+static inline int ci_thread_key_set(ci_thread_key_t key, const void *value) {
+    return pthread_setspecific(key, value);
+}
+
 #else /*ifdef _WIN32*/
 
 #include <windows.h>
@@ -145,6 +175,7 @@ CI_DECLARE_FUNC(int) ci_thread_rwlock_unlock(ci_thread_rwlock_t *);
 CI_DECLARE_FUNC(int)  ci_thread_cond_init(ci_thread_cond_t *pcond);
 CI_DECLARE_FUNC(int) ci_thread_cond_destroy(ci_thread_cond_t *pcond);
 CI_DECLARE_FUNC(int) ci_thread_cond_wait(ci_thread_cond_t *pcond,ci_thread_mutex_t *pmutex);
+CI_DECLARE_FUNC(int) ci_thread_cond_timedwait(ci_thread_cond_t *pcond,ci_thread_mutex_t *pmutex, int msecs);
 CI_DECLARE_FUNC(int)  ci_thread_cond_broadcast(ci_thread_cond_t *pcond);
 CI_DECLARE_FUNC(int) ci_thread_cond_signal(ci_thread_cond_t *pcond);
 
@@ -152,6 +183,12 @@ CI_DECLARE_FUNC(int) ci_thread_cond_signal(ci_thread_cond_t *pcond);
 CI_DECLARE_FUNC(int) ci_thread_create(ci_thread_t *thread_id, void *(*pfunc)(void *), void *parg);
 CI_DECLARE_FUNC(int) ci_thread_join(ci_thread_t thread_id);
 
+/*The destructor is not supported on win32*/
+#define  ci_thread_key_t     DWORD
+CI_DECLARE_FUNC(int) ci_thread_key_create(ci_thread_key_t *key, void (*destructor)(void *));
+CI_DECLARE_FUNC(void *) ci_thread_key_get(ci_thread_key_t key);
+CI_DECLARE_FUNC(int) ci_thread_key_set(ci_thread_key_t key, const void *value);
+
 #endif
 
 #ifdef __cplusplus
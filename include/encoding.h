@@ -146,6 +146,8 @@ enum CI_UNCOMPRESS_ERRORS {
     CI_UNCOMP_ERR_ERROR = -1,
     CI_UNCOMP_ERR_NONE = 0,
     CI_UNCOMP_OK = 1,
+    CI_UNCOMP_NEED_INPUT = 2,
+    CI_UNCOMP_HAVE_OUTPUT = 3,
 };
 
 enum CI_COMPRESS_ERRORS {
@@ -155,6 +157,8 @@ enum CI_COMPRESS_ERRORS {
     CI_COMP_ERR_ERROR = -1,
     CI_COMP_ERR_NONE = 0,
     CI_COMP_OK = 1,
+    CI_COMP_NEED_INPUT = 2,
+    CI_COMP_HAVE_OUTPUT = 3,
 };
 
 /**
@@ -273,6 +277,91 @@ CI_DECLARE_FUNC(int) ci_zstd_uncompress_to_membuf(const char *inbuf, size_t inle
  */
 CI_DECLARE_FUNC(int) ci_zstd_uncompress_to_simple_file(const char *inbuf, size_t inlen, struct ci_simple_file *outbuf, ci_off_t max_size);
 
+/*  Streaming data decompression */
+
+/**
+ \typedef ci_decompressor_t
+ \ingroup UTILITY
+ * A stateful decoder which decompresses data as they arrive, using
+ * caller supplied, bounded, output buffers.
+ *
+ * Example use from inside a ci_service_module::mod_service_io function,
+ * where the rbuf holds the next chunk of compressed body data:
+ \code
+   ci_decompressor_feed(data->dec, rbuf, *rlen, iseof);
+   do {
+       ret = ci_decompressor_drain(data->dec, out, sizeof(out), &outlen);
+       if (outlen)
+           scan_data(data, out, outlen);
+   } while (ret == CI_UNCOMP_HAVE_OUTPUT);
+   if (ret != CI_UNCOMP_NEED_INPUT && ret != CI_UNCOMP_OK)
+       ... ret is a CI_UNCOMPRESS_ERRORS error code ...
+ \endcode
+ */
+typedef struct ci_decompressor ci_decompressor_t;
+
+/**
+ * Allocates and initializes a streaming decoder.
+ \ingroup UTILITY
+ *
+ \param encoding_format the CI_ENCODE_* compression method of the data
+ \param max_size if it is greater than zero, the output data limit
+ \return the new decoder, or NULL if the compression method is not supported
+ */
+CI_DECLARE_FUNC(ci_decompressor_t *) ci_decompressor_create(int encoding_format, ci_off_t max_size);
+
+/**
+ * Releases a decoder allocated using ci_decompressor_create.
+ \ingroup UTILITY
+ */
+CI_DECLARE_FUNC(void) ci_decompressor_destroy(ci_decompressor_t *dec);
+
+/**
+ * Passes the next block of compressed data to the decoder.
+ * The data are not copied, the buf must remain valid until the
+ * ci_decompressor_drain returns CI_UNCOMP_NEED_INPUT or any other
+ * code except CI_UNCOMP_HAVE_OUTPUT.
+ \ingroup UTILITY
+ *
+ \param dec the decoder
+ \param buf the compressed data
+ \param len the size of compressed data
+ \param iseof non zero if this is the last block of compressed data
+ \return CI_UNCOMP_HAVE_OUTPUT, or a CI_UNCOMPRESS_ERRORS code if the
+ *       decoder is already finished
+ */
+CI_DECLARE_FUNC(int) ci_decompressor_feed(ci_decompressor_t *dec, const char *buf, size_t len, int iseof);
+
+/**
+ * Decompresses data from the current input block to the out buffer.
+ * Even on errors the *outlen may be non zero and the produced data
+ * should be consumed.
+ \ingroup UTILITY
+ *
+ \param dec the decoder
+ \param out the output buffer
+ \param outsize the size of the output buffer
+ \param outlen is set to the number of bytes stored to the out buffer
+ \return CI_UNCOMP_HAVE_OUTPUT if the ci_decompressor_drain should be
+ *       called again, CI_UNCOMP_NEED_INPUT if the input block is consumed
+ *       and more data are required, CI_UNCOMP_OK when the compressed stream
+ *       is finished, CI_UNCOMP_ERR_NONE if the max_size is exceeded, or
+ *       an CI_UNCOMPRESS_ERRORS error code
+ */
+CI_DECLARE_FUNC(int) ci_decompressor_drain(ci_decompressor_t *dec, char *out, size_t outsize, size_t *outlen);
+
+/**
+ * The number of compressed bytes consumed by the decoder.
+ \ingroup UTILITY
+ */
+CI_DECLARE_FUNC(ci_off_t) ci_decompressor_total_in(const ci_decompressor_t *dec);
+
+/**
+ * The number of decompressed bytes produced by the decoder.
+ \ingroup UTILITY
+ */
+CI_DECLARE_FUNC(ci_off_t) ci_decompressor_total_out(const ci_decompressor_t *dec);
+
 /*  Data Compression core functions */
 
 /**
@@ -393,6 +482,77 @@ CI_DECLARE_FUNC(int) ci_zstd_compress_to_membuf(const char *inbuf, size_t inlen,
  */
 CI_DECLARE_FUNC(int) ci_zstd_compress_to_simple_file(const char *inbuf, size_t inlen, struct ci_simple_file *outbuf, ci_off_t max_size);
 
+/*  Streaming data compression */
+
+/**
+ \typedef ci_compressor_t
+ \ingroup UTILITY
+ * A stateful encoder which compresses data block by block, using caller
+ * supplied, bounded, output buffers. It is used the same way as the
+ * ci_decompressor_t object.
+ */
+typedef struct ci_compressor ci_compressor_t;
+
+/**
+ * Allocates and initializes a streaming encoder.
+ \ingroup UTILITY
+ *
+ \param encoding_format the CI_ENCODE_* compression method to use
+ \param level the compression level, or -1 for the method default. It is
+ *      0-9 for gzip/deflate, the number of 100k blocks (1-9) for bzip2, 0-11
+ *      for brotli and 1-22 for zstd.
+ \return the new encoder, or NULL if the compression method is not supported
+ */
+CI_DECLARE_FUNC(ci_compressor_t *) ci_compressor_create(int encoding_format, int level);
+
+/**
+ * Releases an encoder allocated using ci_compressor_create.
+ \ingroup UTILITY
+ */
+CI_DECLARE_FUNC(void) ci_compressor_destroy(ci_compressor_t *comp);
+
+/**
+ * Passes the next block of data to the encoder.
+ * The data are not copied, the buf must remain valid until the
+ * ci_compressor_drain returns a code other than CI_COMP_HAVE_OUTPUT.
+ \ingroup UTILITY
+ *
+ \param comp the encoder
+ \param buf the data
+ \param len the size of data
+ \param iseof non zero if this is the last block of data
+ \return CI_COMP_HAVE_OUTPUT, or a CI_COMPRESS_ERRORS code if the encoder
+ *       is already finished
+ */
+CI_DECLARE_FUNC(int) ci_compressor_feed(ci_compressor_t *comp, const char *buf, size_t len, int iseof);
+
+/**
+ * Compresses data from the current input block to the out buffer.
+ \ingroup UTILITY
+ *
+ \param comp the encoder
+ \param out the output buffer
+ \param outsize the size of the output buffer
+ \param outlen is set to the number of bytes stored to the out buffer
+ \return CI_COMP_HAVE_OUTPUT if the ci_compressor_drain should be called
+ *       again, CI_COMP_NEED_INPUT if the input block is consumed and more
+ *       data are required, CI_COMP_OK when the last block is compressed and
+ *       all of the compressed data returned, or a CI_COMPRESS_ERRORS code
+ */
+CI_DECLARE_FUNC(int) ci_compressor_drain(ci_compressor_t *comp, char *out, size_t outsize, size_t *outlen);
+
+/**
+ * The number of bytes consumed by the encoder.
+ \ingroup UTILITY
+ */
+CI_DECLARE_FUNC(ci_off_t) ci_compressor_total_in(const ci_compressor_t *comp);
+
+/**
+ * The number of compressed bytes produced by the encoder.
+ \ingroup UTILITY
+ */
+CI_DECLARE_FUNC(ci_off_t) ci_compressor_total_out(const ci_compressor_t *comp);
+
 /**
  * Decodes a base64 encoded string, and also allocate memory for the result.
  \ingroup UTILITY
@@ -29,30 +29,84 @@ extern "C"
 {
 #endif
 
-struct ci_hash_entry {
-    unsigned int hash;
-    const void *key;
-    const void *val;
-    struct ci_hash_entry *hnext;
-};
-
-
-struct ci_hash_table {
-    struct ci_hash_entry **hash_table;
-    unsigned int hash_table_size;
-    const ci_type_ops_t *ops;
-    ci_mem_allocator_t *allocator;
-};
+/**
+ \defgroup HASH Hash tables
+ \ingroup API
+ * Open addressing hash tables. The slots are grouped in groups of 16
+ * and every slot has a control byte, which keeps 7 bits of the key
+ * hash or marks the slot as empty or deleted. A search compares the
+ * control bytes of a whole group at once (using SSE2 or NEON
+ * instructions where available) and compares the keys only for the
+ * slots whose hash bits match. The table grows when it becomes full.
+ * The keys and values are not copied, they must remain valid while
+ * they are stored in the table.
+ */
 
+/*The hash table layout is private to the library, the tables are
+  used only through the functions below*/
+struct ci_hash_table;
 
+/**
+ * The djb2 hash of the key, masked with the hash_max_value.
+ \ingroup HASH
+ \param len The key length or 0 for '\0' terminated keys
+ */
 CI_DECLARE_FUNC(unsigned int) ci_hash_compute(unsigned long hash_max_value, const void *key, int len);
+
+/**
+ * Build an hash table.
+ \ingroup HASH
+ \param hash_size The expected number of items. The table grows if
+ *                 more items are added.
+ \param ops The keys type operators. The ops->size and ops->compare
+ *            methods are used.
+ */
 CI_DECLARE_FUNC(struct ci_hash_table *) ci_hash_build(unsigned int hash_size,
         const ci_type_ops_t *ops,
         ci_mem_allocator_t *allocator);
+
+/**
+ * Destroy an hash table. The keys and values are not released.
+ \ingroup HASH
+ */
 CI_DECLARE_FUNC(void)   ci_hash_destroy(struct ci_hash_table *htable);
+
+/**
+ * Search for a key.
+ \ingroup HASH
+ \return The value of the key or NULL if not found
+ */
 CI_DECLARE_FUNC(const void *) ci_hash_search(struct ci_hash_table *htable,const void *key);
+
+/**
+ * Add a key. If the key already exists, its key and value are
+ * replaced.
+ \ingroup HASH
+ \return NULL on error or a not NULL pointer on success
+ */
 CI_DECLARE_FUNC(void *) ci_hash_add(struct ci_hash_table *htable, const void *key, const void *val);
 
+/**
+ * Remove a key.
+ \ingroup HASH
+ \return The value of the removed key or NULL if not found
+ */
+CI_DECLARE_FUNC(const void *) ci_hash_remove(struct ci_hash_table *htable, const void *key);
+
+/**
+ * Run the given function for every key and value. The iteration stops
+ * if the function returns non zero. The table must not be modified
+ * while iterating.
+ \ingroup HASH
+ */
+CI_DECLARE_FUNC(void) ci_hash_iterate(struct ci_hash_table *htable, void *data, int (*fn)(void *data, const void *key, const void *val));
+
+/**
+ * The number of keys stored in the table.
+ \ingroup HASH
+ */
+CI_DECLARE_FUNC(unsigned int) ci_hash_items(const struct ci_hash_table *htable);
+
 #ifdef __cplusplus
 }
 #endif
@@ -66,6 +66,7 @@ typedef struct ci_headers_list {
     int bufused;
     char *buf;
     int packed;
+    struct ci_headers_index *index; /*Internal, the header names index*/
 } ci_headers_list_t;
 
 
@@ -245,6 +246,48 @@ CI_DECLARE_FUNC(const char *) ci_headers_value2(const ci_headers_list_t * h, con
  */
 CI_DECLARE_FUNC(const char *) ci_headers_copy_value(const ci_headers_list_t *heads, const char *header, char *buf, size_t len);
 
+/**
+ * Get the values of many headers at once.
+ * Like the other header search functions, it uses the index of the
+ * header names if it is built with ci_headers_build_index.
+ \ingroup HEADERS
+ \param heads is a pointer to the ci_headers_list_t object
+ \param names is an array with the names of the headers
+ \param values is an array of count elements to store the values of
+ *      the headers, like the ci_headers_value returns them. The
+ *      values for the headers which do not exist are set to NULL
+ \param count is the number of the headers to search
+ \return the number of the headers found
+ *
+ *example usage:
+ \code
+ const char *names[] = {"Content-Type", "Content-Encoding"};
+ const char *values[2];
+ if (ci_headers_values(heads, names, values, 2) && values[0])
+     printf("Content-Type: %s\n", values[0]);
+ \endcode
+ *
+ */
+CI_DECLARE_FUNC(int) ci_headers_values(const ci_headers_list_t *heads, const char **names, const char **values, int count);
+
+/**
+ * Build an index of the header names for a long headers list which
+ * will be searched many times. Building the index costs more than a
+ * few tens of linear searches, so it pays off only for lists which are
+ * searched more times before they are modified.
+ * The header search functions use the index until the list is
+ * modified. The headers added at the end of the list are added to the
+ * index, any other modification drops it. The search functions never
+ * build or modify the index, so the index must be built before the
+ * headers list is shared with other threads. The short lists are not
+ * indexed, the linear search is as fast for them.
+ \ingroup HEADERS
+ \param heads is a pointer to the ci_headers_list_t object
+ 
+eturn non zero if the headers list is indexed, zero otherwise
+ */
+CI_DECLARE_FUNC(int) ci_headers_build_index(ci_headers_list_t *heads);
+
 /**
  * Run the given function for each header name/value pair
  \ingroup HEADERS
@@ -303,6 +346,32 @@ CI_DECLARE_FUNC(ci_headers_list_t *) ci_headers_clone(const ci_headers_list_t *h
 
 CI_DECLARE_FUNC(void) ci_headers_pack(ci_headers_list_t *heads);
 CI_DECLARE_FUNC(int)  ci_headers_unpack(ci_headers_list_t *heads);
+
+/*
+  A resumable scanner which searches the end of headers ("\r\n\r\n")
+  in a buffer as data are appended to it, and keeps the positions of
+  the lines, so that the headers index can be built without parsing
+  the headers again.
+*/
+#define CI_HEADERS_SCAN_LINES 256
+typedef struct ci_headers_scan {
+    int scanned;      /*The bytes of the buffer already scanned*/
+    int eoh;          /*The end of headers, after the "\r\n\r\n", or 0*/
+    int has_nul;      /*A '\0' char found*/
+    int lines;        /*The '\n' chars found*/
+    int nl[CI_HEADERS_SCAN_LINES]; /*The positions of the first '\n' chars*/
+} ci_headers_scan_t;
+
+CI_DECLARE_FUNC(void) ci_headers_scan_init(ci_headers_scan_t *scan);
+
+/*Scans the bytes of the buffer added after the previous call. The
+  buffer may be reallocated between the calls. Returns the end of
+  headers or 0 if it is not found yet.*/
+CI_DECLARE_FUNC(int)  ci_headers_scan(ci_headers_scan_t *scan, const char *buf, int len);
+
+/*Like the ci_headers_unpack, for headers which have been scanned up to
+  the end of headers using the ci_headers_scan*/
+CI_DECLARE_FUNC(int)  ci_headers_unpack_scanned(ci_headers_list_t *heads, const ci_headers_scan_t *scan);
 CI_DECLARE_FUNC(int)  sizeofheader(const ci_headers_list_t *heads);
 
 CI_DECLARE_FUNC(ci_encaps_entity_t) *mk_encaps_entity(int type,int val);
@@ -0,0 +1,162 @@
+/*
+ *  Copyright (C) 2004-2022 Christos Tsantilas
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA.
+ */
+
+#ifndef __C_ICAP_HTABLE_H
+#define __C_ICAP_HTABLE_H
+
+#include "c-icap.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ \defgroup HTABLE Read-only hash table files
+ \ingroup API
+ * A read-only hash table stored in a file, built once using the
+ * ci_htable_builder_* functions (or the c-icap-mkhtable utility) and
+ * then mapped in memory and searched without parsing or copying it.
+ * The keys and values are strings.
+ * The file consists of a header, the string pool which holds the
+ * rows (the key followed by its values, all '\0' terminated) and an
+ * open addressing (linear probing) array of buckets, each of them
+ * pointing to a row in the pool. The file is stored in the byte order
+ * of the building machine.
+ */
+
+#define CI_HTABLE_MAGIC "CIHTABLE"
+#define CI_HTABLE_VERSION 1
+#define CI_HTABLE_BYTE_ORDER 0x01020304
+
+typedef struct ci_htable_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t rows;
+    uint64_t pool_offset;
+    uint64_t pool_size;
+    uint64_t buckets_num;   /*A power of 2*/
+    uint64_t buckets_offset;
+    uint64_t file_size;
+} ci_htable_header_t;
+
+typedef struct ci_htable_bucket {
+    uint64_t hash;
+    uint64_t offset;        /*The row offset in file, 0 for empty buckets*/
+} ci_htable_bucket_t;
+
+typedef struct ci_htable_row {
+    uint32_t key_size;      /*The key length, without the '\0'*/
+    uint32_t vals_num;
+    uint32_t size;          /*The size of the key and values which follow*/
+    /*Followed by the key and the values, all '\0' terminated.
+      The rows are aligned to 4 bytes*/
+} ci_htable_row_t;
+
+typedef struct ci_htable ci_htable_t;
+typedef struct ci_htable_builder ci_htable_builder_t;
+
+/**
+ * The hash function used for the keys.
+ \ingroup HTABLE
+ */
+CI_DECLARE_FUNC(uint64_t) ci_htable_hash(const char *key, size_t len);
+
+/**
+ * Map an hash table file in memory.
+ \ingroup HTABLE
+ \return The table or NULL if the file can not be opened or it is
+ *       not a valid hash table file.
+ */
+CI_DECLARE_FUNC(ci_htable_t *) ci_htable_open(const char *path);
+
+/**
+ * Unmap an hash table.
+ \ingroup HTABLE
+ */
+CI_DECLARE_FUNC(void) ci_htable_close(ci_htable_t *table);
+
+/**
+ * Search for a key.
+ \ingroup HTABLE
+ \param vals If the key found, a pointer to the first of its values is
+ *           stored here. The values are stored one after the other,
+ *           each of them '\0' terminated.
+ \param vals_num If the key found, the number of values is stored here
+ \return The key as stored in the table or NULL if not found. The key
+ *       and the values point to the mapped file and remain valid until
+ *       the table is closed.
+ */
+CI_DECLARE_FUNC(const char *) ci_htable_search(const ci_htable_t *table, const char *key, const char **vals, int *vals_num);
+
+/**
+ * Walk the rows of the table, in the order they are stored in the file.
+ \ingroup HTABLE
+ \param pos Should point to 0 for the first row. It is updated to
+ *          point to the next row.
+ \return The key of the row or NULL if there are not more rows.
+ */
+CI_DECLARE_FUNC(const char *) ci_htable_next_row(const ci_htable_t *table, uint64_t *pos, const char **vals, int *vals_num);
+
+/**
+ * The header of the table.
+ \ingroup HTABLE
+ */
+CI_DECLARE_FUNC(const ci_htable_header_t *) ci_htable_header(const ci_htable_t *table);
+
+/**
+ * Start building an hash table file. The table is written to a
+ * temporary file which replaces the given path on
+ * ci_htable_builder_finish, so the running servers keep using the old
+ * table until they reopen it.
+ \ingroup HTABLE
+ */
+CI_DECLARE_FUNC(ci_htable_builder_t *) ci_htable_builder_create(const char *path);
+
+/**
+ * Add a row.
+ \ingroup HTABLE
+ \param vals A NULL terminated array of values or NULL
+ \return 1 on success or 0 on error
+ */
+CI_DECLARE_FUNC(int) ci_htable_builder_add(ci_htable_builder_t *builder, const char *key, const char **vals);
+
+/**
+ * Build the buckets array and write the table file. If a key added
+ * more than once, the first row is used.
+ \ingroup HTABLE
+ \param duplicates If not NULL, the number of the duplicated keys is
+ *                 stored here.
+ \return 1 on success or 0 on error
+ */
+CI_DECLARE_FUNC(int) ci_htable_builder_finish(ci_htable_builder_t *builder, uint64_t *duplicates);
+
+/**
+ * Release the builder. If the ci_htable_builder_finish is not called or
+ * failed the temporary file is removed.
+ \ingroup HTABLE
+ */
+CI_DECLARE_FUNC(void) ci_htable_builder_destroy(ci_htable_builder_t *builder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__C_ICAP_HTABLE_H*/
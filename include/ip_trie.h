@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2004-2022 Christos Tsantilas
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA.
+ */
+
+#ifndef __C_ICAP_IP_TRIE_H
+#define __C_ICAP_IP_TRIE_H
+
+#include "c-icap.h"
+#include "net_io.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ \defgroup IPTRIE IP prefixes trie
+ \ingroup API
+ * A compressed radix trie which stores IPv4 and IPv6 networks and
+ * finds the longest network (prefix) which contains an ip address.
+ * The networks match the ip addresses like the ci_ip_ops and
+ * ci_ip_sockaddr_ops equal methods do: the IPv4 networks also match
+ * the IPv4-mapped IPv6 addresses and the IPv4-mapped IPv6 networks
+ * also match IPv4 addresses.
+ */
+
+typedef struct ci_ip_trie ci_ip_trie_t;
+
+/**
+ * Create an empty trie.
+ \ingroup IPTRIE
+ */
+CI_DECLARE_FUNC(ci_ip_trie_t *) ci_ip_trie_create();
+
+/**
+ * Destroy a trie. The stored values are not released.
+ \ingroup IPTRIE
+ */
+CI_DECLARE_FUNC(void) ci_ip_trie_destroy(ci_ip_trie_t *trie);
+
+/**
+ * Add a network to the trie.
+ \ingroup IPTRIE
+ \param net The network. Its netmask must be contiguous.
+ \param value A not NULL value to return on searches. If the network
+ *            already exists, the existing value is kept.
+ \return non zero on success, zero if the netmask is not contiguous or
+ *       on memory allocation errors.
+ */
+CI_DECLARE_FUNC(int) ci_ip_trie_add(ci_ip_trie_t *trie, const ci_ip_t *net, const void *value);
+
+/**
+ * Search the trie for the longest network which contains an address.
+ \ingroup IPTRIE
+ \param family AF_INET or AF_INET6
+ \param addr Pointer to a struct in_addr or struct in6_addr
+ \return The value of the network or NULL if not found
+ */
+CI_DECLARE_FUNC(const void *) ci_ip_trie_search(const ci_ip_trie_t *trie, int family, const void *addr);
+
+/**
+ * The number of the networks stored in the trie.
+ \ingroup IPTRIE
+ */
+CI_DECLARE_FUNC(int) ci_ip_trie_entries(const ci_ip_trie_t *trie);
+
+/**
+ * Search the trie for the address of a ci_ip_t object.
+ \ingroup IPTRIE
+ */
+#define ci_ip_trie_search_ip(trie, ip) ci_ip_trie_search(trie, (ip)->family, &(ip)->address)
+
+/**
+ * Search the trie for the address of a ci_sockaddr_t object.
+ \ingroup IPTRIE
+ */
+#define ci_ip_trie_search_sockaddr(trie, addr) ci_ip_trie_search(trie, (addr)->ci_sin_family, (addr)->ci_sin_addr)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
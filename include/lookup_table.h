@@ -72,6 +72,17 @@ struct ci_lookup_table {
     void *data;
 };
 
+/**
+ * If it is non zero the text file based lookup tables (file, hash, regex
+ * and iptrie) are loaded in a memory arena, in large memory blocks
+ * which are not shared with other allocations. When the tables are
+ * opened by the main process, its children share these memory pages
+ * without copying them.
+ * The default is 0.
+ \ingroup LOOKUPTABLE
+ */
+CI_DECLARE_DATA extern int CI_LOOKUP_TABLES_ARENA;
+
 CI_DECLARE_FUNC(struct ci_lookup_table_type *) ci_lookup_table_type_register(struct ci_lookup_table_type *lt_type);
 CI_DECLARE_FUNC(void) ci_lookup_table_type_unregister(struct ci_lookup_table_type *lt_type);
 CI_DECLARE_FUNC(const struct ci_lookup_table_type *) ci_lookup_table_type_search(const char *type);
@@ -79,6 +79,14 @@ CI_DECLARE_FUNC(void)    ci_object_pool_unregister(int id);
 CI_DECLARE_FUNC(void *)  ci_object_pool_alloc(int id);
 CI_DECLARE_FUNC(void)    ci_object_pool_free(void *ptr);
 
+/*The maximum number of free objects each thread caches for each
+  memory pool. Set it to 0 to disable the per-thread caches.*/
+CI_DECLARE_DATA extern int CI_MEM_POOLS_THREAD_CACHE;
+
+/*Release to the system the memory pools free objects which are not
+  used for a long time. It is safe to call it periodically.*/
+CI_DECLARE_FUNC(void) ci_mem_pools_trim();
+
 CI_DECLARE_FUNC(int) ci_mem_init();
 CI_DECLARE_FUNC(void) ci_mem_exit();
 #ifdef __cplusplus
@@ -31,6 +31,7 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 #else
 #include <WinSock2.h>
 #endif
@@ -51,6 +52,15 @@ extern "C"
 #endif
 typedef ci_socket ci_socket_t;
 
+#ifndef _WIN32
+typedef struct iovec ci_iovec_t;
+#else
+typedef struct ci_iovec {
+    void *iov_base;
+    size_t iov_len;
+} ci_iovec_t;
+#endif
+
 typedef struct ci_sockaddr {
 #ifdef USE_IPV6
     struct sockaddr_storage  sockaddr;
@@ -163,6 +173,7 @@ CI_DECLARE_FUNC(void) ci_copy_connection(ci_connection_t *dest, ci_connection_t
 CI_DECLARE_FUNC(void) ci_connection_reset(ci_connection_t *conn);
 
 CI_DECLARE_FUNC(int) icap_socket_opts(ci_socket fd, int secs_to_linger);
+CI_DECLARE_FUNC(int) icap_socket_reuseport(ci_socket fd);
 CI_DECLARE_FUNC(ci_socket) icap_init_server(struct ci_port *port);
 CI_DECLARE_FUNC(int) icap_accept_raw_connection(struct ci_port *port, ci_connection_t *conn);
 
@@ -182,6 +193,7 @@ CI_DECLARE_FUNC(int) ci_read(ci_socket fd,void *buf,size_t count,int timeout);
 CI_DECLARE_FUNC(int) ci_write(ci_socket fd, const void *buf,size_t count,int timeout);
 CI_DECLARE_FUNC(int) ci_read_nonblock(ci_socket fd, void *buf,size_t count);
 CI_DECLARE_FUNC(int) ci_write_nonblock(ci_socket fd, const void *buf,size_t count);
+CI_DECLARE_FUNC(int) ci_writev_nonblock(ci_socket fd, const ci_iovec_t *iov, int iovcnt);
 
 CI_DECLARE_FUNC(int) ci_linger_close(ci_socket fd,int secs_to_linger);
 CI_DECLARE_FUNC(int) ci_hard_close(ci_socket fd);
@@ -199,6 +211,7 @@ CI_DECLARE_FUNC(int) ci_connection_read(ci_connection_t *conn, void *buf, size_t
 CI_DECLARE_FUNC(int) ci_connection_write(ci_connection_t *conn, const void *buf, size_t count, int timeout);
 CI_DECLARE_FUNC(int) ci_connection_read_nonblock(ci_connection_t *conn, void *buf, size_t count);
 CI_DECLARE_FUNC(int) ci_connection_write_nonblock(ci_connection_t *conn, const void *buf, size_t count);
+CI_DECLARE_FUNC(int) ci_connection_writev_nonblock(ci_connection_t *conn, const ci_iovec_t *iov, int iovcnt);
 CI_DECLARE_FUNC(int) ci_connection_linger_close(ci_connection_t *conn, int timeout);
 CI_DECLARE_FUNC(int) ci_connection_hard_close(ci_connection_t *conn);
 #ifdef __cplusplus
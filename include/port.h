@@ -65,6 +65,7 @@ typedef struct ci_port {
     struct ci_tls_server_accept_details *tls_accept_details;
 #endif
     int stat_connections;
+    int reuse_port; /*Each child listens to its own SO_REUSEPORT socket*/
 } ci_port_t;
 
 /*For internal c-icap use*/
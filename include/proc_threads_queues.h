@@ -46,6 +46,8 @@ enum KILL_MODE {NO_KILL = 0,GRACEFULLY,IMMEDIATELY};
 struct connections_queue_item {
     ci_connection_t conn;
     int proto;
+    int access_type; /*The access type of an already served connection*/
+    int keepalive_reqs; /*Requests already served, 0 for new connections*/
 };
 
 struct connections_queue {
@@ -62,6 +64,7 @@ typedef struct child_shared_data {
     int servers;
     _CI_ATOMIC_TYPE int32_t usedservers;
     _CI_ATOMIC_TYPE int64_t requests;
+    _CI_ATOMIC_TYPE int32_t parked_connections;
     process_pid_t pid;
     int idle;
     int to_be_killed;
@@ -73,6 +73,16 @@ enum SENDDATA_STATUS {SEND_NOTHING = 0, SEND_RESPHEAD, SEND_HEAD1, SEND_HEAD2, S
 
 #define EXTRA_CHUNK_SIZE  30
 #define MAX_CHUNK_SIZE    4064   /*4096 -EXTRA_CHUNK_SIZE-2*/
+
+/*The limits for the size of the request read and write buffers*/
+#define CI_REQUEST_MIN_BUFFER_SIZE BUFSIZE
+#define CI_REQUEST_MAX_BUFFER_SIZE (256*1024)
+
+/*Space at the end of req->wbuf for a last-chunk following the last data chunk*/
+#define CI_LAST_CHUNK_RESERVE 64
+
+/*The maximum body data which can be formated as a chunk in req->wbuf*/
+#define CI_REQUEST_MAX_CHUNK_SIZE(req) ((req)->wbuf_size - EXTRA_CHUNK_SIZE - 2 - CI_LAST_CHUNK_RESERVE)
 #define MAX_USERNAME_LEN 255
 
 typedef struct ci_buf {
@@ -92,6 +102,10 @@ struct ci_ring_buf;
    * request. The developers should not access directly the fields of
    * this struct but better use the documented macros and functions
 */
+struct ci_body_encoder;
+struct ci_mem_allocator;
+struct ci_acl_memo;
+
 typedef struct ci_request {
     ci_connection_t *connection;
     int packed;
@@ -118,8 +132,10 @@ typedef struct ci_request {
 
     void *service_data;
 
-    char rbuf[BUFSIZE];
-    char wbuf[MAX_CHUNK_SIZE+EXTRA_CHUNK_SIZE+2];
+    char *rbuf;
+    char *wbuf;
+    int rbuf_size;
+    int wbuf_size;
     int eof_received;
     int eof_sent;
     int data_locked;
@@ -134,6 +150,13 @@ typedef struct ci_request {
     int return_code;
     char *pstrblock_responce;
     int remain_send_block_bytes;
+    /*A body chunk formatted while the headers are not sent yet, it is
+      sent with them. Its status is SEND_EOF if it includes the last-chunk*/
+    struct {
+        char *buf;
+        int len;
+        int status;
+    } ready_body;
 
     /*Used to echo data back to a client which does not support preview
       in the case of 204 outside preview.*/
@@ -147,6 +170,11 @@ typedef struct ci_request {
     char *log_str;
     ci_str_array_t *attributes;
 
+    /*Memory allocated with ci_request_mem_alloc, released on reset*/
+    struct ci_mem_allocator *mem_arena;
+    /*Acl test data and results, allocated from the mem_arena*/
+    struct ci_acl_memo *acl_memo;
+
     /* statistics */
     uint64_t bytes_in; /*May include bytes from next pipelined request*/
     uint64_t bytes_out;
@@ -169,6 +197,9 @@ typedef struct ci_request {
     int64_t i206_use_original_body;
     int allow_trailers;
     ci_ip_t xclient_ip;
+    int body_encoding; /*The CI_ENCODE_* method to compress the service output*/
+    int body_encoding_level;
+    struct ci_body_encoder *body_encoder;
     enum CI_PROTO protocol;
     struct {
         int major;
@@ -179,8 +210,14 @@ typedef struct ci_request {
 /*This functions needed in server (mpmt_server.c ) */
 ci_request_t *server_request_alloc();
 int server_request_use_connection(ci_request_t * req, ci_connection_t * connection, int protocol);
+int server_request_resume_connection(ci_request_t * req, ci_connection_t * connection, int protocol, int access_type);
 int keepalive_request(ci_request_t *req);
 int process_request(ci_request_t *);
+CI_DECLARE_FUNC(int) ci_request_body_encoder_start(ci_request_t *req, int (*service_io)(char *rbuf, int *rlen, char *wbuf, int *wlen, int iseof, ci_request_t *req), int level);
+CI_DECLARE_FUNC(int) ci_request_body_encoder_io(char *rbuf, int *rlen, char *wbuf, int *wlen, int iseof, ci_request_t *req);
+
+/*The size of the read and write buffers of new requests*/
+CI_DECLARE_DATA extern int CI_REQUEST_BUFFER_SIZE;
 
 /*Functions used in both server and icap-client library*/
 CI_DECLARE_FUNC(int) parse_chunk_data(ci_request_t *req, char **wdata);
@@ -207,8 +244,17 @@ CI_DECLARE_FUNC(ci_encaps_entity_t *) ci_request_alloc_entity(ci_request_t *req,
 CI_DECLARE_FUNC(int)          ci_request_release_entity(ci_request_t *req,int pos);
 CI_DECLARE_FUNC(char *)       ci_request_set_log_str(ci_request_t *req, char *logstr);
 CI_DECLARE_FUNC(int)       ci_request_set_str_attribute(ci_request_t *req, const char *name, const char *value);
+/*Allocate memory which lives until the request is reset or destroyed.
+  It must not be released by the caller.*/
+CI_DECLARE_FUNC(void *)       ci_request_mem_alloc(ci_request_t *req, size_t size);
+CI_DECLARE_FUNC(char *)       ci_request_mem_strdup(ci_request_t *req, const char *str);
 
 CI_DECLARE_FUNC(int)          ci_request_206_origin_body(ci_request_t *req, uint64_t offset);
+/*Compress the service output using the CI_ENCODE_* encoding method. A
+  negative level uses the service CompressionLevel or the method default.
+  It can not be combined with the ci_request_206_origin_body, the client
+  would append the not encoded original body to the encoded data*/
+CI_DECLARE_FUNC(int)          ci_request_set_body_encoding(ci_request_t *req, int encoding, int level);
 
 #ifdef __CI_COMPAT
 #define request_t   ci_request_t
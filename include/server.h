@@ -57,7 +57,9 @@ extern "C"
  */
 static inline ci_kbs_t ci_server_stat_kbs_get(int id)
 {
-    ci_stat_memblock_t *block = ci_stat_memblock_get();
+    ci_stat_memblock_t *block;
+    ci_stat_shards_fold();
+    block = ci_stat_memblock_get();
     _CI_ASSERT(block);
     return  ci_stat_memblock_get_kbs(block, id);
 }
@@ -72,7 +74,9 @@ static inline ci_kbs_t ci_server_stat_kbs_get(int id)
  */
 static inline uint64_t ci_server_stat_uint64_get(int id)
 {
-    ci_stat_memblock_t *block = ci_stat_memblock_get();
+    ci_stat_memblock_t *block;
+    ci_stat_shards_fold();
+    block = ci_stat_memblock_get();
     _CI_ASSERT(block);
     return  ci_stat_memblock_get_counter(block, id);
 }
@@ -100,6 +100,7 @@ typedef struct ci_service_xdata {
     int allow_204;
     int allow_206;
     int disable_206; /*even if service support it do not use 206*/
+    int compression_level; /*level to use when the service output is compressed*/
     struct ci_list *option_handlers;
     /*statistics IDS*/
     int stat_bytes_in;
@@ -115,6 +116,7 @@ typedef struct ci_service_xdata {
     int stat_allow206;
     int stat_time_per_request;
     int stat_proc_time_per_request;
+    int histo_proc_time;
     struct timestat {
         time_t indx;
         uint64_t accumulated_time;
@@ -483,6 +485,16 @@ CI_DECLARE_FUNC(void) ci_service_enable_206(ci_service_xdata_t *srv_xdata);
  */
 CI_DECLARE_FUNC(void) ci_service_set_max_connections(ci_service_xdata_t *srv_xdata, int max_connections);
 
+/**
+  \ingroup SERVICES
+  \brief Sets the compression level to use when the service output is
+  *      compressed by the c-icap server (see ci_request_set_body_encoding)
+  *
+  \param srv_xdata is a pointer to the c-icap internal service data.
+  \param level is the compression level, -1 for the compression method default
+ */
+CI_DECLARE_FUNC(void) ci_service_set_compression_level(ci_service_xdata_t *srv_xdata, int level);
+
 /**
   \ingroup SERVICES
   \brief Sets the Options ttl for this service
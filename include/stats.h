@@ -196,6 +196,17 @@ CI_DECLARE_FUNC(void) ci_stat_update(const ci_stat_item_t *stats, int count);
  */
 CI_DECLARE_FUNC(uint64_t) ci_stat_uint64_get(int ID);
 
+/*
+  Adds to a counter updated by a single thread, or under a lock.
+  The kbs and counters are _Atomic, a compound assignment or a plain
+  store is an atomic operation. Use relaxed load and store instead.
+*/
+#if defined(__GNUC__)
+#define _CI_STAT_NL_ADD(var, count) __atomic_store_n(&(var), __atomic_load_n(&(var), __ATOMIC_RELAXED) + (count), __ATOMIC_RELAXED)
+#else
+#define _CI_STAT_NL_ADD(var, count) ((var) = (var) + (count))
+#endif
+
 /**
  \typedef ci_kbs_t
  * Represents (accumulated) kilobytes
@@ -242,9 +253,7 @@ static inline uint64_t ci_kbs_remainder_bytes(const ci_kbs_t *kbs)
 static inline void ci_kbs_update(ci_kbs_t *kbs, uint64_t bytes)
 {
     _CI_ASSERT(kbs);
-    /* Warning: kbs.bytes is an _Atomic, do not use compound assignment
-       to avoid atomic operation */
-    kbs->bytes = kbs->bytes + bytes;
+    _CI_STAT_NL_ADD(kbs->bytes, bytes);
 }
 
 /**
@@ -380,6 +389,36 @@ CI_DECLARE_FUNC(int) ci_stat_histo_create_custom_bins(const char *label, const c
  */
 CI_DECLARE_FUNC(int) ci_stat_histo_create_enum(const char *label, const char *data_descr, const char **labels, int bins_number);
 
+/**
+ * The parameters of the c-icap request time, processing time and body
+ * size HDR histograms. The time is measured in microseconds, up to one hour.
+ \ingroup HISTOGRAMS
+ */
+#define CI_HISTO_TIME_MAX ((uint64_t)3600 * 1000000)
+#define CI_HISTO_SIZE_MAX ((uint64_t)1 << 40)
+#define CI_HISTO_PRECISION_BITS 5
+
+/**
+ * Builds a log-linear (HDR like) histogram. The values are grouped by
+ * their highest set bit, and each group is split to 2^precision_bits
+ * equal sized bins. The bin of a value is computed with bit operations,
+ * and the bin width is at most value/2^precision_bits, so the values
+ * reported for the bins and the percentiles have a relative error smaller
+ * than 1/2^precision_bits. The values smaller than 2^(precision_bits + 1)
+ * are stored exactly.
+ * The histogram bins with zero count are not displayed.
+ \ingroup HISTOGRAMS
+ \param label A name to identify the histogram
+ \param data_descr Short description of accounted data
+ \param max The maximum accounted value. Bigger values are counted in
+            the "other" bin
+ \param precision_bits The bits used to split each group of values, from
+            1 to 10. Each group requires 2^precision_bits bins, for
+            example 5 bits gives a 3.1% maximum relative error and requires
+            about 830 bins for values up to 10^9.
+ */
+CI_DECLARE_FUNC(int) ci_stat_histo_create_hdr(const char *label, const char *data_descr, uint64_t max, int precision_bits);
+
 /**
  * Retrieve the histogram id using its name
  \ingroup HISTOGRAMS
@@ -397,7 +436,7 @@ CI_DECLARE_FUNC(const char *) ci_stat_histo_data_descr(int id);
  \ingroup HISTOGRAMS
  */
 typedef enum ci_histo_flag {
-    CI_HISTO_IGNORE_COUNT_ZERO = 0x01 /*!< Ignore zero bins when displaying histogram. Only for use with enum histograms */
+    CI_HISTO_IGNORE_COUNT_ZERO = 0x01 /*!< Ignore zero bins when displaying histogram. Only for use with enum and HDR histograms */
 } ci_histo_flag_t;
 
 /**
@@ -453,6 +492,53 @@ CI_DECLARE_FUNC(void) ci_stat_histo_bins_iterate(int id, void *data, void (*fn)(
 */
 CI_DECLARE_FUNC(int) ci_stat_histo_bins_number(int id);
 
+/**
+ * The number of the values accounted in the histogram, including the
+ * values which are out of the histogram range.
+ \ingroup HISTOGRAMS
+ \param id The histogram id
+*/
+CI_DECLARE_FUNC(uint64_t) ci_stat_histo_count(int id);
+
+/**
+ * Computes the value below which the given fraction of the accounted
+ * values falls. The reported value is the maximum value of the histogram
+ * bin where the quantile falls, or the histogram maximum value if it falls
+ * in the "other" bin. It is not supported for enum histograms.
+ \ingroup HISTOGRAMS
+ \param id The histogram id
+ \param quantile A number from 0 to 1, eg 0.99
+ \param value Where to store the computed value
+ \return 1 on success, 0 if the histogram does not exist, it does not
+         support quantiles or it has no values.
+*/
+CI_DECLARE_FUNC(int) ci_stat_histo_quantile(int id, double quantile, uint64_t *value);
+
+/**
+ * Computes many quantiles for the same histogram values. Similar to
+ * the ci_stat_histo_quantile but computes all of the quantiles from the
+ * same snapshot of the histogram, while it is updated by other threads
+ * or processes.
+ \ingroup HISTOGRAMS
+ \param id The histogram id
+ \param quantiles An array with the quantiles to compute
+ \param values An array to store the computed values
+ \param num The number of items of the quantiles and values arrays
+ \return 1 on success, 0 otherwise
+*/
+CI_DECLARE_FUNC(int) ci_stat_histo_quantiles(int id, const double *quantiles, uint64_t *values, int num);
+
+/**
+ * Computes the given percentile. The same as
+ * ci_stat_histo_quantile(id, percentile / 100, value).
+ \ingroup HISTOGRAMS
+ \param id The histogram id
+ \param percentile A number from 0 to 100, eg 99.9
+ \param value Where to store the computed value
+ \return 1 on success, 0 otherwise
+*/
+CI_DECLARE_FUNC(int) ci_stat_histo_percentile(int id, double percentile, uint64_t *value);
+
 /*Histogram functions for c-icap internal use*/
 CI_DECLARE_FUNC(void) ci_stat_histo_iterate(void *data, int (*fn)(void *data, const char *name, int id));
 CI_DECLARE_FUNC(size_t) ci_stat_histo_mem_size();
@@ -475,6 +561,35 @@ CI_DECLARE_FUNC(int) ci_stat_memblock_size(void);
 
 CI_DECLARE_FUNC(ci_stat_memblock_t *) ci_stat_memblock_get(void);
 
+/**
+ * Enables the per-thread statistics shards. The CI_STAT_INT64_T and
+ * CI_STAT_KBS_T counters updated by the ci_stat_uint64_inc,
+ * ci_stat_uint64_dec, ci_stat_kbs_inc and ci_stat_update functions are
+ * increased in a private memory block of the calling thread. They are
+ * added to the statistics memory block when the statistics are read by
+ * the current process, or by calling ci_stat_shards_fold.
+ * The c-icap server sets it with the "StatisticsThreadShards"
+ * configuration parameter.
+ \ingroup STAT
+ */
+CI_DECLARE_DATA extern int CI_STAT_THREAD_SHARDS;
+
+/**
+ * Return the statistics memory block of the current thread, or NULL if
+ * the per-thread statistics shards are disabled. Only the current thread
+ * updates this block, so its counters can be updated using the
+ * STAT_INT64_INC_NL and STAT_KBS_INC_NL macros without locking.
+ \ingroup STAT
+ */
+CI_DECLARE_FUNC(ci_stat_memblock_t *) ci_stat_thread_memblock_get(void);
+
+/**
+ * Add the counters of the per-thread statistics shards of the current
+ * process to the statistics memory block.
+ \ingroup STAT
+ */
+CI_DECLARE_FUNC(void) ci_stat_shards_fold(void);
+
 CI_DECLARE_FUNC(void) ci_stat_entry_release_lists();
 
 CI_DECLARE_FUNC(int) ci_stat_attach_mem(void *mem, size_t size, void *histos_mem, size_t histos_size, void (*release_mem)(void *));
@@ -530,9 +645,8 @@ static inline ci_kbs_t ci_stat_memblock_get_kbs(const ci_stat_memblock_t *block,
 #define STAT_INT64_INC(memblock, id, count) ci_atomic_add_u64(&(memblock->stats[id].counter), count)
 #define STAT_INT64_DEC(memblock, id, count) ci_atomic_sub_u64(&(memblock->stats[id].counter), count)
 #define STAT_KBS_INC(memblock, id, count) ci_kbs_lock_and_update(&(memblock->stats[id].kbs), count)
-/* do not use compound assignment to avoid atomic operation: */
-#define STAT_INT64_INC_NL(memblock, id, count) (memblock->stats[id].counter = memblock->stats[id].counter + count)
-#define STAT_INT64_DEC_NL(memblock, id, count) (memblock->stats[id].counter = memblock->stats[id].counter - count)
+#define STAT_INT64_INC_NL(memblock, id, count) _CI_STAT_NL_ADD(memblock->stats[id].counter, count)
+#define STAT_INT64_DEC_NL(memblock, id, count) _CI_STAT_NL_ADD(memblock->stats[id].counter, -(count))
 #define STAT_KBS_INC_NL(memblock, id, count) ci_kbs_update(&(memblock->stats[id].kbs), count)
 
 #define STAT_INT64_NL(memblock, id) (memblock->stats[id].counter)
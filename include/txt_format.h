@@ -75,6 +75,44 @@ struct ci_fmt_entry {
 CI_DECLARE_FUNC(int) ci_format_text(ci_request_t *req_data, const char *fmt, char *buffer, int len,
                                     struct ci_fmt_entry *user_table);
 
+/**
+ * \brief A format string compiled to a list of formating operations
+ * \ingroup FORMATING
+ */
+typedef struct ci_fmt_program ci_fmt_program_t;
+
+/**
+ * \brief Compiles a format string to be used with ci_format_program_text
+ * \ingroup FORMATING
+ * \param fmt The format string
+ * \param user_table An array of user defined directives
+ * \return The compiled format on success, NULL on error
+ *
+ * The format string is parsed only once. The %tl and %tg directives of
+ * the compiled format are formated once per second.
+ */
+CI_DECLARE_FUNC(ci_fmt_program_t *) ci_format_compile(const char *fmt, struct ci_fmt_entry *user_table);
+
+/**
+ * \brief Produces formated text based on a compiled format.
+ * \ingroup FORMATING
+ * \param req_data The current request
+ * \param program The compiled format
+ * \param buffer The output buffer
+ * \param len The length of the output buffer
+ * \return the number of written bytes
+ *
+ * The output is the same as the ci_format_text output for the
+ * compiled format string.
+ */
+CI_DECLARE_FUNC(int) ci_format_program_text(ci_request_t *req_data, const ci_fmt_program_t *program, char *buffer, int len);
+
+/**
+ * \brief Releases a compiled format
+ * \ingroup FORMATING
+ */
+CI_DECLARE_FUNC(void) ci_format_program_release(ci_fmt_program_t *program);
+
 #ifdef __cplusplus
 }
 #endif
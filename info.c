@@ -82,9 +82,12 @@ struct time_counters_ids{
 };
 #define InfoTimeCountersIdLength (sizeof(InfoTimeCountersId) / sizeof(InfoTimeCountersId[0]))
 
+static int InfoAcceptedConnectionsId = -1;
+
 struct per_time_stats {
     uint64_t requests;
     uint64_t requests_per_sec;
+    uint64_t accepted_per_sec;
     int used_servers;
     int max_servers;
     int children;
@@ -114,8 +117,10 @@ struct info_req_data {
     char time_str[128];
     int childs;
     int *child_pids;
+    uint64_t *child_accepted;
     int free_servers;
     int used_servers;
+    int parked_connections;
     unsigned int closing_childs;
     int *closing_child_pids;
     unsigned int started_childs;
@@ -161,6 +166,7 @@ int info_post_init_service(ci_service_xdata_t * srv_xdata, struct ci_server_conf
     int i;
     for (i = 0; InfoTimeCountersId[i].name != NULL; i++)
         InfoTimeCountersId[i].id = ci_stat_entry_find(InfoTimeCountersId[i].name, InfoTimeCountersId[i].group, InfoTimeCountersId[i].type);
+    InfoAcceptedConnectionsId = ci_stat_entry_find("ACCEPTED CONNECTIONS", "Server", CI_STAT_INT64_T);
     return CI_OK;
 }
 
@@ -189,8 +195,10 @@ void *info_init_request_data(ci_request_t * req)
     info_data->time_str[0] = '\0';
     info_data->childs = 0;
     info_data->child_pids = malloc(childs_queue->size * sizeof(int));
+    info_data->child_accepted = malloc(childs_queue->size * sizeof(uint64_t));
     info_data->free_servers = 0;
     info_data->used_servers = 0;
+    info_data->parked_connections = 0;
     info_data->closing_childs = 0;
     info_data->closing_child_pids = malloc(childs_queue->size * sizeof(int));
     info_data->started_childs = 0;
@@ -231,6 +239,9 @@ void info_release_request_data(void *data)
     if (info_data->child_pids)
         free(info_data->child_pids);
 
+    if (info_data->child_accepted)
+        free(info_data->child_accepted);
+
     if (info_data->closing_child_pids)
         free(info_data->closing_child_pids);
 
@@ -320,12 +331,15 @@ void fill_queue_statistics(struct childs_queue *q, struct info_req_data *info_da
 
     int i;
     int requests = 0;
-    int32_t used_servers;
+    int32_t used_servers, parked;
     const ci_stat_memblock_t *stats;
     const struct server_statistics *srv_stats;
     if (!q->childs)
         return;
 
+    /*Include the not yet folded counters of this child threads*/
+    ci_stat_shards_fold();
+
     /*Merge childs data*/
     for (i = 0; i < q->size; i++) {
         if (q->childs[i].pid == 0)
@@ -336,13 +350,17 @@ void fill_queue_statistics(struct childs_queue *q, struct info_req_data *info_da
         if (q->childs[i].to_be_killed == 0) {
             if (info_data->child_pids)
                 info_data->child_pids[info_data->childs] = q->childs[i].pid;
+            stats = q->stats_area + i * (q->stats_block_size);
+            if (info_data->child_accepted)
+                info_data->child_accepted[info_data->childs] = InfoAcceptedConnectionsId >= 0 ? ci_stat_memblock_get_counter(stats, InfoAcceptedConnectionsId) : 0;
             info_data->childs++;
             ci_atomic_load_i32(&q->childs[i].usedservers, &used_servers);
             info_data->free_servers += (q->childs[i].servers - used_servers);
             info_data->used_servers += used_servers;
+            ci_atomic_load_i32(&q->childs[i].parked_connections, &parked);
+            info_data->parked_connections += parked;
             requests += q->childs[i].requests;
 
-            stats = q->stats_area + i * (q->stats_block_size);
             assert(ci_stat_memblock_check(stats));
             ci_stat_memblock_merge(info_data->collect_stats, stats, 0, (info_data->childs - 1));
         } else if (q->childs[i].to_be_killed) {
@@ -764,6 +782,9 @@ static void print_running_servers_statistics(struct info_req_data *info_data)
     sz = snprintf(buf, sizeof(buf), tmpl->simple_table_item_int, "Used Servers", info_data->used_servers);
     ci_membuf_write(info_data->body, buf, sz < sizeof(buf) ? sz : sizeof(buf), 0);
 
+    sz = snprintf(buf, sizeof(buf), tmpl->simple_table_item_int, "Parked Connections", info_data->parked_connections);
+    ci_membuf_write(info_data->body, buf, sz < sizeof(buf) ? sz : sizeof(buf), 0);
+
     sz = snprintf(buf, sizeof(buf), tmpl->simple_table_item_int, "Started Processes", info_data->started_childs);
     ci_membuf_write(info_data->body, buf, sz < sizeof(buf) ? sz : sizeof(buf), 0);
 
@@ -786,6 +807,15 @@ static void print_running_servers_statistics(struct info_req_data *info_data)
     sz = snprintf(buf, sizeof(buf), tmpl->simple_table_item_str, "Children pids", ci_membuf_raw(tmp_membuf));
     ci_membuf_write(info_data->body, buf, sz < sizeof(buf) ? sz : sizeof(buf), 0);
 
+    /*Accepted connections per child, to check connections distribution*/
+    ci_membuf_truncate(tmp_membuf, 0);
+    for (i = 0; i < info_data->childs && info_data->child_accepted; i++) {
+        sz = snprintf(buf, sizeof(buf), "%d:%" PRIu64 " ", info_data->child_pids[i], info_data->child_accepted[i]);
+        ci_membuf_write(tmp_membuf, buf, sz, 0);
+    }
+    sz = snprintf(buf, sizeof(buf), tmpl->simple_table_item_str, "Children accepted connections", ci_membuf_raw(tmp_membuf));
+    ci_membuf_write(info_data->body, buf, sz < sizeof(buf) ? sz : sizeof(buf), 0);
+
     /*Closing children pids*/
     ci_membuf_truncate(tmp_membuf, 0);
     for (i = 0; i < info_data->closing_childs; i++) {
@@ -906,6 +936,11 @@ static void print_per_time_table(struct info_req_data *info_data, const char *la
         sz = sizeof(buf) - 1;
     ci_membuf_write(info_data->body, buf, sz, 0);
 
+    sz = snprintf(buf, sizeof(buf), tmpl->simple_table_item_int, "Accepted connections/second", time_stats->accepted_per_sec);
+    if (sz >= sizeof(buf))
+        sz = sizeof(buf) - 1;
+    ci_membuf_write(info_data->body, buf, sz, 0);
+
     sz = snprintf(buf, sizeof(buf), tmpl->simple_table_item_int, "Average used servers", time_stats->used_servers);
     if (sz >= sizeof(buf))
         sz = sizeof(buf) - 1;
@@ -1066,7 +1101,8 @@ static void print_a_histo_svg(struct info_req_data *info_data, const char *histo
         sz = sizeof(buf) - 1;
     ci_membuf_write(info_data->body, buf, sz, 0);
 
-    sz = snprintf(buf, sizeof(buf), "<svg width=\"100%%\" height=\"%d\">\n", (bins_number + 2) * 20);
+    /*The bins with zero count may not be displayed*/
+    sz = snprintf(buf, sizeof(buf), "<svg width=\"100%%\" height=\"%d\">\n", (int)(ci_dyn_array_size(histo_data.histogram) + 2) * 20);
     if (sz >= sizeof(buf))
         sz = sizeof(buf) - 1;
     ci_membuf_write(info_data->body, buf, sz, 0);
@@ -1119,6 +1155,58 @@ static void print_histo_bin(void *data, const char *bin_label, uint64_t count)
     ci_membuf_write(info_data->body, buf, sz, 0);
 }
 
+static void print_histo_percentiles(struct info_req_data *info_data, const char *histo_name, int histo_id)
+{
+    static const double quantiles[] = {0.5, 0.9, 0.95, 0.99, 0.999, 1};
+    static const char *labels[] = {"p50", "p90", "p95", "p99", "p99.9", "max"};
+    uint64_t values[sizeof(quantiles) / sizeof(quantiles[0])];
+    const int num = sizeof(quantiles) / sizeof(quantiles[0]);
+    int i, sz;
+    char buf[1024];
+    struct stats_tmpl *tmpl = NULL;
+
+    if (!ci_stat_histo_quantiles(histo_id, quantiles, values, num))
+        return;
+
+    if (info_data->format == OUT_FMT_TEXT)
+        tmpl = &txt_tmpl;
+    else if (info_data->format == OUT_FMT_HTML)
+        tmpl = &html_tmpl;
+
+    if (tmpl) {
+        sz = snprintf(buf, sizeof(buf), tmpl->simple_table_start, histo_name, "percentiles", info_data->time_str);
+        if (sz >= sizeof(buf))
+            sz = sizeof(buf) - 1;
+        ci_membuf_write(info_data->body, buf, sz, 0);
+        ci_membuf_write(info_data->body, tmpl->table_row_start, strlen(tmpl->table_row_start), 0);
+        sz = snprintf(buf, sizeof(buf), tmpl->table_header, "Percentile");
+        if (sz >= sizeof(buf))
+            sz = sizeof(buf) - 1;
+        ci_membuf_write(info_data->body, buf, sz, 0);
+        ci_membuf_write(info_data->body, tmpl->table_col_sep, strlen(tmpl->table_col_sep), 0);
+        sz = snprintf(buf, sizeof(buf), tmpl->table_header, ci_stat_histo_data_descr(histo_id));
+        if (sz >= sizeof(buf))
+            sz = sizeof(buf) - 1;
+        ci_membuf_write(info_data->body, buf, sz, 0);
+        ci_membuf_write(info_data->body, tmpl->table_row_end, strlen(tmpl->table_row_end), 0);
+    } else {
+        sz = snprintf(buf, sizeof(buf), "\"percentile\", \"%s\"\n", ci_stat_histo_data_descr(histo_id));
+        if (sz >= sizeof(buf))
+            sz = sizeof(buf) - 1;
+        ci_membuf_write(info_data->body, buf, sz, 0);
+    }
+
+    for (i = 0; i < num; i++)
+        print_histo_bin(info_data, labels[i], values[i]);
+
+    if (tmpl) {
+        sz = snprintf(buf, sizeof(buf), "%s", tmpl->simple_table_end);
+        if (sz >= sizeof(buf))
+            sz = sizeof(buf) - 1;
+        ci_membuf_write(info_data->body, buf, sz, 0);
+    }
+}
+
 static int print_a_histo(void *data, const char *histo_name, int histo_id)
 {
     struct info_req_data *info_data = (struct info_req_data *)data;
@@ -1135,6 +1223,7 @@ static int print_a_histo(void *data, const char *histo_name, int histo_id)
     case OUT_FMT_HTML:
         if (info_data->supports_svg) {
             print_a_histo_svg(info_data, histo_name, histo_id);
+            print_histo_percentiles(info_data, histo_name, histo_id);
             return 0;
         }
         tmpl = &html_tmpl;
@@ -1175,6 +1264,7 @@ static int print_a_histo(void *data, const char *histo_name, int histo_id)
             sz = sizeof(buf) - 1;
         ci_membuf_write(info_data->body, buf, sz, 0);
     }
+    print_histo_percentiles(info_data, histo_name, histo_id);
     return 0;
 }
 
@@ -1432,6 +1522,7 @@ struct info_time_stats_snapshot {
     time_t when;
     time_t when_max;
     uint64_t requests;
+    uint64_t accepted;
     int children;
     int servers;
     int used_servers;
@@ -1448,6 +1539,8 @@ struct info_time_stats_snapshot_results {
     time_t when_end;
     uint64_t requests_start;
     uint64_t requests_end;
+    uint64_t accepted_start;
+    uint64_t accepted_end;
     int children;
     int servers;
     int used_servers;
@@ -1464,12 +1557,14 @@ static void append_snapshots(struct info_time_stats_snapshot_results *result, co
     if (result->when_start > add->when || result->when_start == 0) {
         result->when_start = add->when;
         result->requests_start = add->requests;
+        result->accepted_start = add->accepted;
         result->kbs_counters_instance_start = add->kbs_counters_instance;
     }
 
     if (result->when_end < add->when_max) {
         result->when_end = add->when_max;
         result->requests_end = add->requests;
+        result->accepted_end = add->accepted;
         result->kbs_counters_instance_end = add->kbs_counters_instance;
     }
     assert(result->kbs_counters_instance_start);
@@ -1490,6 +1585,7 @@ static void build_per_time_stats(struct per_time_stats *tr, const struct info_ti
         return;
     tr->requests = requests;
     tr->requests_per_sec = requests / period;
+    tr->accepted_per_sec = (accumulated->accepted_end - accumulated->accepted_start) / period;
     tr->max_servers = accumulated->servers / accumulated->snapshots;
     tr->used_servers = accumulated->used_servers / accumulated->snapshots;
     tr->children = accumulated->children / accumulated->snapshots;
@@ -1538,6 +1634,10 @@ static struct info_time_stats_snapshot *take_snapshot(time_t curr_time)
     /*Will update with newer higher value*/
     snapshot->requests = q->srv_stats->history_requests;
     minsnapshot->requests = q->srv_stats->history_requests;
+    if (InfoAcceptedConnectionsId >= 0) {
+        snapshot->accepted = ci_stat_memblock_get_counter(q->stats_history, InfoAcceptedConnectionsId);
+        minsnapshot->accepted = snapshot->accepted;
+    }
     for (k = 0; InfoTimeCountersId[k].name != NULL; k++) {
         if (InfoTimeCountersId[k].id >= 0) {
             if (InfoTimeCountersId[k].type == CI_STAT_KBS_T) {
@@ -1565,6 +1665,11 @@ static struct info_time_stats_snapshot *take_snapshot(time_t curr_time)
 
             ci_stat_memblock_t *stats;
             stats = (ci_stat_memblock_t *)(q->stats_area + i * (q->stats_block_size));
+            if (InfoAcceptedConnectionsId >= 0) {
+                uint64_t accepted = ci_stat_memblock_get_counter(stats, InfoAcceptedConnectionsId);
+                snapshot->accepted += accepted;
+                minsnapshot->accepted += accepted;
+            }
             for (k = 0; InfoTimeCountersId[k].name != NULL; k++) {
                 if (InfoTimeCountersId[k].id >= 0) {
                     if (InfoTimeCountersId[k].type == CI_STAT_KBS_T) {
@@ -0,0 +1,422 @@
+/*
+ *  Copyright (C) 2004-2022 Christos Tsantilas
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA.
+ */
+
+#include "common.h"
+#include "c-icap.h"
+#include "debug.h"
+#include "ip_trie.h"
+
+/*
+  A path compressed binary trie (Patricia trie). The IPv4 addresses are
+  stored as IPv4-mapped IPv6 addresses (::ffff:a.b.c.d) so all the keys
+  are 128 bits long. Every node holds a prefix, and only the nodes
+  which have a value are networks added to the trie, the others are
+  branching nodes. The nodes are kept in one array and linked using
+  array indexes, to keep them close in memory.
+
+  There are two tries sharing the nodes array: the first is searched
+  for IPv4 addresses and the second for IPv6 addresses. The IPv4
+  networks are added to both. The IPv6 networks are added to the
+  second, and the IPv4-mapped IPv6 networks also to the first one,
+  using the netmask the ip_equal and ip_sockaddr_equal use for them.
+
+  When the IPv4 trie becomes large, a direct table indexed by the first
+  16 bits of the IPv4 address keeps for every /16 network the value of
+  the longest network which contains it and the first trie node with
+  a longer prefix, so the searches skip the top of the trie.
+*/
+
+#define IP_TRIE_NONE 0xFFFFFFFF
+/*The IPv4 /16 prefix length in the 128 bits keys*/
+#define IP_TRIE_DIRECT_PLEN (96 + 16)
+#define IP_TRIE_DIRECT_SIZE 65536
+#define IP_TRIE_DIRECT_MIN 1024
+
+struct ip_trie_node {
+    uint64_t key[2];
+    uint32_t child[2];
+    uint32_t value; /*index in the values array, 0 if none*/
+    uint32_t plen;
+};
+
+struct ip_trie_direct {
+    uint32_t node;
+    uint32_t value;
+};
+
+struct ci_ip_trie {
+    struct ip_trie_node *nodes;
+    uint32_t nodes_num;
+    uint32_t nodes_size;
+    const void **values;
+    uint32_t values_num;
+    uint32_t values_size;
+    uint32_t root4;
+    uint32_t root6;
+    struct ip_trie_direct *direct4;
+    int entries4;
+    int entries;
+};
+
+static inline uint64_t ip_mask64(int len)
+{
+    if (len <= 0)
+        return 0;
+    if (len >= 64)
+        return ~(uint64_t)0;
+    return ~(uint64_t)0 << (64 - len);
+}
+
+static inline int ip_clz64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while (!(x & ((uint64_t)1 << 63))) {
+        x <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static inline int ip_key_bit(const uint64_t key[2], int pos)
+{
+    if (pos < 64)
+        return (key[0] >> (63 - pos)) & 1;
+    return (key[1] >> (127 - pos)) & 1;
+}
+
+static inline int ip_key_match(const uint64_t key[2], const uint64_t prefix[2], int plen)
+{
+    return ((key[0] ^ prefix[0]) & ip_mask64(plen)) == 0 &&
+           ((key[1] ^ prefix[1]) & ip_mask64(plen - 64)) == 0;
+}
+
+static int ip_key_common(const uint64_t key1[2], const uint64_t key2[2])
+{
+    uint64_t x;
+    if ((x = key1[0] ^ key2[0]))
+        return ip_clz64(x);
+    if ((x = key1[1] ^ key2[1]))
+        return 64 + ip_clz64(x);
+    return 128;
+}
+
+static inline void ip_key_v4(uint64_t key[2], uint32_t addr)
+{
+    key[0] = 0;
+    key[1] = ((uint64_t)0xFFFF << 32) | addr;
+}
+
+static void ip_key_bytes(uint64_t key[2], const void *addr)
+{
+    const unsigned char *s = (const unsigned char *)addr;
+    int i;
+    key[0] = key[1] = 0;
+    for (i = 0; i < 8; i++) {
+        key[0] = (key[0] << 8) | s[i];
+        key[1] = (key[1] << 8) | s[i + 8];
+    }
+}
+
+/*Returns the length of the netmask or -1 if it is not contiguous*/
+static int ip_mask_len(const uint64_t mask[2])
+{
+    int len;
+    if (mask[0] != ~(uint64_t)0)
+        len = ip_clz64(~mask[0]);
+    else if (mask[1] != ~(uint64_t)0)
+        len = 64 + ip_clz64(~mask[1]);
+    else
+        len = 128;
+    if (mask[0] != ip_mask64(len) || mask[1] != ip_mask64(len - 64))
+        return -1;
+    return len;
+}
+
+ci_ip_trie_t *ci_ip_trie_create()
+{
+    ci_ip_trie_t *trie;
+    if (!(trie = malloc(sizeof(ci_ip_trie_t))))
+        return NULL;
+    trie->nodes = NULL;
+    trie->nodes_num = 0;
+    trie->nodes_size = 0;
+    trie->values = NULL;
+    trie->values_num = 1; /*the index 0 is the "no value"*/
+    trie->values_size = 0;
+    trie->root4 = IP_TRIE_NONE;
+    trie->root6 = IP_TRIE_NONE;
+    trie->direct4 = NULL;
+    trie->entries4 = 0;
+    trie->entries = 0;
+    return trie;
+}
+
+void ci_ip_trie_destroy(ci_ip_trie_t *trie)
+{
+    if (!trie)
+        return;
+    free(trie->nodes);
+    free(trie->values);
+    free(trie->direct4);
+    free(trie);
+}
+
+int ci_ip_trie_entries(const ci_ip_trie_t *trie)
+{
+    return trie->entries;
+}
+
+static uint32_t ip_trie_value_new(ci_ip_trie_t *trie, const void *value)
+{
+    const void **values;
+    uint32_t size;
+
+    if (trie->values_num >= trie->values_size) {
+        size = trie->values_size ? 2 * trie->values_size : 64;
+        if (size >= IP_TRIE_NONE || !(values = realloc(trie->values, size * sizeof(void *)))) {
+            ci_debug_printf(1, "Failed to allocate memory for ip trie values\n");
+            return 0;
+        }
+        trie->values = values;
+        trie->values_size = size;
+    }
+    trie->values[trie->values_num] = value;
+    return trie->values_num++;
+}
+
+static uint32_t ip_trie_node_new(ci_ip_trie_t *trie, const uint64_t key[2], int plen, uint32_t value)
+{
+    struct ip_trie_node *nodes, *n;
+    uint32_t size;
+
+    if (trie->nodes_num == trie->nodes_size) {
+        size = trie->nodes_size ? 2 * trie->nodes_size : 64;
+        if (size >= IP_TRIE_NONE || !(nodes = realloc(trie->nodes, size * sizeof(struct ip_trie_node)))) {
+            ci_debug_printf(1, "Failed to allocate memory for ip trie nodes\n");
+            return IP_TRIE_NONE;
+        }
+        trie->nodes = nodes;
+        trie->nodes_size = size;
+    }
+    n = &trie->nodes[trie->nodes_num];
+    n->key[0] = key[0] & ip_mask64(plen);
+    n->key[1] = key[1] & ip_mask64(plen - 64);
+    n->child[0] = n->child[1] = IP_TRIE_NONE;
+    n->value = value;
+    n->plen = plen;
+    return trie->nodes_num++;
+}
+
+/*Returns 1 if the network added, 0 if it already exists, -1 on error*/
+static int ip_trie_insert(ci_ip_trie_t *trie, uint32_t *root, const uint64_t key[2], int plen, uint32_t value)
+{
+    uint32_t idx = *root, parent = IP_TRIE_NONE, node, glue;
+    struct ip_trie_node *n;
+    int dir = 0, common = 0;
+
+    while (idx != IP_TRIE_NONE) {
+        n = &trie->nodes[idx];
+        common = ip_key_common(key, n->key);
+        if (common > plen)
+            common = plen;
+        if (common < n->plen)
+            break;
+        if (n->plen == plen) {
+            /*The network exists, keep the first value*/
+            if (n->value)
+                return 0;
+            n->value = value;
+            return 1;
+        }
+        parent = idx;
+        dir = ip_key_bit(key, n->plen);
+        idx = n->child[dir];
+    }
+
+    if ((node = ip_trie_node_new(trie, key, plen, value)) == IP_TRIE_NONE)
+        return -1;
+
+    if (idx != IP_TRIE_NONE) {
+        /*Split: the existing node "idx" does not contain the new network*/
+        if (common == plen) {
+            trie->nodes[node].child[ip_key_bit(trie->nodes[idx].key, plen)] = idx;
+        } else {
+            if ((glue = ip_trie_node_new(trie, key, common, 0)) == IP_TRIE_NONE)
+                return -1;
+            trie->nodes[glue].child[ip_key_bit(trie->nodes[idx].key, common)] = idx;
+            trie->nodes[glue].child[ip_key_bit(key, common)] = node;
+            node = glue;
+        }
+    }
+
+    if (parent == IP_TRIE_NONE)
+        *root = node;
+    else
+        trie->nodes[parent].child[dir] = node;
+    return 1;
+}
+
+static void ip_trie_direct_slot(ci_ip_trie_t *trie, uint32_t slot)
+{
+    const struct ip_trie_node *n;
+    uint32_t idx = trie->root4, value = 0;
+    uint64_t key[2];
+
+    ip_key_v4(key, slot << 16);
+    while (idx != IP_TRIE_NONE) {
+        n = &trie->nodes[idx];
+        if (n->plen >= IP_TRIE_DIRECT_PLEN)
+            break;
+        if (!ip_key_match(key, n->key, n->plen)) {
+            idx = IP_TRIE_NONE;
+            break;
+        }
+        if (n->value)
+            value = n->value;
+        idx = n->child[ip_key_bit(key, n->plen)];
+    }
+    trie->direct4[slot].node = idx;
+    trie->direct4[slot].value = value;
+}
+
+/*Updates the direct table after a network added to the IPv4 trie*/
+static void ip_trie_direct_update(ci_ip_trie_t *trie, const uint64_t key[2], int plen)
+{
+    uint32_t slot, first, last;
+
+    if (!trie->direct4) {
+        if (trie->entries4 < IP_TRIE_DIRECT_MIN)
+            return;
+        if (!(trie->direct4 = malloc(IP_TRIE_DIRECT_SIZE * sizeof(struct ip_trie_direct))))
+            return;
+        first = 0;
+        last = IP_TRIE_DIRECT_SIZE - 1;
+    } else if (plen >= IP_TRIE_DIRECT_PLEN) {
+        first = last = ((uint32_t)key[1]) >> 16;
+    } else {
+        first = (((uint32_t)key[1]) >> 16) & ~(0xFFFF >> (plen - 96));
+        last = first | (0xFFFF >> (plen - 96));
+    }
+    for (slot = first; slot <= last; slot++)
+        ip_trie_direct_slot(trie, slot);
+}
+
+static int ip_trie_insert4(ci_ip_trie_t *trie, const uint64_t key[2], int plen, uint32_t value)
+{
+    int ret = ip_trie_insert(trie, &trie->root4, key, plen, value);
+    if (ret > 0) {
+        trie->entries4++;
+        ip_trie_direct_update(trie, key, plen);
+    }
+    return ret;
+}
+
+int ci_ip_trie_add(ci_ip_trie_t *trie, const ci_ip_t *net, const void *value)
+{
+    uint64_t key[2], mask[2], key4[2];
+    uint32_t addr4, mask4, val;
+    int plen, ret;
+
+    if (!trie || !value)
+        return 0;
+
+    if (net->family == AF_INET) {
+        memcpy(&addr4, &net->address, sizeof(uint32_t));
+        memcpy(&mask4, &net->netmask, sizeof(uint32_t));
+        ip_key_v4(key, ntohl(addr4));
+        mask[0] = ~(uint64_t)0;
+        mask[1] = ((uint64_t)0xFFFFFFFF << 32) | ntohl(mask4);
+        if ((plen = ip_mask_len(mask)) < 0)
+            return 0;
+        if (!(val = ip_trie_value_new(trie, value)))
+            return 0;
+        if ((ret = ip_trie_insert4(trie, key, plen, val)) < 0 ||
+                ip_trie_insert(trie, &trie->root6, key, plen, val) < 0)
+            return 0;
+        if (ret > 0)
+            trie->entries++;
+        return 1;
+    }
+
+#ifdef USE_IPV6
+    if (net->family == AF_INET6) {
+        ip_key_bytes(key, &net->address);
+        ip_key_bytes(mask, &net->netmask);
+        if ((plen = ip_mask_len(mask)) < 0)
+            return 0;
+        if (!(val = ip_trie_value_new(trie, value)))
+            return 0;
+        if ((ret = ip_trie_insert(trie, &trie->root6, key, plen, val)) < 0)
+            return 0;
+        if (key[0] == 0 && (key[1] >> 32) == 0xFFFF) {
+            /*The IPv4 addresses are checked using the first 32 bits
+              of the netmask of IPv4-mapped networks*/
+            ip_key_v4(key4, (uint32_t)key[1]);
+            if (ip_trie_insert4(trie, key4, 96 + (plen < 32 ? plen : 32), val) < 0)
+                return 0;
+        }
+        if (ret > 0)
+            trie->entries++;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+const void *ci_ip_trie_search(const ci_ip_trie_t *trie, int family, const void *addr)
+{
+    const struct ip_trie_node *n;
+    uint32_t addr4, idx, found = 0;
+    uint64_t key[2];
+
+    if (family == AF_INET) {
+        memcpy(&addr4, addr, sizeof(uint32_t));
+        addr4 = ntohl(addr4);
+        ip_key_v4(key, addr4);
+        if (trie->direct4) {
+            idx = trie->direct4[addr4 >> 16].node;
+            found = trie->direct4[addr4 >> 16].value;
+        } else
+            idx = trie->root4;
+    }
+#ifdef USE_IPV6
+    else if (family == AF_INET6) {
+        ip_key_bytes(key, addr);
+        idx = trie->root6;
+    }
+#endif
+    else
+        return NULL;
+
+    while (idx != IP_TRIE_NONE) {
+        n = &trie->nodes[idx];
+        if (!ip_key_match(key, n->key, n->plen))
+            break;
+        if (n->value)
+            found = n->value;
+        if (n->plen == 128)
+            break;
+        idx = n->child[ip_key_bit(key, n->plen)];
+    }
+    return found ? trie->values[found] : NULL;
+}
@@ -33,9 +33,16 @@
 #include "proc_threads_queues.h"
 #include "commands.h"
 #include "array.h"
+#include "stats.h"
 #include <errno.h>
 #include <assert.h>
 
+#if !defined(_WIN32) && defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#define CI_ASYNC_ACCESS_LOG 1
+#include <stdatomic.h>
+#include <sys/uio.h>
+#endif
+
 static ci_list_t *default_loggers = NULL;
 static int disable_logs = 0;
 
@@ -254,6 +261,7 @@ struct logfile {
     char *file;
     FILE *access_log;
     const char *log_fmt;
+    ci_fmt_program_t *log_prog;
     ci_access_entry_t *access_list;
     ci_thread_rwlock_t rwlock;
     struct logfile *next;
@@ -289,6 +297,351 @@ FILE *logfile_open(const char *fname)
     return f;
 }
 
+/*
+  The asynchronous access log. The worker threads append the formatted
+  log lines to a per-child ring buffer and a writer thread writes them
+  in batches to the log files using writev.
+
+  The ring is a multi-producer/single-consumer byte ring. A producer
+  reserves space for its record by advancing the tail position and marks
+  the record as ready by storing the record ring position in the record
+  header. The writer consumes the ready records from the head position
+  and releases their space by advancing the head position after the
+  data are written to the log file. A record never wraps around the end
+  of the ring, the remaining space is filled with a padding record.
+*/
+int ASYNC_ACCESS_LOG = 0;
+size_t ASYNC_ACCESS_LOG_BUFFER_SIZE = 1024 * 1024;
+char *ASYNC_ACCESS_LOG_OVERFLOW = "block";
+int ASYNC_ACCESS_LOG_FLUSH_INTERVAL = 100; /*milliseconds*/
+
+#if defined(CI_ASYNC_ACCESS_LOG)
+
+static int STAT_ASYNC_LOG_QUEUED = -1;
+static int STAT_ASYNC_LOG_DROPPED = -1;
+static int STAT_ASYNC_LOG_FLUSHES = -1;
+static int STAT_ASYNC_LOG_FLUSH_TIME = -1;
+
+#define ASYNC_LOG_RECORD_ALIGN 32
+#define ASYNC_LOG_ALIGN(size) (((size) + ASYNC_LOG_RECORD_ALIGN - 1) & ~((uint64_t)ASYNC_LOG_RECORD_ALIGN - 1))
+#define ASYNC_LOG_MIN_SIZE (64 * 1024)
+#define ASYNC_LOG_IOV_MAX 64
+#define ASYNC_LOG_BATCH 256
+#define ASYNC_LOG_CACHE_LINE 64
+
+struct async_log_record {
+    _Atomic uint64_t pos;
+    struct logfile *lf; /*NULL for padding records*/
+    uint32_t size;
+    uint32_t len;
+};
+
+struct async_log {
+    char *buf;
+    uint64_t size;
+    uint64_t mask;
+    uint64_t flush_size;
+    int drop;
+    _Atomic int stop;
+    _Atomic int waiters;
+    ci_thread_mutex_t mtx;
+    ci_thread_cond_t writer_cond;
+    ci_thread_cond_t space_cond;
+    ci_thread_t writer;
+    char pad1[ASYNC_LOG_CACHE_LINE];
+    _Atomic uint64_t tail;
+    char pad2[ASYNC_LOG_CACHE_LINE - sizeof(uint64_t)];
+    _Atomic uint64_t head;
+    char pad3[ASYNC_LOG_CACHE_LINE - sizeof(uint64_t)];
+    /*Used only by the writer thread*/
+    time_t stat_indx;
+    uint64_t stat_flushes;
+    uint64_t stat_flush_time;
+};
+
+static struct async_log *AsyncLog = NULL;
+
+static void async_log_wait_space(struct async_log *al)
+{
+    ci_thread_mutex_lock(&al->mtx);
+    atomic_fetch_add(&al->waiters, 1);
+    ci_thread_cond_signal(&al->writer_cond);
+    ci_thread_cond_timedwait(&al->space_cond, &al->mtx, 10);
+    atomic_fetch_sub(&al->waiters, 1);
+    ci_thread_mutex_unlock(&al->mtx);
+}
+
+static int async_log_put(struct async_log *al, struct logfile *lf, const char *line, size_t len)
+{
+    struct async_log_record *rec;
+    uint64_t tail, head, off, pad, need;
+
+    need = ASYNC_LOG_ALIGN(sizeof(struct async_log_record) + len + 1);
+    if (need > al->size / 2)
+        return 0;
+
+    tail = atomic_load_explicit(&al->tail, memory_order_relaxed);
+    do {
+        head = atomic_load_explicit(&al->head, memory_order_acquire);
+        off = tail & al->mask;
+        pad = (off + need > al->size) ? al->size - off : 0;
+        if (tail + pad + need - head > al->size) {
+            if (al->drop) {
+                ci_stat_uint64_inc(STAT_ASYNC_LOG_DROPPED, 1);
+                return 0;
+            }
+            async_log_wait_space(al);
+            tail = atomic_load_explicit(&al->tail, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(&al->tail, &tail, tail + pad + need, memory_order_relaxed, memory_order_relaxed))
+            break;
+    } while (1);
+
+    if (pad) {
+        rec = (struct async_log_record *)(al->buf + off);
+        rec->lf = NULL;
+        rec->size = pad;
+        rec->len = 0;
+        atomic_store_explicit(&rec->pos, tail, memory_order_release);
+        tail += pad;
+        off = 0;
+    }
+    rec = (struct async_log_record *)(al->buf + off);
+    rec->lf = lf;
+    rec->size = need;
+    rec->len = len + 1;
+    memcpy((char *)(rec + 1), line, len);
+    ((char *)(rec + 1))[len] = '\n';
+    atomic_store_explicit(&rec->pos, tail, memory_order_release);
+    ci_stat_uint64_inc(STAT_ASYNC_LOG_QUEUED, 1);
+
+    /*Wake up the writer when the pending data reach the flush size*/
+    if (tail - head < al->flush_size && tail + need - head >= al->flush_size) {
+        ci_thread_mutex_lock(&al->mtx);
+        ci_thread_cond_signal(&al->writer_cond);
+        ci_thread_mutex_unlock(&al->mtx);
+    }
+    return 1;
+}
+
+static void async_log_writev(struct logfile *lf, struct iovec *iov, int n)
+{
+    ssize_t ret;
+    struct timespec start, stop;
+    time_t now;
+
+    ci_thread_rwlock_rdlock(&lf->rwlock);
+    if (!lf->access_log) {
+        ci_thread_rwlock_unlock(&lf->rwlock);
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (n > 0) {
+        ret = writev(fileno(lf->access_log), iov, n);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        while (n > 0 && (size_t)ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    ci_thread_rwlock_unlock(&lf->rwlock);
+
+    /*The flush time statistic is the mean flush time of the last second*/
+    now = stop.tv_sec;
+    if (now != AsyncLog->stat_indx) {
+        if (AsyncLog->stat_flushes)
+            ci_stat_value_set(STAT_ASYNC_LOG_FLUSH_TIME, AsyncLog->stat_flush_time / AsyncLog->stat_flushes);
+        AsyncLog->stat_indx = now;
+        AsyncLog->stat_flushes = 0;
+        AsyncLog->stat_flush_time = 0;
+    }
+    AsyncLog->stat_flushes++;
+    AsyncLog->stat_flush_time += ((int64_t)(stop.tv_sec - start.tv_sec) * 1000000) + ((stop.tv_nsec - start.tv_nsec) / 1000);
+    ci_stat_uint64_inc(STAT_ASYNC_LOG_FLUSHES, 1);
+}
+
+static void async_log_clear(struct async_log *al, uint64_t from, uint64_t to)
+{
+    uint64_t off = from & al->mask;
+    if (off + (to - from) > al->size) {
+        memset(al->buf + off, 0, al->size - off);
+        memset(al->buf, 0, (to - from) - (al->size - off));
+    } else
+        memset(al->buf + off, 0, to - from);
+}
+
+/*Writes all of the ready records, returns the number of written lines*/
+static int async_log_flush(struct async_log *al)
+{
+    struct async_log_record *rec, *recs[ASYNC_LOG_BATCH];
+    struct logfile *lf;
+    struct iovec iov[ASYNC_LOG_IOV_MAX];
+    uint64_t head, new_head;
+    int i, k, n, iovn, lines = 0;
+
+    head = atomic_load_explicit(&al->head, memory_order_relaxed);
+    do {
+        n = 0;
+        new_head = head;
+        while (n < ASYNC_LOG_BATCH) {
+            rec = (struct async_log_record *)(al->buf + (new_head & al->mask));
+            if (atomic_load_explicit(&rec->pos, memory_order_acquire) != new_head)
+                break;
+            if (rec->lf)
+                recs[n++] = rec;
+            new_head += rec->size;
+        }
+
+        /*Every writev goes to a single log file, keep the lines order*/
+        for (i = 0; i < n; i++) {
+            if (!recs[i])
+                continue;
+            lf = recs[i]->lf;
+            for (k = i, iovn = 0; k < n; k++) {
+                if (!recs[k] || recs[k]->lf != lf)
+                    continue;
+                iov[iovn].iov_base = (char *)(recs[k] + 1);
+                iov[iovn].iov_len = recs[k]->len;
+                recs[k] = NULL;
+                if (++iovn == ASYNC_LOG_IOV_MAX) {
+                    async_log_writev(lf, iov, iovn);
+                    iovn = 0;
+                }
+            }
+            if (iovn)
+                async_log_writev(lf, iov, iovn);
+        }
+
+        if (new_head != head) {
+            /*Clear the consumed records, only valid record headers should be found*/
+            async_log_clear(al, head, new_head);
+            atomic_store_explicit(&al->head, new_head, memory_order_release);
+            head = new_head;
+            if (atomic_load(&al->waiters) > 0) {
+                ci_thread_mutex_lock(&al->mtx);
+                ci_thread_cond_broadcast(&al->space_cond);
+                ci_thread_mutex_unlock(&al->mtx);
+            }
+        }
+        lines += n;
+    } while (n > 0);
+    return lines;
+}
+
+static void *async_log_writer(void *data)
+{
+    struct async_log *al = (struct async_log *)data;
+    uint64_t tail, head;
+    int stop;
+
+    do {
+        stop = atomic_load(&al->stop);
+        async_log_flush(al);
+        if (stop)
+            break;
+        ci_thread_mutex_lock(&al->mtx);
+        tail = atomic_load_explicit(&al->tail, memory_order_relaxed);
+        head = atomic_load_explicit(&al->head, memory_order_relaxed);
+        if (!atomic_load(&al->stop) && tail - head < al->flush_size && atomic_load(&al->waiters) == 0)
+            ci_thread_cond_timedwait(&al->writer_cond, &al->mtx, ASYNC_ACCESS_LOG_FLUSH_INTERVAL);
+        ci_thread_mutex_unlock(&al->mtx);
+    } while (1);
+    return NULL;
+}
+
+static void async_log_start(const char *name, int type, void *data)
+{
+    struct async_log *al;
+    uint64_t size;
+
+    if (AsyncLog)
+        return;
+
+    /*A power of 2*/
+    for (size = ASYNC_LOG_MIN_SIZE; size * 2 <= ASYNC_ACCESS_LOG_BUFFER_SIZE; size *= 2);
+
+    al = calloc(1, sizeof(struct async_log));
+    if (!al || !(al->buf = calloc(1, size))) {
+        ci_debug_printf(1, "WARNING! Can not allocate memory for the asynchronous access log, using synchronous logging\n");
+        free(al);
+        return;
+    }
+    al->size = size;
+    al->mask = size - 1;
+    al->flush_size = size / 4 < 65536 ? size / 4 : 65536;
+    al->drop = (strcasecmp(ASYNC_ACCESS_LOG_OVERFLOW, "drop") == 0);
+    atomic_store(&al->stop, 0);
+    atomic_store(&al->waiters, 0);
+    /*The zeroed buffer must not look like a ready record at position 0*/
+    atomic_store(&al->tail, size);
+    atomic_store(&al->head, size);
+    ci_thread_mutex_init(&al->mtx);
+    ci_thread_cond_init(&al->writer_cond);
+    ci_thread_cond_init(&al->space_cond);
+    AsyncLog = al;
+    if (ci_thread_create(&al->writer, async_log_writer, al) != 0) {
+        ci_debug_printf(1, "WARNING! Can not start the asynchronous access log writer thread, using synchronous logging\n");
+        AsyncLog = NULL;
+        ci_thread_mutex_destroy(&al->mtx);
+        ci_thread_cond_destroy(&al->writer_cond);
+        ci_thread_cond_destroy(&al->space_cond);
+        free(al->buf);
+        free(al);
+        return;
+    }
+    ci_debug_printf(5, "Asynchronous access log started, buffer size: %" PRIu64 "\n", size);
+}
+
+/*Called after the worker threads are stopped, writes the pending lines*/
+static void async_log_stop(const char *name, int type, void *data)
+{
+    struct async_log *al = AsyncLog;
+
+    if (!al)
+        return;
+
+    ci_thread_mutex_lock(&al->mtx);
+    atomic_store(&al->stop, 1);
+    ci_thread_cond_signal(&al->writer_cond);
+    ci_thread_mutex_unlock(&al->mtx);
+    ci_thread_join(al->writer);
+    AsyncLog = NULL;
+    ci_thread_mutex_destroy(&al->mtx);
+    ci_thread_cond_destroy(&al->writer_cond);
+    ci_thread_cond_destroy(&al->space_cond);
+    free(al->buf);
+    free(al);
+}
+
+#endif /*CI_ASYNC_ACCESS_LOG*/
+
+static void async_log_init()
+{
+    if (!ASYNC_ACCESS_LOG)
+        return;
+#if defined(CI_ASYNC_ACCESS_LOG)
+    STAT_ASYNC_LOG_QUEUED = ci_stat_entry_register("Async access log queued lines", CI_STAT_INT64_T, "Server");
+    STAT_ASYNC_LOG_DROPPED = ci_stat_entry_register("Async access log dropped lines", CI_STAT_INT64_T, "Server");
+    STAT_ASYNC_LOG_FLUSHES = ci_stat_entry_register("Async access log flushes", CI_STAT_INT64_T, "Server");
+    STAT_ASYNC_LOG_FLUSH_TIME = ci_stat_entry_register("Async access log flush time", CI_STAT_TIME_US_T, "Server");
+    ci_command_register_action("file_logger::async_log_start", CI_CMD_CHILD_START, NULL, async_log_start);
+    ci_command_register_action("file_logger::async_log_stop", CI_CMD_CHILD_STOP, NULL, async_log_stop);
+#else
+    ci_debug_printf(1, "WARNING! Asynchronous access log is not supported, using synchronous logging\n");
+#endif
+}
+
 int file_log_open()
 {
     int error = 0, ret = 0;
@@ -296,6 +649,7 @@ int file_log_open()
 
     assert(ret == 0);
     register_command("relog", MONITOR_PROC_CMD | CHILDS_PROC_CMD, file_log_relog);
+    async_log_init();
 
     for (lf = ACCESS_LOG_FILES; lf != NULL; lf = lf->next) {
         if (!lf->file) {
@@ -304,6 +658,7 @@ int file_log_open()
         }
         if (lf->log_fmt == NULL)
             lf->log_fmt = (char *)DEFAULT_LOG_FORMAT;
+        lf->log_prog = ci_format_compile(lf->log_fmt, NULL);
 
         if (ci_thread_rwlock_init(&(lf->rwlock)) != 0) {
             ci_debug_printf (1, "WARNING! Can not initialize locks/structures for log file: %s\n", lf->file);
@@ -341,6 +696,8 @@ void file_log_close()
         free(lf->file);
         if (lf->access_list)
             ci_access_entry_release(lf->access_list);
+        if (lf->log_prog)
+            ci_format_program_release(lf->log_prog);
         ci_thread_rwlock_destroy(&(lf->rwlock)); // Initialize logfile::rwlock
         tmp = lf;
         lf = lf->next;
@@ -382,6 +739,7 @@ void file_log_access(ci_request_t *req)
 {
     struct logfile *lf;
     char logline[4096];
+    int len;
 
     for (lf = ACCESS_LOG_FILES; lf != NULL; lf = lf->next) {
         if (lf->access_list && !(ci_access_entry_match_request(lf->access_list, req) == CI_ACCESS_ALLOW)) {
@@ -389,7 +747,18 @@ void file_log_access(ci_request_t *req)
             continue;
         }
         ci_debug_printf(6, "Log request to access log file %s\n", lf->file);
-        ci_format_text(req, lf->log_fmt, logline, sizeof(logline), NULL);
+        if (lf->log_prog)
+            len = ci_format_program_text(req, lf->log_prog, logline, sizeof(logline));
+        else
+            len = ci_format_text(req, lf->log_fmt, logline, sizeof(logline), NULL);
+
+#if defined(CI_ASYNC_ACCESS_LOG)
+        if (AsyncLog) {
+            /*The returned length includes the terminating '\0'*/
+            async_log_put(AsyncLog, lf, logline, len > 0 ? len - 1 : 0);
+            continue;
+        }
+#endif
 
         ci_thread_rwlock_rdlock(&lf->rwlock); /*obtain a read lock*/
         if (lf->access_log)
@@ -436,6 +805,7 @@ int file_log_addlogfile(const char *file, const char *format, const char **acls)
     newlf = malloc(sizeof(struct logfile));
     newlf->file = access_log_file;
     newlf->log_fmt = (access_log_format != NULL? access_log_format : DEFAULT_LOG_FORMAT);
+    newlf->log_prog = NULL;
     newlf->access_log = NULL;
     newlf->access_list = NULL;
     newlf->next = NULL;
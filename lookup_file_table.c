@@ -20,6 +20,9 @@
 #include "common.h"
 #include "lookup_table.h"
 #include "hash.h"
+#include "htable.h"
+#include "ip_trie.h"
+#include "ci_regex.h"
 #include "debug.h"
 #include <assert.h>
 
@@ -49,6 +52,9 @@ struct text_table_entry {
 struct text_table {
     struct text_table_entry *entries;
     struct ci_hash_table *hash_table;
+    ci_ip_trie_t *ip_trie;
+    ci_regex_set_t *regex_set;
+    struct text_table_entry **regex_rows;
     int rows;
 };
 
@@ -150,17 +156,35 @@ int read_row(FILE *f, int cols, struct text_table_entry **e,
     while (*s == ' ' || *s == '\t') s++;
     val=s;
 
+    /*A key which includes ':' chars (eg IPv6 addresses) can be enclosed
+      in brackets: "[2001:db8::/32]: val1, val2, ..." */
+    if (*val == '[') {
+        for (end = strchr(val, ']'); end != NULL; end = strchr(end + 1, ']')) {
+            for (s = end + 1; *s == ' ' || *s == '\t'; s++);
+            if (*s == ':' || *s == '\0')
+                break;
+        }
+        if (end) {
+            val++;
+            *end = '\0';
+            s = end + 1;
+        } else
+            s = val;
+    }
+
     end = NULL;
     if (row_cols > 1)
         end = strchr(s, ':');
     if (end == NULL) /*no ":" char or the only column is the key (row_cols <=1)*/
         end = s + strlen(s);
 
-    s = end+1; /*Now points to the end (*s = '\0') or after the ':' */
+    s = (*end == '\0') ? end : end + 1; /*Now points to the end (*s = '\0') or after the ':' */
 
-    end--;
-    while (*end == ' ' || *end == '\t') end--;
-    *(end+1) = '\0';
+    if (end > val) {
+        end--;
+        while (end >= val && (*end == ' ' || *end == '\t')) end--;
+        *(end+1) = '\0';
+    }
     (*e)->key = key_ops->dup(val, allocator);
 
     if (!(*e)->key) {
@@ -242,10 +266,24 @@ int load_text_table(char *filename, struct ci_lookup_table *table)
 }
 
 
+/*The size of the memory blocks of the lookup tables arena*/
+#define TEXT_TABLE_ARENA_BLOCK (1024 * 1024)
+
 void *file_table_open(struct ci_lookup_table *table)
 {
-    struct ci_mem_allocator *allocator = table->allocator;
-    struct text_table *text_table = allocator->alloc(allocator, sizeof(struct text_table));
+    struct ci_mem_allocator *allocator;
+    struct text_table *text_table;
+
+    if (CI_LOOKUP_TABLES_ARENA && table->allocator->type != SERIAL_ALLOC) {
+        /*The rows are never freed before the table is closed, store
+          them in an arena instead of the table allocator*/
+        if (!(allocator = ci_create_serial_allocator(TEXT_TABLE_ARENA_BLOCK)))
+            return NULL;
+        ci_mem_allocator_destroy(table->allocator);
+        table->allocator = allocator;
+    }
+    allocator = table->allocator;
+    text_table = allocator->alloc(allocator, sizeof(struct text_table));
 
     if (!text_table)
         return NULL;
@@ -256,6 +294,9 @@ void *file_table_open(struct ci_lookup_table *table)
         return (table->data = NULL);
     }
     text_table->hash_table = NULL;
+    text_table->ip_trie = NULL;
+    text_table->regex_set = NULL;
+    text_table->regex_rows = NULL;
     return text_table;
 }
 
@@ -287,6 +328,8 @@ void  file_table_close(struct ci_lookup_table *table)
     }
     allocator->free(allocator, text_table);
     table->data = NULL;
+    if (allocator->type == SERIAL_ALLOC)
+        allocator->reset(allocator); /*Release the arena memory blocks*/
 }
 
 void *file_table_search(struct ci_lookup_table *table, void *key, void ***vals)
@@ -418,6 +461,10 @@ void *regex_table_open(struct ci_lookup_table *table)
 {
 #ifdef USE_REGEX
     struct text_table *text_table;
+    struct text_table_entry *e;
+    const struct ci_acl_regex *reg;
+    ci_regex_set_stats_t stats;
+    int i;
     if (table->key_ops != &ci_str_ops) {
         ci_debug_printf(1,"This type of table is not compatible with regex tables!\n");
         return NULL;
@@ -428,6 +475,28 @@ void *regex_table_open(struct ci_lookup_table *table)
     if (!text_table)
         return NULL;
 
+    /*Build the regex set of all rows, the regex ids are the row numbers*/
+    text_table->regex_set = ci_regex_set_create();
+    text_table->regex_rows = table->allocator->alloc(table->allocator, (text_table->rows + 1) * sizeof(struct text_table_entry *));
+    if (!text_table->regex_set || !text_table->regex_rows) {
+        regex_table_close(table);
+        return NULL;
+    }
+    for (i = 0, e = text_table->entries; e != NULL; e = e->next, i++) {
+        reg = (const struct ci_acl_regex *)e->key;
+        text_table->regex_rows[i] = e;
+        if (ci_regex_set_add(text_table->regex_set, reg->str, reg->flags, reg->preg) != i) {
+            regex_table_close(table);
+            return NULL;
+        }
+    }
+    if (!ci_regex_set_compile(text_table->regex_set)) {
+        regex_table_close(table);
+        return NULL;
+    }
+    ci_regex_set_stats(text_table->regex_set, &stats);
+    ci_debug_printf(3, "regex table %s: %d regexes, %d prefiltered, %u automaton states, %lu bytes\n",
+                    table->path, stats.regexes, stats.literal_regexes, stats.states, (unsigned long)stats.memory);
     return text_table;
 #else
     ci_debug_printf(1,"regex lookup tables are not supported on this system!\n");
@@ -438,7 +507,15 @@ void *regex_table_open(struct ci_lookup_table *table)
 void  regex_table_close(struct ci_lookup_table *table)
 {
 #ifdef USE_REGEX
-    /*just call the file_table_close:*/
+    struct text_table *text_table = (struct text_table *)table->data;
+    if (text_table) {
+        ci_regex_set_destroy(text_table->regex_set);
+        text_table->regex_set = NULL;
+        if (text_table->regex_rows)
+            table->allocator->free(table->allocator, text_table->regex_rows);
+        text_table->regex_rows = NULL;
+    }
+    /*... and then call the file_table_close:*/
     file_table_close(table);
 #else
     ci_debug_printf(1,"regex lookup tables are not supported on this system!\n");
@@ -448,7 +525,21 @@ void  regex_table_close(struct ci_lookup_table *table)
 void *regex_table_search(struct ci_lookup_table *table, void *key, void ***vals)
 {
 #ifdef USE_REGEX
-    return file_table_search(table, key, vals);
+    const struct text_table_entry *e;
+    struct text_table *text_table = (struct text_table *)table->data;
+    int id;
+
+    if (!text_table) {
+        ci_debug_printf(1, "Search a non open regex lookup table?(%s)\n", table->path);
+        return NULL;
+    }
+
+    *vals = NULL;
+    if (ci_regex_set_match(text_table->regex_set, (const char *)key, -1, &id, 1) == 0)
+        return NULL;
+    e = text_table->regex_rows[id];
+    *vals = (void **)e->vals;
+    return (void *)e->key;
 #else
     ci_debug_printf(1,"regex lookup tables are not supported on this system!\n");
     return NULL;
@@ -460,3 +551,192 @@ void  regex_table_release_result(struct ci_lookup_table *table_data,void **val)
     /*do nothing*/
 }
 
+
+/******************************************************/
+/* iptrie lookup table implementation                 */
+
+void *iptrie_table_open(struct ci_lookup_table *table);
+void  iptrie_table_close(struct ci_lookup_table *table);
+void *iptrie_table_search(struct ci_lookup_table *table, void *key, void ***vals);
+void  iptrie_table_release_result(struct ci_lookup_table *table_data,void **val);
+
+struct ci_lookup_table_type iptrie_table_type = {
+    iptrie_table_open,
+    iptrie_table_close,
+    iptrie_table_search,
+    iptrie_table_release_result,
+    NULL,
+    "iptrie"
+};
+
+static int iptrie_table_ip_keys(struct ci_lookup_table *table)
+{
+    return table->key_ops == &ci_ip_ops || table->key_ops == &ci_ip_sockaddr_ops;
+}
+
+void *iptrie_table_open(struct ci_lookup_table *table)
+{
+    struct text_table_entry *e;
+    struct text_table *text_table;
+    ci_ip_t *ip;
+    int ret, row;
+
+    if (!iptrie_table_ip_keys(table) && table->key_ops != &ci_str_ops) {
+        ci_debug_printf(1,"This type of table is not compatible with iptrie tables!\n");
+        return NULL;
+    }
+
+    text_table = file_table_open(table);
+    if (!text_table)
+        return NULL;
+
+    if (!(text_table->ip_trie = ci_ip_trie_create())) {
+        file_table_close(table);
+        return NULL;
+    }
+
+    for (e = text_table->entries, row = 1; e != NULL; e = e->next, row++) {
+        if (iptrie_table_ip_keys(table))
+            ret = ci_ip_trie_add(text_table->ip_trie, (ci_ip_t *)e->key, e);
+        else if ((ip = ci_ip_ops.dup((const char *)e->key, ci_os_allocator))) {
+            ret = ci_ip_trie_add(text_table->ip_trie, ip, e);
+            ci_ip_ops.free(ip, ci_os_allocator);
+        } else
+            ret = 0;
+        if (!ret) {
+            ci_debug_printf(1, "Error loading iptrie table %s: wrong network or not contiguous netmask in entry %d\n", table->path, row);
+            iptrie_table_close(table);
+            return NULL;
+        }
+    }
+    ci_debug_printf(7, "Iptrie table %s: %d networks\n", table->path, ci_ip_trie_entries(text_table->ip_trie));
+    return text_table;
+}
+
+void  iptrie_table_close(struct ci_lookup_table *table)
+{
+    struct text_table *text_table = (struct text_table *)table->data;
+    if (text_table && text_table->ip_trie) {
+        ci_ip_trie_destroy(text_table->ip_trie);
+        text_table->ip_trie = NULL;
+    }
+    file_table_close(table);
+}
+
+void *iptrie_table_search(struct ci_lookup_table *table, void *key, void ***vals)
+{
+    const struct text_table_entry *e;
+    struct text_table *text_table = (struct text_table *)table->data;
+    ci_in_addr_t addr;
+    int family;
+
+    if (!text_table) {
+        ci_debug_printf(1, "Search a non open iptrie lookup table?(%s)\n", table->path);
+        return NULL;
+    }
+
+    *vals = NULL;
+    if (table->key_ops == &ci_ip_ops)
+        e = ci_ip_trie_search_ip(text_table->ip_trie, (const ci_ip_t *)key);
+    else if (table->key_ops == &ci_ip_sockaddr_ops)
+        e = ci_ip_trie_search_sockaddr(text_table->ip_trie, (const ci_sockaddr_t *)key);
+    else {
+#ifdef USE_IPV6
+        family = strchr((const char *)key, ':') ? AF_INET6 : AF_INET;
+#else
+        family = AF_INET;
+#endif
+        if (!ci_inet_aton(family, (const char *)key, &addr))
+            return NULL;
+        e = ci_ip_trie_search(text_table->ip_trie, family, &addr);
+    }
+    if (!e)
+        return NULL;
+
+    *vals = (void **)e->vals;
+    return (void *)e->key;
+}
+
+void  iptrie_table_release_result(struct ci_lookup_table *table_data,void **val)
+{
+    /*do nothing*/
+}
+
+
+/******************************************************/
+/* htable lookup table implementation                 */
+
+void *htable_table_open(struct ci_lookup_table *table);
+void  htable_table_close(struct ci_lookup_table *table);
+void *htable_table_search(struct ci_lookup_table *table, void *key, void ***vals);
+void  htable_table_release_result(struct ci_lookup_table *table_data,void **val);
+
+struct ci_lookup_table_type htable_table_type = {
+    htable_table_open,
+    htable_table_close,
+    htable_table_search,
+    htable_table_release_result,
+    NULL,
+    "htable"
+};
+
+void *htable_table_open(struct ci_lookup_table *table)
+{
+    ci_htable_t *htable;
+    if ((table->key_ops != &ci_str_ops && table->key_ops != &ci_str_ext_ops) ||
+            (table->val_ops != &ci_str_ops && table->val_ops != &ci_str_ext_ops)) {
+        ci_debug_printf(1,"This type of table is not compatible with htable tables!\n");
+        return NULL;
+    }
+
+    if (!(htable = ci_htable_open(table->path)))
+        return NULL;
+    ci_debug_printf(7, "Htable table %s: %llu rows\n", table->path, (unsigned long long)ci_htable_header(htable)->rows);
+    return (table->data = htable);
+}
+
+void  htable_table_close(struct ci_lookup_table *table)
+{
+    if (!table->data) {
+        ci_debug_printf(1,"Closing a non open htable lookup table?(%s)\n", table->path);
+        return;
+    }
+    ci_htable_close((ci_htable_t *)table->data);
+    table->data = NULL;
+}
+
+void *htable_table_search(struct ci_lookup_table *table, void *key, void ***vals)
+{
+    ci_htable_t *htable = (ci_htable_t *)table->data;
+    const char *row_key, *v;
+    void **values;
+    int i, vals_num;
+
+    if (!htable) {
+        ci_debug_printf(1, "Search a non open htable lookup table?(%s)\n", table->path);
+        return NULL;
+    }
+
+    *vals = NULL;
+    if (!(row_key = ci_htable_search(htable, (const char *)key, &v, &vals_num)))
+        return NULL;
+    if (vals_num > 0) {
+        /*Only the array is allocated, the values point to the mapped table*/
+        values = table->allocator->alloc(table->allocator, (vals_num + 1) * sizeof(void *));
+        if (!values)
+            return NULL;
+        for (i = 0; i < vals_num; i++) {
+            values[i] = (void *)v;
+            v += strlen(v) + 1;
+        }
+        values[i] = NULL;
+        *vals = values;
+    }
+    return (void *)row_key;
+}
+
+void  htable_table_release_result(struct ci_lookup_table *table, void **val)
+{
+    if (val)
+        table->allocator->free(table->allocator, val);
+}
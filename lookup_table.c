@@ -30,6 +30,8 @@
 const struct ci_lookup_table_type *lookup_tables_types[128];
 int lookup_tables_types_num = 0;
 
+int CI_LOOKUP_TABLES_ARENA = 0;
+
 /*********************************************************************/
 /*Lookuptable library functions                                      */
 
@@ -236,9 +238,13 @@ const char * ci_lookup_table_get_row(struct ci_lookup_table *table, const char *
 extern struct ci_lookup_table_type file_table_type;
 extern struct ci_lookup_table_type hash_table_type;
 extern struct ci_lookup_table_type regex_table_type;
+extern struct ci_lookup_table_type iptrie_table_type;
+extern struct ci_lookup_table_type htable_table_type;
 CI_DECLARE_FUNC(void) init_internal_lookup_tables()
 {
     ci_lookup_table_type_register(&file_table_type);
     ci_lookup_table_type_register(&hash_table_type);
     ci_lookup_table_type_register(&regex_table_type);
+    ci_lookup_table_type_register(&iptrie_table_type);
+    ci_lookup_table_type_register(&htable_table_type);
 }
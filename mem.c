@@ -534,6 +534,7 @@ typedef struct serial_allocator {
     char *curpos;
     char *endpos;
     struct serial_allocator *next;
+    struct serial_allocator *current; /*Used by the first chunk: the chunk to allocate from*/
 } serial_allocator_t;
 
 
@@ -550,6 +551,8 @@ static serial_allocator_t *serial_allocator_build(size_t size)
     /*The allocated block size maybe is larger, than the requested.
       Fix size to actual block size */
     buffer = (char *)ci_buffer_alloc2(size, &size);
+    if (!buffer)
+        return NULL;
     serial_alloc = (serial_allocator_t *)buffer;
 
     serial_alloc->memchunk = buffer + sizeof(serial_allocator_t);
@@ -557,6 +560,7 @@ static serial_allocator_t *serial_allocator_build(size_t size)
     serial_alloc->curpos = serial_alloc->memchunk;
     serial_alloc->endpos = serial_alloc->memchunk + size;
     serial_alloc->next = NULL;
+    serial_alloc->current = serial_alloc;
     return serial_alloc;
 }
 
@@ -564,22 +568,34 @@ static void *serial_allocation(serial_allocator_t *serial_alloc, size_t size)
 {
     size_t max_size;
     char *mem;
+    serial_allocator_t *chunk, *large;
     size = _CI_ALIGN(size); /*round size to a correct alignment size*/
     max_size = serial_alloc->endpos - serial_alloc->memchunk;
-    if (size > max_size)
-        return NULL;
+    chunk = serial_alloc->current;
+    if (size > max_size) {
+        /*Does not fit in a chunk, allocate a full chunk for it and link
+          it after the current one*/
+        if (!(large = serial_allocator_build(sizeof(serial_allocator_t) + size)))
+            return NULL;
+        mem = large->curpos;
+        large->curpos = large->endpos;
+        large->next = chunk->next;
+        chunk->next = large;
+        return (void *)mem;
+    }
 
-    while (size > (serial_alloc->endpos - serial_alloc->curpos)) {
-        if (serial_alloc->next == NULL) {
-            serial_alloc->next = serial_allocator_build(max_size);
-            if (!serial_alloc->next)
+    while (size > (chunk->endpos - chunk->curpos)) {
+        if (chunk->next == NULL) {
+            chunk->next = serial_allocator_build(max_size);
+            if (!chunk->next)
                 return NULL;
         }
-        serial_alloc = serial_alloc->next;
+        chunk = chunk->next;
     }
+    serial_alloc->current = chunk;
 
-    mem = serial_alloc->curpos;
-    serial_alloc->curpos += size;
+    mem = chunk->curpos;
+    chunk->curpos += size;
     return (void *)mem;
 }
 
@@ -605,6 +621,7 @@ static void serial_allocator_reset(ci_mem_allocator_t *allocator)
     serial_alloc->curpos = serial_alloc->memchunk + _CI_ALIGN(sizeof(ci_mem_allocator_t));
     sa = serial_alloc->next;
     serial_alloc->next = NULL;
+    serial_alloc->current = serial_alloc;
 
     /*release any other allocated chunk*/
     while (sa) {
@@ -868,6 +885,23 @@ struct mem_block_item {
 
 #define MEM_BLOCK_DATA_OFFSET offsetof(struct mem_block_item, data.ptr[0])
 
+/*
+  The pool allocators keep a small per-thread cache (magazine) of free
+  items for each pool. The items are moved between the magazines and the
+  pool free list in batches, so the pool mutex is locked once per
+  several alloc/free operations.
+  The magazine holds at most CI_MEM_POOLS_THREAD_CACHE items, and no more
+  than MAGAZINE_MAX_BYTES of memory. When full, the half of the items are
+  returned to the pool.
+*/
+int CI_MEM_POOLS_THREAD_CACHE = 32;
+#define MAGAZINE_MAX_BYTES (128*1024)
+/*Publish the magazine statistics every MAGAZINE_SYNC_OPS operations*/
+#define MAGAZINE_SYNC_OPS 64
+/*Every POOL_TRIM_INTERVAL seconds release the half of the free items
+  which remained unused in pool since the previous check*/
+#define POOL_TRIM_INTERVAL 10
+
 struct pool_allocator {
     char *name;
     int items_size;
@@ -877,12 +911,88 @@ struct pool_allocator {
     int stat_hits_id;
     int stat_idle_id;
     int stat_used_id;
+    int stat_cache_hits_id;
+    int stat_cache_misses_id;
+    int stat_cache_flushes_id;
     int disable_stats;
 
+    int cache_id;
+    int magazine_max;
+
     ci_thread_mutex_t mutex;
     struct mem_block_item *free;
+    int free_count;
+    int free_low;
+    time_t last_trim;
 };
 
+struct pool_magazine {
+    struct pool_allocator *palloc;
+    struct mem_block_item *items;
+    int count;
+    int ops;
+    /*Not yet published statistics*/
+    int64_t allocs;
+    int64_t hits;
+    int64_t idle;
+    int64_t used;
+    int64_t cache_hits;
+    int64_t cache_misses;
+    int64_t cache_flushes;
+};
+
+struct mem_thread_cache {
+    struct pool_magazine *magazines;
+    int size;
+    struct mem_thread_cache *prev, *next;
+};
+
+/*All of the pool allocators, indexed by their cache_id.
+  The cache_id of a destroyed pool is never reused.*/
+static struct pool_allocator **PoolsRegistry = NULL;
+static int PoolsRegistrySize = 0;
+static int PoolsRegistryUsed = 0;
+static int PoolsRegistryInitialized = 0;
+static ci_thread_mutex_t PoolsRegistryMtx;
+static ci_thread_key_t ThreadCacheKey;
+/*The per-thread caches of all threads, guarded by the PoolsRegistryMtx.
+  A destroyed pool releases the items cached by each thread.*/
+static struct mem_thread_cache *ThreadCaches = NULL;
+
+static void mem_thread_cache_release(void *data);
+
+static void pools_registry_init()
+{
+    if (PoolsRegistryInitialized)
+        return;
+    ci_thread_mutex_init(&PoolsRegistryMtx);
+    if (ci_thread_key_create(&ThreadCacheKey, mem_thread_cache_release) != 0) {
+        ci_debug_printf(1, "WARNING: Can not create thread key, the memory pools per-thread caches are disabled\n");
+        CI_MEM_POOLS_THREAD_CACHE = 0;
+    }
+    PoolsRegistryInitialized = 1;
+}
+
+static int pools_registry_add(struct pool_allocator *palloc)
+{
+    int id;
+    ci_thread_mutex_lock(&PoolsRegistryMtx);
+    if (PoolsRegistryUsed == PoolsRegistrySize) {
+        int new_size = PoolsRegistrySize + 64;
+        struct pool_allocator **reg = realloc(PoolsRegistry, new_size * sizeof(struct pool_allocator *));
+        if (!reg) {
+            ci_thread_mutex_unlock(&PoolsRegistryMtx);
+            return -1;
+        }
+        PoolsRegistry = reg;
+        PoolsRegistrySize = new_size;
+    }
+    id = PoolsRegistryUsed++;
+    PoolsRegistry[id] = palloc;
+    ci_thread_mutex_unlock(&PoolsRegistryMtx);
+    return id;
+}
+
 static struct pool_allocator *pool_allocator_build(const char *name, int items_size, int strict)
 {
     char stat_group[256];
@@ -894,11 +1004,19 @@ static struct pool_allocator *pool_allocator_build(const char *name, int items_s
         return NULL;
     }
 
+    pools_registry_init();
+
     palloc->name = name ? strdup(name) : NULL;
     palloc->items_size = items_size;
     palloc->strict = strict;
     palloc->free = NULL;
+    palloc->free_count = 0;
+    palloc->free_low = 0;
+    palloc->last_trim = time(NULL);
     palloc->disable_stats = 0;
+    palloc->magazine_max = MAGAZINE_MAX_BYTES / items_size;
+    if (palloc->magazine_max < 2)
+        palloc->magazine_max = 2;
 
     snprintf(stat_group, sizeof(stat_group), "%s mem-pool", name);
     ci_stat_group_register(stat_group, MEMPOOLS_STAT_MASTER_GROUP);
@@ -910,6 +1028,12 @@ static struct pool_allocator *pool_allocator_build(const char *name, int items_s
         palloc->disable_stats = 1;
     if ((palloc->stat_used_id = ci_stat_entry_register("Used", CI_STAT_INT64_T, stat_group)) < 0)
         palloc->disable_stats = 1;
+    if ((palloc->stat_cache_hits_id = ci_stat_entry_register("Cache hits", CI_STAT_INT64_T, stat_group)) < 0)
+        palloc->disable_stats = 1;
+    if ((palloc->stat_cache_misses_id = ci_stat_entry_register("Cache misses", CI_STAT_INT64_T, stat_group)) < 0)
+        palloc->disable_stats = 1;
+    if ((palloc->stat_cache_flushes_id = ci_stat_entry_register("Cache flushes", CI_STAT_INT64_T, stat_group)) < 0)
+        palloc->disable_stats = 1;
 
     if (palloc->disable_stats) {
         ci_debug_printf(1,
@@ -919,22 +1043,296 @@ static struct pool_allocator *pool_allocator_build(const char *name, int items_s
     }
 
     ci_thread_mutex_init(&palloc->mutex);
+    palloc->cache_id = pools_registry_add(palloc);
     return palloc;
 }
 
+/*The statistics block to update from the current thread. The pool
+  counters are updated with the palloc->mutex locked, but with the
+  per-thread statistics shards the threads do not share their cache lines*/
+static inline ci_stat_memblock_t *pool_stats_block(const struct pool_allocator *palloc)
+{
+    ci_stat_memblock_t *block;
+    if (palloc->disable_stats)
+        return NULL;
+    if ((block = ci_stat_thread_memblock_get()))
+        return block;
+    return ci_stat_memblock_get();
+}
+
+/*Must called with palloc->mutex locked*/
+static void pool_magazine_stats_publish(struct pool_allocator *palloc, struct pool_magazine *mag, ci_stat_memblock_t *STATS)
+{
+    mag->ops = 0;
+    if (!STATS)
+        return; /*Keep them until the statistics are available*/
+    STAT_INT64_INC_NL(STATS, palloc->stat_allocs_id, mag->allocs);
+    STAT_INT64_INC_NL(STATS, palloc->stat_hits_id, mag->hits);
+    STAT_INT64_INC_NL(STATS, palloc->stat_idle_id, mag->idle);
+    STAT_INT64_INC_NL(STATS, palloc->stat_used_id, mag->used);
+    STAT_INT64_INC_NL(STATS, palloc->stat_cache_hits_id, mag->cache_hits);
+    STAT_INT64_INC_NL(STATS, palloc->stat_cache_misses_id, mag->cache_misses);
+    STAT_INT64_INC_NL(STATS, palloc->stat_cache_flushes_id, mag->cache_flushes);
+    mag->allocs = mag->hits = mag->idle = mag->used = 0;
+    mag->cache_hits = mag->cache_misses = mag->cache_flushes = 0;
+}
+
+/*Must called with palloc->mutex locked.
+  Detaches and returns the items to be released to the system*/
+static struct mem_block_item *pool_allocator_trim(struct pool_allocator *palloc, ci_stat_memblock_t *STATS, time_t now)
+{
+    struct mem_block_item *mem_item, *trimmed;
+    int keep, release, unaccounted;
+
+    if (now - palloc->last_trim < POOL_TRIM_INTERVAL)
+        return NULL;
+    palloc->last_trim = now;
+    release = palloc->free_low / 2;
+    palloc->free_low = palloc->free_count - release;
+    if (release <= 0)
+        return NULL;
+
+    /*The items at the end of the list are the least recently used*/
+    keep = palloc->free_count - release;
+    if (keep == 0) {
+        trimmed = palloc->free;
+        palloc->free = NULL;
+    } else {
+        for (mem_item = palloc->free; --keep > 0; mem_item = mem_item->next);
+        trimmed = mem_item->next;
+        mem_item->next = NULL;
+    }
+    palloc->free_count -= release;
+    if (STATS) {
+        unaccounted = 0;
+        for (mem_item = trimmed; mem_item != NULL; mem_item = mem_item->next) {
+            if (mem_item->flags & FL_MEM_BLOCK_UNACCOUNTED)
+                unaccounted++;
+        }
+        STAT_INT64_DEC_NL(STATS, palloc->stat_idle_id, release - unaccounted);
+    }
+    return trimmed;
+}
+
+static void mem_block_items_release(struct mem_block_item *mem_item)
+{
+    struct mem_block_item *cur;
+    while (mem_item != NULL) {
+        cur = mem_item;
+        mem_item = mem_item->next;
+        free(cur);
+    }
+}
+
+static inline int pool_magazine_capacity(const struct pool_allocator *palloc)
+{
+    if (CI_MEM_POOLS_THREAD_CACHE <= 0 || palloc->cache_id < 0)
+        return 0;
+    return CI_MEM_POOLS_THREAD_CACHE < palloc->magazine_max ? CI_MEM_POOLS_THREAD_CACHE : palloc->magazine_max;
+}
+
+static struct pool_magazine *pool_magazine_get(struct pool_allocator *palloc)
+{
+    struct mem_thread_cache *cache;
+    struct pool_magazine *mag;
+
+    if (pool_magazine_capacity(palloc) <= 0)
+        return NULL;
+
+    if (!(cache = ci_thread_key_get(ThreadCacheKey))) {
+        if (!(cache = calloc(1, sizeof(struct mem_thread_cache))))
+            return NULL;
+        ci_thread_key_set(ThreadCacheKey, cache);
+        ci_thread_mutex_lock(&PoolsRegistryMtx);
+        cache->next = ThreadCaches;
+        if (ThreadCaches)
+            ThreadCaches->prev = cache;
+        ThreadCaches = cache;
+        ci_thread_mutex_unlock(&PoolsRegistryMtx);
+    }
+
+    if (palloc->cache_id >= cache->size) {
+        int new_size = palloc->cache_id + 32;
+        /*The pool_allocator_destroy may walk the magazines array*/
+        ci_thread_mutex_lock(&PoolsRegistryMtx);
+        mag = realloc(cache->magazines, new_size * sizeof(struct pool_magazine));
+        if (!mag) {
+            ci_thread_mutex_unlock(&PoolsRegistryMtx);
+            return NULL;
+        }
+        memset(mag + cache->size, 0, (new_size - cache->size) * sizeof(struct pool_magazine));
+        cache->magazines = mag;
+        cache->size = new_size;
+        ci_thread_mutex_unlock(&PoolsRegistryMtx);
+    }
+    mag = &cache->magazines[palloc->cache_id];
+    if (!mag->palloc)
+        mag->palloc = palloc;
+    _CI_ASSERT(mag->palloc == palloc);
+    return mag;
+}
+
+/*Move the half of the magazine capacity from the pool free list to the
+  magazine*/
+static void pool_magazine_refill(struct pool_allocator *palloc, struct pool_magazine *mag)
+{
+    struct mem_block_item *mem_item;
+    int batch = pool_magazine_capacity(palloc) / 2;
+    if (batch < 1)
+        batch = 1;
+
+    ci_stat_memblock_t *STATS = pool_stats_block(palloc);
+    ci_thread_mutex_lock(&palloc->mutex);
+    while (batch > 0 && palloc->free) {
+        mem_item = palloc->free;
+        palloc->free = mem_item->next;
+        if (mem_item->flags & FL_MEM_BLOCK_UNACCOUNTED) {
+            /*Account it now as an idle item of the magazine*/
+            mem_item->flags = 0;
+            if (!palloc->disable_stats)
+                mag->idle++;
+        }
+        mem_item->next = mag->items;
+        mag->items = mem_item;
+        mag->count++;
+        palloc->free_count--;
+        batch--;
+    }
+    if (palloc->free_count < palloc->free_low)
+        palloc->free_low = palloc->free_count;
+    if (!palloc->disable_stats) {
+        mag->cache_misses++;
+        pool_magazine_stats_publish(palloc, mag, STATS);
+    }
+    ci_thread_mutex_unlock(&palloc->mutex);
+}
+
+/*Return the n least recently used items of the magazine to the pool*/
+static void pool_magazine_flush(struct pool_allocator *palloc, struct pool_magazine *mag, int n)
+{
+    struct mem_block_item *first, *last;
+    int keep;
+
+    if (n > mag->count)
+        n = mag->count;
+    if (n <= 0)
+        return;
+    keep = mag->count - n;
+    if (keep == 0) {
+        first = mag->items;
+        mag->items = NULL;
+    } else {
+        for (last = mag->items; --keep > 0; last = last->next);
+        first = last->next;
+        last->next = NULL;
+    }
+    mag->count -= n;
+    for (last = first; last->next != NULL; last = last->next);
+
+    ci_stat_memblock_t *STATS = pool_stats_block(palloc);
+    ci_thread_mutex_lock(&palloc->mutex);
+    last->next = palloc->free;
+    palloc->free = first;
+    palloc->free_count += n;
+    if (!palloc->disable_stats) {
+        mag->cache_flushes++;
+        pool_magazine_stats_publish(palloc, mag, STATS);
+    }
+    ci_thread_mutex_unlock(&palloc->mutex);
+}
+
+static void pool_magazine_sync(struct pool_allocator *palloc, struct pool_magazine *mag)
+{
+    ci_stat_memblock_t *STATS = pool_stats_block(palloc);
+    if (!STATS) {
+        mag->ops = 0;
+        return;
+    }
+    ci_thread_mutex_lock(&palloc->mutex);
+    pool_magazine_stats_publish(palloc, mag, STATS);
+    ci_thread_mutex_unlock(&palloc->mutex);
+}
+
+/*Called on thread exit, returns the cached items to their pools*/
+static void mem_thread_cache_release(void *data)
+{
+    struct mem_thread_cache *cache = (struct mem_thread_cache *)data;
+    struct pool_magazine *mag;
+    int i;
+
+    ci_thread_mutex_lock(&PoolsRegistryMtx);
+    for (i = 0; i < cache->size; i++) {
+        mag = &cache->magazines[i];
+        if (!mag->palloc)
+            continue;
+        if (i < PoolsRegistryUsed && PoolsRegistry[i] == mag->palloc) {
+            pool_magazine_flush(mag->palloc, mag, mag->count);
+            pool_magazine_sync(mag->palloc, mag);
+        } else {
+            /*The pool is destroyed*/
+            mem_block_items_release(mag->items);
+        }
+    }
+    if (cache->prev)
+        cache->prev->next = cache->next;
+    else
+        ThreadCaches = cache->next;
+    if (cache->next)
+        cache->next->prev = cache->prev;
+    ci_thread_mutex_unlock(&PoolsRegistryMtx);
+    free(cache->magazines);
+    free(cache);
+}
+
 static void *pool_allocator_alloc(ci_mem_allocator_t *allocator,size_t size)
 {
     struct mem_block_item *mem_item;
     struct pool_allocator *palloc = (struct pool_allocator *)allocator->data;
+    struct pool_magazine *mag;
 
     if (size > palloc->items_size)
         return NULL;
 
-    ci_stat_memblock_t *STATS = palloc->disable_stats ? NULL : ci_stat_memblock_get();
+    if ((mag = pool_magazine_get(palloc))) {
+        if (!mag->items)
+            pool_magazine_refill(palloc, mag);
+        if ((mem_item = mag->items)) {
+            mag->items = mem_item->next;
+            mag->count--;
+            if (!palloc->disable_stats) {
+                mag->hits++;
+                mag->cache_hits++;
+                mag->idle--;
+            }
+        } else {
+            /*The pool is empty too*/
+            if (!(mem_item = malloc(palloc->items_size + MEM_BLOCK_DATA_OFFSET)))
+                return NULL;
+            mem_item->sig = MEM_BLOCK_SIGNATURE;
+            mem_item->flags = 0;
+            if (!palloc->disable_stats) {
+                mag->allocs++;
+                /*Publish the new allocations without delay*/
+                mag->ops = MAGAZINE_SYNC_OPS;
+            }
+        }
+        mem_item->next = NULL;
+        if (!palloc->disable_stats) {
+            mag->used++;
+            if (++mag->ops >= MAGAZINE_SYNC_OPS)
+                pool_magazine_sync(palloc, mag);
+        }
+        return (void *)mem_item->data.ptr;
+    }
+
+    ci_stat_memblock_t *STATS = pool_stats_block(palloc);
     ci_thread_mutex_lock(&palloc->mutex);
     if (palloc->free) {
         mem_item = palloc->free;
         palloc->free=palloc->free->next;
+        palloc->free_count--;
+        if (palloc->free_count < palloc->free_low)
+            palloc->free_low = palloc->free_count;
         if (STATS) {
             STAT_INT64_INC_NL(STATS, palloc->stat_hits_id, 1);
             if (!(mem_item->flags & FL_MEM_BLOCK_UNACCOUNTED))
@@ -962,12 +1360,33 @@ static void pool_allocator_free(ci_mem_allocator_t *allocator,void *p)
 {
     struct mem_block_item *mem_item;
     struct pool_allocator *palloc = (struct pool_allocator *)allocator->data;
+    struct pool_magazine *mag;
+    int capacity;
 
-    ci_stat_memblock_t *STATS = palloc->disable_stats ? NULL : ci_stat_memblock_get();
-    ci_thread_mutex_lock(&palloc->mutex);
     mem_item = (struct mem_block_item *)(p - MEM_BLOCK_DATA_OFFSET);
+    if ((mag = pool_magazine_get(palloc))) {
+        if (!palloc->disable_stats) {
+            mag->idle++;
+            if (!(mem_item->flags & FL_MEM_BLOCK_UNACCOUNTED))
+                mag->used--;
+            mem_item->flags = 0;
+        }
+        mem_item->next = mag->items;
+        mag->items = mem_item;
+        mag->count++;
+        capacity = pool_magazine_capacity(palloc);
+        if (mag->count >= capacity)
+            pool_magazine_flush(palloc, mag, mag->count - capacity / 2);
+        else if (!palloc->disable_stats && ++mag->ops >= MAGAZINE_SYNC_OPS)
+            pool_magazine_sync(palloc, mag);
+        return;
+    }
+
+    ci_stat_memblock_t *STATS = pool_stats_block(palloc);
+    ci_thread_mutex_lock(&palloc->mutex);
     mem_item->next = palloc->free;
     palloc->free = mem_item;
+    palloc->free_count++;
     if (STATS) {
         STAT_INT64_INC_NL(STATS, palloc->stat_idle_id, 1);
         if (!(mem_item->flags & FL_MEM_BLOCK_UNACCOUNTED))
@@ -982,7 +1401,7 @@ static void pool_allocator_reset(ci_mem_allocator_t *allocator)
 {
     struct mem_block_item *mem_item, *cur;
     struct pool_allocator *palloc = (struct pool_allocator *)allocator->data;
-    ci_stat_memblock_t *STATS = palloc->disable_stats ? NULL : ci_stat_memblock_get();
+    ci_stat_memblock_t *STATS = pool_stats_block(palloc);
     ci_thread_mutex_lock(&palloc->mutex);
     if (palloc->free) {
         int freed = 0;
@@ -997,14 +1416,32 @@ static void pool_allocator_reset(ci_mem_allocator_t *allocator)
             STAT_INT64_DEC_NL(STATS, palloc->stat_idle_id, freed);
     }
     palloc->free = NULL;
+    palloc->free_count = 0;
+    palloc->free_low = 0;
     ci_thread_mutex_unlock(&palloc->mutex);
 }
 
 
 static void pool_allocator_destroy(ci_mem_allocator_t *allocator)
 {
-    pool_allocator_reset(allocator);
     struct pool_allocator *palloc = (struct pool_allocator *)allocator->data;
+    struct mem_thread_cache *cache;
+    struct pool_magazine *mag;
+    if (palloc->cache_id >= 0) {
+        /*Release the items cached by all threads. The pool must not be
+          used by any thread while it is destroyed.*/
+        ci_thread_mutex_lock(&PoolsRegistryMtx);
+        PoolsRegistry[palloc->cache_id] = NULL;
+        for (cache = ThreadCaches; cache != NULL; cache = cache->next) {
+            if (palloc->cache_id >= cache->size)
+                continue;
+            mag = &cache->magazines[palloc->cache_id];
+            mem_block_items_release(mag->items);
+            memset(mag, 0, sizeof(struct pool_magazine));
+        }
+        ci_thread_mutex_unlock(&PoolsRegistryMtx);
+    }
+    pool_allocator_reset(allocator);
     ci_thread_mutex_destroy(&palloc->mutex);
     free(palloc->name);
     free(palloc);
@@ -1030,3 +1467,27 @@ ci_mem_allocator_t *ci_create_pool_allocator(const char *name, int items_size)
     allocator->must_free = 1;
     return allocator;
 }
+
+void ci_mem_pools_trim()
+{
+    struct pool_allocator *palloc;
+    struct mem_block_item *trimmed;
+    ci_stat_memblock_t *STATS;
+    time_t now;
+    int i;
+
+    if (!PoolsRegistryInitialized)
+        return;
+    now = time(NULL);
+    ci_thread_mutex_lock(&PoolsRegistryMtx);
+    for (i = 0; i < PoolsRegistryUsed; i++) {
+        if (!(palloc = PoolsRegistry[i]))
+            continue;
+        STATS = pool_stats_block(palloc);
+        ci_thread_mutex_lock(&palloc->mutex);
+        trimmed = pool_allocator_trim(palloc, STATS, now);
+        ci_thread_mutex_unlock(&palloc->mutex);
+        mem_block_items_release(trimmed);
+    }
+    ci_thread_mutex_unlock(&PoolsRegistryMtx);
+}
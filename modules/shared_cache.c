@@ -3,20 +3,40 @@
 #include "commands.h"
 #include "debug.h"
 #include "cache.h"
+#include "cfg_param.h"
 #include "module.h"
 #include "proc_mutex.h"
 #include "shared_mem.h"
 #include <assert.h>
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+/*
+  Readers do not lock. Every slot carries a version number which the
+  writer makes odd while it modifies the slot and even again when it is
+  done. A reader copies the slot data and retries if the version was odd
+  or changed while copying (seqlock). Only the writers serialize on the
+  page mutexes.
+*/
+#define SHARED_CACHE_LOCKLESS_READERS 1
+#endif
 
 static int init_shared_cache(struct ci_server_conf *server_conf);
 static void release_shared_cache();
 
+/*The number of the pages, a power of 2 equal or less than 64*/
+int SHARED_CACHE_PAGES = 16;
+
+static struct ci_conf_entry scache_conf_variables[] = {
+    {"pages", &SHARED_CACHE_PAGES, ci_cfg_set_int, NULL},
+    {NULL, NULL, NULL, NULL}
+};
+
 static common_module_t scache_module = {
     "shared_cache",
     init_shared_cache,
     NULL,
     release_shared_cache,
-    NULL,
+    scache_conf_variables,
 };
 _CI_DECLARE_COMMON_MODULE(scache_module);
 
@@ -44,18 +64,26 @@ struct ci_cache_type ci_shared_cache = {
     "shared"
 };
 
-/*Should be power of 2 and equal or less than 64*/
-#define CACHE_PAGES 4
+#define CACHE_MAX_PAGES 64
+/*Maximum retries of a reader while a writer modifies the slot*/
+#define CACHE_READ_RETRIES 1000
+#define CACHE_LINE_SIZE 64
+/*The searches copy the slots of up to this size to a stack buffer*/
+#define CACHE_SEARCH_STACK_BUF 4096
+
+/*For debugging reasons, how the pages are used.*/
+struct page_stats {
+    _CI_ATOMIC_TYPE uint64_t hits;
+    _CI_ATOMIC_TYPE uint64_t searches;
+    _CI_ATOMIC_TYPE uint64_t updates;
+    _CI_ATOMIC_TYPE uint64_t update_hits;
+    /*Children update the counters of different pages without sharing cache lines*/
+    char pad[CACHE_LINE_SIZE - 4 * sizeof(uint64_t)];
+};
 
 struct shared_cache_stats {
     _CI_ATOMIC_TYPE int cache_users;
-    /*For debugging reasons, how the pages are used.*/
-    struct page_stats {
-        int64_t hits;
-        int64_t searches;
-        int64_t updates;
-        int64_t update_hits;
-    } page[CACHE_PAGES];
+    struct page_stats page[];
 };
 
 struct shared_cache_data {
@@ -69,8 +97,9 @@ struct shared_cache_data {
     int pages;
     int page_size;
     int page_shift_op;
+    size_t stats_size;
     struct shared_cache_stats *stats;
-    ci_proc_mutex_t mutex[CACHE_PAGES];
+    ci_proc_mutex_t *mutex;
 
     int stat_failures;
     int stat_hit;
@@ -79,6 +108,7 @@ struct shared_cache_data {
 };
 
 struct shared_cache_slot {
+    _CI_ATOMIC_TYPE uint32_t version;
     unsigned int hash;
     time_t expires;
     size_t key_size;
@@ -120,7 +150,7 @@ void command_attach_shared_mem(const char *name, int type, void *data)
     struct shared_cache_data *shared_cache = (struct shared_cache_data *)data;
     shared_cache->mem_ptr = ci_shared_mem_attach(&shared_cache->id);
     shared_cache->stats = (struct shared_cache_stats *)shared_cache->mem_ptr;
-    shared_cache->slots = (void *)(shared_cache->mem_ptr + sizeof(struct shared_cache_stats));
+    shared_cache->slots = (void *)(shared_cache->mem_ptr + shared_cache->stats_size);
     ci_debug_printf(3, "Shared cache id:'%s' attached on address %p\n", ci_shared_mem_print_id(buf, sizeof(buf), &shared_cache->id), shared_cache->mem_ptr);
     ci_atomic_add_i32_gl(&shared_cache->stats->cache_users, 1);
 }
@@ -132,6 +162,10 @@ int ci_shared_cache_init(struct ci_cache *cache, const char *name)
     int i;
     struct shared_cache_data *data;
     data = (struct shared_cache_data *)malloc(sizeof(struct shared_cache_data));
+    if (!data) {
+        ci_debug_printf(1, "Error allocating memory for %s cache\n", name);
+        return 0;
+    }
     data->entry_size = _CI_ALIGN(cache->max_object_size > 0 ? cache->max_object_size : 1);
     data->entries = _CI_ALIGN(cache->mem_size) / data->entry_size;
 
@@ -143,7 +177,11 @@ int ci_shared_cache_init(struct ci_cache *cache, const char *name)
 
     data->max_hash = final_max_hash;
     data->entries = final_max_hash + 1;
-    data->shared_mem_size = sizeof(struct shared_cache_stats) + data->entries * data->entry_size;
+
+    /* The pages should be a power of 2, and no more than the entries (at least 64)*/
+    for (data->pages = 1; data->pages * 2 <= SHARED_CACHE_PAGES && data->pages < CACHE_MAX_PAGES; data->pages *= 2);
+    data->stats_size = _CI_ALIGN(sizeof(struct shared_cache_stats) + data->pages * sizeof(struct page_stats));
+    data->shared_mem_size = data->stats_size + data->entries * data->entry_size;
 
     data->mem_ptr = ci_shared_mem_create(&data->id, name, data->shared_mem_size);
     if (!data->mem_ptr) {
@@ -152,26 +190,31 @@ int ci_shared_cache_init(struct ci_cache *cache, const char *name)
         return 0;
     }
     data->stats = (struct shared_cache_stats *)data->mem_ptr;
-    data->slots = data->mem_ptr + sizeof(struct shared_cache_stats);
-    memset(data->stats, 0, sizeof(struct shared_cache_stats));
+    data->slots = data->mem_ptr + data->stats_size;
+    memset(data->stats, 0, data->stats_size);
     data->stats->cache_users = 1;
 
-    /*TODO: check for error*/
-    for (i = 0; i < CACHE_PAGES; ++i) {
+    data->mutex = malloc(data->pages * sizeof(ci_proc_mutex_t));
+    if (!data->mutex) {
+        ci_shared_mem_destroy(&data->id);
+        free(data);
+        ci_debug_printf(1, "Error allocating the page mutexes for %s cache\n", name);
+        return 0;
+    }
+    for (i = 0; i < data->pages; ++i) {
         ci_proc_mutex_init(&(data->mutex[i]), name);
     }
 
-    data->page_size = data->entries / CACHE_PAGES;
-    /* CACHE_PAGES can not be bigger than 64, the minimum entries value*/
+    data->page_size = data->entries / data->pages;
+    /* The pages can not be more than 64, the minimum entries value*/
     assert(data->entries % data->page_size == 0);
-    data->pages = CACHE_PAGES;
     /* The pages and page_size should be a power of 2*/
     assert((data->pages & (data->pages - 1)) == 0);
     assert((data->page_size & (data->page_size - 1)) == 0);
     for (data->page_shift_op = 0; ((data->page_size >> data->page_shift_op) & 0x1) ==0 && data->page_shift_op < 64; ++data->page_shift_op );
     assert(data->page_shift_op < 64);
 
-    ci_debug_printf(1, "Shared mem %s created\nMax shared memory: %u (of the %u requested), max entry size: %u, maximum entries: %u\n", name, (unsigned int)data->shared_mem_size, (unsigned int)cache->mem_size, (unsigned int)data->entry_size, data->entries);
+    ci_debug_printf(1, "Shared mem %s created\nMax shared memory: %u (of the %u requested), max entry size: %u, maximum entries: %u, pages: %d\n", name, (unsigned int)data->shared_mem_size, (unsigned int)cache->mem_size, (unsigned int)data->entry_size, data->entries, data->pages);
 
     char buf[512];
     snprintf(buf, sizeof(buf), "shared_cache(%s)_errors", name);
@@ -210,62 +253,131 @@ time_t ci_internal_time()
     return time(NULL);
 }
 
+static void slot_write_begin(struct shared_cache_slot *slot)
+{
+#if defined(SHARED_CACHE_LOCKLESS_READERS)
+    /*The version is already odd if the previous writer crashed*/
+    uint32_t version = atomic_load_explicit(&slot->version, memory_order_relaxed);
+    atomic_store_explicit(&slot->version, version | 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+#endif
+}
+
+static void slot_write_end(struct shared_cache_slot *slot)
+{
+#if defined(SHARED_CACHE_LOCKLESS_READERS)
+    uint32_t version = atomic_load_explicit(&slot->version, memory_order_relaxed);
+    atomic_store_explicit(&slot->version, version + 1, memory_order_release);
+#endif
+}
+
+/*
+  Copies the key and value stored in slot to the buf, which should be
+  of entry_size bytes. Returns 1 if the slot holds an entry for the hash,
+  0 if it does not and -1 if the slot could not be read because it is
+  continuously modified.
+*/
+static int slot_read(struct shared_cache_data *cache_data, struct shared_cache_slot *slot, unsigned int hash, struct shared_cache_slot *hdr, void *buf)
+{
+    int ret;
+#if defined(SHARED_CACHE_LOCKLESS_READERS)
+    uint32_t version;
+    int retries;
+    for (retries = 0; retries < CACHE_READ_RETRIES; ++retries) {
+        version = atomic_load_explicit(&slot->version, memory_order_acquire);
+        if (version & 1)
+            continue;
+#endif
+        hdr->hash = slot->hash;
+        hdr->expires = slot->expires;
+        hdr->key_size = slot->key_size;
+        hdr->value_size = slot->value_size;
+        ret = 0;
+        if (hdr->hash == hash &&
+            (sizeof(struct shared_cache_slot) + hdr->key_size + 1 + hdr->value_size) <= cache_data->entry_size) {
+            memcpy(buf, slot->bytes, hdr->key_size + 1 + hdr->value_size);
+            ret = 1;
+        }
+#if defined(SHARED_CACHE_LOCKLESS_READERS)
+        atomic_thread_fence(memory_order_acquire);
+        if (version == atomic_load_explicit(&slot->version, memory_order_relaxed))
+            return ret;
+    }
+    return -1;
+#else
+    return ret;
+#endif
+}
+
 const void *ci_shared_cache_search(struct ci_cache *cache, const void *key, void **val, void *user_data, void *(*dup_from_cache)(const void *stored_val, size_t stored_val_size, void *user_data))
 {
-    time_t current_time;
-    const void *cache_key, *cache_val;
+    struct shared_cache_slot hdr;
+    char stack_buf[CACHE_SEARCH_STACK_BUF];
+    char *buf;
+    int ret, found;
     struct shared_cache_data *cache_data = cache->cache_data;
     unsigned int hash = ci_hash_compute(cache_data->max_hash, key, cache->key_ops->size(key));
     *val = NULL;
     if (hash >= cache_data->entries)
         hash = cache_data->entries -1;
 
+    /*The value is copied to a new buffer only when it is found*/
+    if (cache_data->entry_size <= sizeof(stack_buf))
+        buf = stack_buf;
+    else if (!(buf = ci_buffer_alloc(cache_data->entry_size))) {
+        ci_stat_uint64_inc(cache_data->stat_failures, 1);
+        return NULL;
+    }
+
+#if !defined(SHARED_CACHE_LOCKLESS_READERS)
     if (!rd_lock_page(cache_data, hash)) {
         ci_stat_uint64_inc(cache_data->stat_failures, 1);
+        if (buf != stack_buf)
+            ci_buffer_free(buf);
         return NULL;
     }
+#endif
     unsigned int page = (hash >> cache_data->page_shift_op);
-    ++cache_data->stats->page[page].searches;
+    ci_atomic_add_u64_gl(&cache_data->stats->page[page].searches, 1);
     unsigned int pos;
-    int done;
-    for (pos = hash, done = 0, cache_key = NULL;
-            !cache_key && !done && ((pos >> cache_data->page_shift_op) == page);
+    for (pos = hash, found = 0, ret = 1;
+            !found && ret > 0 && ((pos >> cache_data->page_shift_op) == page);
             ++pos) {
         struct shared_cache_slot *slot = cache_data->slots + (pos * cache_data->entry_size);
-        cache_key = (const void *)slot->bytes;
-        cache_val = (const void *)(&slot->bytes[slot->key_size + 1]);
-
-        if (slot->hash != hash) {
-            cache_key = NULL;
-            done = 1;
-        } else if (cache->key_ops->compare(cache_key, key) == 0) {
-            current_time = ci_internal_time();
-            if (slot->expires < current_time)
-                cache_key = NULL;
-            else if (slot->value_size) {
-                if (dup_from_cache)
-                    *val = (*dup_from_cache)(cache_val, slot->value_size, user_data);
-                else {
-                    if ((*val = ci_buffer_alloc(slot->value_size)))
-                        memcpy(*val, cache_val, slot->value_size);
-                }
-            }
-        } else
-            cache_key = NULL;
+        ret = slot_read(cache_data, slot, hash, &hdr, buf);
+        if (ret > 0 && cache->key_ops->compare(buf, key) == 0)
+            found = 1;
     }
+#if !defined(SHARED_CACHE_LOCKLESS_READERS)
+    unlock_page(cache_data, hash);
+#endif
 
-    if (cache_key)
-        ++cache_data->stats->page[page].hits;
+    if (ret < 0)
+        ci_stat_uint64_inc(cache_data->stat_failures, 1);
 
-    unlock_page(cache_data, hash);
+    if (found && hdr.expires < ci_internal_time())
+        found = 0;
+
+    if (found && hdr.value_size) {
+        if (dup_from_cache)
+            *val = (*dup_from_cache)(buf + hdr.key_size + 1, hdr.value_size, user_data);
+        else if ((*val = ci_buffer_alloc(hdr.value_size)))
+            memcpy(*val, buf + hdr.key_size + 1, hdr.value_size);
+        else {
+            ci_stat_uint64_inc(cache_data->stat_failures, 1);
+            found = 0;
+        }
+    }
 
-    if (cache_key)
+    if (found) {
+        ci_atomic_add_u64_gl(&cache_data->stats->page[page].hits, 1);
         ci_stat_uint64_inc(cache_data->stat_hit, 1);
-    else
+    } else
         ci_stat_uint64_inc(cache_data->stat_miss, 1);
 
-
-    return cache_key;
+    if (buf != stack_buf)
+        ci_buffer_free(buf);
+    return found ? key : NULL;
 }
 
 int ci_shared_cache_update(struct ci_cache *cache, const void *key, const void *val, size_t val_size, void *(*copy_to_cache)(void *buf, const void *val, size_t buf_size))
@@ -276,7 +388,7 @@ int ci_shared_cache_update(struct ci_cache *cache, const void *key, const void *
     int ret, can_updated;
     struct shared_cache_data *cache_data = cache->cache_data;
     key_size = cache->key_ops->size(key);
-    if ((key_size + val_size + sizeof(struct shared_cache_slot)) > cache_data->entry_size) {
+    if ((key_size + 1 + val_size + sizeof(struct shared_cache_slot)) > cache_data->entry_size) {
         /*Does not fit to a cache_data slot.*/
         return 0;
     }
@@ -294,7 +406,7 @@ int ci_shared_cache_update(struct ci_cache *cache, const void *key, const void *
     }
 
     unsigned int page = (hash >> cache_data->page_shift_op);
-    ++cache_data->stats->page[page].updates;
+    ci_atomic_add_u64_gl(&cache_data->stats->page[page].updates, 1);
 
     unsigned int pos;
     int done;
@@ -320,6 +432,7 @@ int ci_shared_cache_update(struct ci_cache *cache, const void *key, const void *
             done = 1;
         }
         if (can_updated) {
+            slot_write_begin(slot);
             slot->hash = pos;
             slot->expires = expire_time;
             slot->key_size = key_size;
@@ -332,8 +445,9 @@ int ci_shared_cache_update(struct ci_cache *cache, const void *key, const void *
                 else
                     memcpy(cache_val, val, slot->value_size);
             }
+            slot_write_end(slot);
             ret = 1;
-            ++cache_data->stats->page[page].update_hits;
+            ci_atomic_add_u64_gl(&cache_data->stats->page[page].update_hits, 1);
         } else
             ret = 0;
     }
@@ -347,20 +461,26 @@ int ci_shared_cache_update(struct ci_cache *cache, const void *key, const void *
 void ci_shared_cache_destroy(struct ci_cache *cache)
 {
     int i;
+    uint64_t updates, update_hits, searches, hits;
     struct shared_cache_data *data = cache->cache_data;
     int users = ci_atomic_fetch_sub_i32_gl(&data->stats->cache_users, 1);
     assert(users > 0);
     if (users == 1) {
         ci_debug_printf(3, "Last user, the cache will be destroyed\n");
-        for (i = 0; i < CACHE_PAGES; ++i) {
+        for (i = 0; i < data->pages; ++i) {
+            ci_atomic_load_u64_gl(&data->stats->page[i].updates, &updates);
+            ci_atomic_load_u64_gl(&data->stats->page[i].update_hits, &update_hits);
+            ci_atomic_load_u64_gl(&data->stats->page[i].searches, &searches);
+            ci_atomic_load_u64_gl(&data->stats->page[i].hits, &hits);
             ci_debug_printf(3, "Cache page %d updates: %" PRIu64 ", update hits:%" PRIu64 ", searches: %" PRIu64 ", hits: %" PRIu64 "\n", i,
-                            data->stats->page[i].updates, data->stats->page[i].update_hits, data->stats->page[i].searches, data->stats->page[i].hits
-                );
+                            updates, update_hits, searches, hits);
         }
         ci_shared_mem_destroy(&data->id);
-        for (i = 0; i < CACHE_PAGES; ++i) {
+        for (i = 0; i < data->pages; ++i) {
             ci_proc_mutex_destroy(&data->mutex[i]);
         }
     } else
         ci_shared_mem_detach(&data->id);
+    free(data->mutex);
+    free(data);
 }
@@ -46,6 +46,7 @@ static int FACILITY = LOG_DAEMON;
 static int ACCESS_PRIORITY = LOG_INFO;
 static int SERVER_PRIORITY = LOG_CRIT;
 char *syslog_logformat = "%la %a %im %iu %is";
+static ci_fmt_program_t *syslog_logprog = NULL;
 static ci_access_entry_t *syslog_access_list = NULL;
 
 
@@ -169,12 +170,17 @@ int cfg_syslog_logformat(const char *directive, const char **argv, void *setdata
 int sys_log_open()
 {
     openlog(log_ident, 0, FACILITY);
+    if (syslog_logformat)
+        syslog_logprog = ci_format_compile(syslog_logformat, NULL);
     return 1;
 }
 
 void sys_log_close()
 {
     closelog();
+    if (syslog_logprog)
+        ci_format_program_release(syslog_logprog);
+    syslog_logprog = NULL;
     if (syslog_access_list)
         ci_access_entry_release(syslog_access_list);
     syslog_access_list = NULL;
@@ -193,7 +199,10 @@ void sys_log_access(ci_request_t *req)
         return;
     }
 
-    ci_format_text(req, syslog_logformat, logline, 1024, NULL);
+    if (syslog_logprog)
+        ci_format_program_text(req, syslog_logprog, logline, sizeof(logline));
+    else
+        ci_format_text(req, syslog_logformat, logline, sizeof(logline), NULL);
 
     syslog(ACCESS_PRIORITY, "%s\n", logline);
 }
@@ -36,6 +36,9 @@
 #else
 #include <sys/select.h>
 #endif
+#if defined(HAVE_EPOLL)
+#include <sys/epoll.h>
+#endif
 #include <assert.h>
 #include "acl.h"
 #include "atomic.h"
@@ -54,11 +57,21 @@
 #include "commands.h"
 #include "util.h"
 #include "ci_regex.h"
+#include "mem.h"
 
 extern int MAX_KEEPALIVE_REQUESTS;
 extern int MAX_SECS_TO_LINGER;
 extern int MAX_REQUESTS_BEFORE_REALLOCATE_MEM;
 extern int MAX_REQUESTS_PER_CHILD;
+extern int TIMEOUT;
+extern int KEEPALIVE_TIMEOUT;
+extern int PIPELINING;
+#if defined(HAVE_EPOLL)
+extern int EVENT_DRIVEN_CONNECTIONS;
+#endif
+#if defined(SO_REUSEPORT)
+extern int REUSE_PORT;
+#endif
 extern struct ci_server_conf CI_CONF;
 
 typedef struct server_decl {
@@ -84,6 +97,9 @@ child_shared_data_t *child_data = NULL;
 struct connections_queue *con_queue;
 process_pid_t MY_PROC_PID = 0;
 static ci_stat_memblock_t *STATS = NULL;
+static int STAT_ACCEPTED_CONNECTIONS = -1;
+static int STAT_CHILD_PRIVATE_MEMORY = -1;
+static int STAT_CHILD_SHARED_MEMORY = -1;
 /*Child shutdown timeout is 10 seconds:*/
 const int CHILD_SHUTDOWN_TIMEOUT = 10;
 int CHILD_HALT = 0;
@@ -91,6 +107,41 @@ int CHILD_HALT = 0;
 /*Interprocess accepting mutex ....*/
 ci_proc_mutex_t accept_mutex;
 
+#if defined(HAVE_EPOLL)
+/*
+  The connections parked in the child epoll reactor, while waiting for
+  client data. They are kept in FIFO lists, one per timeout, so the head
+  of each list is always the first connection to expire.
+*/
+typedef struct parked_connection {
+    struct connections_queue_item item;
+    time_t expires;
+    struct parked_list *list;
+    struct parked_connection *prev;
+    struct parked_connection *next;
+} parked_connection_t;
+
+struct parked_list {
+    parked_connection_t *head;
+    parked_connection_t *tail;
+};
+
+#define REACTOR_MAX_EVENTS 256
+/*Many parked connections may become ready at once, allow a long queue*/
+#define REACTOR_MAX_QUEUED_CONNECTIONS 16384
+static int reactor_fd = -1;
+static int reactor_running = 0;
+static ci_thread_t reactor_thread_id;
+static ci_thread_mutex_t parked_mtx;
+static int parked_mtx_initialized = 0;
+static struct parked_list parked_new = {NULL, NULL}; /*accepted, expire after TIMEOUT*/
+static struct parked_list parked_idle = {NULL, NULL}; /*keep-alive, expire after KEEPALIVE_TIMEOUT*/
+static int STAT_PARKED_CONNECTIONS = -1;
+static int STAT_PARKED_TIMEOUTS = -1;
+static void reactor_stop();
+static void reactor_release();
+#endif
+
 /*Main proccess variables*/
 int c_icap_going_to_term = 0;
 int c_icap_reconfigure = 0;
@@ -241,6 +292,12 @@ static void cancel_all_threads()
         /*fuck the listener! going down ..... */
     }
 
+#if defined(HAVE_EPOLL)
+    /*The reactor queues or closes the parked connections and exits
+      within a second*/
+    reactor_stop();
+#endif
+
     /*We are going to interupt the waiting for queue childs.
        We are going to wait threads which serve a request. */
     ci_thread_cond_broadcast(&(con_queue->queue_cond));
@@ -272,6 +329,9 @@ static void cancel_all_threads()
             }/*the i thread is still alive*/
         } /* for(i=0;i< CI_CONF.THREADS_PER_CHILD;i++)*/
 
+        /*The listener may still run, wake up the servers waiting for it*/
+        ci_thread_cond_broadcast(&(con_queue->queue_cond));
+
         /*wait for 1 second for the next round*/
         ci_usleep(999999);
 
@@ -289,6 +349,9 @@ static void cancel_all_threads()
     } else {
         ci_debug_printf(5, "All servers canceled\n");
         free(threads_list);
+#if defined(HAVE_EPOLL)
+        reactor_release();
+#endif
     }
 }
 
@@ -554,6 +617,247 @@ void handle_child_process_commands(char *cmd_line)
 /*************************************************************************************/
 /*Children  functions                                                                  */
 
+#if defined(HAVE_EPOLL)
+static void parked_list_append(struct parked_list *list, parked_connection_t *pc)
+{
+    pc->list = list;
+    pc->next = NULL;
+    pc->prev = list->tail;
+    if (list->tail)
+        list->tail->next = pc;
+    else
+        list->head = pc;
+    list->tail = pc;
+}
+
+static void parked_list_remove(parked_connection_t *pc)
+{
+    struct parked_list *list = pc->list;
+    if (pc->prev)
+        pc->prev->next = pc->next;
+    else
+        list->head = pc->next;
+    if (pc->next)
+        pc->next->prev = pc->prev;
+    else
+        list->tail = pc->prev;
+    pc->list = NULL;
+    pc->prev = pc->next = NULL;
+}
+
+/*
+  Add the connection to the reactor. The reactor passes it to the
+  connections queue when client data arrive, or closes it after 'timeout'
+  seconds. Returns 0 if the connection can not be parked and must be
+  handled by the caller.
+*/
+static int park_connection(struct connections_queue_item *con, int timeout, struct parked_list *list)
+{
+    parked_connection_t *pc;
+    struct epoll_event ev;
+
+#if defined(USE_OPENSSL)
+    if (ci_connection_is_tls((&con->conn)) && ci_connection_read_pending_tls(&con->conn) > 0)
+        return 0; /*Data already read, epoll will not inform us*/
+#endif
+    if (!(pc = malloc(sizeof(parked_connection_t))))
+        return 0;
+    ci_copy_connection(&pc->item.conn, &con->conn);
+    pc->item.proto = con->proto;
+    pc->item.access_type = con->access_type;
+    pc->item.keepalive_reqs = con->keepalive_reqs;
+    pc->expires = time(NULL) + timeout;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = pc;
+    /*Add to list and to epoll set under lock, the reactor may expire it*/
+    ci_thread_mutex_lock(&parked_mtx);
+    if (!reactor_running) {
+        ci_thread_mutex_unlock(&parked_mtx);
+        free(pc);
+        return 0;
+    }
+    parked_list_append(list, pc);
+    if (epoll_ctl(reactor_fd, EPOLL_CTL_ADD, con->conn.fd, &ev) < 0) {
+        parked_list_remove(pc);
+        ci_thread_mutex_unlock(&parked_mtx);
+        ci_debug_printf(1, "Error %d adding connection to epoll set\n", errno);
+        free(pc);
+        return 0;
+    }
+    ci_atomic_add_i32(&(child_data->parked_connections), 1);
+    ci_thread_mutex_unlock(&parked_mtx);
+    if (STAT_PARKED_CONNECTIONS >= 0)
+        STAT_INT64_INC(STATS, STAT_PARKED_CONNECTIONS, 1);
+    return 1;
+}
+
+/*Park an idle keep-alive connection, the request must be completely served*/
+static int park_keepalive_connection(ci_request_t *req, int keepalive_reqs)
+{
+    struct connections_queue_item con;
+    if (PIPELINING && req->pstrblock_read && req->pstrblock_read_len > 0)
+        return 0; /*Pipelined request data already read, serve them now*/
+
+    ci_copy_connection(&con.conn, req->connection);
+    con.proto = req->protocol;
+    con.access_type = req->access_type;
+    con.keepalive_reqs = keepalive_reqs;
+    if (!park_connection(&con, KEEPALIVE_TIMEOUT, &parked_idle))
+        return 0;
+    /*The connection is owned by reactor now*/
+    ci_connection_reset(req->connection);
+    ci_request_reset(req);
+    return 1;
+}
+
+/*Must called with parked_mtx locked*/
+static void parked_connection_close(parked_connection_t *pc)
+{
+    parked_list_remove(pc);
+    epoll_ctl(reactor_fd, EPOLL_CTL_DEL, pc->item.conn.fd, NULL);
+    ci_connection_hard_close(&pc->item.conn);
+    ci_atomic_sub_i32(&(child_data->parked_connections), 1);
+    free(pc);
+}
+
+/*Check if the peer closed the connection without sending any data*/
+static int parked_connection_eof(parked_connection_t *pc, uint32_t events)
+{
+    char c;
+    if (!(events & EPOLLIN))
+        return 1; /*Error or hangup*/
+    if (!(events & EPOLLRDHUP))
+        return 0;
+#if defined(USE_OPENSSL)
+    if (ci_connection_is_tls((&pc->item.conn)))
+        return 0; /*Let the TLS layer handle it*/
+#endif
+    return (recv(pc->item.conn.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) <= 0);
+}
+
+static void parked_list_expire(struct parked_list *list, time_t now)
+{
+    while (list->head && (now == 0 || list->head->expires <= now)) {
+        if (now != 0 && STAT_PARKED_TIMEOUTS >= 0)
+            STAT_INT64_INC(STATS, STAT_PARKED_TIMEOUTS, 1);
+        parked_connection_close(list->head);
+    }
+}
+
+/*Must called with parked_mtx locked*/
+static void parked_list_to_queue(struct parked_list *list)
+{
+    parked_connection_t *pc;
+    while ((pc = list->head) != NULL) {
+        parked_list_remove(pc);
+        epoll_ctl(reactor_fd, EPOLL_CTL_DEL, pc->item.conn.fd, NULL);
+        ci_atomic_sub_i32(&(child_data->parked_connections), 1);
+        if (put_to_queue(con_queue, &pc->item) <= 0) {
+            ci_debug_printf(5, "Connections queue full, drop parked connection\n");
+            ci_connection_hard_close(&pc->item.conn);
+        }
+        free(pc);
+    }
+}
+
+void reactor_thread(void *unused)
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    parked_connection_t *pc;
+    int i, n;
+    thread_signals(0);
+    while (!child_data->to_be_killed) {
+        n = epoll_wait(reactor_fd, events, REACTOR_MAX_EVENTS, 1000);
+        if (n < 0 && errno != EINTR) {
+            ci_debug_printf(1, "Error %d while waiting for epoll events, stop parking connections\n", errno);
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            pc = (parked_connection_t *)events[i].data.ptr;
+            ci_thread_mutex_lock(&parked_mtx);
+            if (parked_connection_eof(pc, events[i].events)) {
+                /*Error or closed by client without sending data*/
+                parked_connection_close(pc);
+                ci_thread_mutex_unlock(&parked_mtx);
+                continue;
+            }
+            parked_list_remove(pc);
+            epoll_ctl(reactor_fd, EPOLL_CTL_DEL, pc->item.conn.fd, NULL);
+            ci_atomic_sub_i32(&(child_data->parked_connections), 1);
+            ci_thread_mutex_unlock(&parked_mtx);
+            if (put_to_queue(con_queue, &pc->item) <= 0) {
+                ci_debug_printf(5, "Connections queue full, drop parked connection\n");
+                ci_connection_hard_close(&pc->item.conn);
+            }
+            free(pc);
+        }
+        ci_thread_mutex_lock(&parked_mtx);
+        time_t now = time(NULL);
+        parked_list_expire(&parked_new, now);
+        parked_list_expire(&parked_idle, now);
+        ci_thread_mutex_unlock(&parked_mtx);
+    }
+
+    ci_thread_mutex_lock(&parked_mtx);
+    /*
+      Going down. The accepted connections did not send their request yet,
+      pass them to the servers which serve them before exit, as they do for
+      the connections in queue. Close the idle keep-alive connections.
+      The reactor_running is cleared last, the servers keep waiting for
+      connections while it is set.
+    */
+    parked_list_to_queue(&parked_new);
+    parked_list_expire(&parked_idle, 0);
+    reactor_running = 0;
+    ci_thread_mutex_unlock(&parked_mtx);
+}
+
+static int reactor_start()
+{
+    int ret;
+    /*The workers may try to park connections even if the reactor
+      is not running, the mutex lives until all workers are joined*/
+    ci_thread_mutex_init(&parked_mtx);
+    parked_mtx_initialized = 1;
+    if ((reactor_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        ci_debug_printf(1, "Error %d creating epoll instance, event driven connections disabled\n", errno);
+        return 0;
+    }
+    reactor_running = 1;
+    ret = ci_thread_create(&reactor_thread_id, (void *(*)(void *)) reactor_thread, NULL);
+    if (ret != 0) {
+        reactor_running = 0;
+        close(reactor_fd);
+        reactor_fd = -1;
+        return 0;
+    }
+    return 1;
+}
+
+static void reactor_stop()
+{
+    if (reactor_fd < 0)
+        return;
+    ci_thread_join(reactor_thread_id);
+    /*The reactor_running is 0 now, no more connections are parked*/
+    ci_thread_mutex_lock(&parked_mtx);
+    close(reactor_fd);
+    reactor_fd = -1;
+    ci_thread_mutex_unlock(&parked_mtx);
+}
+
+/*Must called after all worker threads are joined*/
+static void reactor_release()
+{
+    if (!parked_mtx_initialized)
+        return;
+    ci_thread_mutex_destroy(&parked_mtx);
+    parked_mtx_initialized = 0;
+}
+#endif
+
 server_decl_t *newthread(struct connections_queue *con_queue)
 {
     server_decl_t *serv;
@@ -568,12 +872,28 @@ server_decl_t *newthread(struct connections_queue *con_queue)
     return serv;
 }
 
+/*
+  While going down gracefully the listener, which drains the child own
+  SO_REUSEPORT sockets, and the reactor may still pass connections to the
+  servers, they must wait for them before exit.
+*/
+static int connections_producers_running()
+{
+    if (listener_running)
+        return 1;
+#if defined(HAVE_EPOLL)
+    if (reactor_running)
+        return 1;
+#endif
+    return 0;
+}
+
 int thread_main(server_decl_t * srv)
 {
     struct connections_queue_item con;
     char clientname[CI_MAXHOSTNAMELEN + 1];
     int ret, request_status = CI_NO_STATUS;
-    int keepalive_reqs;
+    int keepalive_reqs, parked;
 //***********************
     thread_signals(0);
 //*************************
@@ -591,7 +911,7 @@ int thread_main(server_decl_t * srv)
         }
 
         if ((ret = get_from_queue(con_queue, &con)) == 0) {
-            if (child_data->to_be_killed) {
+            if (child_data->to_be_killed && !connections_producers_running()) {
                 srv->running = 0;
                 return 1;
             }
@@ -618,7 +938,10 @@ int thread_main(server_decl_t * srv)
             }
         }
 
-        ret = server_request_use_connection(srv->current_req, &con.conn, con.proto);
+        if (con.keepalive_reqs > 0) /*A parked keep-alive connection*/
+            ret = server_request_resume_connection(srv->current_req, &con.conn, con.proto, con.access_type);
+        else
+            ret = server_request_use_connection(srv->current_req, &con.conn, con.proto);
         if (ret == 0) {
             /*The request rejected. Log an error and continue*/
             ci_sockaddr_t_to_host(&(con.conn.claddr), clientname,
@@ -628,7 +951,8 @@ int thread_main(server_decl_t * srv)
             goto end_of_main_loop_thread;
         }
 
-        keepalive_reqs = 0;
+        keepalive_reqs = con.keepalive_reqs;
+        parked = 0;
         do {
             if (MAX_KEEPALIVE_REQUESTS > 0
                     && keepalive_reqs >= MAX_KEEPALIVE_REQUESTS)
@@ -666,6 +990,16 @@ int thread_main(server_decl_t * srv)
             if (!srv->current_req->keepalive)
                 break;
 
+#if defined(HAVE_EPOLL)
+            /*Do not park while going down, the reactor may be stopped*/
+            if (EVENT_DRIVEN_CONNECTIONS && !child_data->to_be_killed &&
+                    park_keepalive_connection(srv->current_req, keepalive_reqs)) {
+                ci_debug_printf(8, "Server %d parked keep-alive connection\n", srv->srv_id);
+                parked = 1;
+                break;
+            }
+#endif
+
             if (keepalive_request(srv->current_req) <= 0) {
                 /* timeout or error. done with this conn */
                 ci_debug_printf(5, "keepalive request timed-out, or connection closed/errored...\n");
@@ -675,7 +1009,7 @@ int thread_main(server_decl_t * srv)
             ci_debug_printf(8, "Server %d going to serve new request from client (keep-alive) \n", srv->srv_id);
         } while (1);
 
-        if (srv->current_req) {
+        if (srv->current_req && !parked) {
             if (request_status != CI_OK || child_data->to_be_killed) {
                 ci_connection_hard_close(srv->current_req->connection);
             } else {
@@ -701,14 +1035,97 @@ end_of_main_loop_thread:
     return 0;
 }
 
+static int listener_accept(ci_port_t *port, ci_connection_t *conn)
+{
+    ci_connection_reset(conn);
+#ifdef USE_OPENSSL
+    if (port->tls_accept_details)
+        return icap_accept_tls_connection(port, conn);
+#endif
+    return icap_accept_raw_connection(port, conn);
+}
+
+static int listener_mutex_lock(int pid)
+{
+    errno = 0;
+    while (!ci_proc_mutex_lock(&accept_mutex)) {
+        if (errno != EINTR || child_data->to_be_killed) {
+            ci_debug_printf(1, "Error:%d while trying to lock proc_mutex of server:%d\n", errno, pid);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int listener_mutex_unlock(int pid)
+{
+    errno = 0;
+    while (!ci_proc_mutex_unlock(&accept_mutex)) {
+        if (errno != EINTR) {
+            ci_debug_printf(1, "Error:%d while trying to unlock proc_mutex of server:%d\n", errno, pid);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+  The connections waiting in the backlog of the child own SO_REUSEPORT
+  sockets are reset when the sockets are closed. Pass them to the
+  servers before going down gracefully.
+*/
+static void listener_drain_reuseport_sockets()
+{
+    struct connections_queue_item con;
+    ci_port_t *port;
+    int i, ret;
+    for (i = 0; (port = (ci_port_t *)ci_vector_get(CI_CONF.PORTS, i)) != NULL; ++i) {
+        if (!port->reuse_port || !ci_socket_valid(port->accept_socket))
+            continue;
+        while (ci_wait_ms_for_data(port->accept_socket, 0, ci_wait_for_read) > 0) {
+            if ((ret = listener_accept(port, &con.conn)) == 0)
+                continue;
+            if (ret < 0 || !ci_socket_valid(con.conn.fd))
+                break;
+            con.proto = port->proto;
+            con.access_type = 0;
+            con.keepalive_reqs = 0;
+            if (put_to_queue(con_queue, &con) == 0) {
+                ci_connection_hard_close(&con.conn);
+                continue;
+            }
+            ci_debug_printf(5, "Pass a pending connection of port %d to servers before exit\n", port->port);
+            STAT_INT64_INC(STATS, port->stat_connections, 1);
+            STAT_INT64_INC(STATS, STAT_ACCEPTED_CONNECTIONS, 1);
+        }
+    }
+}
+
 void listener_thread(void *unused)
 {
     struct connections_queue_item con;
     ci_port_t *port;
     int haschild = 1, jobs_in_queue = 0;
     int32_t child_usedservers;
-    int pid;
+    int pid, i;
+    int shared_ports = 0, reuse_ports = 0;
+    int lock_while_polling, lock_on_accept, mutex_locked = 0;
     thread_signals(1);
+    for (i = 0; (port = (ci_port_t *)ci_vector_get(CI_CONF.PORTS, i)) != NULL; ++i) {
+        if (port->reuse_port)
+            reuse_ports = 1;
+        else
+            shared_ports = 1;
+    }
+    /*
+      The ports with per child SO_REUSEPORT sockets do not need the accept
+      mutex. When they are mixed with shared listening sockets, poll all of
+      them without the mutex, and lock it only to accept from the shared
+      sockets, else the connections of the child own sockets wait until the
+      child gets the mutex.
+     */
+    lock_while_polling = shared_ports && !reuse_ports;
+    lock_on_accept = shared_ports && reuse_ports;
     /*Wait main process to signal us to start accepting requests*/
     ci_thread_mutex_lock(&free_server_mtx);
     listener_running = 1;
@@ -720,7 +1137,7 @@ void listener_thread(void *unused)
             ci_debug_printf(5, "Listener of pid: %d exiting!\n", pid);
             goto LISTENER_FAILS_UNLOCKED;
         }
-        if (!ci_proc_mutex_lock(&accept_mutex)) {
+        if (lock_while_polling && !ci_proc_mutex_lock(&accept_mutex)) {
             if (errno == EINTR) {
                 ci_debug_printf(5,
                                 "proc_mutex_lock interrupted (EINTR received, pid=%d)!\n",
@@ -734,6 +1151,7 @@ void listener_thread(void *unused)
                 goto LISTENER_FAILS_UNLOCKED;
             }
         }
+        mutex_locked = lock_while_polling;
         child_data->idle = 0;
         ci_debug_printf(7, "Child %d getting requests now ...\n", pid);
         do {                  //Getting requests while we have free servers.....
@@ -744,7 +1162,6 @@ void listener_thread(void *unused)
 #else
             fd_set fds;
 #endif
-            int i;
             do {
                 int ret;
                 errno = 0;
@@ -787,14 +1204,20 @@ void listener_thread(void *unused)
                     continue;
 #endif
                 int ret = 0;
+                if (lock_on_accept && !port->reuse_port) {
+                    if (!listener_mutex_lock(pid))
+                        goto LISTENER_FAILS;
+                    mutex_locked = 1;
+                    /*Other child may already accepted the connection*/
+                    if (ci_wait_ms_for_data(port->accept_socket, 0, ci_wait_for_read) <= 0) {
+                        mutex_locked = 0;
+                        if (!listener_mutex_unlock(pid))
+                            goto LISTENER_FAILS;
+                        continue;
+                    }
+                }
                 do {
-                    ci_connection_reset(&con.conn);
-#ifdef USE_OPENSSL
-                    if (port->tls_accept_details)
-                        ret = icap_accept_tls_connection(port, &con.conn);
-                    else
-#endif
-                        ret = icap_accept_raw_connection(port, &con.conn);
+                    ret = listener_accept(port, &con.conn);
                     if (ret <= 0) {
                         if (child_data->to_be_killed) {
                             ci_debug_printf(5, "Accept aborted: listener server signalled to exit!\n");
@@ -806,6 +1229,12 @@ void listener_thread(void *unused)
                     }
                 } while (ret == 0);
 
+                if (lock_on_accept && !port->reuse_port) {
+                    mutex_locked = 0;
+                    if (!listener_mutex_unlock(pid))
+                        goto LISTENER_FAILS;
+                }
+
                 // Probably ECONNABORTED or similar error
                 if (!ci_socket_valid(con.conn.fd))
                     continue;
@@ -814,6 +1243,16 @@ void listener_thread(void *unused)
                 icap_socket_opts(port->accept_socket, MAX_SECS_TO_LINGER);
 
                 con.proto = port->proto;
+                con.access_type = 0;
+                con.keepalive_reqs = 0;
+#if defined(HAVE_EPOLL)
+                /*Pass it to a server when the client sends its request*/
+                if (EVENT_DRIVEN_CONNECTIONS && park_connection(&con, TIMEOUT, &parked_new)) {
+                    STAT_INT64_INC(STATS, port->stat_connections, 1);
+                    STAT_INT64_INC(STATS, STAT_ACCEPTED_CONNECTIONS, 1);
+                    continue;
+                }
+#endif
                 if ((jobs_in_queue = put_to_queue(con_queue, &con)) == 0) {
                     /* connection dropped */
                     ci_debug_printf(8, "Jobs in Queue: %d, Free servers: %d, Used Servers: %d, Requests: %" PRIi64 "\n",
@@ -824,6 +1263,7 @@ void listener_thread(void *unused)
                     continue;
                 }
                 STAT_INT64_INC(STATS, port->stat_connections, 1);
+                STAT_INT64_INC(STATS, STAT_ACCEPTED_CONNECTIONS, 1);
             } /*for (Listen_SOCKETS[i]...*/
 
             if (child_data->to_be_killed) {
@@ -835,7 +1275,7 @@ void listener_thread(void *unused)
         } while (haschild);
         ci_debug_printf(7, "Child %d STOPS getting requests now ...\n", pid);
         child_data->idle = 1;
-        while (!ci_proc_mutex_unlock(&accept_mutex)) {
+        while (mutex_locked && !ci_proc_mutex_unlock(&accept_mutex)) {
             if (errno != EINTR) {
                 ci_debug_printf(1,
                                 "Error:%d while trying to unlock proc_mutex, exiting listener of server:%d\n",
@@ -846,6 +1286,7 @@ void listener_thread(void *unused)
                             "Mutex lock interrupted while trying to unlock proc_mutex, pid: %d\n",
                             pid);
         }
+        mutex_locked = 0;
 
         ci_atomic_load_i32(&child_data->usedservers, &child_usedservers);
         if ((child_data->servers - child_usedservers - connections_pending(con_queue)) <= 0) {
@@ -858,17 +1299,25 @@ void listener_thread(void *unused)
         }
     }
 LISTENER_FAILS_UNLOCKED:
+    if (child_data->to_be_killed == GRACEFULLY)
+        listener_drain_reuseport_sockets();
     ci_port_list_release(CI_CONF.PORTS);
     CI_CONF.PORTS = NULL;
     listener_running = 0;
+    /*Going down, the servers wait for the listener to exit*/
+    ci_thread_cond_broadcast(&(con_queue->queue_cond));
     return;
 
 LISTENER_FAILS:
+    if (child_data->to_be_killed == GRACEFULLY)
+        listener_drain_reuseport_sockets();
     ci_port_list_release(CI_CONF.PORTS);
     CI_CONF.PORTS = NULL;
     listener_running = 0;
+    /*Going down, the servers wait for the listener to exit*/
+    ci_thread_cond_broadcast(&(con_queue->queue_cond));
     errno = 0;
-    while (!ci_proc_mutex_unlock(&accept_mutex)) {
+    while (mutex_locked && !ci_proc_mutex_unlock(&accept_mutex)) {
         if (errno != EINTR) {
             ci_debug_printf(1,
                             "Error:%d while trying to unlock proc_mutex of server:%d\n",
@@ -881,6 +1330,54 @@ LISTENER_FAILS:
     return;
 }
 
+/*Open the child own listening socket for the SO_REUSEPORT ports*/
+static int child_open_reuseport_sockets()
+{
+    int i;
+    ci_port_t *p;
+    for (i = 0; (p = (ci_port_t *)ci_vector_get(CI_CONF.PORTS, i)); ++i) {
+        if (!p->reuse_port)
+            continue;
+        if (CI_SOCKET_INVALID == icap_init_server(p)) {
+            ci_debug_printf(1, "Child %d can not listen to port %d\n", (int)getpid(), p->port);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*Periodically release the memory pools free objects which are not used*/
+static void mem_pools_trim_cmd(const char *name, int type, void *data)
+{
+    ci_mem_pools_trim();
+    ci_command_schedule("mem_pools_trim", NULL, 1);
+}
+
+/*Periodically update the resident memory statistics of the child. The
+  memory pages the child shares with the other processes, eg the lookup
+  tables loaded by the main process, are counted as shared memory*/
+static void child_memory_stats_cmd(const char *name, int type, void *data)
+{
+#if defined(__linux__)
+    FILE *f;
+    char line[256];
+    unsigned long long kb, private_kb = 0, shared_kb = 0;
+
+    if ((f = fopen("/proc/self/smaps_rollup", "r")) != NULL) {
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "Private_%*[A-Za-z]: %llu kB", &kb) == 1)
+                private_kb += kb;
+            else if (sscanf(line, "Shared_%*[A-Za-z]: %llu kB", &kb) == 1)
+                shared_kb += kb;
+        }
+        fclose(f);
+        ci_stat_value_set(STAT_CHILD_PRIVATE_MEMORY, private_kb);
+        ci_stat_value_set(STAT_CHILD_SHARED_MEMORY, shared_kb);
+    }
+    ci_command_schedule("child_memory_stats", NULL, 10);
+#endif
+}
+
 void child_main(int pipefd, int single)
 {
     ci_thread_t thread;
@@ -894,10 +1391,18 @@ void child_main(int pipefd, int single)
     assert(ret);
     STATS = ci_stat_memblock_get();
 
+    if (!child_open_reuseport_sockets())
+        exit(-1);
+
     threads_list =
         (server_decl_t **) malloc((CI_CONF.THREADS_PER_CHILD + 1) *
                                   sizeof(server_decl_t *));
-    con_queue = init_queue(2*CI_CONF.THREADS_PER_CHILD);
+#if defined(HAVE_EPOLL)
+    if (EVENT_DRIVEN_CONNECTIONS)
+        con_queue = init_queue(REACTOR_MAX_QUEUED_CONNECTIONS);
+    else
+#endif
+        con_queue = init_queue(2*CI_CONF.THREADS_PER_CHILD);
 
     for (i = 0; i < CI_CONF.THREADS_PER_CHILD; i++) {
         if ((threads_list[i] = newthread(con_queue)) == NULL) {
@@ -910,6 +1415,10 @@ void child_main(int pipefd, int single)
             threads_list[i]->srv_pthread = thread;
     }
     threads_list[CI_CONF.THREADS_PER_CHILD] = NULL;
+#if defined(HAVE_EPOLL)
+    if (EVENT_DRIVEN_CONNECTIONS)
+        reactor_start();
+#endif
     /*Now start the listener thread.... */
     ret = ci_thread_create(&thread, (void *(*)(void *)) listener_thread,
                            NULL);
@@ -931,6 +1440,10 @@ void child_main(int pipefd, int single)
     /*start child commands may have non thread safe code but the worker threads
       does not serving requests yet.*/
     commands_execute_start_child();
+    ci_command_register_action("mem_pools_trim", CI_CMD_ONDEMAND, NULL, mem_pools_trim_cmd);
+    ci_command_schedule("mem_pools_trim", NULL, 1);
+    ci_command_register_action("child_memory_stats", CI_CMD_ONDEMAND, NULL, child_memory_stats_cmd);
+    child_memory_stats_cmd("child_memory_stats", CI_CMD_ONDEMAND, NULL);
 
     /*Signal listener to start accepting requests.*/
     int doStart = 0;
@@ -969,6 +1482,9 @@ void child_main(int pipefd, int single)
             child_data->to_be_killed = GRACEFULLY;
         }
         commands_exec_scheduled(CI_CMD_ONDEMAND);
+        /*Publish the counters of the threads statistics shards to
+          the main process and the other children*/
+        ci_stat_shards_fold();
     }
 
     ci_debug_printf(5, "Child :%d going down :%s\n", getpid(),
@@ -1078,6 +1594,9 @@ int init_server()
         if (p->configured)
             continue;
 
+#if defined(SO_REUSEPORT)
+        p->reuse_port = (REUSE_PORT && !p->tls_enabled);
+#endif
 #ifdef USE_OPENSSL
         if (p->tls_enabled) {
             if (!icap_init_server_tls(p))
@@ -1090,8 +1609,29 @@ int init_server()
         snprintf(buf, sizeof(buf), "%s:%d%s connections", (p->address ? p->address : "localhost"), p->port, (p->tls_enabled ? ", TLS": ""));
         p->stat_connections = ci_stat_entry_register(buf, CI_STAT_INT64_T, "Server");
         p->configured = 1;
+        if (p->reuse_port) {
+            /*We can listen to this port, children will open their own sockets*/
+            close(p->accept_socket);
+            p->accept_socket = CI_SOCKET_INVALID;
+        }
     }
 
+    if (STAT_ACCEPTED_CONNECTIONS < 0)
+        STAT_ACCEPTED_CONNECTIONS = ci_stat_entry_register("ACCEPTED CONNECTIONS", CI_STAT_INT64_T, "Server");
+
+#if defined(__linux__)
+    if (STAT_CHILD_PRIVATE_MEMORY < 0) {
+        STAT_CHILD_PRIVATE_MEMORY = ci_stat_entry_register("Child private memory (KB)", CI_STAT_INT64_MEAN_T, "Server");
+        STAT_CHILD_SHARED_MEMORY = ci_stat_entry_register("Child shared memory (KB)", CI_STAT_INT64_MEAN_T, "Server");
+    }
+#endif
+
+#if defined(HAVE_EPOLL)
+    if (EVENT_DRIVEN_CONNECTIONS && STAT_PARKED_CONNECTIONS < 0) {
+        STAT_PARKED_CONNECTIONS = ci_stat_entry_register("Parked connections", CI_STAT_INT64_T, "Server");
+        STAT_PARKED_TIMEOUTS = ci_stat_entry_register("Parked connections timeouts", CI_STAT_INT64_T, "Server");
+    }
+#endif
     return 1;
 }
 
@@ -505,6 +505,22 @@ int ci_connection_write_nonblock(ci_connection_t *conn, const void *buf, size_t
     return ci_write_nonblock(conn->fd, buf, count);
 }
 
+int ci_connection_writev_nonblock(ci_connection_t *conn, const ci_iovec_t *iov, int iovcnt)
+{
+    assert(conn);
+#ifdef USE_OPENSSL
+    if (ci_connection_is_tls(conn)) {
+        /*No gather write for TLS, write the first non-empty buffer*/
+        int i;
+        for (i = 0; i < iovcnt && iov[i].iov_len == 0; i++);
+        if (i == iovcnt)
+            return 0;
+        return ci_connection_write_nonblock_tls(conn, iov[i].iov_base, iov[i].iov_len);
+    }
+#endif
+    return ci_writev_nonblock(conn->fd, iov, iovcnt);
+}
+
 int ci_connection_linger_close(ci_connection_t *conn, int timeout)
 {
     assert(conn);
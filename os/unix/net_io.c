@@ -46,6 +46,21 @@ const char *ci_sockaddr_t_to_host(ci_sockaddr_t * addr, char *hname,
 }
 
 
+int icap_socket_reuseport(ci_socket fd)
+{
+#if defined(SO_REUSEPORT)
+    int value = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(value)) == -1) {
+        ci_debug_printf(1, "setsockopt: unable to set SO_REUSEPORT\n");
+        return 0;
+    }
+    return 1;
+#else
+    ci_debug_printf(1, "SO_REUSEPORT is not supported\n");
+    return 0;
+#endif
+}
+
 #ifdef USE_IPV6
 int icap_init_server_ipv6(ci_port_t *port)
 {
@@ -59,6 +74,8 @@ int icap_init_server_ipv6(ci_port_t *port)
     }
 
     icap_socket_opts(port->accept_socket, port->secs_to_linger);
+    if (port->reuse_port)
+        icap_socket_reuseport(port->accept_socket);
 
     memset(&addr, 0, sizeof(addr));
     addr.sin6_family = AF_INET6;
@@ -114,6 +131,8 @@ int icap_init_server(ci_port_t *port)
     }
 
     icap_socket_opts(port->accept_socket, port->secs_to_linger);
+    if (port->reuse_port)
+        icap_socket_reuseport(port->accept_socket);
 
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
@@ -401,6 +420,24 @@ int ci_write_nonblock(int fd, const void *buf, size_t count)
 
 
 
+int ci_writev_nonblock(int fd, const struct iovec *iov, int iovcnt)
+{
+    int bytes = 0;
+    do {
+        bytes = writev(fd, iov, iovcnt);
+    } while (bytes == -1 && errno == EINTR);
+
+    if (bytes < 0 && errno == EAGAIN)
+        return 0;
+
+    if (bytes == 0) /*connection is closed?*/
+        return -1;
+
+    return bytes;
+}
+
+
+
 int ci_linger_close(int fd, int timeout)
 {
     char buf[10];
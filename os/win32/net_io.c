@@ -311,6 +311,16 @@ int ci_write_nonblock(ci_socket fd, const void *buf, size_t count)
     return bytes;
 }
 
+int ci_writev_nonblock(ci_socket fd, const ci_iovec_t *iov, int iovcnt)
+{
+    /*Send only the first buffer, callers handle partial writes*/
+    int i;
+    for (i = 0; i < iovcnt && iov[i].iov_len == 0; i++);
+    if (i == iovcnt)
+        return 0;
+    return ci_write_nonblock(fd, iov[i].iov_base, iov[i].iov_len);
+}
+
 int ci_linger_close(ci_socket fd, int timeout)
 {
     char buf[10];
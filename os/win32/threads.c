@@ -18,6 +18,7 @@
  */
 
 #include "ci_threads.h"
+#include <errno.h>
 int ci_thread_mutex_init(ci_thread_mutex_t * pmutex)
 {
     InitializeCriticalSection(pmutex);
@@ -63,6 +64,15 @@ int ci_thread_cond_wait(ci_thread_cond_t * pcond, ci_thread_mutex_t * pmutex)
     return 0;
 }
 
+int ci_thread_cond_timedwait(ci_thread_cond_t * pcond, ci_thread_mutex_t * pmutex, int msecs)
+{
+    DWORD ret;
+    ci_thread_mutex_unlock(pmutex);
+    ret = WaitForSingleObject(*pcond, msecs);
+    ci_thread_mutex_lock(pmutex);
+    return ret == WAIT_TIMEOUT ? ETIMEDOUT : 0;
+}
+
 int ci_thread_cond_broadcast(ci_thread_cond_t * pcond)
 {
     SetEvent(*pcond);          /*This do not work with autoreset events.
@@ -127,3 +137,20 @@ int ci_thread_rwlock_unlock(ci_thread_rwlock_t * rwlock)
     LeaveCriticalSection(rwlock);
     return 0;
 }
+
+int ci_thread_key_create(ci_thread_key_t * key, void (*destructor) (void *))
+{
+    if ((*key = TlsAlloc()) == TLS_OUT_OF_INDEXES)
+        return -1;
+    return 0;
+}
+
+void *ci_thread_key_get(ci_thread_key_t key)
+{
+    return TlsGetValue(key);
+}
+
+int ci_thread_key_set(ci_thread_key_t key, const void *value)
+{
+    return TlsSetValue(key, (LPVOID) value) ? 0 : -1;
+}
@@ -58,6 +58,7 @@ static void ci_port_move_configured(ci_port_t *dst, ci_port_t *src)
     dst->accept_socket = src->accept_socket;
     dst->stat_connections = src->stat_connections;
     dst->proto = src->proto;
+    dst->reuse_port = src->reuse_port;
     src->configured = 0;
     src->accept_socket = CI_SOCKET_INVALID;
     src->stat_connections = -1;
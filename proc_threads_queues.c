@@ -36,6 +36,8 @@ static int list_copy_connection(void *dest, const void *src)
     struct connections_queue_item *s = (struct connections_queue_item *)src;
     ci_copy_connection(&d->conn, &s->conn);
     d->proto = s->proto;
+    d->access_type = s->access_type;
+    d->keepalive_reqs = s->keepalive_reqs;
     return 1;
 }
 
@@ -83,7 +85,17 @@ int put_to_queue(struct connections_queue *q, struct connections_queue_item *con
     ci_list_push_back(q->connections, con);
     ++q->used;
     ci_thread_mutex_unlock(&(q->queue_mtx));
-    ci_thread_cond_signal(&(q->queue_cond));   //????
+    /*
+      Workers check the queue while holding the cond_mtx before they wait.
+      After we pass through it a worker either sleeps on queue_cond or has
+      already seen our connection. The connection is already queued,
+      signal even if the lock fails.
+    */
+    if (ci_thread_mutex_lock(&(q->cond_mtx)) == 0)
+        ci_thread_mutex_unlock(&(q->cond_mtx));
+    else
+        ci_debug_printf(1, "Error locking the connections queue cond mutex, signal without it\n");
+    ci_thread_cond_signal(&(q->queue_cond));
     return 1;
 }
 
@@ -101,12 +113,23 @@ int get_from_queue(struct connections_queue *q, struct connections_queue_item *c
     return 1;
 }
 
+static int queue_is_empty(struct connections_queue *q)
+{
+    int used;
+    if (ci_thread_mutex_lock(&(q->queue_mtx)) != 0)
+        return 1;
+    used = q->used;
+    ci_thread_mutex_unlock(&(q->queue_mtx));
+    return (used == 0);
+}
+
 int wait_for_queue(struct connections_queue *q)
 {
     ci_debug_printf(7, "Waiting for a connection/request....\n");
     if (ci_thread_mutex_lock(&(q->cond_mtx)) != 0)
         return -1;
-    if (ci_thread_cond_wait(&(q->queue_cond), &(q->cond_mtx)) != 0) {
+    /*A connection pushed after our last get_from_queue will not signal us*/
+    if (queue_is_empty(q) && ci_thread_cond_wait(&(q->queue_cond), &(q->cond_mtx)) != 0) {
         ci_thread_mutex_unlock(&(q->cond_mtx));
         return -1;
     }
@@ -303,6 +326,7 @@ child_shared_data_t *register_child(struct childs_queue * q,
             q->childs[i].servers = maxservers;
             q->childs[i].usedservers = 0;
             q->childs[i].requests = 0;
+            q->childs[i].parked_connections = 0;
             q->childs[i].to_be_killed = 0;
             q->childs[i].father_said = 0;
             q->childs[i].idle = 1;
@@ -523,6 +547,7 @@ ci_kbs_t ci_server_stat_kbs_get_running(int id)
     ci_kbs_t value = {0}, local;
     int i;
     assert(childs_queue);
+    ci_stat_shards_fold();
     for (i = 0; i < childs_queue->size; i++) {
         if (childs_queue->childs[i].pid == 0 || childs_queue->childs[i].to_be_killed != 0)
             continue;
@@ -539,6 +564,7 @@ static void uint64_counters_sum(int id, uint64_t *value, int *kids)
     int i;
     const ci_stat_memblock_t *block;
     assert(childs_queue);
+    ci_stat_shards_fold();
     *kids = 0;
     for (i = 0; i < childs_queue->size; i++) {
         if (childs_queue->childs[i].pid == 0 || childs_queue->childs[i].to_be_killed != 0)
@@ -618,6 +644,7 @@ ci_stat_memblock_t *ci_server_stat_get_all_stats(uint32_t flags)
     int i, kids = 0;
     const ci_stat_memblock_t *kid_stats;
     assert(childs_queue);
+    ci_stat_shards_fold();
     for (i = 0, kids = 0; i < childs_queue->size; i++) {
         if (childs_queue->childs[i].pid == 0 || childs_queue->childs[i].to_be_killed != 0)
             continue;
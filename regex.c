@@ -3,6 +3,8 @@
 #include "array.h"
 #include "mem.h"
 #include "ci_regex.h"
+#include "ci_threads.h"
+#include <ctype.h>
 #if defined(HAVE_PCRE2)
 #define PCRE2_CODE_UNIT_WIDTH 8 // TODO: make it configurable via configure
 #include <pcre2.h>
@@ -16,6 +18,7 @@
 #if defined(HAVE_PCRE2)
 pcre2_general_context *pcre2GenContext = NULL;
 pcre2_match_context *pcre2MatchContext = NULL;
+pcre2_compile_context *pcre2CompileContext = NULL;
 
 void *pcre2_malloc(PCRE2_SIZE size, void *udata)
 {
@@ -92,21 +95,100 @@ static int pcre2_flag_parse(const char **f)
     return 0;
 }
 
+/*
+  Every thread keeps a match data block, to not allocate one for every
+  ci_regex_apply call, and the JIT stack used by the JIT compiled
+  regexes. They are allocated using malloc because they are released
+  on thread exit.
+*/
+struct regex_thread_data {
+    pcre2_match_data *match_data;
+    pcre2_jit_stack *jit_stack;
+};
+
+#define REGEX_JIT_STACK_START (32 * 1024)
+#define REGEX_JIT_STACK_MAX (512 * 1024)
+
+static ci_thread_key_t RegexThreadKey;
+static int RegexThreadKeyInitialized = 0;
+
+static void regex_thread_data_release(void *data)
+{
+    struct regex_thread_data *td = (struct regex_thread_data *)data;
+    if (!td)
+        return;
+    if (td->match_data)
+        pcre2_match_data_free(td->match_data);
+    if (td->jit_stack)
+        pcre2_jit_stack_free(td->jit_stack);
+    free(td);
+}
+
+static struct regex_thread_data *regex_thread_data_get()
+{
+    struct regex_thread_data *td;
+    if (!RegexThreadKeyInitialized)
+        return NULL;
+    if ((td = (struct regex_thread_data *)ci_thread_key_get(RegexThreadKey)))
+        return td;
+    if (!(td = calloc(1, sizeof(struct regex_thread_data))))
+        return NULL;
+    if (!(td->match_data = pcre2_match_data_create(CI_REGEX_SUBMATCHES, NULL))) {
+        free(td);
+        return NULL;
+    }
+    /*If it is NULL the JIT code uses a small stack on the machine stack*/
+    if (CI_REGEX_JIT)
+        td->jit_stack = pcre2_jit_stack_create(REGEX_JIT_STACK_START, REGEX_JIT_STACK_MAX, NULL);
+    if (ci_thread_key_set(RegexThreadKey, td) != 0) {
+        regex_thread_data_release(td);
+        return NULL;
+    }
+    return td;
+}
+
+static pcre2_jit_stack *regex_jit_stack(void *data)
+{
+    struct regex_thread_data *td = regex_thread_data_get();
+    return td ? td->jit_stack : NULL;
+}
+
 #endif
 
+int CI_REGEX_JIT = 1;
+
 void ci_regex_memory_init()
 {
 #if defined(HAVE_PCRE2)
     pcre2GenContext = pcre2_general_context_create(pcre2_malloc, pcre2_free,  NULL);
     pcre2MatchContext = pcre2_match_context_create(pcre2GenContext);
+    /*The newline convention is not a compile option for PCRE2, set it
+      in the compile context*/
+    pcre2CompileContext = pcre2_compile_context_create(pcre2GenContext);
+    if (pcre2CompileContext)
+        pcre2_set_newline(pcre2CompileContext, PCRE2_NEWLINE_ANYCRLF);
+    if (!RegexThreadKeyInitialized) {
+        if (ci_thread_key_create(&RegexThreadKey, regex_thread_data_release) == 0)
+            RegexThreadKeyInitialized = 1;
+        else
+            ci_debug_printf(1, "WARNING: Can not create thread key, the regex match data will not be cached\n");
+    }
+    if (pcre2MatchContext)
+        pcre2_jit_stack_assign(pcre2MatchContext, regex_jit_stack, NULL);
 #endif
 }
 
 void ci_regex_memory_destroy()
 {
 #if defined(HAVE_PCRE2)
+    if (RegexThreadKeyInitialized) {
+        regex_thread_data_release(ci_thread_key_get(RegexThreadKey));
+        ci_thread_key_set(RegexThreadKey, NULL);
+    }
     pcre2_match_context_free(pcre2MatchContext);
     pcre2MatchContext = NULL;
+    pcre2_compile_context_free(pcre2CompileContext);
+    pcre2CompileContext = NULL;
     pcre2_general_context_free(pcre2GenContext);
     pcre2GenContext = NULL;
 #endif
@@ -134,8 +216,7 @@ char *ci_regex_parse(const char *str, int *flags, int *recursive)
         return s;
     *flags = 0;
 #if defined(HAVE_PCRE2)
-    *flags |= PCRE2_NEWLINE_ANY;
-    *flags |= PCRE2_NEWLINE_ANYCRLF;
+    /*The newline convention is set in the pcre2CompileContext*/
 #elif defined(HAVE_PCRE)
     *flags |= PCRE_NEWLINE_ANY;
     *flags |= PCRE_NEWLINE_ANYCRLF;
@@ -209,13 +290,18 @@ ci_regex_t ci_regex_build(const char *regex_str, int regex_flags)
     pcre2_code *re;
     int errcode;
     PCRE2_SIZE erroffset;
-    re =  pcre2_compile((PCRE2_SPTR)regex_str, PCRE2_ZERO_TERMINATED, (uint32_t)regex_flags, &errcode, &erroffset, NULL);
+    re =  pcre2_compile((PCRE2_SPTR)regex_str, PCRE2_ZERO_TERMINATED, (uint32_t)regex_flags, &errcode, &erroffset, pcre2CompileContext);
     if (re == NULL) {
         PCRE2_UCHAR errbuf[256];
         pcre2_get_error_message(errcode, errbuf, sizeof(errbuf));
         ci_debug_printf(2, "PCRE2 compilation of '%s' failed at offset %d: %s\n", regex_str, (int)erroffset, errbuf);
         return NULL;
     }
+    if (CI_REGEX_JIT && (errcode = pcre2_jit_compile(re, PCRE2_JIT_COMPLETE)) != 0) {
+        /*Not supported on this platform, or not enough memory. The
+          pcre2_match will use the interpreter*/
+        ci_debug_printf(5, "PCRE2 JIT compilation of '%s' failed: %d\n", regex_str, errcode);
+    }
     return (ci_regex_t)re;
 #elif defined(HAVE_PCRE)
     pcre *re;
@@ -276,15 +362,19 @@ int ci_regex_apply(const ci_regex_t regex, const char *str, int len, int recurs,
 
 #if defined(HAVE_PCRE2)
     PCRE2_SIZE offset = 0;
-    pcre2_match_data *match_data = pcre2_match_data_create_from_pattern(regex, pcre2GenContext);
+    PCRE2_SIZE str_length = len > 0 ? (PCRE2_SIZE)len : PCRE2_ZERO_TERMINATED;
+    struct regex_thread_data *td = regex_thread_data_get();
+    pcre2_match_data *match_data = td ? td->match_data : pcre2_match_data_create_from_pattern(regex, pcre2GenContext);
+    if (!match_data)
+        return 0;
     do {
-        int str_length = len > 0 ? len : PCRE2_ZERO_TERMINATED;
         int rcaptures = pcre2_match(regex, (PCRE2_SPTR)str, str_length, offset, 0, match_data, pcre2MatchContext);
-        if (rcaptures >= 0)
-            count++;
-        if (rcaptures > 0 && matches) {
+        if (rcaptures == 0) /*The ovector is full*/
+            rcaptures = pcre2_get_ovector_count(match_data);
+        if (rcaptures > 0) {
             PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(match_data);
-            for (i = 0; i < rcaptures && i < CI_REGEX_SUBMATCHES; i++) {
+            count++;
+            for (i = 0; matches && i < rcaptures && i < CI_REGEX_SUBMATCHES; i++) {
                 _CI_ASSERT(ovector[2*i+1] >= ovector[2*i]);
                 if (matches) {
                     parts.user_data = user_data;
@@ -295,13 +385,15 @@ int ci_regex_apply(const ci_regex_t regex, const char *str, int len, int recurs,
                 }
                 ci_list_push_back(matches, (void *)&parts);
             }
-            offset = ovector[1]; /*Assert that it is less than strlen(str)?*/
+            /*Continue after the match, stop on empty matches*/
+            offset = ovector[1] > ovector[0] ? ovector[1] : 0;
         } else if (rcaptures < 0) {
             /* maybe check and report the exact error?*/
             offset = 0;
         } /* the rcaptures==0 not possible for our case, but maybe check and warn?*/
     } while (recurs && offset > 0);
-    pcre2_match_data_free(match_data);
+    if (!td)
+        pcre2_match_data_free(match_data);
 #elif defined(HAVE_PCRE)
     int ovector[OVECCOUNT];
     int rc;
@@ -331,8 +423,15 @@ int ci_regex_apply(const ci_regex_t regex, const char *str, int len, int recurs,
 #else
     int retcode;
     regmatch_t pmatch[CI_REGEX_SUBMATCHES];
-    char *tmpS = NULL;
     const char *s;
+#if defined(REG_STARTEND)
+    /*The regexec matches the str up to len, without copying it*/
+    const char *end = len > 0 ? str + len : NULL;
+    const int eflags = end ? REG_STARTEND : 0;
+    s = str;
+#else
+    const int eflags = 0;
+    char *tmpS = NULL;
     if (len > 0 && len < strlen(str)) {
         tmpS = ci_buffer_alloc(len + 1);
         _CI_ASSERT(tmpS);
@@ -341,8 +440,15 @@ int ci_regex_apply(const ci_regex_t regex, const char *str, int len, int recurs,
         s = tmpS;
     } else
         s = str;
+#endif
     do {
-        if ((retcode = regexec(regex, s, CI_REGEX_SUBMATCHES, pmatch, 0)) == 0) {
+#if defined(REG_STARTEND)
+        if (end) {
+            pmatch[0].rm_so = 0;
+            pmatch[0].rm_eo = end - s;
+        }
+#endif
+        if ((retcode = regexec(regex, s, CI_REGEX_SUBMATCHES, pmatch, eflags)) == 0) {
             ++count;
             ci_debug_printf(9, "Match pattern (pos:%d-%d): '%.*s'\n", (int)pmatch[0].rm_so, (int)pmatch[0].rm_eo, (int)(pmatch[0].rm_eo - pmatch[0].rm_so), s+pmatch[0].rm_so);
 
@@ -359,15 +465,526 @@ int ci_regex_apply(const ci_regex_t regex, const char *str, int len, int recurs,
 
             if (pmatch[0].rm_so >= 0 && pmatch[0].rm_eo >= 0 && pmatch[0].rm_so != pmatch[0].rm_eo) {
                 s += pmatch[0].rm_eo;
-                ci_debug_printf(8, "I will check again starting from: %s\n", s);
+                ci_debug_printf(8, "I will check again starting from position: %d\n", (int)(s - str));
             } else /*stop here*/
                 s = NULL;
         }
+#if defined(REG_STARTEND)
+    } while (recurs && s && (end ? s < end : *s != '\0') && retcode == 0);
+#else
     } while (recurs && s && *s != '\0' && retcode == 0);
     if (tmpS)
         ci_buffer_free(tmpS);
+#endif
 #endif
 
-    ci_debug_printf(5, "ci_regex_apply string '%s' matches count: %d\n", str, count);
+    ci_debug_printf(5, "ci_regex_apply string '%.*s' matches count: %d\n", len > 0 ? len : (int)strlen(str), str, count);
     return count;
 }
+
+/*
+  Regex sets.
+
+  A required literal is extracted from every regex of the set: a string
+  which any match of the regex contains. The literals are folded to
+  lowercase and compiled into an Aho-Corasick automaton. A match scans
+  the subject once using the automaton and runs only the regexes whose
+  literal found (plus the regexes without literal), in the order they
+  added to the set.
+  The regexes added after the last ci_regex_set_compile call are always
+  checked.
+*/
+
+#define REGEX_SET_LITERAL_MAX 32
+#define REGEX_SET_LINEAR_EDGES 8
+
+struct regex_set_state {
+    uint32_t edges;     /*the first edge*/
+    uint32_t edges_num;
+    uint32_t fail;
+    uint32_t dict;      /*the next state in the fail chain with outputs*/
+    uint32_t outputs;   /*the first output*/
+    uint32_t outputs_num;
+};
+
+struct ci_regex_set {
+    ci_regex_t *regexes;
+    char **literals;
+    int num;
+    int size;
+    int compiled;
+    int literal_patterns;
+    /*The automaton*/
+    uint32_t root[256];
+    struct regex_set_state *states;
+    uint32_t states_num;
+    unsigned char *edge_bytes;
+    uint32_t *edge_targets;
+    uint32_t *outputs;
+    uint64_t *always;
+    size_t memory;
+};
+
+/*The regex flags which the literal extraction does not support*/
+static int regex_set_flags_supported(int flags)
+{
+#if defined(HAVE_PCRE2)
+    /*The EXTENDED_MORE, LITERAL and MATCH_INVALID_UTF as in pcre2_flags*/
+    return !(flags & (PCRE2_EXTENDED | PCRE2_UTF | PCRE2_UCP | PCRE2_ALT_BSUX | 0x01000000u | 0x02000000u | 0x04000000u));
+#elif defined(HAVE_PCRE)
+    return !(flags & (PCRE_EXTENDED | PCRE_UTF8 | PCRE_UCP | PCRE_EXTRA | PCRE_JAVASCRIPT_COMPAT));
+#else
+    return (flags & REG_EXTENDED);
+#endif
+}
+
+/*Returns a pointer after the quantifiers starting at s, s if there is
+  not any quantifier, or NULL if they can not be parsed. The minimum
+  number of repetitions (0 or not) is stored to min. The quantifiers
+  following a quantifier are lazy or possessive modifiers for PCRE but
+  repetitions for the posix regex, handle them as repetitions.*/
+static const char *regex_skip_quantifier(const char *s, int *min)
+{
+    const char *e;
+    *min = 1;
+    for (;;) {
+        if (*s == '*' || *s == '?') {
+            *min = 0;
+            s++;
+        } else if (*s == '+')
+            s++;
+        else if (*s == '{') {
+            if (!isdigit((int)s[1]))
+                return NULL;
+            if (atoi(s + 1) == 0)
+                *min = 0;
+            for (e = s + 1; isdigit((int)*e) || *e == ','; e++);
+            if (*e != '}')
+                return NULL;
+            s = e + 1;
+        } else
+            return s;
+    }
+}
+
+/*Returns a pointer after the end of the bracket expression starting at s*/
+static const char *regex_skip_class(const char *s)
+{
+    s++;
+    if (*s == '^')
+        s++;
+    if (*s == ']')
+        s++;
+    while (*s && *s != ']') {
+        if (*s == '\\' && s[1])
+            s += 2;
+        else if (*s == '[' && s[1] == ':') {
+            const char *e = strstr(s + 2, ":]");
+            if (!e)
+                return NULL;
+            s = e + 2;
+        } else
+            s++;
+    }
+    return *s ? s + 1 : NULL;
+}
+
+/*Returns a pointer after the end of the group starting at s*/
+static const char *regex_skip_group(const char *s)
+{
+    int depth = 0;
+    do {
+        if (*s == '\\') {
+            if (!s[1])
+                return NULL;
+            s += 2;
+            continue;
+        }
+        if (*s == '[') {
+            if (!(s = regex_skip_class(s)))
+                return NULL;
+            continue;
+        }
+        if (*s == '(')
+            depth++;
+        else if (*s == ')')
+            depth--;
+        s++;
+    } while (*s && depth > 0);
+    return depth == 0 ? s : NULL;
+}
+
+/*
+  Extracts the longest literal of the top level concatenation of the
+  regex, folded to lowercase. Returns its length, or 0 if the regex has
+  no such literal or it uses not supported constructs.
+*/
+static int regex_required_literal(const char *re, char *literal)
+{
+    char run[REGEX_SET_LITERAL_MAX];
+    int run_len = 0, best_len = 0, min, literal_char;
+    const char *s = re, *next;
+    unsigned char c;
+
+    while (*s) {
+        c = (unsigned char)*s;
+        literal_char = 0;
+        if (c == '|' || c == ')' || c == '*' || c == '+' || c == '?' || c == '{')
+            return 0;
+        if (c == '(') {
+            /*Option settings, comments and verbs*/
+            if (s[1] == '*' || (s[1] == '?' && (isalpha((int)s[2]) || s[2] == '-' || s[2] == '^' || s[2] == '#')))
+                return 0;
+            if (!(next = regex_skip_group(s)))
+                return 0;
+        } else if (c == '[') {
+            if (!(next = regex_skip_class(s)))
+                return 0;
+        } else if (c == '\\') {
+            c = (unsigned char)s[1];
+            if (c == 0 || c >= 0x80)
+                return 0;
+            if (isalnum(c)) {
+                /*Escapes which match one character or are assertions*/
+                if (!strchr("dDwWsSbBAzZGhHvVRNnrtfea", c))
+                    return 0;
+            } else
+                literal_char = 1;
+            next = s + 2;
+        } else if (c == '.' || c == '^' || c == '$' || c >= 0x80) {
+            next = s + 1;
+        } else {
+            literal_char = 1;
+            next = s + 1;
+        }
+
+        if (!(s = regex_skip_quantifier(next, &min)))
+            return 0;
+        if (literal_char && min > 0 && run_len < REGEX_SET_LITERAL_MAX)
+            run[run_len++] = tolower(c);
+        if (!literal_char || s != next) {
+            /*The literal run ends here*/
+            if (run_len > best_len) {
+                best_len = run_len;
+                memcpy(literal, run, run_len);
+            }
+            run_len = 0;
+        }
+    }
+    if (run_len > best_len) {
+        best_len = run_len;
+        memcpy(literal, run, run_len);
+    }
+    literal[best_len] = '\0';
+    return best_len;
+}
+
+ci_regex_set_t *ci_regex_set_create()
+{
+    ci_regex_set_t *set;
+    if (!(set = calloc(1, sizeof(ci_regex_set_t))))
+        return NULL;
+    return set;
+}
+
+static void regex_set_automaton_free(ci_regex_set_t *set)
+{
+    free(set->states);
+    free(set->edge_bytes);
+    free(set->edge_targets);
+    free(set->outputs);
+    free(set->always);
+    set->states = NULL;
+    set->edge_bytes = NULL;
+    set->edge_targets = NULL;
+    set->outputs = NULL;
+    set->always = NULL;
+    set->states_num = 0;
+    set->compiled = 0;
+    set->literal_patterns = 0;
+    set->memory = 0;
+}
+
+void ci_regex_set_destroy(ci_regex_set_t *set)
+{
+    int i;
+    if (!set)
+        return;
+    regex_set_automaton_free(set);
+    for (i = 0; i < set->num; i++)
+        free(set->literals[i]);
+    free(set->literals);
+    free(set->regexes);
+    free(set);
+}
+
+int ci_regex_set_add(ci_regex_set_t *set, const char *regex_str, int regex_flags, const ci_regex_t regex)
+{
+    char literal[REGEX_SET_LITERAL_MAX + 1];
+    ci_regex_t *regexes;
+    char **literals;
+    int size;
+
+    if (!set || !regex_str || !regex)
+        return -1;
+    if (set->num == set->size) {
+        size = set->size ? 2 * set->size : 32;
+        if (!(regexes = realloc(set->regexes, size * sizeof(ci_regex_t))))
+            return -1;
+        set->regexes = regexes;
+        if (!(literals = realloc(set->literals, size * sizeof(char *))))
+            return -1;
+        set->literals = literals;
+        set->size = size;
+    }
+    set->literals[set->num] = NULL;
+    if (regex_set_flags_supported(regex_flags) && regex_required_literal(regex_str, literal) > 0)
+        set->literals[set->num] = strdup(literal);
+    ci_debug_printf(7, "Regex set: added '%s', required literal: '%s'\n", regex_str, set->literals[set->num] ? set->literals[set->num] : "-");
+    set->regexes[set->num] = regex;
+    return set->num++;
+}
+
+/*Temporary trie used while compiling the automaton*/
+struct regex_trie_node {
+    uint32_t child;
+    uint32_t sibling;
+    uint32_t output;
+    unsigned char byte;
+};
+
+static uint32_t regex_trie_child(const struct regex_trie_node *nodes, uint32_t node, unsigned char c)
+{
+    uint32_t k;
+    for (k = nodes[node].child; k != 0; k = nodes[k].sibling) {
+        if (nodes[k].byte == c)
+            return k;
+    }
+    return 0;
+}
+
+int ci_regex_set_compile(ci_regex_set_t *set)
+{
+    struct regex_trie_node *nodes = NULL, *tmp;
+    uint32_t *out_next = NULL, *queue = NULL;
+    uint32_t nodes_num, nodes_size, node, k, f, t, u, head, tail, edges_num, outputs_num;
+    const unsigned char *lit;
+    int i, words, ret = 0;
+
+    if (!set)
+        return 0;
+    regex_set_automaton_free(set);
+    if (set->num == 0)
+        return 1;
+
+    /*Build the trie of the literals. The node 0 is the root*/
+    nodes_size = 1024;
+    nodes_num = 1;
+    if (!(nodes = calloc(nodes_size, sizeof(struct regex_trie_node))) ||
+            !(out_next = calloc(set->num, sizeof(uint32_t))))
+        goto compile_fail;
+    words = (set->num + 63) / 64;
+    if (!(set->always = calloc(words, sizeof(uint64_t))))
+        goto compile_fail;
+    for (i = 0; i < set->num; i++) {
+        if (!set->literals[i]) {
+            set->always[i / 64] |= (uint64_t)1 << (i % 64);
+            continue;
+        }
+        set->literal_patterns++;
+        node = 0;
+        for (lit = (const unsigned char *)set->literals[i]; *lit; lit++) {
+            if ((k = regex_trie_child(nodes, node, *lit)) == 0) {
+                if (nodes_num == nodes_size) {
+                    if (!(tmp = realloc(nodes, 2 * nodes_size * sizeof(struct regex_trie_node))))
+                        goto compile_fail;
+                    nodes = tmp;
+                    nodes_size *= 2;
+                }
+                k = nodes_num++;
+                nodes[k].byte = *lit;
+                nodes[k].child = 0;
+                nodes[k].output = 0;
+                nodes[k].sibling = nodes[node].child;
+                nodes[node].child = k;
+            }
+            node = k;
+        }
+        /*The outputs list holds pattern ids plus one, kept in reverse order*/
+        out_next[i] = nodes[node].output;
+        nodes[node].output = i + 1;
+    }
+
+    if (!(set->states = calloc(nodes_num, sizeof(struct regex_set_state))) ||
+            !(set->edge_bytes = malloc(nodes_num)) ||
+            !(set->edge_targets = malloc(nodes_num * sizeof(uint32_t))) ||
+            !(set->outputs = malloc((set->literal_patterns + 1) * sizeof(uint32_t))) ||
+            !(queue = malloc(nodes_num * sizeof(uint32_t))))
+        goto compile_fail;
+    set->states_num = nodes_num;
+
+    /*Breadth first traversal to compute the fail links and pack the edges
+      and the outputs of every state*/
+    edges_num = outputs_num = 0;
+    head = tail = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        u = queue[head++];
+        set->states[u].edges = edges_num;
+        for (k = nodes[u].child; k != 0; k = nodes[k].sibling) {
+            /*Keep the edges sorted by byte*/
+            for (t = edges_num; t > set->states[u].edges && set->edge_bytes[t - 1] > nodes[k].byte; t--) {
+                set->edge_bytes[t] = set->edge_bytes[t - 1];
+                set->edge_targets[t] = set->edge_targets[t - 1];
+            }
+            set->edge_bytes[t] = nodes[k].byte;
+            set->edge_targets[t] = k;
+            edges_num++;
+            queue[tail++] = k;
+
+            if (u == 0)
+                set->states[k].fail = 0;
+            else {
+                for (f = set->states[u].fail; f != 0 && regex_trie_child(nodes, f, nodes[k].byte) == 0; f = set->states[f].fail);
+                set->states[k].fail = regex_trie_child(nodes, f, nodes[k].byte);
+            }
+            f = set->states[k].fail;
+            set->states[k].dict = nodes[f].output ? f : set->states[f].dict;
+        }
+        set->states[u].edges_num = edges_num - set->states[u].edges;
+        set->states[u].outputs = outputs_num;
+        for (k = nodes[u].output; k != 0; k = out_next[k - 1])
+            set->outputs[outputs_num++] = k - 1;
+        set->states[u].outputs_num = outputs_num - set->states[u].outputs;
+    }
+    memset(set->root, 0, sizeof(set->root));
+    for (t = set->states[0].edges; t < set->states[0].edges + set->states[0].edges_num; t++)
+        set->root[set->edge_bytes[t]] = set->edge_targets[t];
+
+    set->compiled = set->num;
+    set->memory = nodes_num * (sizeof(struct regex_set_state) + 1 + sizeof(uint32_t)) +
+                  (set->literal_patterns + 1) * sizeof(uint32_t) + words * sizeof(uint64_t);
+    ci_debug_printf(5, "Regex set compiled: %d regexes, %d with literal, %u states, %lu bytes\n",
+                    set->num, set->literal_patterns, set->states_num, (unsigned long)set->memory);
+    ret = 1;
+
+compile_fail:
+    if (!ret) {
+        ci_debug_printf(1, "Failed to compile a regex set of %d regexes\n", set->num);
+        regex_set_automaton_free(set);
+    }
+    free(nodes);
+    free(out_next);
+    free(queue);
+    return ret;
+}
+
+static inline uint32_t regex_set_goto(const ci_regex_set_t *set, uint32_t state, unsigned char c)
+{
+    const struct regex_set_state *s = &set->states[state];
+    const unsigned char *bytes = set->edge_bytes + s->edges;
+    int low, high, mid;
+    if (s->edges_num <= REGEX_SET_LINEAR_EDGES) {
+        for (low = 0; low < s->edges_num && bytes[low] <= c; low++) {
+            if (bytes[low] == c)
+                return set->edge_targets[s->edges + low];
+        }
+        return 0;
+    }
+    low = 0;
+    high = s->edges_num - 1;
+    while (low <= high) {
+        mid = (low + high) / 2;
+        if (bytes[mid] == c)
+            return set->edge_targets[s->edges + mid];
+        if (bytes[mid] < c)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+    return 0;
+}
+
+static inline int regex_set_ctz64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+#define REGEX_SET_STACK_WORDS 64
+int ci_regex_set_match(const ci_regex_set_t *set, const char *str, int len, int *ids, int ids_num)
+{
+    uint64_t stack_candidates[REGEX_SET_STACK_WORDS], *candidates, word;
+    const unsigned char *s, *e;
+    uint32_t state, t, o, k;
+    int words, i, id, scan_len, found = 0;
+
+    if (!set || !str || set->num == 0 || ids_num <= 0)
+        return 0;
+    scan_len = len < 0 ? strlen(str) : len;
+
+    words = (set->num + 63) / 64;
+    if (words <= REGEX_SET_STACK_WORDS)
+        candidates = stack_candidates;
+    else if (!(candidates = ci_buffer_alloc(words * sizeof(uint64_t))))
+        return 0;
+    memset(candidates, 0, words * sizeof(uint64_t));
+
+    if (set->compiled) {
+        memcpy(candidates, set->always, ((set->compiled + 63) / 64) * sizeof(uint64_t));
+        state = 0;
+        for (s = (const unsigned char *)str, e = s + scan_len; s < e; s++) {
+            unsigned char c = tolower(*s);
+            for (;;) {
+                if (state == 0) {
+                    state = set->root[c];
+                    break;
+                }
+                if ((t = regex_set_goto(set, state, c))) {
+                    state = t;
+                    break;
+                }
+                state = set->states[state].fail;
+            }
+            o = set->states[state].outputs_num ? state : set->states[state].dict;
+            for (; o != 0; o = set->states[o].dict) {
+                for (k = 0; k < set->states[o].outputs_num; k++) {
+                    id = set->outputs[set->states[o].outputs + k];
+                    candidates[id / 64] |= (uint64_t)1 << (id % 64);
+                }
+            }
+        }
+    }
+    /*The not compiled regexes*/
+    for (id = set->compiled; id < set->num; id++)
+        candidates[id / 64] |= (uint64_t)1 << (id % 64);
+
+    for (i = 0; i < words && found < ids_num; i++) {
+        for (word = candidates[i]; word != 0 && found < ids_num; word &= word - 1) {
+            id = i * 64 + regex_set_ctz64(word);
+            if (ci_regex_apply(set->regexes[id], str, len, 0, NULL, NULL) > 0)
+                ids[found++] = id;
+        }
+    }
+
+    if (candidates != stack_candidates)
+        ci_buffer_free(candidates);
+    return found;
+}
+
+void ci_regex_set_stats(const ci_regex_set_t *set, ci_regex_set_stats_t *stats)
+{
+    stats->regexes = set->num;
+    stats->compiled = set->compiled;
+    stats->literal_regexes = set->literal_patterns;
+    stats->states = set->states_num;
+    stats->memory = set->memory;
+}
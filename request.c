@@ -22,6 +22,7 @@
 #include "debug.h"
 #include "request.h"
 #include "request_util.h"
+#include "request_send.h"
 #include "service.h"
 #include "access.h"
 #include "acl.h"
@@ -29,6 +30,7 @@
 #include "cfg_param.h"
 #include "stats.h"
 #include "body.h"
+#include "encoding.h"
 
 #include <errno.h>
 #include <ctype.h>
@@ -70,6 +72,9 @@ static int STAT_ALLOW204 = -1;
 static int STAT_ALLOW206 = -1;
 static int STAT_TIME_PER_REQUESTS = -1;
 static int STAT_PROC_TIME_PER_REQUESTS = -1;
+static int HISTO_REQUEST_TIME = -1;
+static int HISTO_PROC_TIME = -1;
+static int HISTO_BODY_BYTES_IN = -1;
 
 static struct timestats {
     time_t indx;
@@ -103,6 +108,10 @@ void request_stats_init()
     STAT_HTTP_BYTES_OUT = request_stat_entry_register("HTTP BYTES OUT", CI_STAT_KBS_T, "General");
     STAT_BODY_BYTES_IN = request_stat_entry_register("BODY BYTES IN", CI_STAT_KBS_T, "General");
     STAT_BODY_BYTES_OUT = request_stat_entry_register("BODY BYTES OUT", CI_STAT_KBS_T, "General");
+
+    HISTO_REQUEST_TIME = ci_stat_histo_create_hdr("REQUEST TIME", "usec", CI_HISTO_TIME_MAX, CI_HISTO_PRECISION_BITS);
+    HISTO_PROC_TIME = ci_stat_histo_create_hdr("PROCESSING TIME", "usec", CI_HISTO_TIME_MAX, CI_HISTO_PRECISION_BITS);
+    HISTO_BODY_BYTES_IN = ci_stat_histo_create_hdr("BODY BYTES IN", "bytes", CI_HISTO_SIZE_MAX, CI_HISTO_PRECISION_BITS);
     /*
       Use a threads mutex lock to update request statistics. They are updated
       only in one place in this file (function do_request), so this is should
@@ -161,6 +170,16 @@ int server_request_use_connection(ci_request_t * req, ci_connection_t * connecti
     return 1;
 }
 
+int server_request_resume_connection(ci_request_t * req, ci_connection_t * connection, int protocol, int access_type)
+{
+    /*The connection is already checked by server_request_use_connection*/
+    ci_request_reset(req);
+    ci_copy_connection(req->connection, connection);
+    req->access_type = access_type;
+    req->protocol = protocol;
+    return 1;
+}
+
 int keepalive_request(ci_request_t *req)
 {
     /* Preserve extra read bytes*/
@@ -207,12 +226,12 @@ static int icap_header_check_realloc(char **buf, int *size, int used, int mustad
 
 int ci_read_icap_header(ci_request_t * req, ci_headers_list_t * h, int timeout)
 {
-    int bytes, request_status = EC_100, i, eoh = 0, startsearch = 0, readed = 0;
+    int bytes, request_status = EC_100, readed = 0;
     int wait_status = 0;
-    char *buf_end;
     int dataPrefetch = 0;
+    ci_headers_scan_t scan;
 
-    buf_end = h->buf;
+    ci_headers_scan_init(&scan);
     readed = 0;
     bytes = 0;
 
@@ -223,7 +242,6 @@ int ci_read_icap_header(ci_request_t * req, ci_headers_list_t * h, int timeout)
             return request_status;
         memmove(h->buf, req->pstrblock_read, req->pstrblock_read_len);
         readed = req->pstrblock_read_len;
-        buf_end = h->buf;
         bytes = readed;
         dataPrefetch = 1;
         req->pstrblock_read = NULL;
@@ -237,7 +255,7 @@ int ci_read_icap_header(ci_request_t * req, ci_headers_list_t * h, int timeout)
             if ((wait_status = wait_for_data(req->connection, timeout, ci_wait_for_read)) < 0)
                 return EC_408;
 
-            bytes = ci_connection_read_nonblock(req->connection, buf_end, ICAP_HEADER_READSIZE);
+            bytes = ci_connection_read_nonblock(req->connection, h->buf + readed, ICAP_HEADER_READSIZE);
             if (bytes < 0)
                 return EC_408;
 
@@ -249,29 +267,23 @@ int ci_read_icap_header(ci_request_t * req, ci_headers_list_t * h, int timeout)
         } else
             dataPrefetch = 0;
 
-        for (i = startsearch; i < bytes - 3; i++) {   /*search for end of header.... */
-            if (strncmp(buf_end + i, "\r\n\r\n", 4) == 0) {
-                buf_end = buf_end + i + 4;
-                eoh = 1;
-                break;
-            }
-        }
-        if (eoh)
+        /*Search for the end of header in the new data. The scanner keeps
+          the lines found, to build the headers index*/
+        if (ci_headers_scan(&scan, h->buf, readed))
             break;
 
         if ((request_status =
                     icap_header_check_realloc(&(h->buf), &(h->bufsize), readed,
                                               ICAP_HEADER_READSIZE)) != EC_100)
             break;
-        buf_end = h->buf + readed;
-        if (startsearch > -3)
-            startsearch = (readed > 3 ? -3 : -readed);       /*Including the last 3 char ellements ....... */
     } while (1);
 
-    h->bufused = buf_end - h->buf;     /* -1 ; */
-    req->pstrblock_read = buf_end; /*after the \r\n\r\n */
+    h->bufused = scan.eoh ? scan.eoh : readed;
+    req->pstrblock_read = h->buf + h->bufused; /*after the \r\n\r\n */
     req->pstrblock_read_len = readed - h->bufused;
     req->request_bytes_in = h->bufused;
+    if (request_status == EC_100)
+        request_status = ci_headers_unpack_scanned(h, &scan);
     return request_status;
 }
 
@@ -508,12 +520,10 @@ static int parse_header(ci_request_t * req)
     char *val;
 
     h = req->request_header;
+    /*The ci_read_icap_header also unpacks the headers*/
     if ((request_status = ci_read_icap_header(req, h, TIMEOUT)) != EC_100)
         return request_status;
 
-    if ((request_status = ci_headers_unpack(h)) != EC_100)
-        return request_status;
-
     if ((request_status = parse_request(req, h->headers[0])) != EC_100)
         return request_status;
 
@@ -782,80 +792,6 @@ const char *eol_str = "\r\n";
 const char *eof_str = "0\r\n\r\n";
 
 
-static int send_current_block_data(ci_request_t * req)
-{
-    int bytes;
-    if (req->remain_send_block_bytes == 0)
-        return 0;
-    if ((bytes =
-                ci_connection_write_nonblock(req->connection, req->pstrblock_responce,
-                        req->remain_send_block_bytes)) < 0) {
-        ci_debug_printf(5, "Error writing to socket (errno:%d, bytes:%d. string:\"%s\")", errno, req->remain_send_block_bytes, req->pstrblock_responce);
-        return CI_ERROR;
-    }
-    ci_clock_time_get(&req->stop_w_t);
-    /*
-         if (bytes == 0) {
-             ci_debug_printf(5, "Can not write to the client. Is the connection closed?");
-             return CI_ERROR;
-         }
-    */
-
-    req->pstrblock_responce += bytes;
-    req->remain_send_block_bytes -= bytes;
-    req->bytes_out += bytes;
-    if (req->status >= SEND_HEAD1 &&  req->status <= SEND_HEAD3)
-        req->http_bytes_out +=bytes;
-    return req->remain_send_block_bytes;
-}
-
-
-static int format_body_chunk(ci_request_t * req)
-{
-    int def_bytes;
-    char *wbuf = NULL;
-    char tmpbuf[EXTRA_CHUNK_SIZE];
-    static const size_t REQ_WBUF_SIZE = sizeof(((ci_request_t *)0)->wbuf);
-
-    if (!req->responce_hasbody)
-        return CI_EOF;
-    if (req->remain_send_block_bytes > 0) {
-        assert(req->remain_send_block_bytes <= MAX_CHUNK_SIZE);
-
-        /*The data are not written yet but I hope there is not any problem.
-          It is difficult to compute data sent */
-        req->http_bytes_out += req->remain_send_block_bytes;
-        req->body_bytes_out += req->remain_send_block_bytes;
-
-        wbuf = req->wbuf + EXTRA_CHUNK_SIZE + req->remain_send_block_bytes;
-        /*Put the "\r\n" sequence at the end of chunk */
-        *(wbuf++) = '\r';
-        *wbuf = '\n';
-        def_bytes =
-            snprintf(tmpbuf, sizeof(tmpbuf), "%x\r\n",
-                     req->remain_send_block_bytes);
-        assert(def_bytes < EXTRA_CHUNK_SIZE);
-        wbuf = req->wbuf + EXTRA_CHUNK_SIZE - def_bytes;      /*Copy the chunk define in the beggining of chunk ..... */
-        memcpy(wbuf, tmpbuf, def_bytes);
-        req->pstrblock_responce = wbuf;
-        req->remain_send_block_bytes += def_bytes + 2;
-    } else if (req->remain_send_block_bytes == CI_EOF) {
-        if (req->return_code == EC_206 && req->i206_use_original_body >= 0) {
-            def_bytes = snprintf(req->wbuf, REQ_WBUF_SIZE,
-                                 "0; use-original-body=%" PRId64 "\r\n\r\n",
-                                 req->i206_use_original_body );
-            req->pstrblock_responce = req->wbuf;
-            req->remain_send_block_bytes = def_bytes;
-        } else {
-            def_bytes = snprintf(req->wbuf, REQ_WBUF_SIZE, "0\r\n\r\n");
-            req->pstrblock_responce = req->wbuf;
-            req->remain_send_block_bytes = def_bytes;
-        }
-        return CI_EOF;
-    }
-    return CI_OK;
-}
-
 /*
 The
 if((ret=send_current_block_data(req))!=0)
@@ -979,6 +915,19 @@ static int mod_echo_io(char *wbuf, int *wlen, char *rbuf, int *rlen, int iseof,
     return CI_OK;
 }
 
+/*The service output must be compressed, setup the body encoder*/
+static int start_body_encoder(ci_request_t *req, int (*service_io) (char *rbuf, int *rlen, char *wbuf, int *wlen, int iseof, ci_request_t *))
+{
+    ci_service_xdata_t *srv_xdata;
+    int level = req->body_encoding_level;
+    if (level < 0 && (srv_xdata = service_data(req->current_service_mod))) {
+        ci_thread_rwlock_rdlock(&srv_xdata->lock);
+        level = srv_xdata->compression_level;
+        ci_thread_rwlock_unlock(&srv_xdata->lock);
+    }
+    return ci_request_body_encoder_start(req, service_io, level);
+}
+
 static int get_send_body(ci_request_t * req, int parse_only)
 {
     char *wchunkdata = NULL, *rchunkdata = NULL;
@@ -997,6 +946,11 @@ static int get_send_body(ci_request_t * req, int parse_only)
         service_io = req->current_service_mod->mod_service_io;
     if (!service_io)
         return CI_ERROR;
+    if (service_io == req->current_service_mod->mod_service_io && req->body_encoding != CI_ENCODE_NONE) {
+        if (!start_body_encoder(req, service_io))
+            return CI_ERROR;
+        service_io = ci_request_body_encoder_io;
+    }
 
     req->status = SEND_NOTHING;
     /*in the case we did not have preview data and body is small maybe
@@ -1075,9 +1029,9 @@ static int get_send_body(ci_request_t * req, int parse_only)
                     rchunkdata = req->wbuf + EXTRA_CHUNK_SIZE;
                     req->pstrblock_responce = rchunkdata;  /*does not needed! */
                 }
-                if ((MAX_CHUNK_SIZE - req->remain_send_block_bytes) > 0
+                if ((CI_REQUEST_MAX_CHUNK_SIZE(req) - req->remain_send_block_bytes) > 0
                         && has_formated_data == 0) {
-                    rbytes = MAX_CHUNK_SIZE - req->remain_send_block_bytes;
+                    rbytes = CI_REQUEST_MAX_CHUNK_SIZE(req) - req->remain_send_block_bytes;
                 } else {
                     rbytes = 0;
                 }
@@ -1133,7 +1087,7 @@ static int get_send_body(ci_request_t * req, int parse_only)
             if (req->remain_send_block_bytes == 0 && service_eof == 1)
                 req->remain_send_block_bytes = CI_EOF;
             if (has_formated_data == 0) {
-                if (format_body_chunk(req) == CI_EOF)
+                if (format_body_chunk(req, service_eof) == CI_EOF)
                     req->status = SEND_EOF;
             }
         }
@@ -1170,6 +1124,41 @@ static int get_send_body(ci_request_t * req, int parse_only)
 }
 
 
+/*
+  Reads the service data to req->wbuf, after the space reserved for the
+  chunk definition, until the chunk is full or the service has no more
+  data for now, so that the last-chunk may be sent with the last data.
+  Returns the bytes read or CI_ERROR, and sets service_eof if the service
+  has no more data.
+*/
+static int read_service_chunk(ci_request_t * req, int (*service_io) (char *rbuf, int *rlen, char *wbuf, int *wlen, int iseof, ci_request_t *), int *service_eof)
+{
+    ci_clock_time_t start_t, end_t;
+    int res, bytes, len = 0;
+    char *buf = req->wbuf + EXTRA_CHUNK_SIZE;
+    *service_eof = 0;
+    do {
+        bytes = CI_REQUEST_MAX_CHUNK_SIZE(req) - len;
+        ci_debug_printf(9, "rest response: going to read: %d bytes\n", bytes);
+        ci_clock_time_get(&start_t);
+        res = service_io(buf + len, &bytes, NULL, NULL, 1, req);
+        ci_clock_time_get(&end_t);
+        if (service_io != mod_echo_io)
+            req->processing_time += ci_clock_time_diff_nano(&end_t, &start_t);
+
+        ci_debug_printf(9, "rest response: read: %d bytes\n", bytes);
+
+        if (res == CI_ERROR)    /*CI_EOF of CI_ERROR, stop sending.... */
+            return CI_ERROR;
+
+        if (bytes == CI_EOF)
+            *service_eof = 1;
+        else if (bytes > 0)
+            len += bytes;
+    } while (bytes > 0 && len < CI_REQUEST_MAX_CHUNK_SIZE(req));
+    return len;
+}
+
 /*Return CI_ERROR on error or CI_OK on success*/
 static int send_remaining_response(ci_request_t * req)
 {
@@ -1183,6 +1172,11 @@ static int send_remaining_response(ci_request_t * req)
 
     if (!service_io)
         return CI_ERROR;
+    if (service_io == req->current_service_mod->mod_service_io && req->body_encoding != CI_ENCODE_NONE) {
+        if (!start_body_encoder(req, service_io))
+            return CI_ERROR;
+        service_io = ci_request_body_encoder_io;
+    }
 
 
     if (req->status == SEND_EOF && req->remain_send_block_bytes == 0) {
@@ -1190,6 +1184,19 @@ static int send_remaining_response(ci_request_t * req)
         return CI_OK;
     }
     do {
+        /*
+          The body data the service already has, or its last-chunk, are
+          sent with the response headers, a small response takes one write.
+        */
+        if (req->status >= SEND_RESPHEAD && req->status <= SEND_HEAD3 &&
+                req->remain_send_block_bytes > 0 && req->responce_hasbody &&
+                req->ready_body.len == 0) {
+            int bytes, service_eof;
+            if ((bytes = read_service_chunk(req, service_io, &service_eof)) == CI_ERROR)
+                return CI_ERROR;
+            format_ready_body_chunk(req, bytes, service_eof);
+        }
+
         while (req->remain_send_block_bytes > 0) {
             if ((ret =
                         wait_for_data(req->connection, TIMEOUT,
@@ -1203,27 +1210,19 @@ static int send_remaining_response(ci_request_t * req)
         }
 
         if (req->status == SEND_BODY && req->remain_send_block_bytes == 0) {
+            int bytes, service_eof;
             req->pstrblock_responce = req->wbuf + EXTRA_CHUNK_SIZE;  /*Leave space for chunk spec.. */
-            req->remain_send_block_bytes = MAX_CHUNK_SIZE;
-            ci_debug_printf(9, "rest response: going to read: %d bytes\n", req->remain_send_block_bytes);
-            ci_clock_time_t start_t, end_t;
-            int res;
-            ci_clock_time_get(&start_t);
-            res = service_io(req->pstrblock_responce,
-                             &(req->remain_send_block_bytes), NULL, NULL, 1, req);
-            ci_clock_time_get(&end_t);
-            if (service_io != mod_echo_io)
-                req->processing_time += ci_clock_time_diff_nano(&end_t, &start_t);
-
-            ci_debug_printf(9, "rest response: read: %d bytes\n", req->remain_send_block_bytes);
-
-            if (res == CI_ERROR)    /*CI_EOF of CI_ERROR, stop sending.... */
+            if ((bytes = read_service_chunk(req, service_io, &service_eof)) == CI_ERROR)
                 return CI_ERROR;
+            req->remain_send_block_bytes = bytes;
 
-            if (req->remain_send_block_bytes == 0)
-                break;
+            if (req->remain_send_block_bytes == 0) {
+                if (!service_eof)
+                    break;
+                req->remain_send_block_bytes = CI_EOF;
+            }
 
-            if ((ret = format_body_chunk(req)) == CI_EOF) {
+            if ((ret = format_body_chunk(req, service_eof)) == CI_EOF) {
                 req->status = SEND_EOF;
             }
         }
@@ -1755,6 +1754,7 @@ int process_request(ci_request_t * req)
 {
     int res;
     ci_service_xdata_t *srv_xdata;
+    ci_stat_memblock_t *stats;
 
     if (req->protocol == CI_PROTO_HTTP)
         return http_process_request(req);
@@ -1781,48 +1781,69 @@ int process_request(ci_request_t * req)
   many counters. Moreover the c-icap may have more than 500-1000
   running threads, is not bad idea to put a thread in a wait-state (mutex-lock)
   to give to the other threads the chance to make some job.
+  When the per-thread statistics shards are enabled, the counters are
+  updated in the private statistics block of the thread without locking.
  */
-    ci_thread_mutex_lock(&STAT_MTX);
-    if (!STATS)
-        STATS = ci_stat_memblock_get();
+    stats = ci_stat_thread_memblock_get();
+    if (!stats) {
+        ci_thread_mutex_lock(&STAT_MTX);
+        if (!STATS)
+            STATS = ci_stat_memblock_get();
+        stats = STATS;
+    }
 
-    assert(STATS);
-    STAT_INT64_INC_NL(STATS, STAT_REQUESTS, 1);
+    assert(stats);
+    STAT_INT64_INC_NL(stats, STAT_REQUESTS, 1);
 
     if (req->type == ICAP_REQMOD) {
-        STAT_INT64_INC_NL(STATS, STAT_REQMODS, 1);
+        STAT_INT64_INC_NL(stats, STAT_REQMODS, 1);
         if (srv_xdata)
-            STAT_INT64_INC_NL(STATS, srv_xdata->stat_reqmods, 1);
+            STAT_INT64_INC_NL(stats, srv_xdata->stat_reqmods, 1);
     } else if (req->type == ICAP_RESPMOD) {
-        STAT_INT64_INC_NL(STATS, STAT_RESPMODS, 1);
+        STAT_INT64_INC_NL(stats, STAT_RESPMODS, 1);
         if (srv_xdata)
-            STAT_INT64_INC_NL(STATS, srv_xdata->stat_respmods, 1);
+            STAT_INT64_INC_NL(stats, srv_xdata->stat_respmods, 1);
     } else if (req->type == ICAP_OPTIONS) {
-        STAT_INT64_INC_NL(STATS, STAT_OPTIONS, 1);
+        STAT_INT64_INC_NL(stats, STAT_OPTIONS, 1);
         if (srv_xdata)
-            STAT_INT64_INC_NL(STATS, srv_xdata->stat_options, 1);
+            STAT_INT64_INC_NL(stats, srv_xdata->stat_options, 1);
     }
 
     if (res <0 && STAT_FAILED_REQUESTS >= 0)
-        STAT_INT64_INC_NL(STATS, STAT_FAILED_REQUESTS, 1);
+        STAT_INT64_INC_NL(stats, STAT_FAILED_REQUESTS, 1);
     else if (req->return_code == EC_204) {
-        STAT_INT64_INC_NL(STATS, STAT_ALLOW204, 1);
+        STAT_INT64_INC_NL(stats, STAT_ALLOW204, 1);
         if (srv_xdata)
-            STAT_INT64_INC_NL(STATS, srv_xdata->stat_allow204, 1);
+            STAT_INT64_INC_NL(stats, srv_xdata->stat_allow204, 1);
     } else if (req->return_code == EC_206) {
-        STAT_INT64_INC_NL(STATS, STAT_ALLOW206, 1);
+        STAT_INT64_INC_NL(stats, STAT_ALLOW206, 1);
         if (srv_xdata)
-            STAT_INT64_INC_NL(STATS, srv_xdata->stat_allow206, 1);
+            STAT_INT64_INC_NL(stats, srv_xdata->stat_allow206, 1);
     }
 
-    STAT_KBS_INC_NL(STATS, STAT_BYTES_IN, req->bytes_in);
-    STAT_KBS_INC_NL(STATS, STAT_BYTES_OUT, req->bytes_out);
-    STAT_KBS_INC_NL(STATS, STAT_HTTP_BYTES_IN, req->http_bytes_in);
-    STAT_KBS_INC_NL(STATS, STAT_HTTP_BYTES_OUT, req->http_bytes_out);
-    STAT_KBS_INC_NL(STATS, STAT_BODY_BYTES_IN, req->body_bytes_in);
-    STAT_KBS_INC_NL(STATS, STAT_BODY_BYTES_OUT, req->body_bytes_out);
+    STAT_KBS_INC_NL(stats, STAT_BYTES_IN, req->bytes_in);
+    STAT_KBS_INC_NL(stats, STAT_BYTES_OUT, req->bytes_out);
+    STAT_KBS_INC_NL(stats, STAT_HTTP_BYTES_IN, req->http_bytes_in);
+    STAT_KBS_INC_NL(stats, STAT_HTTP_BYTES_OUT, req->http_bytes_out);
+    STAT_KBS_INC_NL(stats, STAT_BODY_BYTES_IN, req->body_bytes_in);
+    STAT_KBS_INC_NL(stats, STAT_BODY_BYTES_OUT, req->body_bytes_out);
+
+    if (srv_xdata) {
+        STAT_KBS_INC_NL(stats, srv_xdata->stat_bytes_in, req->bytes_in);
+        STAT_KBS_INC_NL(stats, srv_xdata->stat_bytes_out, req->bytes_out);
+        STAT_KBS_INC_NL(stats, srv_xdata->stat_http_bytes_in, req->http_bytes_in);
+        STAT_KBS_INC_NL(stats, srv_xdata->stat_http_bytes_out, req->http_bytes_out);
+        STAT_KBS_INC_NL(stats, srv_xdata->stat_body_bytes_in, req->body_bytes_in);
+        STAT_KBS_INC_NL(stats, srv_xdata->stat_body_bytes_out, req->body_bytes_out);
+    }
+
+    /*The per-thread statistics block is updated without locking, but
+      the request times are shared by all threads*/
+    if (stats != STATS)
+        ci_thread_mutex_lock(&STAT_MTX);
 
     uint64_t req_processing_time = req->processing_time / 1000;
+    uint64_t us = ci_clock_time_diff_micro(&req->stop_w_t, &req->start_r_t);
     time_t curr_time = ci_clock_time_to_unixtime(&req->stop_w_t);
     if (curr_time > STAT_TIME.indx) {
         if (STAT_TIME.requests) {
@@ -1847,7 +1868,6 @@ int process_request(ci_request_t * req)
             srv_xdata->stat_time.requests = 0;
         }
     } else {
-        uint64_t us = ci_clock_time_diff_micro(&req->stop_w_t, &req->start_r_t);
         STAT_TIME.accumulated_time += us;
         STAT_TIME.accumulated_proc_time += req_processing_time;
         STAT_TIME.requests++;
@@ -1858,16 +1878,15 @@ int process_request(ci_request_t * req)
         }
     }
     ci_debug_printf(9, "Accumulated time %lld, %d\n", (long long)STAT_TIME.accumulated_time, STAT_TIME.requests);
-
-    if (srv_xdata) {
-        STAT_KBS_INC_NL(STATS, srv_xdata->stat_bytes_in, req->bytes_in);
-        STAT_KBS_INC_NL(STATS, srv_xdata->stat_bytes_out, req->bytes_out);
-        STAT_KBS_INC_NL(STATS, srv_xdata->stat_http_bytes_in, req->http_bytes_in);
-        STAT_KBS_INC_NL(STATS, srv_xdata->stat_http_bytes_out, req->http_bytes_out);
-        STAT_KBS_INC_NL(STATS, srv_xdata->stat_body_bytes_in, req->body_bytes_in);
-        STAT_KBS_INC_NL(STATS, srv_xdata->stat_body_bytes_out, req->body_bytes_out);
-    }
     ci_thread_mutex_unlock(&STAT_MTX);
 
+    /*The histograms are shared by all children and updated atomically*/
+    ci_stat_histo_update(HISTO_REQUEST_TIME, us);
+    ci_stat_histo_update(HISTO_PROC_TIME, req_processing_time);
+    if (req->hasbody)
+        ci_stat_histo_update(HISTO_BODY_BYTES_IN, req->body_bytes_in);
+    if (srv_xdata)
+        ci_stat_histo_update(srv_xdata->histo_proc_time, req_processing_time);
+
     return res; /*Allow to log even the failed requests*/
 }
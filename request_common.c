@@ -28,6 +28,7 @@
 #include "request_util.h"
 #include "util.h"
 #include "body.h"
+#include "encoding.h"
 #include "mem.h"
 
 /* struct buf functions*/
@@ -226,14 +227,66 @@ int ci_request_release_entity(ci_request_t * req, int pos)
 }
 
 
+/*
+  The request memory arena is a serial allocator, which is reset when
+  the request is reset. The objects which do not fit in an arena block
+  are allocated by the serial allocator in their own block and are
+  released on reset too.
+*/
+#define CI_REQUEST_ARENA_SIZE 4096
+
+void *ci_request_mem_alloc(ci_request_t *req, size_t size)
+{
+    assert(req);
+    if (!req->mem_arena && !(req->mem_arena = ci_create_serial_allocator(CI_REQUEST_ARENA_SIZE)))
+        return NULL;
+    return req->mem_arena->alloc(req->mem_arena, size);
+}
+
+char *ci_request_mem_strdup(ci_request_t *req, const char *str)
+{
+    char *s;
+    size_t len = strlen(str) + 1;
+    if ((s = ci_request_mem_alloc(req, len)))
+        memcpy(s, str, len);
+    return s;
+}
+
+static void request_mem_arena_reset(ci_request_t *req)
+{
+    req->acl_memo = NULL;
+    if (req->mem_arena)
+        req->mem_arena->reset(req->mem_arena);
+}
+
+int CI_REQUEST_BUFFER_SIZE = BUFSIZE;
+
 ci_request_t *ci_request_alloc(ci_connection_t * connection)
 {
     ci_request_t *req;
-    int i;
+    int i, buf_size;
     req = (ci_request_t *) malloc(sizeof(ci_request_t));
     if (!req)
         return NULL;
 
+    buf_size = CI_REQUEST_BUFFER_SIZE;
+    if (buf_size < CI_REQUEST_MIN_BUFFER_SIZE)
+        buf_size = CI_REQUEST_MIN_BUFFER_SIZE;
+    else if (buf_size > CI_REQUEST_MAX_BUFFER_SIZE)
+        buf_size = CI_REQUEST_MAX_BUFFER_SIZE;
+    req->rbuf = ci_buffer_alloc(buf_size);
+    req->wbuf = ci_buffer_alloc(buf_size);
+    if (!req->rbuf || !req->wbuf) {
+        if (req->rbuf)
+            ci_buffer_free(req->rbuf);
+        if (req->wbuf)
+            ci_buffer_free(req->wbuf);
+        free(req);
+        return NULL;
+    }
+    req->rbuf_size = buf_size;
+    req->wbuf_size = buf_size;
+
     req->connection = connection;
     req->packed = 0;
     req->user[0] = '\0';
@@ -274,8 +327,13 @@ ci_request_t *ci_request_alloc(ci_connection_t * connection)
 
     req->pstrblock_responce = NULL;
     req->remain_send_block_bytes = 0;
+    req->ready_body.buf = NULL;
+    req->ready_body.len = 0;
     req->data_locked = 1;
     req->i206_use_original_body = -1;
+    req->body_encoding = CI_ENCODE_NONE;
+    req->body_encoding_level = -1;
+    req->body_encoder = NULL;
 
     req->echo_body = NULL;
 
@@ -287,6 +345,8 @@ ci_request_t *ci_request_alloc(ci_connection_t * connection)
 
     req->log_str = NULL;
     req->attributes = NULL;
+    req->mem_arena = NULL;
+    req->acl_memo = NULL;
     memset(&(req->xclient_ip), 0, sizeof(ci_ip_t));
 
     req->bytes_in = 0;
@@ -312,6 +372,106 @@ ci_request_t *ci_request_alloc(ci_connection_t * connection)
 
 }
 
+/*
+  The body encoder compresses the data produced by the service io function
+  before they are formatted as chunks and sent to the ICAP client. The
+  service data are read to the encoder buffer and the compressed data are
+  drained to the request output buffer, so the memory used is bounded.
+*/
+struct ci_body_encoder {
+    ci_compressor_t *comp;
+    int (*service_io)(char *rbuf, int *rlen, char *wbuf, int *wlen, int iseof, ci_request_t *req);
+    char *buf;
+    int buf_size;
+    int status;
+    int service_eof;
+};
+
+static void body_encoder_release(ci_request_t *req)
+{
+    struct ci_body_encoder *enc = req->body_encoder;
+    ci_compressor_destroy(enc->comp);
+    ci_buffer_free(enc->buf);
+    ci_buffer_free(enc);
+    req->body_encoder = NULL;
+}
+
+int ci_request_body_encoder_start(ci_request_t *req, int (*service_io)(char *rbuf, int *rlen, char *wbuf, int *wlen, int iseof, ci_request_t *req), int level)
+{
+    struct ci_body_encoder *enc;
+    if (req->body_encoder)
+        return 1;
+    if (!(enc = ci_buffer_alloc(sizeof(struct ci_body_encoder))))
+        return 0;
+    enc->service_io = service_io;
+    enc->buf_size = CI_REQUEST_MAX_CHUNK_SIZE(req);
+    enc->buf = ci_buffer_alloc(enc->buf_size);
+    enc->comp = ci_compressor_create(req->body_encoding, level);
+    enc->status = CI_COMP_NEED_INPUT;
+    enc->service_eof = 0;
+    req->body_encoder = enc;
+    if (!enc->buf || !enc->comp) {
+        ci_debug_printf(1, "Failed to initialize the %s body encoder\n", ci_encoding_method_str(req->body_encoding));
+        body_encoder_release(req);
+        return 0;
+    }
+    return 1;
+}
+
+int ci_request_body_encoder_io(char *rbuf, int *rlen, char *wbuf, int *wlen, int iseof, ci_request_t *req)
+{
+    struct ci_body_encoder *enc = req->body_encoder;
+    int space = (rbuf && rlen && *rlen > 0) ? *rlen : 0;
+    int wsize = (wbuf && wlen && *wlen > 0) ? *wlen : 0;
+    int filled = 0, written = 0, bytes = 0, wbytes = 0, res, called = 0;
+    size_t outlen;
+
+    while (1) {
+        if (enc->status == CI_COMP_HAVE_OUTPUT) {
+            if (filled == space)
+                break;
+            enc->status = ci_compressor_drain(enc->comp, rbuf + filled, space - filled, &outlen);
+            filled += outlen;
+            if (enc->status < 0) {
+                ci_debug_printf(1, "Error compressing service data: %d\n", enc->status);
+                return CI_ERROR;
+            }
+            continue;
+        }
+        if (enc->status == CI_COMP_OK)
+            break;
+
+        /*CI_COMP_NEED_INPUT, pass the client data to the service and get
+          more data from service*/
+        if (called && (enc->service_eof || filled == space || (bytes == 0 && wbytes == 0)))
+            break;
+        bytes = (space > filled && !enc->service_eof) ? enc->buf_size : 0;
+        wbytes = wsize - written;
+        res = enc->service_io(enc->buf, &bytes, wbytes ? wbuf + written : NULL, wbytes ? &wbytes : NULL, iseof, req);
+        called = 1;
+        if (res == CI_ERROR || wbytes < 0)
+            return CI_ERROR;
+        written += wbytes;
+        if (bytes == CI_EOF) {
+            enc->service_eof = 1;
+            enc->status = ci_compressor_feed(enc->comp, NULL, 0, 1);
+        } else if (bytes > 0)
+            enc->status = ci_compressor_feed(enc->comp, enc->buf, bytes, 0);
+        else if (bytes < 0)
+            return CI_ERROR;
+    }
+
+    if (wlen)
+        *wlen = written;
+    if (rlen) {
+        if (filled == 0 && enc->status == CI_COMP_OK)
+            *rlen = CI_EOF;
+        else
+            *rlen = filled;
+    }
+    return CI_OK;
+}
+
 /*reset_request simply reset request to use it with tunneled requests
   The req->access_type must not be reset!!!!!
 
@@ -357,9 +517,15 @@ void ci_request_reset(ci_request_t * req)
     req->chunk_bytes_read = 0;
     req->pstrblock_responce = NULL;
     req->remain_send_block_bytes = 0;
+    req->ready_body.buf = NULL;
+    req->ready_body.len = 0;
     req->write_to_module_pending = 0;
     req->data_locked = 1;
     req->i206_use_original_body = -1;
+    req->body_encoding = CI_ENCODE_NONE;
+    req->body_encoding_level = -1;
+    if (req->body_encoder)
+        body_encoder_release(req);
 
     if (req->echo_body) {
         ci_ring_buf_destroy(req->echo_body);
@@ -372,13 +538,12 @@ void ci_request_reset(ci_request_t * req)
     req->proto_version.major = 0;
     req->proto_version.minor = 0;
 
-    if (req->log_str)
-        ci_buffer_free(req->log_str);
     req->log_str = NULL;
 
     if (req->attributes)
         ci_array_destroy(req->attributes);
     req->attributes = NULL;
+    request_mem_arena_reset(req);
     memset(&(req->xclient_ip), 0, sizeof(ci_ip_t));
 
     req->bytes_in = 0;
@@ -436,28 +601,26 @@ void ci_request_destroy(ci_request_t * req)
         req->echo_body = NULL;
     }
 
-    if (req->log_str)
-        ci_buffer_free(req->log_str);
+    if (req->body_encoder)
+        body_encoder_release(req);
 
     if (req->attributes)
         ci_array_destroy(req->attributes);
 
+    request_mem_arena_reset(req);
+    if (req->mem_arena)
+        ci_mem_allocator_destroy(req->mem_arena);
+
+    ci_buffer_free(req->rbuf);
+    ci_buffer_free(req->wbuf);
     free(req);
 }
 
 char *ci_request_set_log_str(ci_request_t *req, char *logstr)
 {
-    int size;
     assert(req);
-    if (req->log_str)
-        ci_buffer_free(req->log_str);
-
-    size = strlen(logstr) + 1;
-    req->log_str = ci_buffer_alloc(size * sizeof(char));
-    if (!req->log_str)
-        return NULL;
-    strncpy(req->log_str, logstr, size);
-    req->log_str[size] = '\0';
+    /*The previous string is released with the request memory*/
+    req->log_str = ci_request_mem_strdup(req, logstr);
     return req->log_str;
 }
 
@@ -495,10 +658,52 @@ int ci_request_206_origin_body(ci_request_t *req, uint64_t offset)
         return 0;
     }
 #endif
+    if (req->body_encoding != CI_ENCODE_NONE) {
+        ci_debug_printf(1, "The response body is encoded, can not set use-original-body extension\n");
+        return 0;
+    }
     req->i206_use_original_body = offset;
     return 1;
 }
 
+int ci_request_set_body_encoding(ci_request_t *req, int encoding, int level)
+{
+    ci_headers_list_t *headers;
+    char buf[256];
+
+    if (!req || req->body_encoder || req->status > SEND_NOTHING) {
+        ci_debug_printf(1, "Can not set the body encoding after the response body is started\n");
+        return 0;
+    }
+    if (encoding != CI_ENCODE_NONE && req->i206_use_original_body >= 0) {
+        /*The client would append the original not encoded body*/
+        ci_debug_printf(1, "Can not encode the response body of a use-original-body response\n");
+        return 0;
+    }
+    if (encoding != CI_ENCODE_NONE) {
+        /*Check if the method is supported*/
+        ci_compressor_t *comp = ci_compressor_create(encoding, level);
+        if (!comp)
+            return 0;
+        ci_compressor_destroy(comp);
+    }
+
+    headers = ci_http_response_headers(req);
+    if (!headers && req->type == ICAP_REQMOD)
+        headers = ci_http_request_headers(req);
+    if (headers) {
+        ci_headers_remove(headers, "Content-Length");
+        ci_headers_remove(headers, "Content-Encoding");
+        if (encoding != CI_ENCODE_NONE) {
+            snprintf(buf, sizeof(buf), "Content-Encoding: %s", ci_encoding_method_str(encoding));
+            ci_headers_add(headers, buf);
+        }
+    }
+    req->body_encoding = encoding;
+    req->body_encoding_level = level;
+    return 1;
+}
+
 int process_encapsulated(ci_request_t * req, const char *buf)
 {
     const char *start;
@@ -531,15 +736,70 @@ int process_encapsulated(ci_request_t * req, const char *buf)
 
 enum chunk_status { READ_CHUNK_DEF = 1, READ_CHUNK_DATA };
 
+/*The maximum chunk size, leaving space for the "\r\n" after chunk data*/
+#define CHUNK_SIZE_MAX (INT_MAX - 2)
+
+static inline int hex_digit(unsigned char c)
+{
+    if ((unsigned char)(c - '0') < 10)
+        return c - '0';
+    c |= 0x20;
+    if ((unsigned char)(c - 'a') < 6)
+        return c - 'a' + 10;
+    return -1;
+}
+
+/*
+  Parses a chunk definition line: the chunk size in hex, optional spaces
+  and an optional extension after a ';', terminated by "\r\n".
+  The size and the end of line are found in one pass over the line,
+  the "\r\n" is searched only after an extension.
+  Returns CI_OK and sets the chunk size, the extension or NULL and the
+  position after the "\r\n", CI_NEEDS_MORE if the line is not complete,
+  or CI_ERROR on parse errors and too big chunks.
+*/
+static int parse_chunk_def(const char *s, int len, unsigned int *size, const char **ext, const char **eol)
+{
+    const char *p = s, *end = s + len;
+    unsigned int val = 0;
+    int d, digits = 0;
+
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    for (; p < end && (d = hex_digit(*p)) >= 0; ++p, ++digits) {
+        if (val > (CHUNK_SIZE_MAX >> 4))
+            return CI_ERROR;
+        val = (val << 4) | d;
+    }
+    if (p < end && !digits)
+        return CI_ERROR;
+    if (val > CHUNK_SIZE_MAX)
+        return CI_ERROR;
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+
+    *ext = NULL;
+    if (p < end && *p == ';') {
+        *ext = p + 1;
+        if ((p = memchr(p, '\n', end - p)) == NULL)
+            return CI_NEEDS_MORE;
+        --p; /*should point to the '\r'*/
+    }
+    if (end - p < 2)
+        return CI_NEEDS_MORE;
+    if (p[0] != '\r' || p[1] != '\n')
+        return CI_ERROR;
+    *size = val;
+    *eol = p + 2;
+    return CI_OK;
+}
 
 /*
   maybe the wdata must moved to the ci_request_t and write_to_module_pending must replace wdata_len
 */
 int parse_chunk_data(ci_request_t * req, char **wdata)
 {
-    char *end;
-    const char *eofChunk;
-    int chunkLen, remains, tmp;
+    const char *eofChunk, *ext;
+    unsigned int size;
+    int chunkLen, remains, tmp, ret;
     int read_status = 0;
 
     *wdata = NULL;
@@ -555,66 +815,58 @@ int parse_chunk_data(ci_request_t * req, char **wdata)
             read_status = READ_CHUNK_DATA;
 
         if (read_status == READ_CHUNK_DEF) {
-            if ((eofChunk = strnstr(req->pstrblock_read, "\r\n", req->pstrblock_read_len)) == NULL) {
+            ret = parse_chunk_def(req->pstrblock_read, req->pstrblock_read_len, &size, &ext, &eofChunk);
+            if (ret == CI_NEEDS_MORE) {
                 /*Check for wrong protocol data, or possible parse error*/
-                if (req->pstrblock_read_len >= BUFSIZE)
+                if (req->pstrblock_read_len >= req->rbuf_size)
                     return CI_ERROR; /* To big chunk definition?*/
                 return CI_NEEDS_MORE;
             }
-            eofChunk += 2;
-            chunkLen = eofChunk - req->pstrblock_read;
-            // Count parse data
-            req->request_bytes_in += (eofChunk - req->pstrblock_read);
-
-            errno = 0;
-            tmp = strtol(req->pstrblock_read, &end, 16);
-            /*here must check for erron */
-            if (tmp == 0 && req->pstrblock_read == end) {    /*Oh .... an error ... */
-                ci_debug_printf(5, "Parse error:count=%d,start=%c\n",
-                                tmp, req->pstrblock_read[0]);
+            if (ret == CI_ERROR) {
+                ci_debug_printf(5, "Parse error in chunk definition: '%.*s'\n",
+                                (req->pstrblock_read_len < 32 ? req->pstrblock_read_len : 32),
+                                req->pstrblock_read);
                 return CI_ERROR;
             }
-            req->current_chunk_len = tmp;
+            chunkLen = eofChunk - req->pstrblock_read;
+            // Count parse data
+            req->request_bytes_in += chunkLen;
+
+            req->current_chunk_len = size;
             req->chunk_bytes_read = 0;
 
-            while (*end == ' ' || *end == '\t') ++end; /*ignore spaces*/
             if (req->current_chunk_len == 0) {
                 remains = req->pstrblock_read_len - chunkLen;
                 if (remains < 2) /*missing the \r\n of the 0[; ...]\r\n\r\n of the eof chunk*/
                     return CI_NEEDS_MORE;
 
-                if (*eofChunk != '\r' && *(eofChunk + 1) != '\n')
+                if (*eofChunk != '\r' || *(eofChunk + 1) != '\n')
                     return CI_ERROR; /* Not an \r\n\r\n eof chunk definition. Parse Error*/
 
-                eofChunk += 2;
                 chunkLen += 2;
                 req->request_bytes_in += 2; /*count 2 extra chars on parsed data*/
 
-                if (*end == ';') {
-                    end++;
-                    while (*end == ' ' || *end == '\t') ++end; /*ignore spaces*/
-                    remains = req->pstrblock_read_len - (end - req->pstrblock_read);
-                    if (remains >= 18 && strncmp(end, "use-original-body=", 18) == 0) {
-                        req->i206_use_original_body = strtol(end + 18, &end, 10);
-                    } else if (remains >= 4 && strncmp(end, "ieof", 4) != 0)
+                if (ext) {
+                    char *end;
+                    while (*ext == ' ' || *ext == '\t') ++ext; /*ignore spaces*/
+                    remains = (eofChunk - 2) - ext;
+                    if (remains >= 18 && strncmp(ext, "use-original-body=", 18) == 0) {
+                        req->i206_use_original_body = strtol(ext + 18, &end, 10);
+                    } else if (remains < 4 || strncmp(ext, "ieof", 4) != 0)
                         return CI_ERROR;
                     // ignore any char after ';'
-                    while (*end != '\r') ++end;
                     req->eof_received = 1;
                 }
 
             } else {
+                /*Chunk extensions are not expected in data chunks*/
+                if (ext)
+                    return CI_ERROR;
                 read_status = READ_CHUNK_DATA;
                 /*include the \r\n end of chunk data */
                 req->current_chunk_len += 2;
             }
 
-            /*The end pointing after the number and extensions. Should point to \r\n*/
-            if (*end != '\r' || *(end + 1) != '\n') {
-                /*Extra chars in chunk definition!*/
-                return CI_ERROR;
-            }
-
             req->pstrblock_read_len -= chunkLen;
             req->pstrblock_read += chunkLen;
         }
@@ -670,17 +922,20 @@ int net_data_read(ci_request_t * req)
     int bytes;
 
     if (req->pstrblock_read != req->rbuf) {
-        /*... put the current data to the begining of buf .... */
+        /*... put the current data to the begining of buf ....
+          The parsed chunk data are consumed before reading more data,
+          so these are only the few bytes of an incomplete chunk
+          definition, or the body data read with the ICAP headers. */
         if (req->pstrblock_read_len)
             memmove(req->rbuf, req->pstrblock_read, req->pstrblock_read_len);
         req->pstrblock_read = req->rbuf;
     }
 
-    bytes = BUFSIZE - req->pstrblock_read_len;
+    bytes = req->rbuf_size - req->pstrblock_read_len;
     if (bytes <= 0) {
         ci_debug_printf(5,
                         "Not enough space to read data! Is this a bug (%d %d)?????\n",
-                        req->pstrblock_read_len, BUFSIZE);
+                        req->pstrblock_read_len, req->rbuf_size);
         return CI_ERROR;
     }
 
@@ -0,0 +1,190 @@
+/*
+ *  Copyright (C) 2004-2022 Christos Tsantilas
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA.
+ */
+
+#include "common.h"
+#include "c-icap.h"
+#include "debug.h"
+#include "header.h"
+#include "request.h"
+#include "request_send.h"
+#include <errno.h>
+#include <assert.h>
+
+/*
+  Collects the current block and, while sending the ICAP response
+  headers, the encapsulated HTTP headers blocks which follow it and the
+  ready body chunk, so that they are sent with one writev call. The send
+  status of each block is stored in the statuses array.
+*/
+#define MAX_SEND_BLOCKS 5
+static int collect_send_blocks(ci_request_t * req, ci_iovec_t *iov, int *statuses)
+{
+    int n, status;
+    ci_encaps_entity_t *e;
+    iov[0].iov_base = req->pstrblock_responce;
+    iov[0].iov_len = req->remain_send_block_bytes;
+    statuses[0] = req->status;
+    n = 1;
+    if (req->status < SEND_RESPHEAD || req->status > SEND_HEAD3)
+        return n;
+
+    for (status = req->status + 1; status <= SEND_HEAD3; status++) {
+        e = req->entities[status - SEND_HEAD1];
+        if (e == NULL || (e->type != ICAP_REQ_HDR && e->type != ICAP_RES_HDR))
+            break;
+        iov[n].iov_base = ((ci_headers_list_t *) e->entity)->buf;
+        iov[n].iov_len = ((ci_headers_list_t *) e->entity)->bufused;
+        statuses[n] = status;
+        n++;
+    }
+    /*The body follows the last headers block*/
+    if (req->ready_body.len > 0) {
+        iov[n].iov_base = req->ready_body.buf;
+        iov[n].iov_len = req->ready_body.len;
+        statuses[n] = req->ready_body.status;
+        n++;
+    }
+    return n;
+}
+
+int send_current_block_data(ci_request_t * req)
+{
+    int bytes, i, n, block_bytes;
+    ci_iovec_t iov[MAX_SEND_BLOCKS];
+    int statuses[MAX_SEND_BLOCKS];
+    if (req->remain_send_block_bytes == 0)
+        return 0;
+    n = collect_send_blocks(req, iov, statuses);
+    if ((bytes = ci_connection_writev_nonblock(req->connection, iov, n)) < 0) {
+        ci_debug_printf(5, "Error writing to socket (errno:%d, bytes:%d. string:\"%s\")", errno, req->remain_send_block_bytes, req->pstrblock_responce);
+        return CI_ERROR;
+    }
+    ci_clock_time_get(&req->stop_w_t);
+    /*
+         if (bytes == 0) {
+             ci_debug_printf(5, "Can not write to the client. Is the connection closed?");
+             return CI_ERROR;
+         }
+    */
+
+    req->bytes_out += bytes;
+    /*Move to the first block which is not completely sent*/
+    for (i = 0; i < n; i++) {
+        block_bytes = (int)iov[i].iov_len < bytes ? (int)iov[i].iov_len : bytes;
+        if (statuses[i] >= SEND_HEAD1 &&  statuses[i] <= SEND_HEAD3)
+            req->http_bytes_out += block_bytes;
+        req->status = statuses[i];
+        req->pstrblock_responce = (char *)iov[i].iov_base + block_bytes;
+        req->remain_send_block_bytes = iov[i].iov_len - block_bytes;
+        bytes -= block_bytes;
+        if (req->remain_send_block_bytes > 0)
+            break;
+    }
+    /*The ready body chunk is the current block now*/
+    if (req->status > SEND_HEAD3) {
+        req->ready_body.buf = NULL;
+        req->ready_body.len = 0;
+    }
+    return req->remain_send_block_bytes;
+}
+
+
+static int format_last_chunk(ci_request_t * req, char *buf, size_t size)
+{
+    if (req->return_code == EC_206 && req->i206_use_original_body >= 0)
+        return snprintf(buf, size, "0; use-original-body=%" PRId64 "\r\n\r\n",
+                        req->i206_use_original_body);
+    return snprintf(buf, size, "0\r\n\r\n");
+}
+
+/*
+  Formats the data in req->wbuf as a chunk. If the service has no more
+  data (eof is non zero) the last-chunk is appended to the data chunk,
+  to be sent with the same write, and CI_EOF is returned.
+*/
+int format_body_chunk(ci_request_t * req, int eof)
+{
+    int def_bytes;
+    char *wbuf = NULL;
+    char tmpbuf[EXTRA_CHUNK_SIZE];
+
+    if (!req->responce_hasbody)
+        return CI_EOF;
+    if (req->remain_send_block_bytes > 0) {
+        assert(req->remain_send_block_bytes <= CI_REQUEST_MAX_CHUNK_SIZE(req));
+
+        /*The data are not written yet but I hope there is not any problem.
+          It is difficult to compute data sent */
+        req->http_bytes_out += req->remain_send_block_bytes;
+        req->body_bytes_out += req->remain_send_block_bytes;
+
+        wbuf = req->wbuf + EXTRA_CHUNK_SIZE + req->remain_send_block_bytes;
+        /*Put the "\r\n" sequence at the end of chunk */
+        *(wbuf++) = '\r';
+        *wbuf = '\n';
+        def_bytes =
+            snprintf(tmpbuf, sizeof(tmpbuf), "%x\r\n",
+                     req->remain_send_block_bytes);
+        assert(def_bytes < EXTRA_CHUNK_SIZE);
+        wbuf = req->wbuf + EXTRA_CHUNK_SIZE - def_bytes;      /*Copy the chunk define in the beggining of chunk ..... */
+        memcpy(wbuf, tmpbuf, def_bytes);
+        req->pstrblock_responce = wbuf;
+        req->remain_send_block_bytes += def_bytes + 2;
+        if (eof) {
+            /*The CI_LAST_CHUNK_RESERVE bytes after the chunk are free*/
+            wbuf = req->pstrblock_responce + req->remain_send_block_bytes;
+            def_bytes = format_last_chunk(req, wbuf, CI_LAST_CHUNK_RESERVE);
+            assert(def_bytes < CI_LAST_CHUNK_RESERVE);
+            req->remain_send_block_bytes += def_bytes;
+            return CI_EOF;
+        }
+    } else if (req->remain_send_block_bytes == CI_EOF) {
+        def_bytes = format_last_chunk(req, req->wbuf, req->wbuf_size);
+        req->pstrblock_responce = req->wbuf;
+        req->remain_send_block_bytes = def_bytes;
+        return CI_EOF;
+    }
+    return CI_OK;
+}
+
+/*
+  Formats the 'bytes' body data stored in req->wbuf, after the
+  EXTRA_CHUNK_SIZE bytes reserved for the chunk definition, as the chunk
+  which is sent with the response headers. The last-chunk is appended if
+  eof is non zero. Must be called while the headers are not completely
+  sent yet.
+*/
+int format_ready_body_chunk(ci_request_t *req, int bytes, int eof)
+{
+    char *headers_block = req->pstrblock_responce;
+    int headers_bytes = req->remain_send_block_bytes;
+    int ret;
+
+    assert(req->status >= SEND_RESPHEAD && req->status <= SEND_HEAD3);
+    if (!req->responce_hasbody || (bytes == 0 && !eof))
+        return CI_OK;
+    req->remain_send_block_bytes = bytes > 0 ? bytes : CI_EOF;
+    ret = format_body_chunk(req, eof);
+    req->ready_body.buf = req->pstrblock_responce;
+    req->ready_body.len = req->remain_send_block_bytes;
+    req->ready_body.status = (ret == CI_EOF ? SEND_EOF : SEND_BODY);
+    req->pstrblock_responce = headers_block;
+    req->remain_send_block_bytes = headers_bytes;
+    return ret;
+}
@@ -0,0 +1,33 @@
+/*
+ *  Copyright (C) 2004-2022 Christos Tsantilas
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *  MA  02110-1301  USA.
+ */
+
+#ifndef __C_ICAP_REQUEST_SEND_H
+#define __C_ICAP_REQUEST_SEND_H
+
+#include "request.h"
+
+/*
+  The response blocks writing functions of the c-icap server requests
+  state machine. They are not part of the c-icap library API.
+*/
+int send_current_block_data(ci_request_t *req);
+int format_body_chunk(ci_request_t *req, int eof);
+int format_ready_body_chunk(ci_request_t *req, int bytes, int eof);
+
+#endif
@@ -77,6 +77,7 @@ int cfg_srv_preview_size(const char *directive, const char **argv, void *setdata
 int cfg_srv_max_connections(const char *directive, const char **argv, void *setdata);
 int cfg_srv_options_ttl(const char *directive, const char **argv, void *setdata);
 int cfg_srv_allow206(const char *directive, const char **argv, void *setdata);
+int cfg_srv_compression_level(const char *directive, const char **argv, void *setdata);
 
 static struct ci_conf_entry services_global_conf_table[] = {
     {"TransferPreview", NULL, cfg_srv_transfer_preview, NULL},
@@ -86,6 +87,7 @@ static struct ci_conf_entry services_global_conf_table[] = {
     {"MaxConnections", NULL, cfg_srv_max_connections, NULL},
     {"OptionsTTL", NULL, cfg_srv_options_ttl, NULL},
     {"Allow206", NULL, cfg_srv_allow206, NULL},
+    {"CompressionLevel", NULL, cfg_srv_compression_level, NULL},
     {NULL, NULL, NULL, NULL}
 };
 
@@ -237,6 +239,26 @@ int cfg_srv_allow206(const char *directive, const char **argv, void *setdata)
     return 1;
 }
 
+int cfg_srv_compression_level(const char *directive, const char **argv, void *setdata)
+{
+    int level;
+    char *end;
+    struct ci_service_xdata *srv_xdata = ( struct ci_service_xdata *)setdata;
+    if (argv == NULL || argv[0] == NULL) {
+        ci_debug_printf(1, "Missing arguments in directive %s \n", directive);
+        return 0;
+    }
+    errno = 0;
+    level = strtol(argv[0], &end, 10);
+    if (errno != 0 || *end != '\0' || level < 0 || level > 22) {
+        ci_debug_printf(1, "Invalid argument in directive %s \n", directive);
+        return 0;
+    }
+    ci_debug_printf(2, "Setting parameter: %s=%d\n", directive, level);
+    ci_service_set_compression_level(srv_xdata, level);
+    return 1;
+}
+
 struct ci_conf_entry *create_service_conf_table(struct ci_service_xdata *srv_xdata,struct ci_conf_entry *user_table)
 {
     int i,k,size;
@@ -316,6 +338,7 @@ void init_extra_data(ci_service_xdata_t * srv_xdata, const char *service)
     srv_xdata->allow_204 = 0;
     srv_xdata->allow_206 = 0;
     srv_xdata->disable_206 = 0;
+    srv_xdata->compression_level = -1;
     srv_xdata->max_connections = -1;
     srv_xdata->xopts = 0;
     srv_xdata->status = CI_SERVICE_NOT_INITIALIZED;
@@ -345,6 +368,9 @@ void init_extra_data(ci_service_xdata_t * srv_xdata, const char *service)
     snprintf(buf, sizeof(buf), "Service %s PROCESSING TIME PER REQUEST", service);
     srv_xdata->stat_proc_time_per_request = service_stat_entry_register(buf, CI_STAT_TIME_US_T, stat_group);
 
+    snprintf(buf, sizeof(buf), "Service %s PROCESSING TIME", service);
+    srv_xdata->histo_proc_time = ci_stat_histo_create_hdr(buf, "usec", CI_HISTO_TIME_MAX, CI_HISTO_PRECISION_BITS);
+
     snprintf(buf, sizeof(buf), "Service %s BYTES IN", service);
     srv_xdata->stat_bytes_in = service_stat_entry_register(buf, CI_STAT_KBS_T, stat_group);
 
@@ -126,6 +126,13 @@ void ci_service_set_max_connections(ci_service_xdata_t *srv_xdata, int max_conne
     ci_thread_rwlock_unlock(&srv_xdata->lock);
 }
 
+void ci_service_set_compression_level(ci_service_xdata_t *srv_xdata, int level)
+{
+    ci_thread_rwlock_wrlock(&srv_xdata->lock);
+    srv_xdata->compression_level = level;
+    ci_thread_rwlock_unlock(&srv_xdata->lock);
+}
+
 void ci_service_set_options_ttl(ci_service_xdata_t *srv_xdata, int ttl)
 {
     ci_thread_rwlock_wrlock(&srv_xdata->lock);
@@ -24,14 +24,19 @@
 #include "body.h"
 #include "request_util.h"
 #include "debug.h"
+#include "encoding.h"
 
 enum srv_echo_mode {mode_echo, mode_allow204, mode_mix};
 static int MODE = mode_echo;
 static int USE_TRAILERS = 0;
+static int OUTPUT_ENCODING = CI_ENCODE_NONE;
 static int srv_echo_cfg_mode(const char *directive, const char **argv, void *setdata);
+static int srv_echo_cfg_output_encoding(const char *directive, const char **argv, void *setdata);
 static struct ci_conf_entry conf_variables[] = {
     {"Mode", NULL, srv_echo_cfg_mode, NULL},
-    {"UseTrailers", &USE_TRAILERS, ci_cfg_onoff, NULL}
+    {"UseTrailers", &USE_TRAILERS, ci_cfg_onoff, NULL},
+    {"OutputEncoding", NULL, srv_echo_cfg_output_encoding, NULL},
+    {NULL, NULL, NULL, NULL}
 };
 
 int echo_init_service(ci_service_xdata_t * srv_xdata,
@@ -198,6 +203,11 @@ int echo_check_preview_handler(char *preview_data, int preview_data_len,
             ci_ring_buf_write(echo_data->body, preview_data, preview_data_len);
             echo_data->eof = ci_req_hasalldata(req);
         }
+        /*Let the c-icap server compress the echoed body, if the
+          HTTP response body is not already compressed*/
+        if (OUTPUT_ENCODING != CI_ENCODE_NONE &&
+            ci_http_response_content_encoding(req) == CI_ENCODE_NONE)
+            ci_request_set_body_encoding(req, OUTPUT_ENCODING, -1);
         ci_icap_add_xheader(req, "X-Echo-Action: continue");
         if (USE_TRAILERS && ci_req_allow_trailers(req))
             ci_icap_response_promise_trailers(req, "X-Echo-Trailer");
@@ -268,3 +278,20 @@ int srv_echo_cfg_mode(const char *directive, const char **argv, void *setdata)
     }
     return 1;
 }
+
+int srv_echo_cfg_output_encoding(const char *directive, const char **argv, void *setdata)
+{
+    int encoding;
+    if (argv == NULL || argv[0] == NULL) {
+        ci_debug_printf(1, "Missing arguments in directive %s \n", directive);
+        return 0;
+    }
+    if (strcasecmp(argv[0], "none") == 0)
+        encoding = CI_ENCODE_NONE;
+    else if ((encoding = ci_encoding_method(argv[0])) == CI_ENCODE_UNKNOWN) {
+        ci_debug_printf(1, "Unknown value '%s' for configuration parameter '%s'\n", argv[0], directive);
+        return 0;
+    }
+    OUTPUT_ENCODING = encoding;
+    return 1;
+}
@@ -50,15 +50,49 @@ struct stat_groups_list {
 struct stat_entry_list STAT_STATS = {NULL, 0, 0};
 struct stat_groups_list STAT_GROUPS = {NULL, 0, 0};
 
+/*
+  The per-thread statistics shards.
+  When CI_STAT_THREAD_SHARDS is set, every thread increases the counters
+  of a private memory block, so the threads do not share the cache lines
+  of the hot counters. The shards are folded to the statistics memory
+  block, the one the other processes read, periodically by the c-icap
+  child main loop and when the statistics are read by the current
+  process.
+  A shard has only one writer thread and its counters are never reset.
+  The folder keeps the values it has already folded and adds to the
+  statistics memory block only the difference.
+*/
+int CI_STAT_THREAD_SHARDS = 0;
+
+#define STAT_SHARD_ALIGN 64
+
+struct stat_shard {
+    ci_stat_memblock_t *block;
+    uint64_t *folded;
+    struct stat_shard *next;
+};
+
+struct stat_thread {
+    unsigned int area_id;
+    struct stat_shard *shard;
+};
+
 struct stat_area {
     void (*release_mem)(void *);
     ci_stat_memblock_t *mem_block;
     size_t mem_block_size;
     void *histos;
     size_t histos_size;
+    unsigned int id;
+    struct stat_shard *shards;
+    ci_thread_mutex_t shards_mtx;
 };
 struct stat_area *STATS = NULL;
 
+static unsigned int StatAreaId = 0;
+static ci_thread_key_t StatThreadKey;
+static int StatThreadKeyInitialized = 0;
+
 #define STEP 128
 
 static struct stat_area * ci_stat_area_construct(void *mem_block, size_t size, void *histos, size_t histos_size, void (*release_mem)(void *));
@@ -271,41 +305,179 @@ void ci_stat_release()
 {
     if (!STATS)
         return;
+    /*The shared statistics memory block may outlive this process*/
+    ci_stat_shards_fold();
     ci_stat_area_destroy(STATS);
     STATS = NULL;
 }
 
+static void stat_thread_release(void *data)
+{
+    /*The shard is kept, it is released with the statistics area*/
+    free(data);
+}
+
+static struct stat_shard *stat_shard_create(struct stat_area *area)
+{
+    struct stat_shard *shard;
+    size_t block_size = _CI_ALIGN(sizeof(ci_stat_memblock_t)) + area->mem_block->stats_count * sizeof(ci_stat_value_t);
+    size_t folded_size = area->mem_block->stats_count * sizeof(uint64_t);
+    uintptr_t block;
+
+    /*Keep the counters of the shard on their own cache lines*/
+    block_size = (block_size + STAT_SHARD_ALIGN - 1) & ~((size_t)STAT_SHARD_ALIGN - 1);
+    if (!(shard = calloc(1, sizeof(struct stat_shard) + folded_size + block_size + STAT_SHARD_ALIGN)))
+        return NULL;
+    shard->folded = (uint64_t *)((char *)shard + sizeof(struct stat_shard));
+    block = (uintptr_t)shard->folded + folded_size;
+    block = (block + STAT_SHARD_ALIGN - 1) & ~((uintptr_t)STAT_SHARD_ALIGN - 1);
+    shard->block = (ci_stat_memblock_t *)block;
+    shard->block->sig = MEMBLOCK_SIG;
+    shard->block->stats_count = area->mem_block->stats_count;
+
+    ci_thread_mutex_lock(&area->shards_mtx);
+    shard->next = area->shards;
+    area->shards = shard;
+    ci_thread_mutex_unlock(&area->shards_mtx);
+    return shard;
+}
+
+/*Returns the shard of the current thread, creating it if required*/
+static inline struct stat_shard *stat_thread_shard()
+{
+    struct stat_thread *thread;
+
+    if (!CI_STAT_THREAD_SHARDS || !STATS || !STATS->mem_block || !StatThreadKeyInitialized)
+        return NULL;
+
+    thread = ci_thread_key_get(StatThreadKey);
+    if (thread && thread->area_id == STATS->id)
+        return thread->shard;
+
+    if (!thread) {
+        if (!(thread = calloc(1, sizeof(struct stat_thread))))
+            return NULL;
+        if (ci_thread_key_set(StatThreadKey, thread) != 0) {
+            free(thread);
+            return NULL;
+        }
+    }
+    /*A new thread, or the statistics area is rebuilt*/
+    if (!(thread->shard = stat_shard_create(STATS)))
+        return NULL;
+    thread->area_id = STATS->id;
+    return thread->shard;
+}
+
+/*The shard has only one writer, no atomic operation is required*/
+static inline void stat_shard_add(struct stat_shard *shard, int ID, uint64_t count)
+{
+    _CI_STAT_NL_ADD(shard->block->stats[ID].counter, count);
+}
+
+/*Must called with area->shards_mtx locked*/
+static void stat_shard_fold(struct stat_area *area, struct stat_shard *shard)
+{
+    uint64_t value;
+    int i;
+
+    for (i = 0; i < shard->block->stats_count; i++) {
+        if (STAT_STATS.entries[i].type != CI_STAT_INT64_T && STAT_STATS.entries[i].type != CI_STAT_KBS_T)
+            continue;
+        ci_atomic_load_u64(&shard->block->stats[i].counter, &value);
+        if (value != shard->folded[i]) {
+            ci_atomic_add_u64(&area->mem_block->stats[i].counter, value - shard->folded[i]);
+            shard->folded[i] = value;
+        }
+    }
+}
+
+void ci_stat_shards_fold()
+{
+    struct stat_shard *shard;
+
+    if (!STATS || !STATS->mem_block || !STATS->shards)
+        return;
+
+    ci_thread_mutex_lock(&STATS->shards_mtx);
+    for (shard = STATS->shards; shard != NULL; shard = shard->next)
+        stat_shard_fold(STATS, shard);
+    ci_thread_mutex_unlock(&STATS->shards_mtx);
+}
+
+/*Folds only the given counter, for the readers of a single value*/
+static void stat_shards_fold_id(int ID)
+{
+    struct stat_shard *shard;
+    uint64_t value;
+
+    if (!STATS || !STATS->mem_block || !STATS->shards)
+        return;
+
+    if (STAT_STATS.entries[ID].type != CI_STAT_INT64_T && STAT_STATS.entries[ID].type != CI_STAT_KBS_T)
+        return;
+
+    ci_thread_mutex_lock(&STATS->shards_mtx);
+    for (shard = STATS->shards; shard != NULL; shard = shard->next) {
+        ci_atomic_load_u64(&shard->block->stats[ID].counter, &value);
+        if (value != shard->folded[ID]) {
+            ci_atomic_add_u64(&STATS->mem_block->stats[ID].counter, value - shard->folded[ID]);
+            shard->folded[ID] = value;
+        }
+    }
+    ci_thread_mutex_unlock(&STATS->shards_mtx);
+}
+
+ci_stat_memblock_t *ci_stat_thread_memblock_get()
+{
+    struct stat_shard *shard = stat_thread_shard();
+    return shard ? shard->block : NULL;
+}
+
 void ci_stat_uint64_inc(int ID, uint64_t count)
 {
+    struct stat_shard *shard;
     if (!STATS || !STATS->mem_block)
         return;
 
-    if (ID < 0 || ID > STATS->mem_block->stats_count)
+    if (ID < 0 || ID >= STATS->mem_block->stats_count)
         return;
 
-    ci_atomic_add_u64(&(STATS->mem_block->stats[ID].counter), (uint64_t)count);
+    if ((shard = stat_thread_shard()))
+        stat_shard_add(shard, ID, count);
+    else
+        ci_atomic_add_u64(&(STATS->mem_block->stats[ID].counter), (uint64_t)count);
 }
 
 void ci_stat_uint64_dec(int ID, uint64_t count)
 {
+    struct stat_shard *shard;
     if (!STATS || !STATS->mem_block)
         return;
 
-    if (ID < 0 || ID > STATS->mem_block->stats_count)
+    if (ID < 0 || ID >= STATS->mem_block->stats_count)
         return;
 
-    ci_atomic_sub_u64(&(STATS->mem_block->stats[ID].counter), (uint64_t)count);
+    /*The counters wrap around, the folded difference is still correct*/
+    if ((shard = stat_thread_shard()))
+        stat_shard_add(shard, ID, -count);
+    else
+        ci_atomic_sub_u64(&(STATS->mem_block->stats[ID].counter), (uint64_t)count);
 }
 
 void ci_stat_kbs_inc(int ID, uint64_t count)
 {
+    struct stat_shard *shard;
     if (!STATS || !STATS->mem_block)
         return;
 
-    if (ID < 0 || ID > STATS->mem_block->stats_count)
+    if (ID < 0 || ID >= STATS->mem_block->stats_count)
         return;
 
-    ci_kbs_lock_and_update(&(STATS->mem_block->stats[ID].kbs), count);
+    if ((shard = stat_thread_shard()))
+        stat_shard_add(shard, ID, count);
+    else
+        ci_kbs_lock_and_update(&(STATS->mem_block->stats[ID].kbs), count);
 }
 
 void ci_stat_value_set(int ID, uint64_t value)
@@ -313,7 +485,7 @@ void ci_stat_value_set(int ID, uint64_t value)
     if (!STATS || !STATS->mem_block)
         return;
 
-    if (ID < 0 || ID > STATS->mem_block->stats_count)
+    if (ID < 0 || ID >= STATS->mem_block->stats_count)
         return;
 
     /*This is also can set kbs statistic type*/
@@ -322,22 +494,29 @@ void ci_stat_value_set(int ID, uint64_t value)
 
 void ci_stat_update(const ci_stat_item_t *stats, int num)
 {
+    struct stat_shard *shard;
     int i;
     if (!STATS || !STATS->mem_block)
         return;
+    shard = stat_thread_shard();
     for (i = 0; i < num; ++i) {
         int id = stats[i].Id;
-        if ( id < 0 || id > STATS->mem_block->stats_count)
+        if ( id < 0 || id >= STATS->mem_block->stats_count)
             continue; /*May print a warning?*/
         switch (stats[i].type) {
         case CI_STAT_INT64_T:
-            if (stats[i].count < 0)
+            if (shard)
+                stat_shard_add(shard, id, (uint64_t)stats[i].count);
+            else if (stats[i].count < 0)
                 ci_atomic_sub_u64(&(STATS->mem_block->stats[id].counter), (uint64_t)(-stats[i].count));
             else
                 ci_atomic_add_u64(&(STATS->mem_block->stats[id].counter), (uint64_t)stats[i].count);
             break;
         case CI_STAT_KBS_T:
-            ci_kbs_lock_and_update(&(STATS->mem_block->stats[id].kbs), stats[i].count);
+            if (shard)
+                stat_shard_add(shard, id, stats[i].count);
+            else
+                ci_kbs_lock_and_update(&(STATS->mem_block->stats[id].kbs), stats[i].count);
             break;
         case CI_STAT_TIME_US_T:
         case CI_STAT_TIME_MS_T:
@@ -379,9 +558,10 @@ uint64_t ci_stat_uint64_get(int ID)
     if (!STATS || !STATS->mem_block)
         return 0;
 
-    if (ID >= 0 && ID < STATS->mem_block->stats_count)
+    if (ID >= 0 && ID < STATS->mem_block->stats_count) {
+        stat_shards_fold_id(ID);
         ci_atomic_load_u64(&STATS->mem_block->stats[ID].counter, &value);
-    else
+    } else
         value = 0;
     return value;
 }
@@ -396,6 +576,7 @@ ci_kbs_t ci_stat_kbs_get(int ID)
 
     if (ID >= 0 && ID < STATS->mem_block->stats_count) {
         uint64_t uint_val;
+        stat_shards_fold_id(ID);
         ci_atomic_load_u64(&STATS->mem_block->stats[ID].kbs.bytes, &uint_val);
         value.bytes = uint_val;
     } else
@@ -418,6 +599,7 @@ void ci_stat_statistics_iterate(void *data, int groupId, int (*stat_call)(void *
 {
     int ret = 0;
     int sid;
+    ci_stat_shards_fold();
     for (sid = 0; sid < STAT_STATS.entries_num && !ret; sid++) {
         if (groupId < 0 || groupId == STAT_STATS.entries[sid].gid) {
             ci_stat_t stat = {
@@ -450,11 +632,26 @@ struct stat_area *ci_stat_area_construct(void *mem_block, size_t size, void *his
     area->histos = histo;
     area->histos_size = histo_size;
     area->release_mem = release_mem;
+    area->id = ++StatAreaId;
+    area->shards = NULL;
+    ci_thread_mutex_init(&area->shards_mtx);
+    if (!StatThreadKeyInitialized) {
+        if (ci_thread_key_create(&StatThreadKey, stat_thread_release) == 0)
+            StatThreadKeyInitialized = 1;
+        else
+            ci_debug_printf(1, "WARNING: Can not create thread key, the statistics per-thread shards are disabled\n");
+    }
     return area;
 }
 
 void ci_stat_area_destroy(struct stat_area  *area)
 {
+    struct stat_shard *shard;
+    while ((shard = area->shards) != NULL) {
+        area->shards = shard->next;
+        free(shard);
+    }
+    ci_thread_mutex_destroy(&area->shards_mtx);
     if (area->release_mem) {
         area->release_mem(area->mem_block);
         if (area->histos)
@@ -526,6 +723,7 @@ typedef enum ci_histo_type {
     CI_HISTO_LOG,
     CI_HISTO_ENUM,
     CI_HISTO_CUSTOM_BINS,
+    CI_HISTO_HDR,
     CI_HISTO_END
 } ci_histo_type_t;
 
@@ -540,6 +738,7 @@ typedef struct ci_stat_histo_spec {
     size_t size;
     double step;
     unsigned int flags;
+    unsigned int sub_bits; /*The mantissa bits of the CI_HISTO_HDR bins*/
     //TODO: recheck if labels and custom_bins attached correctly to
     //      shared memory segments and used correctly.
     const char **labels;
@@ -567,12 +766,18 @@ int ci_stat_histo_register(const char *label, const char *data_descr, int items,
 {
     if (!Histos)
         Histos = ci_dyn_array_new2(64, sizeof(ci_stat_histo_spec_t));
+    /*Already registered, eg by a service initialized again on reconfigure*/
+    const ci_stat_histo_spec_t *exists = ci_dyn_array_search(Histos, label);
+    if (exists)
+        return (exists->histo_type == type && exists->min == min && exists->max == max) ? (int)exists->id : -1;
     unsigned int id = (unsigned int)HistoPos;
-    if (items > (max - min))
+    if (type != CI_HISTO_HDR && items > (max - min))
         items = max - min;
     double step;
     if (type == CI_HISTO_LOG)
         step = ((double) (items - 1) / log((double) (max - min)));
+    else if (type == CI_HISTO_HDR)
+        step = 0;
     else {
         step = ((double) (items - 1) / (double) (max - min));
         _CI_ASSERT(step <= 1);
@@ -588,6 +793,7 @@ int ci_stat_histo_register(const char *label, const char *data_descr, int items,
                                         size: size,
                                         step: step,
                                         flags: 0,
+                                        sub_bits: 0,
                                         labels: NULL,
                                         custom_bins: NULL
     };
@@ -611,6 +817,7 @@ int ci_stat_histo_mem_initialize(void *histos, size_t size)
         ci_stat_histogram_t *histo = (ci_stat_histogram_t *)(histos + spec->id);
         histo->sig = CI_HISTO_SIG;
         memcpy(&histo->header, spec, sizeof(ci_stat_histo_spec_t));
+        histo->other = 0;
         memset(histo->bins, 0, spec->items * sizeof(ci_stat_value_t));
     }
     return 1;
@@ -810,13 +1017,16 @@ static void ci_stat_histo_update_custom_bins(ci_stat_histogram_t *histo, uint64_
     if (value >= histo->header.max)
         ci_atomic_add_u64(&histo->other, 1);
     else{
-        int i;
-        for(i = 0; i < histo->header.items; ++i) {
-            if (histo->header.custom_bins[i] >= value)
-                break;
+        /*The first bin which is not smaller than the value*/
+        int low = 0, high = histo->header.items - 1, mid;
+        while (low < high) {
+            mid = (low + high) / 2;
+            if (histo->header.custom_bins[mid] >= value)
+                high = mid;
+            else
+                low = mid + 1;
         }
-        /* _CI_ASSERT(i <=  histo->header.items); */
-        ci_atomic_add_u64(&histo->bins[i], 1);
+        ci_atomic_add_u64(&histo->bins[low], 1);
     }
 }
 
@@ -837,6 +1047,90 @@ char *ci_stat_histo_get_bin_label_custom_bins(ci_stat_histogram_t *histo, unsign
     return buf;
 }
 
+/*
+  HDR-like histograms. The values smaller than 2^(sub_bits + 1) have their
+  own bin. The bigger values are grouped by their highest set bit, and each
+  group is split to 2^sub_bits bins using the next sub_bits bits of the
+  value, so the bin width is never bigger than value / 2^sub_bits.
+*/
+static inline int histo_clz64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while (!(x & ((uint64_t)1 << 63))) {
+        x <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static inline unsigned int histo_hdr_bin(uint64_t value, unsigned int sub_bits)
+{
+    unsigned int shift;
+    if (value < ((uint64_t)1 << sub_bits))
+        return (unsigned int)value;
+    shift = 63 - histo_clz64(value) - sub_bits;
+    return ((shift + 1) << sub_bits) + (unsigned int)((value >> shift) & (((uint64_t)1 << sub_bits) - 1));
+}
+
+/*The biggest value stored in the given bin*/
+static inline uint64_t histo_hdr_bin_max(unsigned int bin, unsigned int sub_bits)
+{
+    unsigned int group = bin >> sub_bits;
+    uint64_t sub = bin & ((1U << sub_bits) - 1);
+    if (group == 0)
+        return sub;
+    return ((((uint64_t)1 << sub_bits) + sub + 1) << (group - 1)) - 1;
+}
+
+int ci_stat_histo_create_hdr(const char *label, const char *data_descr, uint64_t max, int precision_bits)
+{
+    if (precision_bits < 1)
+        precision_bits = 1;
+    else if (precision_bits > 10)
+        precision_bits = 10;
+    if (max < 1)
+        max = 1;
+    const int items = histo_hdr_bin(max, precision_bits) + 1;
+    int id = ci_stat_histo_register(label, data_descr, items, CI_HISTO_HDR, 0, max);
+    if (id < 0)
+        return id;
+    ci_stat_histo_spec_t *histo = (ci_stat_histo_spec_t *)ci_dyn_array_search(Histos, label);
+    _CI_ASSERT(histo);
+    histo->sub_bits = precision_bits;
+    histo->flags |= CI_HISTO_IGNORE_COUNT_ZERO;
+    return id;
+}
+
+static void ci_stat_histo_update_hdr(ci_stat_histogram_t *histo, uint64_t value)
+{
+    if (value > histo->header.max)
+        ci_atomic_add_u64(&histo->other, 1);
+    else
+        ci_atomic_add_u64(&histo->bins[histo_hdr_bin(value, histo->header.sub_bits)], 1);
+}
+
+double ci_stat_histo_get_bin_value_hdr(ci_stat_histogram_t *histo, unsigned pos)
+{
+    if (pos >= histo->header.items)
+        return (double) -1;
+    uint64_t value = histo_hdr_bin_max(pos, histo->header.sub_bits);
+    return (double)(value < histo->header.max ? value : histo->header.max);
+}
+
+char *ci_stat_histo_get_bin_label_hdr(ci_stat_histogram_t *histo, unsigned pos, char *buf, size_t buf_size, double *bin)
+{
+    *bin = ci_stat_histo_get_bin_value_hdr(histo, pos);
+    if (*bin >= 0)
+        snprintf(buf, buf_size, "%.0f", *bin);
+    else
+        snprintf(buf, buf_size, "Infinity");
+    return buf;
+}
+
 struct _histo_operator {
     ci_histo_type_t type;
     void (*update)(ci_stat_histogram_t *histo, uint64_t value);
@@ -846,7 +1140,8 @@ struct _histo_operator {
     {CI_HISTO_LINEAR, ci_stat_histo_update_linear, ci_stat_histo_get_bin_value_linear, ci_stat_histo_get_bin_label_linear},
     {CI_HISTO_LOG, ci_stat_histo_update_log, ci_stat_histo_get_bin_value_log, ci_stat_histo_get_bin_label_log},
     {CI_HISTO_ENUM, ci_stat_histo_update_enum, ci_stat_histo_get_bin_value_enum, ci_stat_histo_get_bin_label_enum},
-    {CI_HISTO_CUSTOM_BINS,ci_stat_histo_update_custom_bins, ci_stat_histo_get_bin_value_custom_bins, ci_stat_histo_get_bin_label_custom_bins}
+    {CI_HISTO_CUSTOM_BINS,ci_stat_histo_update_custom_bins, ci_stat_histo_get_bin_value_custom_bins, ci_stat_histo_get_bin_label_custom_bins},
+    {CI_HISTO_HDR, ci_stat_histo_update_hdr, ci_stat_histo_get_bin_value_hdr, ci_stat_histo_get_bin_label_hdr}
 };
 
 void ci_stat_histo_update(int id, uint64_t value)
@@ -886,7 +1181,7 @@ void ci_stat_histo_raw_bins_iterate(int id, void *data, void (*fn)(void *data, d
             _CI_ASSERT(count == 0); /*Else we have to merge with the lastbin*/
             continue;
         }
-        if (histo->header.histo_type == CI_HISTO_ENUM && histo->header.flags & CI_HISTO_IGNORE_COUNT_ZERO && count == 0)
+        if ((histo->header.histo_type == CI_HISTO_ENUM || histo->header.histo_type == CI_HISTO_HDR) && histo->header.flags & CI_HISTO_IGNORE_COUNT_ZERO && count == 0)
             continue;
         fn(data, bin, count);
         lastbin = bin;
@@ -910,12 +1205,14 @@ void ci_stat_histo_bins_iterate(int id, void *data, void (*fn)(void *data, const
             _CI_ASSERT(count == 0); /*Else we have to merge with the lastbin*/
             continue;
         }
-        if (histo->header.histo_type == CI_HISTO_ENUM && histo->header.flags & CI_HISTO_IGNORE_COUNT_ZERO && count == 0)
+        if ((histo->header.histo_type == CI_HISTO_ENUM || histo->header.histo_type == CI_HISTO_HDR) && histo->header.flags & CI_HISTO_IGNORE_COUNT_ZERO && count == 0)
             continue;
         fn(data, bin, count);
         lastbin = raw_bin;
     }
-    const char *other_bin = ci_histo_operators[histo->header.histo_type].get_bin_label(histo, (histo->header.max + 1), buf, sizeof(buf), &raw_bin);
+    /*The HDR histograms maximum may not fit in the bin position*/
+    const unsigned other_pos = histo->header.histo_type == CI_HISTO_HDR ? (unsigned)histo->header.items : (unsigned)(histo->header.max + 1);
+    const char *other_bin = ci_histo_operators[histo->header.histo_type].get_bin_label(histo, other_pos, buf, sizeof(buf), &raw_bin);
     fn(data, other_bin, histo->other);
 }
 
@@ -936,3 +1233,73 @@ CI_DECLARE_FUNC(int) ci_stat_histo_bins_number(int id)
         return 0;
     return histo->header.items;
 }
+
+uint64_t ci_stat_histo_count(int id)
+{
+    uint64_t count;
+    int i;
+    ci_stat_histogram_t *histo = ci_stat_histo_get_histo(id);
+    if (!histo)
+        return 0;
+    count = histo->other;
+    for (i = 0; i < histo->header.items; i++)
+        count += histo->bins[i];
+    return count;
+}
+
+int ci_stat_histo_quantiles(int id, const double *quantiles, uint64_t *values, int num)
+{
+    uint64_t *bins, total, rank, accounted;
+    double q, bin;
+    int i, k;
+    ci_stat_histogram_t *histo = ci_stat_histo_get_histo(id);
+    if (!histo || histo->header.histo_type == CI_HISTO_ENUM || num <= 0)
+        return 0;
+
+    /*The histogram may be updated by other threads or processes, work on
+      a copy to compute all of the quantiles from the same values*/
+    if (!(bins = malloc(histo->header.items * sizeof(uint64_t))))
+        return 0;
+    total = histo->other;
+    for (i = 0; i < histo->header.items; i++) {
+        bins[i] = histo->bins[i];
+        total += bins[i];
+    }
+    if (total == 0) {
+        free(bins);
+        return 0;
+    }
+
+    for (k = 0; k < num; k++) {
+        q = quantiles[k];
+        if (q < 0)
+            q = 0;
+        else if (q > 1)
+            q = 1;
+        rank = (uint64_t)ceil(q * (double)total);
+        if (rank < 1)
+            rank = 1;
+        values[k] = histo->header.max; /*If it is counted in the "other" bin*/
+        for (i = 0, accounted = 0; i < histo->header.items; i++) {
+            accounted += bins[i];
+            if (accounted >= rank) {
+                bin = ci_histo_operators[histo->header.histo_type].get_bin_value(histo, i);
+                if (bin >= 0)
+                    values[k] = (uint64_t)bin;
+                break;
+            }
+        }
+    }
+    free(bins);
+    return 1;
+}
+
+int ci_stat_histo_quantile(int id, double quantile, uint64_t *value)
+{
+    return ci_stat_histo_quantiles(id, &quantile, value, 1);
+}
+
+int ci_stat_histo_percentile(int id, double percentile, uint64_t *value)
+{
+    return ci_stat_histo_quantile(id, percentile / 100.0, value);
+}
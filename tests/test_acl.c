@@ -0,0 +1,250 @@
+#include "common.h"
+#include "c-icap.h"
+#include "acl.h"
+#include "cfg_param.h"
+#include "client.h"
+#include "debug.h"
+#include "mem.h"
+#include "net_io.h"
+#include "request.h"
+#include "test_common.h"
+#include <stdio.h>
+
+/*
+  Builds an access list with many access entries and checks that
+  ci_access_entry_match_request gives the same results as the previous
+  implementation, which retrieves the test data and walks the acl data
+  for every acl of every access entry. Then measures the cost of both
+  for a request which matches the last access entry.
+*/
+
+int LOOPS = 10000;
+int ENTRIES = 2000;
+int USE_DEBUG_LEVEL = -1;
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-l", "loops", &LOOPS, ci_cfg_set_int,
+        "The number of the checked requests (default is 10000)"
+    },
+    {
+        "-e", "entries", &ENTRIES, ci_cfg_set_int,
+        "The number of the access entries (default is 2000)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+/*The layout of the content_length acl test data*/
+struct test_clen_data {
+    uint64_t data;
+    int operator;
+};
+
+static struct test_clen_data TestClen;
+
+static void *get_test_clen(ci_request_t *req, char *param)
+{
+    TestClen.operator = (param && param[0] == '>') ? 1 : (param && param[0] == '<') ? 2 : 0;
+    return &TestClen;
+}
+
+static const char *TestUrl = NULL;
+
+static void *get_test_url(ci_request_t *req, char *param)
+{
+    return (void *)TestUrl;
+}
+
+static int legacy_match(ci_access_entry_t *access_entry, ci_request_t *req)
+{
+    const ci_specs_list_t *spec_list;
+    const ci_acl_data_t *spec_data;
+    const ci_acl_spec_t *spec;
+    void *test_data;
+    int matches;
+
+    for (; access_entry != NULL; access_entry = access_entry->next) {
+        for (spec_list = access_entry->spec_list; spec_list != NULL; spec_list = spec_list->next) {
+            spec = spec_list->spec;
+            if (!(test_data = spec->type->get_test_data(req, spec->parameter)))
+                break;
+            matches = 0;
+            for (spec_data = spec->data; spec_data != NULL && !matches; spec_data = spec_data->next)
+                matches = spec->type->type->equal(spec_data->data, test_data);
+            if (spec->type->free_test_data)
+                spec->type->free_test_data(req, test_data);
+            if (matches == spec_list->negate)
+                break;
+        }
+        if (spec_list == NULL && access_entry->spec_list)
+            return access_entry->type;
+    }
+    return CI_ACCESS_UNKNOWN;
+}
+
+static void check(ci_access_entry_t *list, ci_request_t *req, const char *test)
+{
+    int legacy = legacy_match(list, req);
+    int ret = ci_access_entry_match_request(list, req);
+    if (ret != legacy)
+        test_fail(test, "%d, expected %d", ret, legacy);
+}
+
+static double bench(ci_access_entry_t *list, ci_request_t *req, int compiled)
+{
+    struct timespec start;
+    int i;
+
+    bench_start(&start);
+    for (i = 0; i < LOOPS; i++) {
+        if (compiled)
+            ci_access_entry_match_request(list, req);
+        else
+            legacy_match(list, req);
+    }
+    return bench_elapsed_nano(&start) / LOOPS;
+}
+
+int main(int argc, char *argv[])
+{
+    static const uint64_t clen_values[] = {0, 1, 100, 1023, 1024, 1025, 65536, 100000000};
+    static const char *clen_acls[] = {"ClenEq", "ClenGt", "ClenLt"};
+    static const char *urls[] = {
+        "http://www.site7.com/index.html", "http://www.site70.com/", "http://www.site7.com.other.net/",
+        "http://www.other.net/file.exe", "http://www.other.net/file.exe.html", "http://www.other.net/", ""
+    };
+    ci_acl_type_t test_clen_type, test_url_type;
+    ci_access_entry_t *list = NULL, *clen_list = NULL, *url_list = NULL, *entry;
+    ci_connection_t *conn;
+    ci_request_t *req;
+    char name[64], value[64], test[128];
+    double legacy, compiled;
+    int i, k;
+
+    ci_client_library_init();
+    ci_acl_init();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || LOOPS <= 0 || ENTRIES <= 0) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    /*Every access entry checks the same ports, services and time acls
+      and a different users acl*/
+    ci_acl_add_data("Ports", "port", "1344");
+    ci_acl_add_data("Ports", "port", "11344");
+    ci_acl_add_data("OtherPorts", "port", "8080");
+    for (i = 0; i < 100; i++) {
+        snprintf(value, sizeof(value), "service%d", i);
+        ci_acl_add_data("Services", "service", value);
+    }
+    ci_acl_add_data("Services", "service", "srv_echo");
+    ci_acl_add_data("Never", "time", "S/00:00-00:00");
+    ci_acl_add_data("Always", "time", "S,M,T,W,H,F,A/00:00-24:00");
+    for (i = 0; i < ENTRIES; i++) {
+        snprintf(name, sizeof(name), "Users%d", i);
+        for (k = 0; k < 8; k++) {
+            snprintf(value, sizeof(value), "user%d_%d", i, k);
+            ci_acl_add_data(name, "user", value);
+        }
+        entry = ci_access_entry_new(&list, (i % 2) ? CI_ACCESS_ALLOW : CI_ACCESS_DENY);
+        ci_access_entry_add_acl_by_name(entry, name);
+        ci_access_entry_add_acl_by_name(entry, (i % 3) ? "Ports" : "!OtherPorts");
+        ci_access_entry_add_acl_by_name(entry, "Services");
+        ci_access_entry_add_acl_by_name(entry, (i % 5) ? "Always" : "!Never");
+    }
+
+    /*The content_length acls with a test type, to control the test data*/
+    test_clen_type = *ci_acl_type_search("content_length");
+    strcpy(test_clen_type.name, "test_clen");
+    test_clen_type.get_test_data = get_test_clen;
+    ci_acl_type_add(&test_clen_type);
+    for (i = 0; i < 16; i++) {
+        snprintf(value, sizeof(value), "%d", (i + 1) * 1024);
+        ci_acl_add_data("ClenEq", "test_clen{=}", value);
+        ci_acl_add_data("ClenGt", "test_clen{>}", value);
+        ci_acl_add_data("ClenLt", "test_clen{<}", value);
+    }
+    for (i = 0; i < 3; i++) {
+        entry = ci_access_entry_new(&clen_list, CI_ACCESS_ALLOW);
+        ci_access_entry_add_acl_by_name(entry, clen_acls[i]);
+    }
+
+    /*The regex acls, with a test type to control the url*/
+    test_url_type = *ci_acl_type_search("http_req_url");
+    strcpy(test_url_type.name, "test_url");
+    test_url_type.get_test_data = get_test_url;
+    ci_acl_type_add(&test_url_type);
+    for (i = 0; i < 100; i++) {
+        snprintf(value, sizeof(value), "/^http:\\/\\/www\\.site%d\\.com\\//i", i);
+        ci_acl_add_data("Sites", "test_url", value);
+    }
+    ci_acl_add_data("Sites", "test_url", "/\\.exe$/");
+    entry = ci_access_entry_new(&url_list, CI_ACCESS_DENY);
+    ci_access_entry_add_acl_by_name(entry, "Sites");
+    /*Data added after the acl is used in an access entry*/
+    ci_acl_add_data("Sites", "test_url", "/\\.html$/");
+
+    conn = ci_connection_create();
+    ci_ip_to_ci_sockaddr_t("192.168.1.10", &conn->claddr);
+    ci_sockaddr_set_port(&conn->claddr, 34567);
+    ci_ip_to_ci_sockaddr_t("192.168.1.1", &conn->srvaddr);
+    ci_sockaddr_set_port(&conn->srvaddr, 1344);
+    req = ci_request_alloc(conn);
+    req->type = ICAP_REQMOD;
+    strcpy(req->service, "srv_echo");
+
+    for (i = 0; i < ENTRIES; i += (ENTRIES / 10 + 1)) {
+        snprintf(req->user, sizeof(req->user), "user%d_%d", i, i % 8);
+        check(list, req, req->user);
+    }
+    strcpy(req->user, "nobody");
+    check(list, req, "nobody");
+    strcpy(req->service, "other_service");
+    snprintf(req->user, sizeof(req->user), "user%d_0", ENTRIES - 1);
+    check(list, req, "other_service");
+    strcpy(req->service, "srv_echo");
+    for (i = 0; i < sizeof(clen_values) / sizeof(clen_values[0]); i++) {
+        TestClen.data = clen_values[i];
+        snprintf(test, sizeof(test), "content_length %llu", (unsigned long long)clen_values[i]);
+        check(clen_list, req, test);
+    }
+
+    for (i = 0; i < sizeof(urls) / sizeof(urls[0]); i++) {
+        TestUrl = urls[i];
+        check(url_list, req, urls[i]);
+    }
+
+    /*The worst case, the last access entry matches*/
+    snprintf(req->user, sizeof(req->user), "user%d_7", ENTRIES - 1);
+    legacy = bench(list, req, 0);
+    compiled = bench(list, req, 1);
+    printf("Access entries: %d\n", ENTRIES);
+    printf("%-12s %12s\n", "", "ns/request");
+    printf("%-12s %12.1f\n", "legacy", legacy);
+    printf("%-12s %12.1f\n", "compiled", compiled);
+
+    ci_request_destroy(req); /*also frees the connection*/
+    ci_access_entry_release(list);
+    ci_access_entry_release(clen_list);
+    ci_access_entry_release(url_list);
+    ci_acl_reset();
+    ci_acl_destroy();
+    return test_result();
+}
@@ -6,6 +6,7 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <time.h>
 #include "cfg_param.h"
 #include "ci_threads.h"
 #include "mem.h"
@@ -40,6 +41,52 @@ int run_allocs()
     return 1;
 }
 
+/*
+  The contention benchmark: the threads allocate and release buffers
+  of various sizes and objects from an object pool, with and without
+  the memory pools per-thread caches. The total work is the same for
+  any number of threads.
+*/
+int BENCH_LOOPS = 200000;
+static int BenchObjPool = -1;
+static int BenchThreadLoops = 0;
+
+static void *run_contention(void *unused)
+{
+    static const size_t sizes[] = {32, 100, 200, 500, 1000, 2000, 4000, 8000};
+    void *v[sizeof(sizes) / sizeof(sizes[0])], *obj;
+    int l, i;
+    for (l = 0; l < BenchThreadLoops; l++) {
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+            v[i] = ci_buffer_alloc(sizes[i]);
+        obj = ci_object_pool_alloc(BenchObjPool);
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+            ci_buffer_free(v[i]);
+        ci_object_pool_free(obj);
+    }
+    return NULL;
+}
+
+#define CLOCK_TIME_DIFF_nano(tsstop, tsstart) (((int64_t)(tsstop.tv_sec - tsstart.tv_sec) * 1000000000) + (tsstop.tv_nsec - tsstart.tv_nsec))
+
+static double run_contention_test(int threads_num, int thread_cache)
+{
+    int i;
+    struct timespec start, stop;
+    ci_thread_t *threads = malloc(sizeof(ci_thread_t) * threads_num);
+    CI_MEM_POOLS_THREAD_CACHE = thread_cache;
+    BenchThreadLoops = BENCH_LOOPS / threads_num;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < threads_num; i++)
+        ci_thread_create(&(threads[i]), run_contention, NULL);
+    for (i = 0; i < threads_num; i++)
+        ci_thread_join(threads[i]);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    free(threads);
+    /*Every loop allocates and releases 9 objects*/
+    return (double)BenchThreadLoops * threads_num * 9 * 1000000000.0 / (double)CLOCK_TIME_DIFF_nano(stop, start);
+}
+
 int threadsnum = 100;
 int USE_DEBUG_LEVEL = -1;
 static struct ci_options_entry options[] = {
@@ -51,6 +98,10 @@ static struct ci_options_entry options[] = {
         "-t", "threads", &threadsnum, ci_cfg_set_int,
         "The numbers of threads to use"
     },
+    {
+        "-b", "loops", &BENCH_LOOPS, ci_cfg_set_int,
+        "The contention benchmark loops, 0 to disable it (default is 200000)"
+    },
     {NULL,NULL,NULL,NULL,NULL}
 };
 
@@ -101,6 +152,19 @@ int main(int argc, char *argv[])
 
     free(threads);
 
+    if (BENCH_LOOPS > 0) {
+        int n, thread_cache = CI_MEM_POOLS_THREAD_CACHE;
+        BenchObjPool = ci_object_pool_register("bench_object", 128);
+        printf("%8s %20s %20s\n", "threads", "no cache allocs/sec", "cached allocs/sec");
+        for (n = 1; n <= threadsnum; n *= 2) {
+            double no_cache = run_contention_test(n, 0);
+            double cached = run_contention_test(n, thread_cache);
+            printf("%8d %20.0f %20.0f\n", n, no_cache, cached);
+        }
+        CI_MEM_POOLS_THREAD_CACHE = thread_cache;
+        ci_object_pool_unregister(BenchObjPool);
+    }
+
     return 0;
 }
 
@@ -35,6 +35,8 @@ void ci_command_register_action(const char *name, int type, void *data, void (*c
     */
 }
 
+void init_internal_cache_types();
+
 int load_module(const char *directive,const char **argv,void *setdata)
 {
     CI_DLIB_HANDLE lib;
@@ -81,6 +83,8 @@ void log_errors(void *unused, const char *format, ...)
 
 char *CACHE_TYPE = NULL;
 int USE_DEBUG_LEVEL = -1;
+int BENCH_LOOPS = 1000000;
+int BENCH_THREADS = 8;
 static struct ci_options_entry options[] = {
     {
         "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
@@ -94,9 +98,108 @@ static struct ci_options_entry options[] = {
         "-c", "cache", &CACHE_TYPE, ci_cfg_set_str,
         "The type of cache to use"
     },
+    {
+        "-b", "loops", &BENCH_LOOPS, ci_cfg_set_int,
+        "The multi-threaded benchmark loops, 0 to disable it (default is 1000000)"
+    },
+    {
+        "-t", "threads", &BENCH_THREADS, ci_cfg_set_int,
+        "Run the benchmark with 1, 2, 4, ... up to this number of threads (default is 8)"
+    },
     {NULL,NULL,NULL,NULL,NULL}
 };
 
+/*
+  The benchmark threads search the cache and store the missing keys,
+  like a lookup table cache does. The key space first fits in the cache,
+  then it is larger than the cache: a full "local" cache refuses the new
+  keys, while a "local_sharded" cache replaces old keys, so it does more
+  work on misses and has more hits. Each test runs BENCH_REPEAT times and
+  the best run is kept, the short runs are noisy.
+*/
+#define BENCH_CACHE_SIZE (1024*1024)
+#define BENCH_OBJECT_SIZE 256
+#define BENCH_FIT_KEYS 2048
+#define BENCH_KEYS 8192
+#define BENCH_REPEAT 5
+#define CLOCK_TIME_DIFF_nano(tsstop, tsstart) (((int64_t)(tsstop.tv_sec - tsstart.tv_sec) * 1000000000) + (tsstop.tv_nsec - tsstart.tv_nsec))
+
+static struct ci_cache *BenchCache = NULL;
+static int BenchThreadLoops = 0;
+static unsigned int BenchKeys = BENCH_KEYS;
+static ci_thread_mutex_t BenchMtx;
+static int64_t BenchHits = 0;
+
+static void *run_bench(void *seed)
+{
+    char key[32], value[100];
+    unsigned int r = (unsigned int)(uintptr_t)seed;
+    int64_t hits = 0;
+    void *v;
+    int i;
+    memset(value, 'v', sizeof(value));
+    value[sizeof(value) - 1] = '\0';
+    for (i = 0; i < BenchThreadLoops; i++) {
+        /*xorshift, skewed so that some keys are more popular*/
+        r ^= r << 13;
+        r ^= r >> 17;
+        r ^= r << 5;
+        snprintf(key, sizeof(key), "key%u", (r % BenchKeys) % ((r >> 16) % BenchKeys + 1));
+        if (ci_cache_search(BenchCache, key, &v, NULL, NULL)) {
+            hits++;
+            ci_buffer_free(v);
+        } else
+            ci_cache_update(BenchCache, key, value, sizeof(value), NULL);
+    }
+    ci_thread_mutex_lock(&BenchMtx);
+    BenchHits += hits;
+    ci_thread_mutex_unlock(&BenchMtx);
+    return NULL;
+}
+
+static double run_bench_test(const char *type, int threads_num, double *hit_ratio)
+{
+    int i;
+    struct timespec start, stop;
+    ci_thread_t *threads = malloc(sizeof(ci_thread_t) * threads_num);
+    BenchCache = ci_cache_build("bench", type, BENCH_CACHE_SIZE, BENCH_OBJECT_SIZE, 3600, &ci_str_ops);
+    BenchThreadLoops = BENCH_LOOPS / threads_num;
+    BenchHits = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < threads_num; i++)
+        ci_thread_create(&(threads[i]), run_bench, (void *)(uintptr_t)(i + 1));
+    for (i = 0; i < threads_num; i++)
+        ci_thread_join(threads[i]);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    free(threads);
+    ci_cache_destroy(BenchCache);
+    *hit_ratio = (double)BenchHits * 100.0 / (double)(BenchThreadLoops * threads_num);
+    return (double)BenchThreadLoops * threads_num * 1000000000.0 / (double)CLOCK_TIME_DIFF_nano(stop, start);
+}
+
+static void run_bench_table(unsigned int keys)
+{
+    int i, n;
+    double local_hits = 0, sharded_hits = 0;
+    BenchKeys = keys;
+    printf("%u keys\n", BenchKeys);
+    printf("%8s %16s %10s %16s %10s\n", "threads", "local ops/sec", "hits %", "sharded ops/sec", "hits %");
+    for (n = 1; n <= BENCH_THREADS; n *= 2) {
+        double local = 0, sharded = 0, ops, hits;
+        for (i = 0; i < BENCH_REPEAT; i++) {
+            if ((ops = run_bench_test("local", n, &hits)) > local) {
+                local = ops;
+                local_hits = hits;
+            }
+            if ((ops = run_bench_test("local_sharded", n, &hits)) > sharded) {
+                sharded = ops;
+                sharded_hits = hits;
+            }
+        }
+        printf("%8d %16.0f %10.1f %16.0f %10.1f\n", n, local, local_hits, sharded, sharded_hits);
+    }
+}
+
 int main(int argc,char *argv[])
 {
     int i;
@@ -107,6 +210,7 @@ int main(int argc,char *argv[])
 
     ci_cfg_lib_init();
     ci_mem_init();
+    init_internal_cache_types();
 
     __log_error = (void (*)(void *, const char *,...)) log_errors; /*set c-icap library log  function */
 
@@ -216,5 +320,12 @@ int main(int argc,char *argv[])
     }
 
     ci_cache_destroy(cache);
+
+    if (BENCH_LOOPS > 0) {
+        ci_thread_mutex_init(&BenchMtx);
+        run_bench_table(BENCH_FIT_KEYS);
+        run_bench_table(BENCH_KEYS);
+        ci_thread_mutex_destroy(&BenchMtx);
+    }
     return 0;
 }
@@ -0,0 +1,351 @@
+#include "common.h"
+#include "c-icap.h"
+#include "cfg_param.h"
+#include "client.h"
+#include "debug.h"
+#include "request.h"
+#include "test_common.h"
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+/*
+  Sends random chunked bodies over a socket in random pieces and checks
+  the body data parse_chunk_data hands to the service, and the errors
+  for broken chunk definitions. Then measures the body parsing speed
+  for various chunk sizes.
+*/
+
+int ITERATIONS = 2000;
+int BENCH_SIZE = 16 * 1024 * 1024;
+int USE_DEBUG_LEVEL = -1;
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-n", "iterations", &ITERATIONS, ci_cfg_set_int,
+        "The number of the random bodies to check (default is 2000)"
+    },
+    {
+        "-b", "bytes", &BENCH_SIZE, ci_cfg_set_int,
+        "The body size for the benchmark (default is 16M)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+struct body {
+    char *data;
+    int len;
+    int size;
+};
+
+static void body_add(struct body *b, const char *data, int len)
+{
+    if (b->len + len > b->size) {
+        b->size = 2 * (b->len + len);
+        b->data = realloc(b->data, b->size);
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void encode_chunks(struct body *enc, const char *data, int len, int max_chunk, const char *eof)
+{
+    char def[64];
+    int pos, chunk;
+    for (pos = 0; pos < len; pos += chunk) {
+        /*A negative max_chunk is a fixed chunk size*/
+        chunk = max_chunk < 0 ? -max_chunk : 1 + test_rnd() % max_chunk;
+        if (chunk > len - pos)
+            chunk = len - pos;
+        /*Mix lower and upper case hex digits and padding spaces*/
+        if (max_chunk < 0)
+            snprintf(def, sizeof(def), "%x\r\n", chunk);
+        else
+            snprintf(def, sizeof(def), (test_rnd() % 2) ? "%x%s\r\n" : "%X%s\r\n", chunk, (test_rnd() % 8) ? "" : "  ");
+        body_add(enc, def, strlen(def));
+        body_add(enc, data + pos, chunk);
+        body_add(enc, "\r\n", 2);
+    }
+    body_add(enc, eof, strlen(eof));
+}
+
+static ci_request_t *socket_request(int *peer)
+{
+    int sv[2];
+    ci_connection_t *conn;
+    ci_request_t *req;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        return NULL;
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+    conn = calloc(1, sizeof(ci_connection_t));
+    conn->fd = sv[0];
+    req = ci_request_alloc(conn);
+    *peer = sv[1];
+    return req;
+}
+
+static void socket_request_destroy(ci_request_t *req, int peer)
+{
+    close(req->connection->fd);
+    close(peer);
+    ci_request_destroy(req);
+}
+
+/*Writes the encoded body in random pieces, reads and parses the chunks
+  like the c-icap server does while it reads the data.
+  Returns the last parse_chunk_data result*/
+static int read_chunks(ci_request_t *req, int peer, const struct body *enc, struct body *out)
+{
+    char *wdata;
+    int written = 0, piece, ret = CI_NEEDS_MORE;
+
+    req->current_chunk_len = 0;
+    req->chunk_bytes_read = 0;
+    req->write_to_module_pending = 0;
+    req->eof_received = 0;
+    out->len = 0;
+    while (ret != CI_EOF && ret != CI_ERROR) {
+        if (written < enc->len) {
+            piece = 1 + ((test_rnd() % 4) ? test_rnd() % 16 : test_rnd() % 8192);
+            if (piece > enc->len - written)
+                piece = enc->len - written;
+            if (write(peer, enc->data + written, piece) != piece)
+                return CI_ERROR;
+            written += piece;
+        } else if (req->bytes_in >= written && req->pstrblock_read_len == 0)
+            return CI_NEEDS_MORE;
+
+        if (req->bytes_in < written && net_data_read(req) == CI_ERROR)
+            return CI_ERROR;
+        do {
+            ret = parse_chunk_data(req, &wdata);
+            if (ret != CI_ERROR && req->write_to_module_pending) {
+                body_add(out, wdata, req->write_to_module_pending);
+                req->write_to_module_pending = 0;
+            }
+        } while (ret == CI_OK);
+        if (ret == CI_NEEDS_MORE && written == enc->len && req->bytes_in == written && req->pstrblock_read_len != 0) {
+            /*No more data, and the remaining are not parsed*/
+            return CI_NEEDS_MORE;
+        }
+    }
+    /*Send the data after the eof chunk too*/
+    if (written < enc->len && write(peer, enc->data + written, enc->len - written) != enc->len - written)
+        return CI_ERROR;
+    return ret;
+}
+
+static void check_random_bodies()
+{
+    struct body enc = {NULL, 0, 0}, out = {NULL, 0, 0};
+    char *data;
+    const char *next = "OPTIONS icap://localhost/echo ICAP/1.0\r\n";
+    int i, k, len, peer, ret, use_ieof;
+    ci_request_t *req;
+
+    if (!(req = socket_request(&peer))) {
+        test_fail("random bodies", "can not create the sockets");
+        return;
+    }
+    data = malloc(65536);
+    for (i = 0; i < ITERATIONS && Failures < 10; i++) {
+        len = (test_rnd() % 4) ? test_rnd() % 256 : test_rnd() % 65536;
+        for (k = 0; k < len; k++)
+            data[k] = (test_rnd() % 8) ? 'a' + test_rnd() % 26 : "\r\n0;"[test_rnd() % 4];
+        use_ieof = (test_rnd() % 4 == 0);
+        enc.len = 0;
+        encode_chunks(&enc, data, len, (test_rnd() % 2) ? 32 : 20000, use_ieof ? "0; ieof\r\n\r\n" : "0\r\n\r\n");
+        /*The next pipelined request*/
+        body_add(&enc, next, strlen(next));
+        ret = read_chunks(req, peer, &enc, &out);
+        if (ret != CI_EOF)
+            test_fail("random bodies", "the eof chunk is not parsed");
+        else if (out.len != len || memcmp(out.data, data, len) != 0)
+            test_fail("random bodies", "wrong body data");
+        else if (req->eof_received != use_ieof)
+            test_fail("random bodies", "wrong ieof");
+        /*The remaining data must be the next request, read them all*/
+        while (req->bytes_in < enc.len && net_data_read(req) != CI_ERROR);
+        if (req->pstrblock_read_len != (int)strlen(next) || memcmp(req->pstrblock_read, next, strlen(next)) != 0)
+            test_fail("random bodies", "wrong data after the eof chunk");
+        req->pstrblock_read_len = 0;
+        req->bytes_in = 0;
+    }
+    free(data);
+    free(enc.data);
+    free(out.data);
+    socket_request_destroy(req, peer);
+}
+
+struct chunks_test {
+    const char *data;
+    int result;
+    const char *body;
+};
+
+static void check_chunk_definitions()
+{
+    static struct chunks_test tests[] = {
+        {"5\r\nhello\r\n0\r\n\r\n", CI_EOF, "hello"},
+        {"  A  \r\n0123456789\r\n0\r\n\r\n", CI_EOF, "0123456789"},
+        {"a\r\n0123456789\r\n0000\r\n\r\n", CI_EOF, "0123456789"},
+        {"00005\r\nhello\r\n0; ieof\r\n\r\n", CI_EOF, "hello"},
+        {"0; use-original-body=3\r\n\r\n", CI_EOF, ""},
+        {"-5\r\nhello\r\n0\r\n\r\n", CI_ERROR, ""},
+        {"+5\r\nhello\r\n0\r\n\r\n", CI_ERROR, ""},
+        {"0x5\r\nhello\r\n0\r\n\r\n", CI_ERROR, ""},
+        {"5 x\r\nhello\r\n0\r\n\r\n", CI_ERROR, ""},
+        {"5;x=y\r\nhello\r\n0\r\n\r\n", CI_ERROR, ""},
+        {"\r\nhello\r\n0\r\n\r\n", CI_ERROR, ""},
+        {"5\rhello\r\n0\r\n\r\n", CI_ERROR, ""},
+        {"5\nhello\r\n0\r\n\r\n", CI_ERROR, ""},
+        {"FFFFFFFFF\r\n", CI_ERROR, ""},
+        {"80000000\r\n", CI_ERROR, ""},
+        {"7FFFFFFE\r\n", CI_ERROR, ""},
+        {"0\r\nX\r\n", CI_ERROR, ""},
+        {"0; bogus\r\n\r\n", CI_ERROR, ""},
+        {"5\r\nhel", CI_NEEDS_MORE, "hel"},
+        {"5", CI_NEEDS_MORE, ""},
+        {"0; ieof\r\n", CI_NEEDS_MORE, ""},
+        {NULL, 0, NULL}
+    };
+    struct body enc = {NULL, 0, 0}, out = {NULL, 0, 0};
+    char *spaces;
+    int i, peer, ret;
+    ci_request_t *req;
+
+    for (i = 0; tests[i].data != NULL; i++) {
+        if (!(req = socket_request(&peer))) {
+            test_fail("chunk definitions", "can not create the sockets");
+            return;
+        }
+        enc.len = 0;
+        body_add(&enc, tests[i].data, strlen(tests[i].data));
+        ret = read_chunks(req, peer, &enc, &out);
+        if (ret != tests[i].result || (ret != CI_ERROR && (out.len != (int)strlen(tests[i].body) || memcmp(out.data, tests[i].body, out.len) != 0))) {
+            printf("chunk definition '%s' result %d, expected %d\n", tests[i].data, ret, tests[i].result);
+            test_fail("chunk definitions", "wrong result");
+        }
+        if (ret == CI_EOF && strstr(tests[i].data, "ieof") && !req->eof_received)
+            test_fail("chunk definitions", "ieof is not parsed");
+        if (ret == CI_EOF && strstr(tests[i].data, "use-original-body") && req->i206_use_original_body != 3)
+            test_fail("chunk definitions", "use-original-body is not parsed");
+        socket_request_destroy(req, peer);
+    }
+
+    /*A chunk definition bigger than the read buffer is an error*/
+    if (!(req = socket_request(&peer))) {
+        test_fail("chunk definitions", "can not create the sockets");
+        return;
+    }
+    spaces = malloc(req->rbuf_size + 1);
+    memset(spaces, ' ', req->rbuf_size);
+    spaces[req->rbuf_size] = '\0';
+    enc.len = 0;
+    body_add(&enc, spaces, req->rbuf_size);
+    body_add(&enc, "5\r\nhello\r\n0\r\n\r\n", 15);
+    if (read_chunks(req, peer, &enc, &out) != CI_ERROR)
+        test_fail("chunk definitions", "too long chunk definition accepted");
+    socket_request_destroy(req, peer);
+    free(spaces);
+    free(enc.data);
+    free(out.data);
+}
+
+/*Emulates the net_data_read, reading from memory*/
+static int mem_data_read(ci_request_t *req, const struct body *enc, int *pos)
+{
+    int bytes;
+    if (req->pstrblock_read != req->rbuf) {
+        if (req->pstrblock_read_len)
+            memmove(req->rbuf, req->pstrblock_read, req->pstrblock_read_len);
+        req->pstrblock_read = req->rbuf;
+    }
+    bytes = req->rbuf_size - req->pstrblock_read_len;
+    if (bytes > enc->len - *pos)
+        bytes = enc->len - *pos;
+    memcpy(req->rbuf + req->pstrblock_read_len, enc->data + *pos, bytes);
+    *pos += bytes;
+    req->pstrblock_read_len += bytes;
+    return bytes;
+}
+
+static void bench()
+{
+    struct body enc = {NULL, 0, 0};
+    struct timespec start;
+    char *data, *wdata;
+    int64_t body_bytes;
+    double t, best = 0;
+    int chunks[] = {16, 256, 4096, 65536};
+    int i, run, pos, ret;
+    ci_request_t *req = ci_request_alloc(NULL);
+
+    data = malloc(BENCH_SIZE);
+    memset(data, 'a', BENCH_SIZE);
+    printf("%-12s %12s %12s\n", "chunk size", "MB/s", "ns/chunk");
+    for (i = 0; i < 4; i++) {
+        enc.len = 0;
+        encode_chunks(&enc, data, BENCH_SIZE, -chunks[i], "0\r\n\r\n");
+        for (run = 0; run < 5; run++) {
+            req->pstrblock_read = NULL;
+            req->pstrblock_read_len = 0;
+            req->current_chunk_len = 0;
+            req->chunk_bytes_read = 0;
+            req->write_to_module_pending = 0;
+            body_bytes = 0;
+            pos = 0;
+            ret = CI_NEEDS_MORE;
+            bench_start(&start);
+            while (ret != CI_EOF && ret != CI_ERROR && mem_data_read(req, &enc, &pos) >= 0) {
+                do {
+                    ret = parse_chunk_data(req, &wdata);
+                    body_bytes += req->write_to_module_pending;
+                    req->write_to_module_pending = 0;
+                } while (ret == CI_OK);
+            }
+            t = bench_elapsed_nano(&start);
+            if (ret != CI_EOF || body_bytes != BENCH_SIZE)
+                test_fail("bench", "wrong body size");
+            if (run == 0 || t < best)
+                best = t;
+        }
+        printf("%-12d %12.1f %12.1f\n", chunks[i], ((double)BENCH_SIZE / (1024 * 1024)) / (best / 1000000000.0), best / ((BENCH_SIZE + chunks[i] - 1) / chunks[i]));
+    }
+    free(data);
+    free(enc.data);
+    ci_request_destroy(req);
+}
+
+int main(int argc, char *argv[])
+{
+    ci_client_library_init();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || ITERATIONS < 0 || BENCH_SIZE <= 0) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    check_chunk_definitions();
+    check_random_bodies();
+    bench();
+
+    return test_result();
+}
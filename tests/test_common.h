@@ -0,0 +1,63 @@
+#ifndef __C_ICAP_TEST_COMMON_H
+#define __C_ICAP_TEST_COMMON_H
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+  Helpers for the test programs which check their results and measure
+  the time of the tested operations.
+*/
+
+#define CLOCK_TIME_DIFF_nano(tsstop, tsstart) (((int64_t)(tsstop.tv_sec - tsstart.tv_sec) * 1000000000) + (tsstop.tv_nsec - tsstart.tv_nsec))
+
+static int Failures = 0;
+
+/*Reports a failed check, the details are formatted as by printf*/
+static inline void test_fail(const char *test, const char *fmt, ...)
+{
+    va_list ap;
+    printf("%-24s FAILED: ", test);
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf("\n");
+    Failures++;
+}
+
+/*Prints the result of the test program and returns its exit code*/
+static inline int test_result()
+{
+    printf("%s\n", Failures ? "FAILED" : "OK");
+    return Failures ? -1 : 0;
+}
+
+/*
+  A xorshift pseudo-random numbers generator. The tests start from the
+  same seed, so every run checks the same data.
+*/
+static uint32_t TestSeed = 1;
+static inline uint32_t test_rnd()
+{
+    TestSeed ^= TestSeed << 13;
+    TestSeed ^= TestSeed >> 17;
+    TestSeed ^= TestSeed << 5;
+    return TestSeed;
+}
+
+static inline void bench_start(struct timespec *start)
+{
+    clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+/*The nanoseconds passed since the bench_start call*/
+static inline double bench_elapsed_nano(const struct timespec *start)
+{
+    struct timespec stop;
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    return (double)CLOCK_TIME_DIFF_nano(stop, (*start));
+}
+
+#endif
@@ -0,0 +1,299 @@
+#include "common.h"
+#define CI_ATOMICS_INLINE
+#include "atomic.h"
+#include "cfg_param.h"
+#include "ci_threads.h"
+#include "client.h"
+#include "debug.h"
+#include "log.h"
+#include "proc_threads_queues.h"
+#include "test_common.h"
+#include "util.h"
+
+/*
+  Measures the hand-off latency of the c-icap server connections queue
+  (proc_threads_queues.c) against its previous version, where a worker
+  misses the signal of a connection pushed between its get_from_queue
+  and wait_for_queue calls. For each number of worker threads two tests are run:
+   - The throughput test, where one producer thread pushes connections
+     as fast as the queue accepts them.
+   - The latency test, where the producer pushes the next connection
+     only after the previous one is consumed, so the connection must be
+     handed to an idle, sleeping worker. The latency is the time between
+     the put_to_queue call and the moment a worker gets the connection.
+*/
+
+int LOOPS = 100000;
+int MAX_THREADS = 256;
+int USE_DEBUG_LEVEL = -1;
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-l", "loops", &LOOPS, ci_cfg_set_int,
+        "The number of connections to pass to workers (default is 100000)"
+    },
+    {
+        "-t", "threads", &MAX_THREADS, ci_cfg_set_int,
+        "Run with 1, 2, 4, ... up to this number of worker threads (default is 256)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+/*Symbols required by proc_threads_queues.c*/
+struct childs_queue *childs_queue = NULL;
+void log_server(ci_request_t *req, const char *format, ... ) {}
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+/*The queue implementation without the checked wait*/
+struct legacy_queue {
+    ci_list_t *connections;
+    int used;
+    int warn_size;
+    ci_thread_mutex_t queue_mtx;
+    ci_thread_mutex_t cond_mtx;
+    ci_thread_cond_t queue_cond;
+};
+
+static int legacy_copy_connection(void *dest, const void *src)
+{
+    memcpy(dest, src, sizeof(struct connections_queue_item));
+    return 1;
+}
+
+static void *legacy_init(int size)
+{
+    struct legacy_queue *q = calloc(1, sizeof(struct legacy_queue));
+    ci_thread_mutex_init(&(q->queue_mtx));
+    ci_thread_mutex_init(&(q->cond_mtx));
+    ci_thread_cond_init(&(q->queue_cond));
+    q->connections = ci_list_create(65535, sizeof(struct connections_queue_item));
+    ci_list_copy_handler(q->connections, legacy_copy_connection);
+    q->warn_size = size;
+    return q;
+}
+
+static void legacy_destroy(void *data)
+{
+    struct legacy_queue *q = data;
+    ci_thread_mutex_destroy(&(q->queue_mtx));
+    ci_thread_mutex_destroy(&(q->cond_mtx));
+    ci_thread_cond_destroy(&(q->queue_cond));
+    ci_list_destroy(q->connections);
+    free(q);
+}
+
+static int legacy_put(void *data, struct connections_queue_item *con)
+{
+    struct legacy_queue *q = data;
+    ci_thread_mutex_lock(&(q->queue_mtx));
+    if (q->used == q->warn_size) {
+        ci_thread_mutex_unlock(&(q->queue_mtx));
+        return 0;
+    }
+    ci_list_push_back(q->connections, con);
+    ++q->used;
+    ci_thread_mutex_unlock(&(q->queue_mtx));
+    ci_thread_cond_signal(&(q->queue_cond));
+    return 1;
+}
+
+static int legacy_get(void *data, struct connections_queue_item *con)
+{
+    struct legacy_queue *q = data;
+    ci_thread_mutex_lock(&(q->queue_mtx));
+    if (q->used == 0) {
+        ci_thread_mutex_unlock(&(q->queue_mtx));
+        return 0;
+    }
+    q->used--;
+    ci_list_pop(q->connections, con);
+    ci_thread_mutex_unlock(&(q->queue_mtx));
+    return 1;
+}
+
+static int legacy_wait(void *data)
+{
+    struct legacy_queue *q = data;
+    ci_thread_mutex_lock(&(q->cond_mtx));
+    ci_thread_cond_wait(&(q->queue_cond), &(q->cond_mtx));
+    ci_thread_mutex_unlock(&(q->cond_mtx));
+    return 1;
+}
+
+static void legacy_wakeup(void *data)
+{
+    struct legacy_queue *q = data;
+    ci_thread_mutex_lock(&(q->cond_mtx));
+    ci_thread_cond_broadcast(&(q->queue_cond));
+    ci_thread_mutex_unlock(&(q->cond_mtx));
+}
+
+static void *server_init(int size) {return init_queue(size);}
+static void server_destroy(void *q) {destroy_queue(q);}
+static int server_put(void *q, struct connections_queue_item *con) {return put_to_queue(q, con);}
+static int server_get(void *q, struct connections_queue_item *con) {return get_from_queue(q, con);}
+static int server_wait(void *q) {return wait_for_queue(q);}
+static void server_wakeup(void *data)
+{
+    struct connections_queue *q = data;
+    ci_thread_mutex_lock(&(q->cond_mtx));
+    ci_thread_cond_broadcast(&(q->queue_cond));
+    ci_thread_mutex_unlock(&(q->cond_mtx));
+}
+
+struct queue_ops {
+    const char *name;
+    void *(*init)(int size);
+    void (*destroy)(void *q);
+    int (*put)(void *q, struct connections_queue_item *con);
+    int (*get)(void *q, struct connections_queue_item *con);
+    int (*wait)(void *q);
+    void (*wakeup)(void *q);
+};
+
+static struct queue_ops Queues[] = {
+    {"mutex/ci_list_t", legacy_init, legacy_destroy, legacy_put, legacy_get, legacy_wait, legacy_wakeup},
+    {"server", server_init, server_destroy, server_put, server_get, server_wait, server_wakeup},
+};
+
+static const struct queue_ops *Ops = NULL;
+static void *Queue = NULL;
+static struct timespec *Sent = NULL;
+static volatile int Done = 0;
+static ci_thread_mutex_t StatsMtx;
+static int64_t LatencySum = 0;
+static int64_t LatencyMax = 0;
+static int Received = 0;
+static int Finished = 0;
+static _CI_ATOMIC_TYPE uint32_t Consumed = 0;
+
+static void *worker(void *unused)
+{
+    struct connections_queue_item con;
+    struct timespec now;
+    int64_t lat, sum = 0, max = 0;
+    int n = 0, ret;
+    while (1) {
+        if ((ret = Ops->get(Queue, &con)) == 0) {
+            if (Done)
+                break;
+            Ops->wait(Queue);
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        lat = CLOCK_TIME_DIFF_nano(now, Sent[con.conn.fd]);
+        sum += lat;
+        if (lat > max)
+            max = lat;
+        n++;
+        ci_atomic_add_u32(&Consumed, 1);
+    }
+    ci_thread_mutex_lock(&StatsMtx);
+    LatencySum += sum;
+    if (max > LatencyMax)
+        LatencyMax = max;
+    Received += n;
+    Finished++;
+    ci_thread_mutex_unlock(&StatsMtx);
+    return NULL;
+}
+
+static void run_test(const struct queue_ops *ops, int threads, int paced, double *result)
+{
+    int i, finished;
+    uint32_t consumed;
+    struct connections_queue_item con;
+    struct timespec start;
+    double nano;
+    ci_thread_t *tids = calloc(threads, sizeof(ci_thread_t));
+
+    Ops = ops;
+    Queue = ops->init(2 * threads);
+    Done = 0;
+    LatencySum = LatencyMax = 0;
+    Received = Finished = 0;
+    ci_atomic_store_u32(&Consumed, 0);
+    memset(&con, 0, sizeof(con));
+    for (i = 0; i < threads; i++)
+        ci_thread_create(&tids[i], worker, NULL);
+    /*Let the workers block on the queue*/
+    ci_usleep(10000);
+
+    bench_start(&start);
+    for (i = 0; i < LOOPS; i++) {
+        con.conn.fd = i;
+        clock_gettime(CLOCK_MONOTONIC, &Sent[i]);
+        while (ops->put(Queue, &con) == 0)
+            sched_yield();
+        if (paced) {
+            do {
+                ci_atomic_load_u32(&Consumed, &consumed);
+            } while (consumed <= (uint32_t)i);
+        }
+    }
+    Done = 1;
+    do {
+        ops->wakeup(Queue);
+        ci_thread_mutex_lock(&StatsMtx);
+        finished = Finished;
+        ci_thread_mutex_unlock(&StatsMtx);
+        if (finished < threads)
+            ci_usleep(1000);
+    } while (finished < threads);
+    nano = bench_elapsed_nano(&start);
+
+    for (i = 0; i < threads; i++)
+        ci_thread_join(tids[i]);
+    free(tids);
+    ops->destroy(Queue);
+
+    if (Received != LOOPS)
+        test_fail(ops->name, "lost %d connections", LOOPS - Received);
+    if (paced) {
+        result[0] = Received ? (double)LatencySum / Received / 1000.0 : 0.0;
+        result[1] = (double)LatencyMax / 1000.0;
+    } else
+        result[0] = (double)Received * 1000000000.0 / nano;
+}
+
+int main(int argc, char *argv[])
+{
+    int threads, i;
+    double throughput[2], latency[2];
+    ci_client_library_init();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options)) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    /*Do not flood the output with the "drop connection" messages*/
+    CI_DEBUG_LEVEL = USE_DEBUG_LEVEL >= 0 ? USE_DEBUG_LEVEL : 0;
+
+    Sent = malloc(LOOPS * sizeof(struct timespec));
+    ci_thread_mutex_init(&StatsMtx);
+    printf("%-16s %8s %12s %12s %12s\n", "queue", "threads", "conns/sec", "mean usec", "max usec");
+    for (threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        for (i = 0; i < sizeof(Queues)/sizeof(Queues[0]); i++) {
+            run_test(&Queues[i], threads, 0, throughput);
+            run_test(&Queues[i], threads, 1, latency);
+            printf("%-16s %8d %12.0f %12.2f %12.2f\n",
+                   Queues[i].name, threads, throughput[0], latency[0], latency[1]);
+        }
+    }
+    ci_thread_mutex_destroy(&StatsMtx);
+    free(Sent);
+    return test_result();
+}
@@ -0,0 +1,216 @@
+#include "common.h"
+#include "c-icap.h"
+#include "body.h"
+#include "cfg_param.h"
+#include "debug.h"
+#include "encoding.h"
+#include "mem.h"
+#include "test_common.h"
+#include <stdio.h>
+
+/*
+  Compresses test data with every supported encoding and decompresses
+  them using the streaming ci_decompressor_t interface, feeding the
+  compressed data in blocks of various sizes and draining them to
+  small output buffers. Also checks the data compressed using the
+  streaming ci_compressor_t interface.
+*/
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+int DATA_SIZE = 1024*1024;
+int USE_DEBUG_LEVEL = -1;
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-s", "size", &DATA_SIZE, ci_cfg_set_int,
+        "The size of the test data (default is 1M)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+static void check(int cond, const char *encoding, const char *test, const char *msg)
+{
+    if (!cond)
+        test_fail(test, "%s: %s", encoding, msg);
+}
+
+static int stream_decompress(int encoding, const char *in, size_t inlen, size_t block, size_t out_block, ci_off_t max_size, ci_membuf_t *out)
+{
+    ci_decompressor_t *dec;
+    char *obuf;
+    size_t pos, len, outlen;
+    int ret = CI_UNCOMP_NEED_INPUT;
+
+    if (!(dec = ci_decompressor_create(encoding, max_size)))
+        return CI_UNCOMP_ERR_ERROR;
+    obuf = malloc(out_block);
+    for (pos = 0; pos < inlen && ret == CI_UNCOMP_NEED_INPUT; pos += len) {
+        len = (inlen - pos) < block ? (inlen - pos) : block;
+        ci_decompressor_feed(dec, in + pos, len, pos + len >= inlen);
+        do {
+            ret = ci_decompressor_drain(dec, obuf, out_block, &outlen);
+            if (outlen)
+                ci_membuf_write(out, obuf, outlen, 0);
+        } while (ret == CI_UNCOMP_HAVE_OUTPUT);
+    }
+    free(obuf);
+    ci_decompressor_destroy(dec);
+    return ret;
+}
+
+static void test_encoding(int encoding, const char *data, size_t datalen)
+{
+    static const size_t blocks[] = {1, 7, 1000, 65536};
+    static const size_t out_blocks[] = {1, 100, 8192};
+    const char *name = ci_encoding_method_str(encoding);
+    char testname[128];
+    ci_membuf_t *compressed, *out;
+    unsigned i, k;
+    int ret;
+
+    compressed = ci_membuf_new_sized(datalen);
+    if (ci_compress_to_membuf(encoding, data, datalen, compressed, 0) != CI_COMP_OK) {
+        printf("%-8s compression is not supported, skip\n", name);
+        ci_membuf_free(compressed);
+        return;
+    }
+    printf("%-8s %d bytes compressed to %d bytes\n", name, (int)datalen, (int)compressed->endpos);
+
+    for (i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++) {
+        for (k = 0; k < sizeof(out_blocks) / sizeof(out_blocks[0]); k++) {
+            /* Byte at a time in both directions is very slow for big data */
+            if (blocks[i] == 1 && out_blocks[k] == 1 && datalen > 65536)
+                continue;
+            snprintf(testname, sizeof(testname), "in=%d/out=%d", (int)blocks[i], (int)out_blocks[k]);
+            out = ci_membuf_new_sized(datalen);
+            ret = stream_decompress(encoding, compressed->buf, compressed->endpos, blocks[i], out_blocks[k], 0, out);
+            check(ret == CI_UNCOMP_OK, name, testname, ci_decompress_error(ret));
+            check(out->endpos == datalen && memcmp(out->buf, data, datalen) == 0, name, testname, "output does not match");
+            ci_membuf_free(out);
+        }
+    }
+
+    out = ci_membuf_new_sized(datalen);
+    ret = stream_decompress(encoding, compressed->buf, compressed->endpos / 2, 4096, 8192, 0, out);
+    check(ret == CI_UNCOMP_ERR_CORRUPT, name, "truncated", "truncated data not detected");
+    check(memcmp(out->buf, data, out->endpos) == 0, name, "truncated", "output does not match");
+    ci_membuf_free(out);
+
+    out = ci_membuf_new_sized(datalen);
+    ret = stream_decompress(encoding, compressed->buf, compressed->endpos, 4096, 8192, datalen / 2, out);
+    check(ret == CI_UNCOMP_ERR_NONE || ret == CI_UNCOMP_ERR_BOMB, name, "max_size", "max size not detected");
+    check(out->endpos == datalen / 2 && memcmp(out->buf, data, datalen / 2) == 0, name, "max_size", "output does not match");
+    ci_membuf_free(out);
+
+    ci_membuf_free(compressed);
+}
+
+static void test_stream_compress(int encoding, const char *data, size_t datalen)
+{
+    static const int levels[] = {-1, 1, 9};
+    const char *name = ci_encoding_method_str(encoding);
+    char obuf[100], testname[128];
+    ci_compressor_t *comp;
+    ci_membuf_t *compressed, *out;
+    size_t pos, len, outlen;
+    unsigned i;
+    int ret;
+
+    for (i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        snprintf(testname, sizeof(testname), "compress/level=%d", levels[i]);
+        if (!(comp = ci_compressor_create(encoding, levels[i])))
+            return;
+        compressed = ci_membuf_new_sized(datalen);
+        ret = CI_COMP_NEED_INPUT;
+        for (pos = 0; pos <= datalen && ret == CI_COMP_NEED_INPUT; pos += len) {
+            len = (datalen - pos) < 1000 ? (datalen - pos) : 1000;
+            ci_compressor_feed(comp, data + pos, len, len == 0);
+            do {
+                ret = ci_compressor_drain(comp, obuf, sizeof(obuf), &outlen);
+                if (outlen)
+                    ci_membuf_write(compressed, obuf, outlen, 0);
+            } while (ret == CI_COMP_HAVE_OUTPUT);
+            if (len == 0)
+                break;
+        }
+        check(ret == CI_COMP_OK, name, testname, "compression failed");
+        check(ci_compressor_total_in(comp) == (ci_off_t)datalen, name, testname, "wrong input size");
+        check(ci_compressor_total_out(comp) == (ci_off_t)compressed->endpos, name, testname, "wrong output size");
+        ci_compressor_destroy(comp);
+
+        out = ci_membuf_new_sized(datalen);
+        ret = stream_decompress(encoding, compressed->buf, compressed->endpos, 65536, 8192, 0, out);
+        check(ret == CI_UNCOMP_OK, name, testname, ci_decompress_error(ret));
+        check(out->endpos == datalen && memcmp(out->buf, data, datalen) == 0, name, testname, "output does not match");
+        ci_membuf_free(out);
+        ci_membuf_free(compressed);
+    }
+}
+
+static void test_bomb(int encoding, size_t datalen)
+{
+    char *zeros = calloc(1, datalen);
+    const char *name = ci_encoding_method_str(encoding);
+    ci_membuf_t *compressed, *out;
+    int ret;
+
+    compressed = ci_membuf_new_sized(datalen);
+    if (ci_compress_to_membuf(encoding, zeros, datalen, compressed, 0) != CI_COMP_OK) {
+        ci_membuf_free(compressed);
+        free(zeros);
+        return;
+    }
+    out = ci_membuf_new_sized(65536);
+    ret = stream_decompress(encoding, compressed->buf, compressed->endpos, 4096, 8192, 32768, out);
+    check(ret == CI_UNCOMP_ERR_BOMB, name, "bomb", "compression bomb not detected");
+    check(out->endpos == 32768, name, "bomb", "wrong output size");
+    ci_membuf_free(out);
+    ci_membuf_free(compressed);
+    free(zeros);
+}
+
+int init_body_system();
+int main(int argc, char *argv[])
+{
+    static const int encodings[] = {CI_ENCODE_GZIP, CI_ENCODE_DEFLATE, CI_ENCODE_BZIP2, CI_ENCODE_BROTLI, CI_ENCODE_ZSTD};
+    char *data;
+    unsigned i;
+    int k;
+    ci_cfg_lib_init();
+    ci_mem_init();
+    init_body_system();
+
+    __log_error = (void (*)(void *, const char *,...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || DATA_SIZE <= 0) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    /* Compressible but not trivial data */
+    data = malloc(DATA_SIZE);
+    srand(1);
+    for (k = 0; k < DATA_SIZE; k++)
+        data[k] = (rand() % 4 == 0) ? (char)(rand() % 256) : "c-icap streaming test "[k % 22];
+
+    for (i = 0; i < sizeof(encodings) / sizeof(encodings[0]); i++) {
+        test_encoding(encodings[i], data, DATA_SIZE);
+        test_stream_compress(encodings[i], data, DATA_SIZE);
+        test_bomb(encodings[i], 4 * DATA_SIZE);
+    }
+    free(data);
+    return test_result();
+}
@@ -0,0 +1,159 @@
+#include "common.h"
+#include "c-icap.h"
+#include "cfg_param.h"
+#include "client.h"
+#include "debug.h"
+#include "mem.h"
+#include "net_io.h"
+#include "request.h"
+#include "txt_format.h"
+#include "test_common.h"
+#include <stdio.h>
+
+/*
+  Checks that the compiled formats (ci_format_compile) produce the same
+  text as the ci_format_text, and measures the per-request cost of both
+  for the default access log format.
+*/
+
+int LOOPS = 1000000;
+int USE_DEBUG_LEVEL = -1;
+const char *BENCH_FORMAT = "%tl, %la %a %im %iu %is";
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-l", "loops", &LOOPS, ci_cfg_set_int,
+        "The number of the formated log lines (default is 1000000)"
+    },
+    {
+        "-f", "format", &BENCH_FORMAT, ci_cfg_set_str,
+        "The format to benchmark (default is the access log format)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+static int fmt_test_user(ci_request_t *req, char *buf, int len, const char *param)
+{
+    return snprintf(buf, len, "user<%s>", param ? param : "");
+}
+
+static struct ci_fmt_entry UserTable[] = {
+    {"%ZZ", "Test directive", fmt_test_user},
+    {NULL, NULL, NULL}
+};
+
+static const char *Formats[] = {
+    "%tl, %la %a %im %iu %is",
+    "%tg %ts %a:%lp %>a %<A %im %is %Ib %Ob %{10}Ih",
+    "[%20a] [%-20a] [%3iu] [%-3iu] [%40tl] [%-40tg]",
+    "%{%Y%m%d}tl %{%H:%M:%S}tg %{never}ZZ %ZZ",
+    "100% literal %% %q % end %",
+    "%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a",
+    "",
+    "no directives at all",
+    NULL
+};
+
+static void check_format(ci_request_t *req, const char *fmt)
+{
+    static const int lens[] = {4096, 64, 17, 5, 2, 1};
+    char buf1[4096], buf2[4096];
+    ci_fmt_program_t *prog;
+    int i, ret1, ret2, retry;
+
+    prog = ci_format_compile(fmt, UserTable);
+    if (!prog) {
+        test_fail(fmt, "can not compile");
+        return;
+    }
+    for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+        /*Retry once, the time may change between the two calls*/
+        for (retry = 0; retry < 2; retry++) {
+            ret1 = ci_format_text(req, fmt, buf1, lens[i], UserTable);
+            ret2 = ci_format_program_text(req, prog, buf2, lens[i]);
+            if (ret1 == ret2 && strcmp(buf1, buf2) == 0)
+                break;
+        }
+        if (retry == 2)
+            test_fail(fmt, "%d bytes\n    '%s' (%d)\n    '%s' (%d)", lens[i], buf1, ret1, buf2, ret2);
+    }
+    ci_format_program_release(prog);
+}
+
+static double bench(ci_request_t *req, const char *fmt, int compiled)
+{
+    char logline[4096];
+    double nano;
+    struct timespec start;
+    ci_fmt_program_t *prog = NULL;
+    int i;
+
+    if (compiled)
+        prog = ci_format_compile(fmt, NULL);
+    bench_start(&start);
+    for (i = 0; i < LOOPS; i++) {
+        if (prog)
+            ci_format_program_text(req, prog, logline, sizeof(logline));
+        else
+            ci_format_text(req, fmt, logline, sizeof(logline), NULL);
+    }
+    nano = bench_elapsed_nano(&start);
+    if (prog)
+        ci_format_program_release(prog);
+    return nano / LOOPS;
+}
+
+int main(int argc, char *argv[])
+{
+    ci_connection_t *conn;
+    ci_request_t *req;
+    double parsed, compiled;
+    int i;
+
+    ci_client_library_init();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || LOOPS <= 0) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    conn = ci_connection_create();
+    ci_ip_to_ci_sockaddr_t("192.168.1.10", &conn->claddr);
+    ci_sockaddr_set_port(&conn->claddr, 34567);
+    ci_ip_to_ci_sockaddr_t("192.168.1.1", &conn->srvaddr);
+    ci_sockaddr_set_port(&conn->srvaddr, 1344);
+    req = ci_request_alloc(conn);
+    req->type = ICAP_REQMOD;
+    req->return_code = EC_204;
+    strcpy(req->service, "srv_echo");
+    strcpy(req->args, "mode=test");
+
+    for (i = 0; Formats[i] != NULL; i++)
+        check_format(req, Formats[i]);
+
+    parsed = bench(req, BENCH_FORMAT, 0);
+    compiled = bench(req, BENCH_FORMAT, 1);
+    printf("Format: '%s'\n", BENCH_FORMAT);
+    printf("%-12s %12s\n", "", "ns/request");
+    printf("%-12s %12.1f\n", "parsed", parsed);
+    printf("%-12s %12.1f\n", "compiled", compiled);
+
+    ci_request_destroy(req); /*also frees the connection*/
+    return test_result();
+}
@@ -0,0 +1,300 @@
+#include "common.h"
+#include "c-icap.h"
+#include "cfg_param.h"
+#include "client.h"
+#include "debug.h"
+#include "hash.h"
+#include "mem.h"
+#include "types_ops.h"
+#include "test_common.h"
+#include <stdio.h>
+
+/*
+  Checks the ci_hash_* tables adding, searching and removing random keys,
+  and compares the lookups and the memory per entry with the chained
+  hash table c-icap used before.
+*/
+
+int KEYS = 1000000;
+int USE_DEBUG_LEVEL = -1;
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-k", "keys", &KEYS, ci_cfg_set_int,
+        "The number of the keys for the benchmark (default is 1000000)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+/*An allocator which counts the allocated memory*/
+static size_t Allocated = 0;
+static size_t Allocations = 0;
+
+static void *counting_alloc(ci_mem_allocator_t *allocator, size_t size)
+{
+    size_t *p = malloc(size + sizeof(size_t));
+    if (!p)
+        return NULL;
+    *p = size;
+    Allocated += size;
+    Allocations++;
+    return p + 1;
+}
+
+static void counting_free(ci_mem_allocator_t *allocator, void *ptr)
+{
+    size_t *p = (size_t *)ptr - 1;
+    Allocated -= *p;
+    Allocations--;
+    free(p);
+}
+
+static void counting_reset(ci_mem_allocator_t *allocator) {}
+static void counting_destroy(ci_mem_allocator_t *allocator) {}
+
+static ci_mem_allocator_t CountingAllocator = {
+    counting_alloc,
+    counting_free,
+    counting_reset,
+    counting_destroy,
+    NULL,
+    "counting",
+    0,
+    1
+};
+
+/*The chained hash table used before, for comparison*/
+struct chained_entry {
+    unsigned int hash;
+    const void *key;
+    const void *val;
+    struct chained_entry *hnext;
+};
+
+struct chained_table {
+    struct chained_entry **hash_table;
+    unsigned int hash_table_size;
+    const ci_type_ops_t *ops;
+    ci_mem_allocator_t *allocator;
+};
+
+static struct chained_table *chained_build(unsigned int hash_size, const ci_type_ops_t *ops, ci_mem_allocator_t *allocator)
+{
+    struct chained_table *htable = allocator->alloc(allocator, sizeof(struct chained_table));
+    unsigned int new_hash_size = 63;
+    if (hash_size > 63) {
+        while (new_hash_size < hash_size && new_hash_size < 0xFFFFFF) {
+            new_hash_size++;
+            new_hash_size = (new_hash_size << 1) - 1;
+        }
+    }
+    htable->hash_table = allocator->alloc(allocator, (new_hash_size + 1) * sizeof(struct chained_entry *));
+    memset(htable->hash_table, 0, (new_hash_size + 1) * sizeof(struct chained_entry *));
+    htable->hash_table_size = new_hash_size;
+    htable->ops = ops;
+    htable->allocator = allocator;
+    return htable;
+}
+
+static void chained_destroy(struct chained_table *htable)
+{
+    struct chained_entry *e;
+    unsigned int i;
+    for (i = 0; i <= htable->hash_table_size; i++) {
+        while ((e = htable->hash_table[i])) {
+            htable->hash_table[i] = e->hnext;
+            htable->allocator->free(htable->allocator, e);
+        }
+    }
+    htable->allocator->free(htable->allocator, htable->hash_table);
+    htable->allocator->free(htable->allocator, htable);
+}
+
+static const void *chained_search(struct chained_table *htable, const void *key)
+{
+    struct chained_entry *e;
+    unsigned int hash = ci_hash_compute(htable->hash_table_size, key, htable->ops->size(key));
+    for (e = htable->hash_table[hash]; e != NULL; e = e->hnext) {
+        if (htable->ops->compare(e->key, key) == 0)
+            return e->val;
+    }
+    return NULL;
+}
+
+static void *chained_add(struct chained_table *htable, const void *key, const void *val)
+{
+    struct chained_entry *e;
+    unsigned int hash = ci_hash_compute(htable->hash_table_size, key, htable->ops->size(key));
+    if (!(e = htable->allocator->alloc(htable->allocator, sizeof(struct chained_entry))))
+        return NULL;
+    e->key = key;
+    e->val = val;
+    e->hash = hash;
+    e->hnext = htable->hash_table[hash];
+    htable->hash_table[hash] = e;
+    return e;
+}
+
+static int count_items(void *data, const void *key, const void *val)
+{
+    if (strcmp((const char *)key, (const char *)val) != 0)
+        test_fail("ci_hash_iterate", "wrong value");
+    (*(int *)data)++;
+    return 0;
+}
+
+#define CHECK_KEYS 20000
+static void check_operations()
+{
+    static char keys[CHECK_KEYS][16];
+    static int present[CHECK_KEYS];
+    struct ci_hash_table *htable;
+    const void *val;
+    int i, k, items = 0, iterated = 0;
+
+    for (i = 0; i < CHECK_KEYS; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "key%d", i);
+        present[i] = 0;
+    }
+    /*Start small, to grow many times*/
+    htable = ci_hash_build(0, &ci_str_ops, ci_os_allocator);
+    for (i = 0; i < 20 * CHECK_KEYS; i++) {
+        k = test_rnd() % CHECK_KEYS;
+        switch (test_rnd() % 4) {
+        case 0:
+        case 1:
+            if (!ci_hash_add(htable, keys[k], keys[k])) {
+                test_fail("ci_hash_add", "can not add a key");
+                return;
+            }
+            if (!present[k])
+                items++;
+            present[k] = 1;
+            break;
+        case 2:
+            val = ci_hash_remove(htable, keys[k]);
+            if ((val != NULL) != present[k])
+                test_fail("ci_hash_remove", "wrong result");
+            if (present[k])
+                items--;
+            present[k] = 0;
+            break;
+        default:
+            val = ci_hash_search(htable, keys[k]);
+            if ((val != NULL) != present[k] || (val && val != keys[k]))
+                test_fail("ci_hash_search", "wrong result");
+            break;
+        }
+    }
+    for (i = 0; i < CHECK_KEYS; i++) {
+        if ((ci_hash_search(htable, keys[i]) != NULL) != present[i])
+            test_fail("ci_hash_search", "wrong result");
+    }
+    if (ci_hash_items(htable) != items)
+        test_fail("ci_hash_items", "wrong number of items");
+    ci_hash_iterate(htable, &iterated, count_items);
+    if (iterated != items)
+        test_fail("ci_hash_iterate", "wrong number of items");
+    ci_hash_destroy(htable);
+}
+
+static void bench()
+{
+    struct ci_hash_table *htable;
+    struct chained_table *chained;
+    struct timespec start;
+    char **keys, **missing, buf[64];
+    double build[2], hits[2], misses[2], memory[2];
+    int i, found = 0;
+
+    keys = malloc(KEYS * sizeof(char *));
+    missing = malloc(KEYS * sizeof(char *));
+    for (i = 0; i < KEYS; i++) {
+        snprintf(buf, sizeof(buf), "www.site%u.example.com/path/%d", test_rnd(), i);
+        keys[i] = strdup(buf);
+        snprintf(buf, sizeof(buf), "www.missing%u.example.com/%d", test_rnd(), i);
+        missing[i] = strdup(buf);
+    }
+
+    /*Both tables are sized for the number of keys*/
+    bench_start(&start);
+    chained = chained_build(KEYS, &ci_str_ops, &CountingAllocator);
+    for (i = 0; i < KEYS; i++)
+        chained_add(chained, keys[i], keys[i]);
+    build[0] = bench_elapsed_nano(&start) / KEYS;
+    memory[0] = (double)Allocated / KEYS;
+    bench_start(&start);
+    for (i = 0; i < KEYS; i++)
+        found += chained_search(chained, keys[(int)(((int64_t)i * 7919) % KEYS)]) != NULL;
+    hits[0] = bench_elapsed_nano(&start) / KEYS;
+    bench_start(&start);
+    for (i = 0; i < KEYS; i++)
+        found -= chained_search(chained, missing[i]) != NULL;
+    misses[0] = bench_elapsed_nano(&start) / KEYS;
+    chained_destroy(chained);
+    if (found != KEYS)
+        test_fail("chained", "wrong lookup results");
+
+    found = 0;
+    bench_start(&start);
+    htable = ci_hash_build(KEYS, &ci_str_ops, &CountingAllocator);
+    for (i = 0; i < KEYS; i++)
+        ci_hash_add(htable, keys[i], keys[i]);
+    build[1] = bench_elapsed_nano(&start) / KEYS;
+    memory[1] = (double)Allocated / KEYS;
+    bench_start(&start);
+    for (i = 0; i < KEYS; i++)
+        found += ci_hash_search(htable, keys[(int)(((int64_t)i * 7919) % KEYS)]) != NULL;
+    hits[1] = bench_elapsed_nano(&start) / KEYS;
+    bench_start(&start);
+    for (i = 0; i < KEYS; i++)
+        found -= ci_hash_search(htable, missing[i]) != NULL;
+    misses[1] = bench_elapsed_nano(&start) / KEYS;
+    ci_hash_destroy(htable);
+    if (found != KEYS)
+        test_fail("ci_hash", "wrong lookup results");
+
+    printf("Keys: %d\n", KEYS);
+    printf("%-12s %12s %12s %12s %14s\n", "", "ns/add", "ns/hit", "ns/miss", "bytes/entry");
+    printf("%-12s %12.1f %12.1f %12.1f %14.1f\n", "chained", build[0], hits[0], misses[0], memory[0]);
+    printf("%-12s %12.1f %12.1f %12.1f %14.1f\n", "open", build[1], hits[1], misses[1], memory[1]);
+    printf("(the chained table memory does not include the per allocation overhead of the allocator)\n");
+
+    for (i = 0; i < KEYS; i++) {
+        free(keys[i]);
+        free(missing[i]);
+    }
+    free(keys);
+    free(missing);
+}
+
+int main(int argc, char *argv[])
+{
+    ci_client_library_init();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || KEYS <= 0) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    check_operations();
+    bench();
+
+    return test_result();
+}
@@ -0,0 +1,291 @@
+#include "common.h"
+#include "c-icap.h"
+#include "cfg_param.h"
+#include "client.h"
+#include "debug.h"
+#include "header.h"
+#include "test_common.h"
+#include <stdio.h>
+
+/*
+  Checks the header searches on headers lists which are modified with
+  random additions and removals, comparing the results with the linear
+  search c-icap used before. Then compares the time to do the header
+  lookups of a request, like the ACLs, the log formats and the services
+  do, with the linear search and with the headers index.
+*/
+
+int ITERATIONS = 100000;
+int BENCH_LOOPS = 200000;
+int USE_DEBUG_LEVEL = -1;
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-n", "iterations", &ITERATIONS, ci_cfg_set_int,
+        "The number of the random operations to check (default is 100000)"
+    },
+    {
+        "-b", "loops", &BENCH_LOOPS, ci_cfg_set_int,
+        "The number of the requests for every benchmark (default is 200000)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+/*The linear search used before*/
+static const char *linear_value(const ci_headers_list_t * h, const char *header)
+{
+    int i;
+    size_t header_size;
+    const char *h_end;
+    const char *check_head, *lval;
+
+    header_size = strlen(header);
+    if (!header_size)
+        return NULL;
+
+    h_end = h->buf + h->bufused;
+    for (i = 0; i < h->used; i++) {
+        check_head = h->headers[i];
+        if (h_end < check_head + header_size)
+            return NULL;
+        if (*(check_head + header_size) != ':')
+            continue;
+        if (strncasecmp(check_head, header, header_size) == 0) {
+            lval = check_head + header_size + 1;
+            while (lval <= h_end && (*lval == ' ' || *lval == '\t'))
+                ++(lval);
+            return lval;
+        }
+    }
+    return NULL;
+}
+
+static const char *Names[] = {
+    "Host", "host", "HOST", "Accept", "Accept-Encoding", "Accept-Language",
+    "Cookie", "X-Client-IP", "Via", "Content-Type", "Content-Length",
+    "Content-Encoding", "X-A", "X-B", "X-C", "X-D", "X-E", "X-F", "X-G",
+    "Connection", "Cache-Control", "Missing", "Hos", "Hostt", "x-a", ""
+};
+#define NAMES_NUM (int)(sizeof(Names) / sizeof(Names[0]))
+
+static void check_lookups(ci_headers_list_t *h)
+{
+    const char *values[NAMES_NUM];
+    const char *val, *ref;
+    size_t size;
+    int k, found = 0, expected = 0;
+
+    for (k = 0; k < NAMES_NUM; k++) {
+        ref = linear_value(h, Names[k]);
+        expected += (ref != NULL);
+        if ((val = ci_headers_value(h, Names[k])) != ref)
+            test_fail("ci_headers_value", "wrong value, header: %s", Names[k]);
+        if ((ci_headers_search(h, Names[k]) != NULL) != (ref != NULL))
+            test_fail("ci_headers_search", "wrong result, header: %s", Names[k]);
+        if ((val = ci_headers_value2(h, Names[k], &size)) != ref)
+            test_fail("ci_headers_value2", "wrong value, header: %s", Names[k]);
+        else if (val && (size != strcspn(val, "\r\n") || (size && val[size] != '\0' && val[size] != '\r')))
+            test_fail("ci_headers_value2", "wrong value size, header: %s", Names[k]);
+    }
+    found = ci_headers_values(h, Names, values, NAMES_NUM);
+    for (k = 0; k < NAMES_NUM; k++) {
+        if (values[k] != linear_value(h, Names[k]))
+            test_fail("ci_headers_values", "wrong value, header: %s", Names[k]);
+    }
+    if (found != expected)
+        test_fail("ci_headers_values", "wrong number of headers");
+}
+
+static void check_operations()
+{
+    ci_headers_list_t *h = ci_headers_create();
+    ci_headers_list_t *other = ci_headers_create();
+    char line[128];
+    int i, k, op;
+
+    ci_headers_add(other, "X-A: other a");
+    ci_headers_add(other, "Via: 1.1 other");
+    ci_headers_add(h, "GET http://www.example.com/ HTTP/1.1");
+    for (i = 0; i < ITERATIONS && Failures < 10; i++) {
+        op = test_rnd() % 17;
+        k = test_rnd() % (NAMES_NUM - 1);
+        if (op < 7) {
+            snprintf(line, sizeof(line), "%s: value %d", Names[k], i);
+            ci_headers_add(h, line);
+        } else if (op < 13) {
+            int exists = (linear_value(h, Names[k]) != NULL);
+            if (ci_headers_remove(h, Names[k]) != exists)
+                test_fail("ci_headers_remove", "wrong result, header: %s", Names[k]);
+        } else if (op == 13) {
+            if (h->used < 60)
+                ci_headers_addheaders(h, other);
+        } else if (op == 14) {
+            /*Pack and parse again, like a request forwarded to a client*/
+            char *buf = malloc(h->bufused + 1);
+            int len = ci_headers_pack_to_buffer(h, buf, h->bufused + 1);
+            ci_headers_reset(h);
+            if (len > 0) {
+                memcpy(h->buf, buf, len);
+                h->bufused = len;
+                ci_headers_unpack(h);
+            }
+            free(buf);
+        } else if (op == 15) {
+            ci_headers_build_index(h);
+        } else if ((test_rnd() % 8) == 0) {
+            ci_headers_reset(h);
+            ci_headers_add(h, "GET http://www.example.com/ HTTP/1.1");
+        }
+        check_lookups(h);
+    }
+    ci_headers_destroy(h);
+    ci_headers_destroy(other);
+}
+
+/*A typical request forwarded by a proxy, with the ICAP headers the
+  lookups of a request are doing*/
+static const char *BenchHeaders[] = {
+    "GET http://www.example.com/index.html HTTP/1.1",
+    "Host: www.example.com",
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:98.0) Gecko/20100101 Firefox/98.0",
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8",
+    "Accept-Language: en-US,en;q=0.5",
+    "Accept-Encoding: gzip, deflate, br",
+    "Referer: https://www.example.com/",
+    "Cookie: session=4f0a9c1e2b3d; theme=dark; lang=en",
+    "Upgrade-Insecure-Requests: 1",
+    "Sec-Fetch-Dest: document",
+    "Sec-Fetch-Mode: navigate",
+    "Sec-Fetch-Site: same-origin",
+    "Sec-Fetch-User: ?1",
+    "Pragma: no-cache",
+    "Cache-Control: no-cache",
+    "DNT: 1",
+    "TE: trailers",
+    "Via: 1.1 proxy.example.net (squid/5.2)",
+    "X-Forwarded-For: 192.168.1.23",
+    "X-Request-Id: 7f1c2a9e-33b1-4b52-9c0e-8a5d3f3c2b11",
+    "Sec-CH-UA: \"Chromium\";v=\"99\", \"Google Chrome\";v=\"99\"",
+    "Sec-CH-UA-Mobile: ?0",
+    "Sec-CH-UA-Platform: \"Linux\"",
+    "Origin: https://www.example.com",
+    "Connection: keep-alive",
+    NULL
+};
+
+#define BENCH_LOOKUPS 40
+static const char *BenchLookups[BENCH_LOOKUPS + 1] = {
+    "Host", "User-Agent", "Content-Length", "Content-Type", "Content-Encoding",
+    "Cookie", "Referer", "Accept-Language", "X-Forwarded-For", "Via",
+    "Authorization", "Proxy-Authorization", "Connection", "Accept-Encoding",
+    "Transfer-Encoding", "X-Client-IP", "Range", "If-Modified-Since",
+    "Cache-Control", "Origin",
+    /*The rest are X-Extension-Header-* headers*/
+    NULL
+};
+
+/*Every request modifies the headers list, so the index is built again
+  for every request, before the lookups. Returns the best of a few runs,
+  in ns per request*/
+#define BENCH_LINEAR 0
+#define BENCH_VALUE 1
+#define BENCH_VALUES 2
+static double bench_lookups(ci_headers_list_t *h, int lookups, int mode, int *found)
+{
+    struct timespec start;
+    const char *values[BENCH_LOOKUPS];
+    double t, best = 0;
+    int i, k, run;
+
+    *found = 0;
+    for (run = 0; run < 5; run++) {
+        bench_start(&start);
+        for (i = 0; i < BENCH_LOOPS / 5; i++) {
+            ci_headers_add(h, "X-Bench: 1");
+            ci_headers_remove(h, "X-Bench");
+            if (mode != BENCH_LINEAR)
+                ci_headers_build_index(h);
+            if (mode == BENCH_VALUES)
+                *found += ci_headers_values(h, BenchLookups, values, lookups);
+            else {
+                for (k = 0; k < lookups; k++) {
+                    if (mode == BENCH_LINEAR)
+                        *found += linear_value(h, BenchLookups[k]) != NULL;
+                    else
+                        *found += ci_headers_value(h, BenchLookups[k]) != NULL;
+                }
+            }
+        }
+        t = bench_elapsed_nano(&start) / (BENCH_LOOPS / 5);
+        if (run == 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+static void bench()
+{
+    ci_headers_list_t *h;
+    static char extensions[BENCH_LOOKUPS][64];
+    double times[3];
+    char line[64];
+    int found[3];
+    int lists[] = {10, 25, 40, 60, 120}, lookups[] = {4, 20, 40};
+    int l, m, k, mode;
+
+    for (k = 20; k < BENCH_LOOKUPS; k++) {
+        snprintf(extensions[k], sizeof(extensions[k]), "X-Extension-Header-%d", k * 5);
+        BenchLookups[k] = extensions[k];
+    }
+    printf("%-8s %8s %16s %16s %16s\n", "headers", "lookups", "linear ns/req", "index ns/req", "multi ns/req");
+    for (l = 0; l < (int)(sizeof(lists) / sizeof(lists[0])); l++) {
+        h = ci_headers_create();
+        for (k = 0; k < lists[l]; k++) {
+            if (k < 25)
+                ci_headers_add(h, BenchHeaders[k]);
+            else {
+                snprintf(line, sizeof(line), "X-Extension-Header-%d: value %d", k, k);
+                ci_headers_add(h, line);
+            }
+        }
+        for (m = 0; m < 3; m++) {
+            for (mode = BENCH_LINEAR; mode <= BENCH_VALUES; mode++)
+                times[mode] = bench_lookups(h, lookups[m], mode, &found[mode]);
+            if (found[0] != found[1] || found[0] != found[2])
+                test_fail("bench", "wrong lookup results");
+            printf("%-8d %8d %16.1f %16.1f %16.1f\n", h->used, lookups[m], times[0], times[1], times[2]);
+        }
+        ci_headers_destroy(h);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    ci_client_library_init();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || ITERATIONS < 0 || BENCH_LOOPS <= 0) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    check_operations();
+    bench();
+
+    return test_result();
+}
@@ -0,0 +1,210 @@
+#include "common.h"
+#include "c-icap.h"
+#include "cfg_param.h"
+#include "client.h"
+#include "debug.h"
+#include "stats.h"
+#include "test_common.h"
+#include <stdio.h>
+#include <math.h>
+
+/*
+  Checks the percentiles of the HDR histograms against the exact
+  percentiles of the accounted values, checks the custom bins histograms
+  and compares the time to update each histogram type.
+*/
+
+int VALUES = 100000;
+int BENCH_LOOPS = 10000000;
+int USE_DEBUG_LEVEL = -1;
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-n", "values", &VALUES, ci_cfg_set_int,
+        "The number of the random values to account (default is 100000)"
+    },
+    {
+        "-b", "loops", &BENCH_LOOPS, ci_cfg_set_int,
+        "The number of the updates for every benchmark (default is 10000000)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+static uint64_t rnd64()
+{
+    return ((uint64_t)test_rnd() << 32) | test_rnd();
+}
+
+/*Values spread over many orders of magnitude, like latencies*/
+static uint64_t rnd_value(uint64_t max)
+{
+    uint64_t v = rnd64() >> (test_rnd() % 64);
+    return max ? v % (max + 1) : v;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+#define HDR_HISTOS 10
+static int HdrIds[HDR_HISTOS];
+static const uint64_t HdrMax[HDR_HISTOS] = {
+    1000, 1000000, 3600000000ULL, 1ULL << 40, 100, 1ULL << 62, 123456789, 5000, 1ULL << 50, 99999
+};
+
+static const double Percentiles[] = {0, 1, 10, 25, 50, 75, 90, 95, 99, 99.9, 99.99, 100};
+#define PERCENTILES_NUM (int)(sizeof(Percentiles) / sizeof(Percentiles[0]))
+
+static void check_hdr(int k)
+{
+    const int bits = k + 1;
+    uint64_t *values = malloc(VALUES * sizeof(uint64_t));
+    uint64_t reported, exact, rank;
+    int i, p;
+
+    for (i = 0; i < VALUES; i++) {
+        values[i] = rnd_value(HdrMax[k]);
+        ci_stat_histo_update(HdrIds[k], values[i]);
+    }
+    qsort(values, VALUES, sizeof(uint64_t), cmp_u64);
+
+    if (ci_stat_histo_count(HdrIds[k]) != (uint64_t)VALUES)
+        test_fail("ci_stat_histo_count", "wrong count, value: %llu", (unsigned long long)ci_stat_histo_count(HdrIds[k]));
+
+    for (p = 0; p < PERCENTILES_NUM; p++) {
+        if (!ci_stat_histo_percentile(HdrIds[k], Percentiles[p], &reported)) {
+            test_fail("ci_stat_histo_percentile", "failed for the %g percentile", Percentiles[p]);
+            continue;
+        }
+        rank = (uint64_t)ceil(Percentiles[p] / 100.0 * VALUES);
+        exact = values[rank > 0 ? rank - 1 : 0];
+        /*The reported value is the maximum of the bin of the exact value*/
+        if (reported < exact || reported > HdrMax[k])
+            test_fail("ci_stat_histo_percentile", "out of the bin, value: %llu", (unsigned long long)exact);
+        else if (exact < (2ULL << bits) && reported != exact)
+            test_fail("ci_stat_histo_percentile", "not exact, value: %llu", (unsigned long long)exact);
+        else if ((double)(reported - exact) > (double)exact / (double)(1 << bits))
+            test_fail("ci_stat_histo_percentile", "relative error, value: %llu", (unsigned long long)exact);
+        ci_debug_printf(3, "bits %d, p%g: exact %llu, reported %llu\n", bits, Percentiles[p], (unsigned long long)exact, (unsigned long long)reported);
+    }
+
+    /*The values out of range are counted in the "other" bin*/
+    ci_stat_histo_update(HdrIds[k], HdrMax[k] + 1);
+    if (!ci_stat_histo_percentile(HdrIds[k], 100, &reported) || reported != HdrMax[k])
+        test_fail("ci_stat_histo_percentile", "wrong maximum, value: %llu", (unsigned long long)reported);
+    free(values);
+}
+
+static uint64_t CustomBins[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000};
+#define CUSTOM_BINS_NUM (int)(sizeof(CustomBins) / sizeof(CustomBins[0]))
+static int CustomId = -1;
+static uint64_t CustomCounts[CUSTOM_BINS_NUM + 1];
+
+struct bins_check {
+    int bin;
+};
+
+static void check_custom_bin(void *data, double bin_raw, uint64_t count)
+{
+    struct bins_check *check = (struct bins_check *)data;
+    if (count != CustomCounts[check->bin])
+        test_fail("custom bins", "wrong bin count, value: %llu", (unsigned long long)check->bin);
+    check->bin++;
+}
+
+static void check_custom_bins()
+{
+    struct bins_check check = {0};
+    uint64_t value;
+    int i, k;
+
+    for (i = 0; i < VALUES; i++) {
+        value = test_rnd() % 120000;
+        ci_stat_histo_update(CustomId, value);
+        for (k = 0; k < CUSTOM_BINS_NUM && CustomBins[k] < value; k++);
+        if (value >= CustomBins[CUSTOM_BINS_NUM - 1])
+            k = CUSTOM_BINS_NUM;
+        CustomCounts[k]++;
+    }
+    ci_stat_histo_raw_bins_iterate(CustomId, &check, check_custom_bin);
+    if (check.bin != CUSTOM_BINS_NUM + 1)
+        test_fail("custom bins", "wrong bins number, value: %llu", (unsigned long long)check.bin);
+}
+
+static int LinearId = -1;
+static int LogId = -1;
+static int EnumId = -1;
+static int BenchHdrId = -1;
+static const char *EnumLabels[] = {"a", "b", "c"};
+
+static double bench_update(int id)
+{
+    struct timespec start;
+    int i;
+    bench_start(&start);
+    for (i = 0; i < BENCH_LOOPS; i++)
+        ci_stat_histo_update(id, test_rnd() & 0xFFFFF);
+    return bench_elapsed_nano(&start) / BENCH_LOOPS;
+}
+
+int main(int argc, char *argv[])
+{
+    char label[64];
+    uint64_t value;
+    int k;
+    ci_client_library_init();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || VALUES <= 0 || BENCH_LOOPS <= 0) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    for (k = 0; k < HDR_HISTOS; k++) {
+        snprintf(label, sizeof(label), "hdr %d", k);
+        HdrIds[k] = ci_stat_histo_create_hdr(label, "value", HdrMax[k], k + 1);
+    }
+    if (ci_stat_histo_create_hdr("hdr 0", "value", HdrMax[0], 1) != HdrIds[0])
+        test_fail("ci_stat_histo_create_hdr", "registered again");
+    CustomId = ci_stat_histo_create_custom_bins("custom", "value", CustomBins, CUSTOM_BINS_NUM);
+    LinearId = ci_stat_histo_create("linear", "value", 32, 0, 0xFFFFF);
+    LogId = ci_stat_histo_create_log("log", "value", 32, 0, 0xFFFFF);
+    EnumId = ci_stat_histo_create_enum("enum", "value", EnumLabels, 3);
+    BenchHdrId = ci_stat_histo_create_hdr("bench hdr", "value", 0xFFFFF, 5);
+    ci_stat_allocate_mem();
+
+    if (ci_stat_histo_percentile(HdrIds[0], 50, &value))
+        test_fail("ci_stat_histo_percentile", "empty histogram, value: %llu", (unsigned long long)value);
+    for (k = 0; k < HDR_HISTOS; k++)
+        check_hdr(k);
+    check_custom_bins();
+    ci_stat_histo_update(EnumId, 1);
+    if (ci_stat_histo_percentile(EnumId, 50, &value))
+        test_fail("ci_stat_histo_percentile", "enum histogram, value: %llu", (unsigned long long)value);
+
+    printf("%-12s %12s\n", "histogram", "ns/update");
+    printf("%-12s %12.1f\n", "linear", bench_update(LinearId));
+    printf("%-12s %12.1f\n", "log", bench_update(LogId));
+    printf("%-12s %12.1f\n", "custom", bench_update(CustomId));
+    printf("%-12s %12.1f\n", "hdr", bench_update(BenchHdrId));
+    ci_stat_release();
+
+    return test_result();
+}
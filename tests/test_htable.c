@@ -0,0 +1,261 @@
+#include "common.h"
+#include "c-icap.h"
+#include "cfg_param.h"
+#include "client.h"
+#include "debug.h"
+#include "htable.h"
+#include "lookup_table.h"
+#include "mem.h"
+#include "test_common.h"
+#include <stdio.h>
+
+/*
+  Builds an hash table file and checks that all of its rows are found,
+  using both the ci_htable_* api and the htable lookup tables. Then
+  compares the open and lookup times with the hash lookup tables which
+  load the same data from a text file.
+*/
+
+int ROWS = 1000000;
+int USE_DEBUG_LEVEL = -1;
+
+void init_internal_lookup_tables();
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-r", "rows", &ROWS, ci_cfg_set_int,
+        "The number of the rows (default is 1000000)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+static void row_key(char *buf, size_t len, int i)
+{
+    snprintf(buf, len, "www.domain%d.example.com", i);
+}
+
+/*Every third row has no values, the others one or two*/
+static int row_vals(char *buf1, char *buf2, size_t len, int i)
+{
+    snprintf(buf1, len, "category%d", i % 97);
+    snprintf(buf2, len, "score=%d", i % 13);
+    return i % 3;
+}
+
+static void check_api(const char *path)
+{
+    static const char *vals1[] = {"a", "", "c", NULL};
+    static const char *vals2[] = {"other", NULL};
+    ci_htable_builder_t *builder;
+    ci_htable_t *table;
+    const char *key, *vals;
+    uint64_t duplicates = 0, pos = 0;
+    int vals_num, rows = 0;
+
+    builder = ci_htable_builder_create(path);
+    if (!builder ||
+            !ci_htable_builder_add(builder, "key1", vals1) ||
+            !ci_htable_builder_add(builder, "", NULL) ||
+            !ci_htable_builder_add(builder, "key1", vals2) ||
+            !ci_htable_builder_finish(builder, &duplicates)) {
+        test_fail("htable api", "can not build the table");
+        ci_htable_builder_destroy(builder);
+        return;
+    }
+    ci_htable_builder_destroy(builder);
+    if (duplicates != 1)
+        test_fail("htable api", "wrong number of duplicates");
+    if (!(table = ci_htable_open(path))) {
+        test_fail("htable api", "can not open the table");
+        return;
+    }
+    key = ci_htable_search(table, "key1", &vals, &vals_num);
+    if (!key || strcmp(key, "key1") != 0 || vals_num != 3 ||
+            strcmp(vals, "a") != 0 || *(vals + 2) != '\0' || strcmp(vals + 3, "c") != 0)
+        test_fail("htable api", "wrong values of the first row");
+    if (!ci_htable_search(table, "", &vals, &vals_num) || vals_num != 0)
+        test_fail("htable api", "the empty key not found");
+    if (ci_htable_search(table, "key", &vals, &vals_num) || ci_htable_search(table, "key12", &vals, &vals_num))
+        test_fail("htable api", "found a not existing key");
+    while (ci_htable_next_row(table, &pos, &vals, &vals_num))
+        rows++;
+    if (rows != 3)
+        test_fail("htable api", "wrong number of rows");
+    ci_htable_close(table);
+
+    /*A truncated file should not be opened*/
+    if (truncate(path, sizeof(ci_htable_header_t) + 8) == 0 && (table = ci_htable_open(path))) {
+        test_fail("htable api", "truncated file opened");
+        ci_htable_close(table);
+    }
+    unlink(path);
+}
+
+static int check_table(struct ci_lookup_table *table, const char *type, int check_vals)
+{
+    char key[128], val1[64], val2[64];
+    char **vals = NULL;
+    const char *found;
+    int i, vals_num, errors = 0;
+
+    for (i = 0; i < ROWS; i++) {
+        row_key(key, sizeof(key), i);
+        vals_num = row_vals(val1, val2, sizeof(val1), i);
+        found = ci_lookup_table_search(table, key, &vals);
+        if (!found) {
+            errors++;
+            continue;
+        }
+        if (check_vals) {
+            if (strcmp(found, key) != 0 ||
+                    (vals_num == 0 && vals && vals[0]) ||
+                    (vals_num > 0 && (!vals || !vals[0] || strcmp(vals[0], val1) != 0)) ||
+                    (vals_num > 1 && (!vals[1] || strcmp(vals[1], val2) != 0 || vals[2])) ||
+                    (vals_num == 1 && vals[1]))
+                errors++;
+        }
+        if (vals)
+            ci_lookup_table_release_result(table, (void **)vals);
+        vals = NULL;
+    }
+    row_key(key, sizeof(key), ROWS);
+    if (ci_lookup_table_search(table, key, &vals))
+        errors++;
+    if (errors)
+        test_fail(type, "wrong lookup results");
+    return errors;
+}
+
+static struct ci_lookup_table *open_table(const char *type, const char *path, double *open_time)
+{
+    struct ci_lookup_table *table;
+    struct timespec start;
+    char table_path[256];
+
+    snprintf(table_path, sizeof(table_path), "%s:%s", type, path);
+    bench_start(&start);
+    table = ci_lookup_table_create(table_path);
+    if (!table || !ci_lookup_table_open(table)) {
+        test_fail(type, "can not open the table");
+        if (table)
+            ci_lookup_table_destroy(table);
+        return NULL;
+    }
+    *open_time = bench_elapsed_nano(&start) / 1000000.0;
+    return table;
+}
+
+static double lookups_time(struct ci_lookup_table *table)
+{
+    struct timespec start;
+    char key[128];
+    char **vals = NULL;
+    int i;
+    bench_start(&start);
+    for (i = 0; i < ROWS; i++) {
+        row_key(key, sizeof(key), (int)(((int64_t)i * 7919) % ROWS));
+        if (ci_lookup_table_search(table, key, &vals) && vals)
+            ci_lookup_table_release_result(table, (void **)vals);
+        vals = NULL;
+    }
+    return bench_elapsed_nano(&start) / ROWS;
+}
+
+static void check_and_bench()
+{
+    char txt_path[] = "/tmp/test_htable.XXXXXX";
+    char htable_path[64];
+    char key[128], val1[64], val2[64];
+    const char *vals[3];
+    ci_htable_builder_t *builder;
+    struct ci_lookup_table *table;
+    struct timespec start;
+    double build_time, htable_open = 0, htable_lookup = 0, hash_open = 0, hash_lookup = 0;
+    FILE *f;
+    int fd, i, vals_num;
+
+    if ((fd = mkstemp(txt_path)) < 0 || !(f = fdopen(fd, "w"))) {
+        test_fail("htable", "can not create the text file");
+        return;
+    }
+    snprintf(htable_path, sizeof(htable_path), "%s.htable", txt_path);
+
+    bench_start(&start);
+    builder = ci_htable_builder_create(htable_path);
+    for (i = 0; builder && i < ROWS; i++) {
+        row_key(key, sizeof(key), i);
+        vals_num = row_vals(val1, val2, sizeof(val1), i);
+        vals[0] = vals_num > 0 ? val1 : NULL;
+        vals[1] = vals_num > 1 ? val2 : NULL;
+        vals[2] = NULL;
+        if (!ci_htable_builder_add(builder, key, vals))
+            break;
+        fprintf(f, "%s%s%s%s%s\n", key, vals_num ? ": " : "", vals_num ? val1 : "", vals_num > 1 ? ", " : "", vals_num > 1 ? val2 : "");
+    }
+    fclose(f);
+    if (!builder || i < ROWS || !ci_htable_builder_finish(builder, NULL)) {
+        test_fail("htable", "can not build the table");
+        ci_htable_builder_destroy(builder);
+        unlink(txt_path);
+        return;
+    }
+    ci_htable_builder_destroy(builder);
+    build_time = bench_elapsed_nano(&start) / 1000000.0;
+
+    if ((table = open_table("htable", htable_path, &htable_open))) {
+        check_table(table, "htable", 1);
+        htable_lookup = lookups_time(table);
+        ci_lookup_table_destroy(table);
+    }
+    if ((table = open_table("hash", txt_path, &hash_open))) {
+        check_table(table, "hash", 0);
+        hash_lookup = lookups_time(table);
+        ci_lookup_table_destroy(table);
+    }
+
+    printf("Rows: %d, htable build time: %.1f ms\n", ROWS, build_time);
+    printf("%-12s %12s %12s\n", "", "open ms", "ns/lookup");
+    printf("%-12s %12.1f %12.1f\n", "htable", htable_open, htable_lookup);
+    printf("%-12s %12.1f %12.1f\n", "hash", hash_open, hash_lookup);
+    unlink(txt_path);
+    unlink(htable_path);
+}
+
+int main(int argc, char *argv[])
+{
+    char path[] = "/tmp/test_htable_api.XXXXXX";
+    int fd;
+
+    ci_client_library_init();
+    init_internal_lookup_tables();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || ROWS <= 0) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    if ((fd = mkstemp(path)) >= 0) {
+        close(fd);
+        check_api(path);
+    } else
+        test_fail("htable api", "can not create the table file");
+    check_and_bench();
+
+    return test_result();
+}
@@ -0,0 +1,268 @@
+#include "common.h"
+#include "c-icap.h"
+#include "cfg_param.h"
+#include "client.h"
+#include "debug.h"
+#include "ip_trie.h"
+#include "lookup_table.h"
+#include "mem.h"
+#include "net_io.h"
+#include "types_ops.h"
+#include "test_common.h"
+#include <stdio.h>
+
+/*
+  Checks that the ip trie matches the ip addresses like the ci_ip_ops
+  and ci_ip_sockaddr_ops equal methods do, that it finds the longest
+  matching network and that the iptrie lookup tables work. Then
+  measures the lookups with a large number of networks.
+*/
+
+int NETWORKS = 1000000;
+int LOOKUPS = 1000000;
+int USE_DEBUG_LEVEL = -1;
+
+void init_internal_lookup_tables();
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-n", "networks", &NETWORKS, ci_cfg_set_int,
+        "The number of the networks for the benchmark (default is 1000000)"
+    },
+    {
+        "-l", "lookups", &LOOKUPS, ci_cfg_set_int,
+        "The number of the lookups for the benchmark (default is 1000000)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+/*The random networks and addresses are in a small space, to overlap*/
+static void random_network(char *buf, size_t len, int v6, int *plen)
+{
+    unsigned int a = test_rnd();
+    *plen = test_rnd() % 33;
+#ifdef USE_IPV6
+    if (v6 == 1) {
+        *plen = 16 + test_rnd() % 113;
+        snprintf(buf, len, "2001:db8:%x:%x::%x/%d", test_rnd() % 4, test_rnd() % 16, test_rnd() % 256, *plen);
+        return;
+    } else if (v6 == 2) {
+        *plen = 96 + test_rnd() % 33;
+        snprintf(buf, len, "::ffff:10.%u.%u.%u/%d", (a >> 8) % 4, (a >> 16) % 8, a >> 24, *plen);
+        return;
+    }
+#endif
+    snprintf(buf, len, "10.%u.%u.%u/%d", (a >> 8) % 4, (a >> 16) % 8, a >> 24, *plen);
+}
+
+static void random_address(char *buf, size_t len, int v6)
+{
+    unsigned int a = test_rnd();
+#ifdef USE_IPV6
+    if (v6 == 1) {
+        snprintf(buf, len, "2001:db8:%x:%x::%x", test_rnd() % 4, test_rnd() % 16, test_rnd() % 256);
+        return;
+    } else if (v6 == 2) {
+        snprintf(buf, len, "::ffff:10.%u.%u.%u", (a >> 8) % 4, (a >> 16) % 8, a >> 24);
+        return;
+    }
+#endif
+    snprintf(buf, len, "10.%u.%u.%u", (a >> 8) % 4, (a >> 16) % 8, a >> 24);
+}
+
+#define CHECK_NETWORKS 3000
+#define CHECK_LOOKUPS 3000
+static void check_matching()
+{
+    ci_ip_t *nets[CHECK_NETWORKS], *ip;
+    int plens[CHECK_NETWORKS], families = 1;
+    ci_ip_trie_t *trie, *trie4;
+    ci_sockaddr_t addr;
+    const int *found;
+    char buf[128];
+    int i, k, matches, sockaddr_matches, longest, v6;
+
+#ifdef USE_IPV6
+    families = 3;
+#endif
+    trie = ci_ip_trie_create();
+    /*Only the IPv4 networks, to check the longest prefix match*/
+    trie4 = ci_ip_trie_create();
+    for (i = 0; i < CHECK_NETWORKS; i++) {
+        v6 = i % families;
+        random_network(buf, sizeof(buf), v6, &plens[i]);
+        nets[i] = ci_ip_ops.dup(buf, ci_os_allocator);
+        if (!nets[i] || !ci_ip_trie_add(trie, nets[i], nets[i])) {
+            test_fail(buf, "can not add network");
+            return;
+        }
+        if (v6 == 0)
+            ci_ip_trie_add(trie4, nets[i], &plens[i]);
+    }
+
+    for (i = 0; i < CHECK_LOOKUPS; i++) {
+        random_address(buf, sizeof(buf), i % families);
+        ip = ci_ip_ops.dup(buf, ci_os_allocator);
+        ci_ip_to_ci_sockaddr_t(buf, &addr);
+        matches = sockaddr_matches = 0;
+        longest = -1;
+        for (k = 0; k < CHECK_NETWORKS; k++) {
+            if (ci_ip_ops.equal(nets[k], ip)) {
+                matches++;
+                if (k % families == 0 && ip->family == AF_INET && plens[k] > longest)
+                    longest = plens[k];
+            }
+            if (ci_ip_sockaddr_ops.equal(nets[k], &addr))
+                sockaddr_matches++;
+        }
+        if ((ci_ip_trie_search_ip(trie, ip) != NULL) != (matches > 0))
+            test_fail(buf, "does not match like ip_equal");
+        if ((ci_ip_trie_search_sockaddr(trie, &addr) != NULL) != (sockaddr_matches > 0))
+            test_fail(buf, "does not match like ip_sockaddr_equal");
+        if (ip->family == AF_INET) {
+            found = ci_ip_trie_search_ip(trie4, ip);
+            if ((found ? *found : -1) != longest)
+                test_fail(buf, "not the longest network");
+        }
+        ci_ip_ops.free(ip, ci_os_allocator);
+    }
+    ci_ip_trie_destroy(trie);
+    ci_ip_trie_destroy(trie4);
+    for (i = 0; i < CHECK_NETWORKS; i++)
+        ci_ip_ops.free(nets[i], ci_os_allocator);
+}
+
+static void check_lookup_table()
+{
+    static const char *data =
+        "# comment\n"
+        "10.0.0.0/8: internal\n"
+        "10.1.2.0/255.255.255.0: lab\n"
+        "10.1.2.3: host\n"
+#ifdef USE_IPV6
+        "[2001:db8::/32]: internal6\n"
+#endif
+        ;
+    static const struct {
+        const char *key;
+        const char *val;
+    } tests[] = {
+        {"10.9.9.9", "internal"},
+        {"10.1.2.4", "lab"},
+        {"10.1.2.3", "host"},
+        {"192.168.1.1", NULL},
+#ifdef USE_IPV6
+        {"::ffff:10.1.2.4", "lab"},
+        {"2001:db8:1::1", "internal6"},
+        {"2001:db9::1", NULL},
+#endif
+        {NULL, NULL}
+    };
+    char path[] = "/tmp/test_ip_trie.XXXXXX", table_path[64];
+    struct ci_lookup_table *table;
+    char **vals = NULL;
+    const char *key;
+    FILE *f;
+    int fd, i;
+
+    if ((fd = mkstemp(path)) < 0 || !(f = fdopen(fd, "w"))) {
+        test_fail("iptrie table", "can not create the table file");
+        return;
+    }
+    fputs(data, f);
+    fclose(f);
+    snprintf(table_path, sizeof(table_path), "iptrie:%s", path);
+    table = ci_lookup_table_create(table_path);
+    if (!table || !ci_lookup_table_open(table)) {
+        test_fail("iptrie table", "can not open the table");
+        unlink(path);
+        return;
+    }
+    for (i = 0; tests[i].key != NULL; i++) {
+        key = ci_lookup_table_search(table, tests[i].key, &vals);
+        if ((key == NULL) != (tests[i].val == NULL) ||
+                (key && (!vals || !vals[0] || strcmp(vals[0], tests[i].val) != 0)))
+            test_fail(tests[i].key, "wrong lookup table result");
+        if (key)
+            ci_lookup_table_release_result(table, (void **)vals);
+    }
+    ci_lookup_table_destroy(table);
+    unlink(path);
+}
+
+static void bench()
+{
+    ci_ip_trie_t *trie;
+    ci_ip_t net;
+    struct timespec start;
+    uint32_t *addrs, a;
+    int i, plen, found = 0;
+    double build_time, lookup_time;
+
+    trie = ci_ip_trie_create();
+    net.family = AF_INET;
+    bench_start(&start);
+    for (i = 0; i < NETWORKS; i++) {
+        /*Mostly /16 - /24 networks, like the routing tables*/
+        plen = 16 + test_rnd() % 9;
+        if (test_rnd() % 8 == 0)
+            plen = 8 + test_rnd() % 25;
+        a = test_rnd() & (plen ? 0xFFFFFFFF << (32 - plen) : 0);
+        ci_inaddr_zero(net.address);
+        ci_inaddr_zero(net.netmask);
+        a = htonl(a);
+        memcpy(&net.address, &a, sizeof(a));
+        a = htonl(plen ? 0xFFFFFFFF << (32 - plen) : 0);
+        memcpy(&net.netmask, &a, sizeof(a));
+        ci_ip_trie_add(trie, &net, trie);
+    }
+    build_time = bench_elapsed_nano(&start) / 1000000.0;
+
+    addrs = malloc(LOOKUPS * sizeof(uint32_t));
+    for (i = 0; i < LOOKUPS; i++)
+        addrs[i] = htonl(test_rnd());
+    bench_start(&start);
+    for (i = 0; i < LOOKUPS; i++) {
+        if (ci_ip_trie_search(trie, AF_INET, &addrs[i]))
+            found++;
+    }
+    lookup_time = bench_elapsed_nano(&start) / LOOKUPS;
+
+    printf("Networks: %d (%d distinct), build time: %.1f ms\n", NETWORKS, ci_ip_trie_entries(trie), build_time);
+    printf("Lookups: %d, found: %d, %.1f ns/lookup\n", LOOKUPS, found, lookup_time);
+    free(addrs);
+    ci_ip_trie_destroy(trie);
+}
+
+int main(int argc, char *argv[])
+{
+    ci_client_library_init();
+    init_internal_lookup_tables();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || NETWORKS <= 0 || LOOKUPS <= 0) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    check_matching();
+    check_lookup_table();
+    bench();
+
+    return test_result();
+}
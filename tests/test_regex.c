@@ -0,0 +1,207 @@
+#include "common.h"
+#include "c-icap.h"
+#include "array.h"
+#include "cfg_param.h"
+#include "ci_regex.h"
+#include "ci_threads.h"
+#include "client.h"
+#include "debug.h"
+#include "mem.h"
+#include "test_common.h"
+#include <stdio.h>
+
+/*
+  Checks the ci_regex_apply on strings which are not '\0' terminated,
+  and measures the matching of acl-like url regexes, with and without
+  JIT compilation, from many threads.
+*/
+
+int PATTERNS = 200;
+int LOOPS = 2000;
+int THREADS = 2;
+int USE_DEBUG_LEVEL = -1;
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-p", "patterns", &PATTERNS, ci_cfg_set_int,
+        "The number of the url regexes (default is 200)"
+    },
+    {
+        "-l", "loops", &LOOPS, ci_cfg_set_int,
+        "The number of the urls matched by every thread (default is 2000)"
+    },
+    {
+        "-t", "threads", &THREADS, ci_cfg_set_int,
+        "The number of the threads (default is 2)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+static ci_regex_t build(const char *def)
+{
+    ci_regex_t regex;
+    char *str;
+    int flags;
+    if (!(str = ci_regex_parse(def, &flags, NULL)))
+        return NULL;
+    regex = ci_regex_build(str, flags);
+    free(str);
+    return regex;
+}
+
+static void check(const char *def, const char *str, int len, int recurs, int expect)
+{
+    ci_regex_t regex;
+    int count;
+    if (!(regex = build(def))) {
+        test_fail(def, "can not build");
+        return;
+    }
+    count = ci_regex_apply(regex, str, len, recurs, NULL, NULL);
+    if (count != expect)
+        test_fail(def, "'%s' length %d: %d matches, expected %d", str, len, count, expect);
+    ci_regex_free(regex);
+}
+
+static void check_submatches()
+{
+    ci_regex_replace_part_t *part;
+    ci_list_t *matches;
+    ci_regex_t regex;
+
+    regex = build("/(\\w+)=(\\w+)/");
+    matches = ci_regex_create_match_list();
+    /*The "c=d" is after the length*/
+    if (ci_regex_apply(regex, "a=b;c=d", 3, 1, matches, NULL) != 1 ||
+            !(part = (ci_regex_replace_part_t *)ci_list_first(matches)) ||
+            part->matches[0].s != 0 || part->matches[0].e != 3)
+        test_fail("/(\\w+)=(\\w+)/", "wrong sub-matches");
+    ci_list_destroy(matches);
+    ci_regex_free(regex);
+}
+
+static ci_regex_t *Regexes = NULL;
+static char **Urls = NULL;
+
+static int match_urls()
+{
+    int i, k, found = 0;
+    for (i = 0; i < LOOPS; i++) {
+        /*Like an access list which walks the url acls until a match*/
+        for (k = 0; k < PATTERNS; k++) {
+            if (ci_regex_apply(Regexes[k], Urls[i], -1, 0, NULL, NULL) > 0) {
+                found++;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+static int Found[64];
+
+static int match_thread(void *data)
+{
+    int id = *(int *)data;
+    Found[id] = match_urls();
+    return 0;
+}
+
+static double bench(int jit, int *found)
+{
+    ci_thread_t threads[64];
+    int ids[64], i;
+    struct timespec start;
+    double nano;
+    char buf[256];
+
+    CI_REGEX_JIT = jit;
+    for (i = 0; i < PATTERNS; i++) {
+        snprintf(buf, sizeof(buf), "/^https?:\\/\\/([^\\/]+\\.)?(site%d|mirror%d)\\.(com|net)(:[0-9]+)?\\/.*\\.(exe|zip)$/i", i, i);
+        if (!(Regexes[i] = build(buf))) {
+            test_fail(buf, "can not build");
+            return 0;
+        }
+    }
+
+    bench_start(&start);
+    for (i = 0; i < THREADS; i++) {
+        ids[i] = i;
+        ci_thread_create(&threads[i], (void *(*)(void *))match_thread, (void *)&ids[i]);
+    }
+    for (i = 0; i < THREADS; i++)
+        ci_thread_join(threads[i]);
+    nano = bench_elapsed_nano(&start);
+
+    for (i = 0; i < THREADS; i++) {
+        if (Found[i] != Found[0])
+            test_fail("threads", "the threads found different matches");
+    }
+    *found = Found[0];
+    for (i = 0; i < PATTERNS; i++)
+        ci_regex_free(Regexes[i]);
+    return nano / ((double)THREADS * LOOPS * PATTERNS);
+}
+
+int main(int argc, char *argv[])
+{
+    char buf[256];
+    double interp, jit;
+    int i, found_interp, found_jit;
+
+    ci_client_library_init();
+    ci_regex_memory_init();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || PATTERNS <= 0 || LOOPS <= 0 || THREADS <= 0 || THREADS > 64) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    check("/^abc$/", "abcdef", 3, 0, 1);
+    check("/def/", "abcdef", 3, 0, 0);
+    check("/^abc$/", "abcdef", -1, 0, 0);
+    check("/a/", "aaab", 3, 1, 3);
+    check("/b/", "aaab", 3, 1, 0);
+    check("/a.c/i", "xAbC", 4, 0, 1);
+    check_submatches();
+
+    Regexes = calloc(PATTERNS, sizeof(ci_regex_t));
+    Urls = calloc(LOOPS, sizeof(char *));
+    for (i = 0; i < LOOPS; i++) {
+        /*One of four urls matches a regex*/
+        snprintf(buf, sizeof(buf), "http://www.%s%d.%s/download/files/file%d.%s",
+                 (i % 2) ? "site" : "mirror", (i * 7) % (2 * PATTERNS), (i % 3) ? "com" : "net", i, (i % 4) ? "zip" : "html");
+        Urls[i] = strdup(buf);
+    }
+    interp = bench(0, &found_interp);
+    jit = bench(1, &found_jit);
+    if (found_interp != found_jit)
+        test_fail("jit", "different matches with JIT");
+    printf("Regexes: %d, urls: %d, matching urls: %d, threads: %d\n", PATTERNS, LOOPS, found_jit, THREADS);
+    printf("%-12s %12s\n", "", "ns/match");
+    printf("%-12s %12.1f\n", "no jit", interp);
+    printf("%-12s %12.1f\n", "jit", jit);
+
+    for (i = 0; i < LOOPS; i++)
+        free(Urls[i]);
+    free(Urls);
+    free(Regexes);
+    ci_regex_memory_destroy();
+    return test_result();
+}
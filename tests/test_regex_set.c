@@ -0,0 +1,347 @@
+#include "common.h"
+#include "c-icap.h"
+#include "cfg_param.h"
+#include "ci_regex.h"
+#include "client.h"
+#include "debug.h"
+#include "lookup_table.h"
+#include "mem.h"
+#include "test_common.h"
+#include <stdio.h>
+
+/*
+  Checks that the regex sets match like the regexes executed one by one,
+  using hand written and random regexes, and that the regex lookup
+  tables return the first matching row. Then measures a large set of
+  url regexes.
+*/
+
+int PATTERNS = 10000;
+int LOOPS = 100;
+int USE_DEBUG_LEVEL = -1;
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-p", "patterns", &PATTERNS, ci_cfg_set_int,
+        "The number of the regexes for the benchmark (default is 10000)"
+    },
+    {
+        "-l", "loops", &LOOPS, ci_cfg_set_int,
+        "The number of the matched urls for the benchmark (default is 100)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void init_internal_lookup_tables();
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+struct test_regex {
+    char *str;
+    int flags;
+    ci_regex_t regex;
+};
+
+static int test_regex_build(struct test_regex *r, const char *def)
+{
+    if (!(r->str = ci_regex_parse(def, &r->flags, NULL)) ||
+            !(r->regex = ci_regex_build(r->str, r->flags))) {
+        free(r->str);
+        r->str = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+static void test_regex_release(struct test_regex *r)
+{
+    ci_regex_free(r->regex);
+    free(r->str);
+}
+
+/*Compares the regex set matches with the matches of every regex*/
+static void check_subject(const ci_regex_set_t *set, struct test_regex *regexes, int num, const char *subject)
+{
+    int ids[256], found, i, k, first = -1;
+
+    found = ci_regex_set_match(set, subject, -1, ids, 256);
+    for (i = 0, k = 0; i < num; i++) {
+        if (ci_regex_apply(regexes[i].regex, subject, -1, 0, NULL, NULL) <= 0)
+            continue;
+        if (first < 0)
+            first = i;
+        if (k >= found || ids[k] != i) {
+            test_fail(subject, "regex %s does not match", regexes[i].str);
+            return;
+        }
+        k++;
+    }
+    if (k != found) {
+        test_fail(subject, "regex %s matches", regexes[ids[k]].str);
+        return;
+    }
+    found = ci_regex_set_match(set, subject, -1, ids, 1);
+    if ((found ? ids[0] : -1) != first)
+        test_fail(subject, "not the first matching regex");
+}
+
+static const char *Regexes[] = {
+    "/abc/", "/ab?c/", "/a(b|c)d/", "/foo|bar/", "/x{2,3}yz/", "/x{0}yz/",
+    "/\\.com$/", "/^https?:\\/\\/[^\\/]*example\\.org\\//i", "/Ab+Cd/",
+    "/ab*c/", "/[a-c]+xyz/", "/(?i)HELLO/", "/a.c/", "/\\d+px/", "/hello/i",
+    "/HELLO/", "/[]]x/", "/(?:abc)?def/", "/(a|b)*zz/", "/q\\+r/", "/ab(?=cd)/",
+    "/(?!xy)za/", "/^$/", "/.*/", "/a\\|b/", "/[\\]]y/", "/\\w+@\\w+\\.net/",
+    "/colou?r/", "/ab{1}c/", "/(ab)+ab/", "/a\\x41b/", "/\\Qa.b\\E/", "/ab\\b/",
+    NULL
+};
+
+static const char *Subjects[] = {
+    "abc", "ac", "abd", "acd", "foo", "bar", "xxyz", "xyz", "yz", "site.com",
+    "https://www.example.org/", "HTTPS://WWW.EXAMPLE.ORG/x", "AbbCd", "abbbc",
+    "bxyz", "hello", "HeLLo", "HELLO", "]x", "def", "abcdef", "zz", "abzz",
+    "q+r", "abcd", "zab", "", "a|b", "]y", "me@host.net", "color", "colour",
+    "ababab", "aAb", "a.b", "ab cd", "ab_cd", NULL
+};
+
+static void check_regexes()
+{
+    struct test_regex regexes[64];
+    ci_regex_set_t *set;
+    int i, num = 0;
+
+    set = ci_regex_set_create();
+    for (i = 0; Regexes[i] != NULL; i++) {
+        /*some of the regexes are not supported by all regex libraries*/
+        if (!test_regex_build(&regexes[num], Regexes[i]))
+            continue;
+        if (ci_regex_set_add(set, regexes[num].str, regexes[num].flags, regexes[num].regex) != num) {
+            test_fail(Regexes[i], "can not add regex");
+            return;
+        }
+        num++;
+    }
+    /*The regexes are not compiled, then compiled*/
+    for (i = 0; Subjects[i] != NULL; i++)
+        check_subject(set, regexes, num, Subjects[i]);
+    ci_regex_set_compile(set);
+    for (i = 0; Subjects[i] != NULL; i++)
+        check_subject(set, regexes, num, Subjects[i]);
+
+    ci_regex_set_destroy(set);
+    for (i = 0; i < num; i++)
+        test_regex_release(&regexes[i]);
+}
+
+/*Random regexes and subjects from a small alphabet, to match often*/
+static void random_regex(char *buf, size_t size)
+{
+    static const char *atoms[] = {
+        "a", "b", "c", "A", "B", "\\.", ".", "[ab]", "[^a]", "(ab|c)", "(?:ba)",
+        "^", "$", "\\w", "\\d", "-", "|"
+    };
+    static const char *quantifiers[] = {"?", "*", "+", "{0,2}", "{1,2}", "{2}", "+?"};
+    int i, n, len = 0;
+
+    len += snprintf(buf, size, "/");
+    n = 1 + test_rnd() % 8;
+    for (i = 0; i < n; i++) {
+        /*mostly literals, the alternation rarely*/
+        if (test_rnd() % 3)
+            len += snprintf(buf + len, size - len, "%s", atoms[test_rnd() % 5]);
+        else
+            len += snprintf(buf + len, size - len, "%s", atoms[test_rnd() % 17]);
+        if (test_rnd() % 4 == 0 && buf[len - 1] != '|' && buf[len - 1] != '^' && buf[len - 1] != '$')
+            len += snprintf(buf + len, size - len, "%s", quantifiers[test_rnd() % 7]);
+    }
+    snprintf(buf + len, size - len, "/%s", test_rnd() % 2 ? "i" : "");
+}
+
+static void random_subject(char *buf, size_t size)
+{
+    static const char alphabet[] = "abcAB.-1";
+    int i, n = test_rnd() % 12;
+    for (i = 0; i < n && i < size - 1; i++)
+        buf[i] = alphabet[test_rnd() % (sizeof(alphabet) - 1)];
+    buf[i] = '\0';
+}
+
+#define RANDOM_REGEXES 200
+#define RANDOM_SUBJECTS 5000
+static void check_random_regexes()
+{
+    struct test_regex regexes[RANDOM_REGEXES];
+    ci_regex_set_t *set;
+    char buf[256];
+    int i, num = 0;
+
+    set = ci_regex_set_create();
+    while (num < RANDOM_REGEXES) {
+        random_regex(buf, sizeof(buf));
+        if (!test_regex_build(&regexes[num], buf))
+            continue;
+        ci_regex_set_add(set, regexes[num].str, regexes[num].flags, regexes[num].regex);
+        num++;
+    }
+    ci_regex_set_compile(set);
+    for (i = 0; i < RANDOM_SUBJECTS; i++) {
+        random_subject(buf, sizeof(buf));
+        check_subject(set, regexes, num, buf);
+    }
+    ci_regex_set_destroy(set);
+    for (i = 0; i < num; i++)
+        test_regex_release(&regexes[i]);
+}
+
+static void check_lookup_table()
+{
+    static const char *data =
+        "# comment\n"
+        "[/^https?:\\/\\/[^\\/]*\\.example\\.com\\//i]: example\n"
+        "/\\.exe$/: executable\n"
+        "/download/: download\n"
+        "/.*/: default\n";
+    static const struct {
+        const char *key;
+        const char *val;
+    } tests[] = {
+        {"http://www.EXAMPLE.com/download/a.exe", "example"},
+        {"http://www.other.com/download/a.exe", "executable"},
+        {"http://www.other.com/download/a.zip", "download"},
+        {"http://www.other.com/", "default"},
+        {NULL, NULL}
+    };
+    char path[] = "/tmp/test_regex_set.XXXXXX", table_path[64];
+    struct ci_lookup_table *table;
+    char **vals = NULL;
+    const void *key;
+    FILE *f;
+    int fd, i;
+
+    if ((fd = mkstemp(path)) < 0 || !(f = fdopen(fd, "w"))) {
+        test_fail("regex table", "can not create the table file");
+        return;
+    }
+    fputs(data, f);
+    fclose(f);
+    snprintf(table_path, sizeof(table_path), "regex:%s", path);
+    table = ci_lookup_table_create(table_path);
+    if (!table || !ci_lookup_table_open(table)) {
+        test_fail("regex table", "can not open the table");
+        unlink(path);
+        return;
+    }
+    for (i = 0; tests[i].key != NULL; i++) {
+        key = ci_lookup_table_search(table, tests[i].key, &vals);
+        if ((key == NULL) != (tests[i].val == NULL) ||
+                (key && (!vals || !vals[0] || strcmp(vals[0], tests[i].val) != 0)))
+            test_fail(tests[i].key, "wrong lookup table result");
+        if (key)
+            ci_lookup_table_release_result(table, (void **)vals);
+    }
+    ci_lookup_table_destroy(table);
+    unlink(path);
+}
+
+static void bench()
+{
+    struct test_regex *regexes;
+    ci_regex_set_t *set;
+    ci_regex_set_stats_t stats;
+    struct timespec start;
+    char buf[256], **urls;
+    unsigned int *sites;
+    int i, k, id, found_seq = 0, found_set = 0;
+    double seq_time, set_time, build_time;
+
+    regexes = calloc(PATTERNS, sizeof(struct test_regex));
+    sites = calloc(PATTERNS, sizeof(unsigned int));
+    urls = calloc(LOOPS, sizeof(char *));
+    set = ci_regex_set_create();
+    for (i = 0; i < PATTERNS; i++) {
+        sites[i] = test_rnd();
+        snprintf(buf, sizeof(buf), "/^https?:\\/\\/([^\\/]*\\.)?w%dsite%x\\.com\\//i", i, sites[i]);
+        if (!test_regex_build(&regexes[i], buf)) {
+            test_fail(buf, "can not build regex");
+            return;
+        }
+        ci_regex_set_add(set, regexes[i].str, regexes[i].flags, regexes[i].regex);
+    }
+    bench_start(&start);
+    ci_regex_set_compile(set);
+    build_time = bench_elapsed_nano(&start) / 1000000.0;
+    for (i = 0; i < LOOPS; i++) {
+        /*The half of the urls match a regex*/
+        k = test_rnd() % (2 * PATTERNS);
+        snprintf(buf, sizeof(buf), "http://www.w%dsite%x.com/path/to/some/file%d.html", k, k < PATTERNS ? sites[k] : test_rnd(), i);
+        urls[i] = strdup(buf);
+    }
+
+    bench_start(&start);
+    for (i = 0; i < LOOPS; i++) {
+        for (k = 0; k < PATTERNS; k++) {
+            if (ci_regex_apply(regexes[k].regex, urls[i], -1, 0, NULL, NULL) > 0) {
+                found_seq++;
+                break;
+            }
+        }
+    }
+    seq_time = bench_elapsed_nano(&start) / LOOPS;
+
+    bench_start(&start);
+    for (i = 0; i < LOOPS; i++)
+        found_set += ci_regex_set_match(set, urls[i], -1, &id, 1);
+    set_time = bench_elapsed_nano(&start) / LOOPS;
+
+    if (found_seq != found_set)
+        test_fail("benchmark", "different matches");
+    ci_regex_set_stats(set, &stats);
+    printf("Regexes: %d, prefiltered: %d, states: %u, memory: %lu bytes, build time: %.1f ms\n",
+           stats.regexes, stats.literal_regexes, stats.states, (unsigned long)stats.memory, build_time);
+    printf("Urls: %d, matching: %d\n", LOOPS, found_set);
+    printf("%-12s %12s\n", "", "ns/url");
+    printf("%-12s %12.1f\n", "sequential", seq_time);
+    printf("%-12s %12.1f\n", "regex set", set_time);
+
+    ci_regex_set_destroy(set);
+    for (i = 0; i < PATTERNS; i++)
+        test_regex_release(&regexes[i]);
+    for (i = 0; i < LOOPS; i++)
+        free(urls[i]);
+    free(regexes);
+    free(sites);
+    free(urls);
+}
+
+int main(int argc, char *argv[])
+{
+    ci_client_library_init();
+    init_internal_lookup_tables();
+    ci_regex_memory_init();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || PATTERNS <= 0 || LOOPS <= 0) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    check_regexes();
+    check_random_regexes();
+    check_lookup_table();
+    bench();
+
+    ci_regex_memory_destroy();
+    return test_result();
+}
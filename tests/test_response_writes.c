@@ -0,0 +1,264 @@
+#include "common.h"
+#include "c-icap.h"
+#include "cfg_param.h"
+#include "client.h"
+#include "debug.h"
+#include "header.h"
+#include "request.h"
+#include "request_send.h"
+#include "test_common.h"
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+/*
+  Sends small ICAP responses over a socket like the c-icap server does
+  and counts the writes. A response whose body the service already has
+  must be sent with one write, and the client must receive the ICAP and
+  HTTP headers, the body chunk and the last-chunk in order.
+*/
+
+int USE_DEBUG_LEVEL = -1;
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+static const char *ICAP_HEADERS[] = {
+    "ICAP/1.0 200 OK",
+    "ISTag: \"test-response-writes\"",
+    NULL
+};
+
+static const char *HTTP_HEADERS[] = {
+    "HTTP/1.1 200 OK",
+    "Content-Type: text/plain",
+    NULL
+};
+
+static const char *BODY = "A small response body";
+
+static ci_request_t *socket_request(int *peer)
+{
+    int sv[2];
+    ci_connection_t *conn;
+    ci_request_t *req;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        return NULL;
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+    conn = calloc(1, sizeof(ci_connection_t));
+    conn->fd = sv[0];
+    req = ci_request_alloc(conn);
+    *peer = sv[1];
+    return req;
+}
+
+static void socket_request_destroy(ci_request_t *req, int peer)
+{
+    close(req->connection->fd);
+    close(peer);
+    ci_request_destroy(req);
+}
+
+static void add_headers(ci_headers_list_t *h, const char **headers)
+{
+    int i;
+    for (i = 0; headers[i]; i++)
+        ci_headers_add(h, headers[i]);
+    ci_headers_pack(h);
+}
+
+/*Builds a RESPMOD response with HTTP headers, or a 204 one, ready to send*/
+static void prepare_response(ci_request_t *req, int with_body)
+{
+    ci_encaps_entity_t *e;
+    req->type = ICAP_RESPMOD;
+    if (with_body) {
+        add_headers(req->response_header, ICAP_HEADERS);
+        e = ci_request_alloc_entity(req, ICAP_RES_HDR, 0);
+        add_headers((ci_headers_list_t *)e->entity, HTTP_HEADERS);
+        req->entities[0] = e;
+        req->entities[1] = ci_request_alloc_entity(req, ICAP_RES_BODY, ((ci_headers_list_t *)e->entity)->bufused);
+        req->return_code = EC_200;
+    } else {
+        ci_headers_add(req->response_header, "ICAP/1.0 204 Unmodified");
+        ci_headers_pack(req->response_header);
+        req->return_code = EC_204;
+    }
+    req->responce_hasbody = with_body;
+    req->status = SEND_RESPHEAD;
+    req->pstrblock_responce = req->response_header->buf;
+    req->remain_send_block_bytes = req->response_header->bufused;
+}
+
+/*Sends the current blocks, returns the number of the writes*/
+static int send_blocks(ci_request_t *req)
+{
+    int writes = 0;
+    while (req->remain_send_block_bytes > 0) {
+        if (send_current_block_data(req) == CI_ERROR)
+            return -1;
+        writes++;
+    }
+    return writes;
+}
+
+/*Formats the data in req->wbuf as a chunk and sends it*/
+static int send_body_data(ci_request_t *req, const char *data, int eof)
+{
+    int len = data ? strlen(data) : 0;
+    if (len)
+        memcpy(req->wbuf + EXTRA_CHUNK_SIZE, data, len);
+    req->remain_send_block_bytes = len ? len : CI_EOF;
+    if (format_body_chunk(req, eof) == CI_EOF)
+        req->status = SEND_EOF;
+    else
+        req->status = SEND_BODY;
+    return send_blocks(req);
+}
+
+static int read_peer(int peer, char *buf, int size)
+{
+    int bytes, len = 0;
+    fcntl(peer, F_SETFL, fcntl(peer, F_GETFL) | O_NONBLOCK);
+    while (len < size - 1 && (bytes = read(peer, buf + len, size - 1 - len)) > 0)
+        len += bytes;
+    buf[len] = '\0';
+    return len;
+}
+
+static void expected_response(char *buf, int size, ci_request_t *req, const char *chunks)
+{
+    ci_headers_list_t *h = (ci_headers_list_t *)req->entities[0]->entity;
+    snprintf(buf, size, "%.*s%.*s%s",
+             req->response_header->bufused, req->response_header->buf,
+             h->bufused, h->buf, chunks);
+}
+
+static void check_response(const char *test, int peer, const char *expect)
+{
+    char buf[4096];
+    read_peer(peer, buf, sizeof(buf));
+    if (strcmp(buf, expect) != 0)
+        test_fail(test, "unexpected response data");
+}
+
+/*The service has all the body data: headers, body and last-chunk together*/
+static void check_small_response()
+{
+    const char *test = "small response";
+    char expect[4096], chunks[256];
+    int peer, writes;
+    ci_request_t *req = socket_request(&peer);
+    prepare_response(req, 1);
+    strcpy(req->wbuf + EXTRA_CHUNK_SIZE, BODY);
+    if (format_ready_body_chunk(req, strlen(BODY), 1) != CI_EOF)
+        test_fail(test, "the last-chunk is not appended");
+    if ((writes = send_blocks(req)) != 1)
+        test_fail(test, "not sent with one write");
+    if (req->status != SEND_EOF)
+        test_fail(test, "the body is not sent");
+    snprintf(chunks, sizeof(chunks), "%x\r\n%s\r\n0\r\n\r\n", (int)strlen(BODY), BODY);
+    expected_response(expect, sizeof(expect), req, chunks);
+    check_response(test, peer, expect);
+    socket_request_destroy(req, peer);
+}
+
+/*The service has some body data: headers and body together, then the rest*/
+static void check_partial_body_response()
+{
+    const char *test = "partial body response";
+    char expect[4096], chunks[256];
+    int peer, writes;
+    ci_request_t *req = socket_request(&peer);
+    prepare_response(req, 1);
+    strcpy(req->wbuf + EXTRA_CHUNK_SIZE, BODY);
+    if (format_ready_body_chunk(req, strlen(BODY), 0) != CI_OK)
+        test_fail(test, "unexpected last-chunk");
+    if ((writes = send_blocks(req)) != 1)
+        test_fail(test, "headers and body not sent with one write");
+    if (req->status != SEND_BODY)
+        test_fail(test, "the body is not sent");
+    writes += send_body_data(req, BODY, 1);
+    if (writes != 2)
+        test_fail(test, "the rest body is not sent with one write");
+    snprintf(chunks, sizeof(chunks), "%x\r\n%s\r\n%x\r\n%s\r\n0\r\n\r\n",
+             (int)strlen(BODY), BODY, (int)strlen(BODY), BODY);
+    expected_response(expect, sizeof(expect), req, chunks);
+    check_response(test, peer, expect);
+    socket_request_destroy(req, peer);
+}
+
+/*The service has no body data yet: the headers and the body separately*/
+static void check_no_ready_body_response()
+{
+    const char *test = "no ready body response";
+    char expect[4096], chunks[256];
+    int peer, writes;
+    ci_request_t *req = socket_request(&peer);
+    prepare_response(req, 1);
+    if (format_ready_body_chunk(req, 0, 0) != CI_OK || req->ready_body.len != 0)
+        test_fail(test, "unexpected ready body");
+    writes = send_blocks(req);
+    if (req->status != SEND_HEAD1)
+        test_fail(test, "the headers are not sent");
+    req->status = SEND_BODY;
+    writes += send_body_data(req, NULL, 1);
+    if (writes != 2)
+        test_fail(test, "unexpected number of writes");
+    snprintf(chunks, sizeof(chunks), "0\r\n\r\n");
+    expected_response(expect, sizeof(expect), req, chunks);
+    check_response(test, peer, expect);
+    socket_request_destroy(req, peer);
+}
+
+/*A 204 response has only the ICAP headers*/
+static void check_204_response()
+{
+    const char *test = "204 response";
+    char expect[4096];
+    int peer;
+    ci_request_t *req = socket_request(&peer);
+    prepare_response(req, 0);
+    if (format_ready_body_chunk(req, 0, 1) != CI_OK || req->ready_body.len != 0)
+        test_fail(test, "unexpected ready body");
+    if (send_blocks(req) != 1)
+        test_fail(test, "not sent with one write");
+    snprintf(expect, sizeof(expect), "%.*s", req->response_header->bufused, req->response_header->buf);
+    check_response(test, peer, expect);
+    socket_request_destroy(req, peer);
+}
+
+int main(int argc, char *argv[])
+{
+    ci_client_library_init();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options)) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    check_small_response();
+    check_partial_body_response();
+    check_no_ready_body_response();
+    check_204_response();
+
+    return test_result();
+}
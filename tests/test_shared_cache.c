@@ -0,0 +1,235 @@
+#include "common.h"
+#include "c-icap.h"
+#include "atomic.h"
+#include "cache.h"
+#include "cfg_param.h"
+#include "client.h"
+#include "debug.h"
+#include "mem.h"
+#include "module.h"
+#include "proc_mutex.h"
+#include "shared_mem.h"
+#include "test_common.h"
+#include "util.h"
+
+#include <sys/wait.h>
+
+/*
+  Measures the lookup throughput of the shared_cache module (which is
+  compiled into this program) with many children processes searching
+  the cache at the same time, like the c-icap children do. The
+  "locked" test emulates the previous implementation, where every
+  lookup takes one of the 4 cache pages mutexes. The "lockless" test
+  uses the cache as is, where readers do not lock.
+*/
+
+int LOOPS = 100000;
+int MIN_PROCS = 8;
+int MAX_PROCS = 64;
+int KEYS = 10000;
+int WRITES = 1;
+int USE_DEBUG_LEVEL = -1;
+const char *SCHEME = NULL;
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-s", "locking_scheme", &SCHEME, ci_cfg_set_str,
+        "posix|sysv|file|pthread"
+    },
+    {
+        "-l", "loops", &LOOPS, ci_cfg_set_int,
+        "The number of lookups per child (default is 100000)"
+    },
+    {
+        "-m", "min_processes", &MIN_PROCS, ci_cfg_set_int,
+        "Start with this number of children (default is 8)"
+    },
+    {
+        "-p", "max_processes", &MAX_PROCS, ci_cfg_set_int,
+        "Double the children up to this number (default is 64)"
+    },
+    {
+        "-k", "keys", &KEYS, ci_cfg_set_int,
+        "The number of the keys to search for (default is 10000)"
+    },
+    {
+        "-w", "writes", &WRITES, ci_cfg_set_int,
+        "The percent of lookups followed by a cache update (default is 1)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+common_module_t * ci_common_module_build(const char *name, int (*init_module)(struct ci_server_conf *server_conf), int (*post_init_module)(struct ci_server_conf *server_conf), void (*close_module)(), struct ci_conf_entry *conf_table)
+{
+    common_module_t *mod = malloc(sizeof(common_module_t));
+    mod->name = name;
+    mod->init_module = init_module;
+    mod->post_init_module = post_init_module;
+    mod->close_module = close_module;
+    mod->conf_table = conf_table;
+    return mod;
+}
+
+/*
+  The children inherit the shared memory from the parent process, there
+  is not any need to attach to it.
+*/
+void ci_command_register_action(const char *name, int type, void *data, void (*command_action) (const char *name, int type, void *data))
+{
+}
+
+extern struct ci_cache_type ci_shared_cache;
+extern int SHARED_CACHE_PAGES;
+
+#define LEGACY_PAGES 4
+
+struct bench_stats {
+    _CI_ATOMIC_TYPE int ready;
+    _CI_ATOMIC_TYPE int go;
+    _CI_ATOMIC_TYPE uint64_t hits;
+};
+
+static ci_proc_mutex_t LegacyMutex[LEGACY_PAGES];
+static struct bench_stats *Stats = NULL;
+static ci_cache_t *Cache = NULL;
+static const char *Value = "A cached verdict value";
+
+static void run_child(int id, int locked)
+{
+    char key[32];
+    void *val;
+    unsigned int r = id + 1, k;
+    uint64_t hits = 0;
+    int i, go;
+
+    ci_atomic_add_i32_gl(&Stats->ready, 1);
+    do {
+        ci_atomic_load_i32_gl(&Stats->go, &go);
+        if (!go)
+            ci_usleep(100);
+    } while (!go);
+
+    for (i = 0; i < LOOPS; i++) {
+        r ^= r << 13;
+        r ^= r >> 17;
+        r ^= r << 5;
+        k = r % KEYS;
+        snprintf(key, sizeof(key), "key%u", k);
+        if (locked)
+            ci_proc_mutex_lock(&LegacyMutex[k % LEGACY_PAGES]);
+        if (ci_cache_search(Cache, key, &val, NULL, NULL)) {
+            hits++;
+            if (val)
+                ci_buffer_free(val);
+        }
+        if (locked)
+            ci_proc_mutex_unlock(&LegacyMutex[k % LEGACY_PAGES]);
+        if (WRITES > 0 && (r % 100) < (unsigned int)WRITES)
+            ci_cache_update(Cache, key, Value, strlen(Value) + 1, NULL);
+    }
+    ci_atomic_add_u64_gl(&Stats->hits, hits);
+}
+
+static double run_test(int procs, int locked, double *hit_ratio)
+{
+    struct timespec start;
+    double nano;
+    int i, ready, status;
+    uint64_t hits;
+
+    ci_atomic_store_i32_gl(&Stats->ready, 0);
+    ci_atomic_store_i32_gl(&Stats->go, 0);
+    ci_atomic_store_u64_gl(&Stats->hits, 0);
+    fflush(stdout);
+    for (i = 0; i < procs; i++) {
+        if (fork() == 0) {
+            run_child(i, locked);
+            exit(0);
+        }
+    }
+    do {
+        ci_atomic_load_i32_gl(&Stats->ready, &ready);
+        if (ready < procs)
+            ci_usleep(1000);
+    } while (ready < procs);
+
+    bench_start(&start);
+    ci_atomic_store_i32_gl(&Stats->go, 1);
+    for (i = 0; i < procs; i++) {
+        if (wait(&status) < 0 || !WIFEXITED(status))
+            ci_debug_printf(1, "Child abnormal termination\n");
+    }
+    nano = bench_elapsed_nano(&start);
+
+    ci_atomic_load_u64_gl(&Stats->hits, &hits);
+    *hit_ratio = (double)hits * 100.0 / ((double)LOOPS * procs);
+    return (double)LOOPS * procs * 1000000000.0 / nano;
+}
+
+int main(int argc, char *argv[])
+{
+    ci_shared_mem_id_t sid;
+    char key[32];
+    double locked, lockless, locked_hits, lockless_hits;
+    int i, procs;
+
+    ci_client_library_init();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || MIN_PROCS <= 0 || KEYS <= 0) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    CI_DEBUG_LEVEL = USE_DEBUG_LEVEL >= 0 ? USE_DEBUG_LEVEL : 0;
+
+    if (SCHEME && !ci_proc_mutex_set_scheme(SCHEME)) {
+        ci_debug_printf(1, "Wrong locking scheme: %s\n", SCHEME);
+        exit(-1);
+    }
+
+    Stats = ci_shared_mem_create(&sid, "test_shared_cache", sizeof(struct bench_stats));
+    if (!Stats) {
+        ci_debug_printf(1, "Can not create shared memory\n");
+        exit(-1);
+    }
+    for (i = 0; i < LEGACY_PAGES; i++)
+        ci_proc_mutex_init(&LegacyMutex[i], "legacy");
+
+    ci_cache_type_register(&ci_shared_cache);
+    Cache = ci_cache_build("bench", "shared", 8 * 1024 * 1024, 256, 3600, &ci_str_ops);
+    if (!Cache) {
+        ci_debug_printf(1, "Can not create the shared cache\n");
+        exit(-1);
+    }
+    for (i = 0; i < KEYS; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        ci_cache_update(Cache, key, Value, strlen(Value) + 1, NULL);
+    }
+
+    printf("Cache pages: %d, keys: %d, lookups per child: %d, writes: %d%%\n", SHARED_CACHE_PAGES, KEYS, LOOPS, WRITES);
+    printf("%8s %20s %10s %20s %10s\n", "children", "locked lookups/sec", "hits %", "lockless lookups/sec", "hits %");
+    for (procs = MIN_PROCS; procs <= MAX_PROCS; procs *= 2) {
+        locked = run_test(procs, 1, &locked_hits);
+        lockless = run_test(procs, 0, &lockless_hits);
+        printf("%8d %20.0f %10.1f %20.0f %10.1f\n", procs, locked, locked_hits, lockless, lockless_hits);
+    }
+
+    ci_cache_destroy(Cache);
+    for (i = 0; i < LEGACY_PAGES; i++)
+        ci_proc_mutex_destroy(&LegacyMutex[i]);
+    ci_shared_mem_destroy(&sid);
+    return 0;
+}
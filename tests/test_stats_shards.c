@@ -0,0 +1,159 @@
+#include "common.h"
+#include "c-icap.h"
+#include "cfg_param.h"
+#include "ci_threads.h"
+#include "client.h"
+#include "debug.h"
+#include "stats.h"
+#include "test_common.h"
+#include <stdio.h>
+
+/*
+  Checks that the statistics counters updated by many threads sum up
+  to the expected values when the per-thread statistics shards are
+  used, while a reader thread is reading them, and compares the time
+  the threads need to update the counters with and without the shards.
+*/
+
+int LOOPS = 1000000;
+int THREADS = 8;
+int USE_DEBUG_LEVEL = -1;
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-l", "loops", &LOOPS, ci_cfg_set_int,
+        "The number of the updates per thread (default is 1000000)"
+    },
+    {
+        "-t", "threads", &THREADS, ci_cfg_set_int,
+        "The number of the threads (default is 8)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+static int REQUESTS_ID = -1;
+static int BYTES_ID = -1;
+static int RUNNING_ID = -1;
+static volatile int Running = 0;
+
+static void *run_updates(void *unused)
+{
+    int i;
+    for (i = 0; i < LOOPS; i++) {
+        ci_stat_uint64_inc(REQUESTS_ID, 1);
+        ci_stat_kbs_inc(BYTES_ID, 1500);
+        ci_stat_uint64_inc(RUNNING_ID, 1);
+        ci_stat_uint64_dec(RUNNING_ID, 1);
+    }
+    return NULL;
+}
+
+/*The folded values must never decrease*/
+static void *run_reader(void *unused)
+{
+    uint64_t value, last = 0;
+    ci_kbs_t kbs;
+    while (Running) {
+        value = ci_stat_uint64_get(REQUESTS_ID);
+        if (value < last)
+            test_fail("ci_stat_uint64_get", "the value decreased");
+        last = value;
+        kbs = ci_stat_kbs_get(BYTES_ID);
+        if (kbs.bytes > (uint64_t)THREADS * LOOPS * 1500)
+            test_fail("ci_stat_kbs_get", "wrong value");
+    }
+    return NULL;
+}
+
+static double run_test(const char *test, int shards)
+{
+    struct timespec start;
+    double nano;
+    ci_thread_t *threads, reader;
+    uint64_t requests, running;
+    ci_kbs_t kbs;
+    int i;
+
+    CI_STAT_THREAD_SHARDS = shards;
+    ci_stat_allocate_mem();
+    threads = malloc(sizeof(ci_thread_t) * THREADS);
+    Running = 1;
+    ci_thread_create(&reader, run_reader, NULL);
+    bench_start(&start);
+    for (i = 0; i < THREADS; i++)
+        ci_thread_create(&threads[i], run_updates, NULL);
+    for (i = 0; i < THREADS; i++)
+        ci_thread_join(threads[i]);
+    nano = bench_elapsed_nano(&start);
+    Running = 0;
+    ci_thread_join(reader);
+    free(threads);
+
+    requests = ci_stat_uint64_get(REQUESTS_ID);
+    running = ci_stat_uint64_get(RUNNING_ID);
+    kbs = ci_stat_kbs_get(BYTES_ID);
+    if (requests != (uint64_t)THREADS * LOOPS)
+        test_fail(test, "wrong requests counter");
+    if (running != 0)
+        test_fail(test, "wrong running counter");
+    if (kbs.bytes != (uint64_t)THREADS * LOOPS * 1500)
+        test_fail(test, "wrong bytes counter");
+    ci_stat_release();
+    return nano / LOOPS;
+}
+
+/*The shards of a released statistics area must not be used by the
+  threads when a new area is allocated*/
+static void check_area_rebuild()
+{
+    CI_STAT_THREAD_SHARDS = 1;
+    ci_stat_allocate_mem();
+    ci_stat_uint64_inc(REQUESTS_ID, 10);
+    if (!ci_stat_thread_memblock_get())
+        test_fail("area rebuild", "no thread shard");
+    ci_stat_release();
+    ci_stat_allocate_mem();
+    ci_stat_uint64_inc(REQUESTS_ID, 3);
+    if (ci_stat_uint64_get(REQUESTS_ID) != 3)
+        test_fail("area rebuild", "wrong requests counter");
+    ci_stat_release();
+}
+
+int main(int argc, char *argv[])
+{
+    double atomics, shards;
+    ci_client_library_init();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || LOOPS <= 0 || THREADS <= 0) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    REQUESTS_ID = ci_stat_entry_register("Test requests", CI_STAT_INT64_T, "Test");
+    BYTES_ID = ci_stat_entry_register("Test bytes", CI_STAT_KBS_T, "Test");
+    RUNNING_ID = ci_stat_entry_register("Test running", CI_STAT_INT64_T, "Test");
+
+    check_area_rebuild();
+    atomics = run_test("atomic counters", 0);
+    shards = run_test("thread shards", 1);
+    printf("%-8s %16s %16s\n", "threads", "atomics ns/loop", "shards ns/loop");
+    printf("%-8d %16.1f %16.1f\n", THREADS, atomics, shards);
+
+    return test_result();
+}
@@ -0,0 +1,211 @@
+#include "common.h"
+#include "c-icap.h"
+#include "cfg_param.h"
+#include "client.h"
+#include "debug.h"
+#include "lookup_table.h"
+#include "mem.h"
+#include "test_common.h"
+#include <stdio.h>
+#include <sys/wait.h>
+
+/*
+  Loads an hash lookup table with and without the lookup tables arena
+  and forks a child which searches the table while it allocates and
+  releases memory, like a c-icap child serving requests. Compares the
+  load and release times and the memory of the main process and the
+  private and shared memory of the child.
+*/
+
+int ROWS = 500000;
+int USE_DEBUG_LEVEL = -1;
+
+void init_internal_lookup_tables();
+
+static struct ci_options_entry options[] = {
+    {
+        "-d", "debug_level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-r", "rows", &ROWS, ci_cfg_set_int,
+        "The number of the rows (default is 500000)"
+    },
+    {NULL,NULL,NULL,NULL,NULL}
+};
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+struct memory {
+    long long private_kb;
+    long long shared_kb;
+};
+
+static void process_memory(struct memory *mem)
+{
+    FILE *f;
+    char line[256];
+    long long kb;
+    mem->private_kb = -1;
+    mem->shared_kb = -1;
+#if defined(__linux__)
+    if (!(f = fopen("/proc/self/smaps_rollup", "r")))
+        return;
+    mem->private_kb = 0;
+    mem->shared_kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "Private_%*[A-Za-z]: %lld kB", &kb) == 1)
+            mem->private_kb += kb;
+        else if (sscanf(line, "Shared_%*[A-Za-z]: %lld kB", &kb) == 1)
+            mem->shared_kb += kb;
+    }
+    fclose(f);
+#endif
+}
+
+static void row_key(char *buf, size_t len, int i)
+{
+    snprintf(buf, len, "www.domain%d.example.com", i);
+}
+
+/*Searches all of the rows, allocating and releasing objects of
+  various sizes between the searches*/
+static int child_work(struct ci_lookup_table *table)
+{
+    void *objects[1024];
+    char key[128];
+    char **vals = NULL;
+    int i, errors = 0;
+
+    memset(objects, 0, sizeof(objects));
+    for (i = 0; i < ROWS; i++) {
+        free(objects[i % 1024]);
+        objects[i % 1024] = malloc(16 + (i * 37) % 2048);
+        row_key(key, sizeof(key), (int)(((int64_t)i * 7919) % ROWS));
+        if (!ci_lookup_table_search(table, key, &vals) || !vals || strcmp(vals[0], "category") != 0)
+            errors++;
+        if (vals)
+            ci_lookup_table_release_result(table, (void **)vals);
+        vals = NULL;
+    }
+    for (i = 0; i < 1024; i++)
+        free(objects[i]);
+    return errors;
+}
+
+static void check_mode(const char *path, int arena)
+{
+    const char *mode = arena ? "arena" : "malloc";
+    struct ci_lookup_table *table;
+    struct timespec start;
+    struct memory before, loaded, child;
+    double load_ms, release_ms;
+    char table_path[256];
+    int pipefd[2], status, errors;
+    pid_t pid;
+
+    CI_LOOKUP_TABLES_ARENA = arena;
+    snprintf(table_path, sizeof(table_path), "hash:%s", path);
+    process_memory(&before);
+    bench_start(&start);
+    table = ci_lookup_table_create(table_path);
+    if (!table || !ci_lookup_table_open(table)) {
+        test_fail(mode, "can not open the table");
+        if (table)
+            ci_lookup_table_destroy(table);
+        return;
+    }
+    load_ms = bench_elapsed_nano(&start) / 1000000.0;
+    process_memory(&loaded);
+
+    if (pipe(pipefd) < 0 || (pid = fork()) < 0) {
+        test_fail(mode, "can not fork");
+        ci_lookup_table_destroy(table);
+        return;
+    }
+    if (pid == 0) {
+        close(pipefd[0]);
+        errors = child_work(table);
+        process_memory(&child);
+        if (write(pipefd[1], &child, sizeof(child)) != sizeof(child) ||
+                write(pipefd[1], &errors, sizeof(errors)) != sizeof(errors))
+            _exit(1);
+        _exit(0);
+    }
+    close(pipefd[1]);
+    if (read(pipefd[0], &child, sizeof(child)) != sizeof(child) ||
+            read(pipefd[0], &errors, sizeof(errors)) != sizeof(errors))
+        test_fail(mode, "no results from the child");
+    else if (errors)
+        test_fail(mode, "wrong lookup results");
+    close(pipefd[0]);
+    waitpid(pid, &status, 0);
+
+    bench_start(&start);
+    ci_lookup_table_destroy(table);
+    release_ms = bench_elapsed_nano(&start) / 1000000.0;
+
+    printf("%-8s %10.1f %10.1f %14lld %14lld %14lld\n", mode, load_ms, release_ms,
+           loaded.private_kb - before.private_kb, child.private_kb, child.shared_kb);
+}
+
+/*Every mode runs in its own process, so that the memory released by
+  the previous one is not reused*/
+static void run_mode(const char *path, int arena)
+{
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    if ((pid = fork()) == 0) {
+        check_mode(path, arena);
+        fflush(stdout);
+        _exit(Failures ? 1 : 0);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        test_fail(arena ? "arena" : "malloc", "the test process failed");
+}
+
+int main(int argc, char *argv[])
+{
+    char path[] = "/tmp/test_tables_arena.XXXXXX";
+    char key[128];
+    FILE *f;
+    int fd, i;
+
+    ci_client_library_init();
+    init_internal_lookup_tables();
+
+    __log_error = (void (*)(void *, const char *, ...)) log_errors;     /*set c-icap library log  function */
+
+    if (!ci_args_apply(argc, argv, options) || ROWS <= 0) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (USE_DEBUG_LEVEL >= 0)
+        CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
+
+    if ((fd = mkstemp(path)) < 0 || !(f = fdopen(fd, "w"))) {
+        test_fail("tables arena", "can not create the table file");
+        return -1;
+    }
+    for (i = 0; i < ROWS; i++) {
+        row_key(key, sizeof(key), i);
+        fprintf(f, "%s: category, score=%d\n", key, i % 13);
+    }
+    fclose(f);
+
+    printf("Rows: %d\n", ROWS);
+    printf("%-8s %10s %10s %14s %14s %14s\n", "", "load ms", "release ms", "table KB", "child priv KB", "child shrd KB");
+    run_mode(path, 0);
+    run_mode(path, 1);
+    unlink(path);
+
+    return test_result();
+}
@@ -38,6 +38,8 @@ typedef struct {
     char *SERVICE_NAME;
     char *LANGUAGE;
     ci_membuf_t *data;
+    ci_fmt_program_t *program;
+    struct ci_fmt_entry *program_table;
     time_t last_used;
     time_t loaded;
     time_t modified;
@@ -79,6 +81,7 @@ int ci_txt_template_init(void)
         // The following three elements are critical to be cleared,
         // the rest can be left unintialized
         templates[i].data = NULL;
+        templates[i].program = NULL;
         templates[i].loaded = 0;
         templates[i].locked = 0;
         templates[i].must_free = 0;
@@ -140,6 +143,9 @@ static void templateFree(txtTemplate_t *template)
     template->TEMPLATE_NAME = template->SERVICE_NAME = template->LANGUAGE = NULL;
     ci_membuf_free(template->data);
     template->data = NULL;
+    if (template->program)
+        ci_format_program_release(template->program);
+    template->program = NULL;
 }
 
 static void template_release(txtTemplate_t *template)
@@ -242,7 +248,7 @@ static txtTemplate_t *templateFindFree(void)
 }
 
 static txtTemplate_t *templateTryLoadText(const ci_request_t * req, const char *service_name,
-        const char *page_name, const char *lang)
+        const char *page_name, const char *lang, struct ci_fmt_entry *user_table)
 {
     int fd;
     char path[CI_MAX_PATH];
@@ -250,6 +256,7 @@ static txtTemplate_t *templateTryLoadText(const ci_request_t * req, const char *
     struct stat file;
     ssize_t len;
     ci_membuf_t *textbuff = NULL;
+    ci_fmt_program_t *program;
     txtTemplate_t *tempTemplate = NULL;
     time_t current_time;
 
@@ -302,6 +309,9 @@ static txtTemplate_t *templateTryLoadText(const ci_request_t * req, const char *
     }
     ci_membuf_write(textbuff, "\0", 1, 1);     // terminate the string for safety
 
+    /*Parse the template once, not on every request*/
+    program = ci_format_compile(textbuff->buf, user_table);
+
     // Protect the template cache structure
     ci_thread_mutex_lock(&templates_mutex);
     // Find free template
@@ -316,6 +326,8 @@ static txtTemplate_t *templateTryLoadText(const ci_request_t * req, const char *
             ci_debug_printf(1, "templateTryLoadText: memory allocation error!\n");
             ci_thread_mutex_unlock(&templates_mutex);
             ci_membuf_free(textbuff);
+            if (program)
+                ci_format_program_release(program);
             return NULL;
         }
         tempTemplate->non_cached = 1;
@@ -325,6 +337,8 @@ static txtTemplate_t *templateTryLoadText(const ci_request_t * req, const char *
     tempTemplate->TEMPLATE_NAME = strdup(page_name);
     tempTemplate->LANGUAGE = strdup(lang);
     tempTemplate->data = textbuff;
+    tempTemplate->program = program;
+    tempTemplate->program_table = user_table;
     tempTemplate->loaded = current_time;
     tempTemplate->modified = file.st_mtime;
     tempTemplate->last_used = current_time;
@@ -337,7 +351,7 @@ static txtTemplate_t *templateTryLoadText(const ci_request_t * req, const char *
 }
 
 static txtTemplate_t *templateLoadText(const ci_request_t * req, const char *service_name,
-                                       const char *page_name)
+                                       const char *page_name, struct ci_fmt_entry *user_table)
 {
     const char *acceptLangHeader;
     const char *s;
@@ -355,7 +369,7 @@ static txtTemplate_t *templateLoadText(const ci_request_t * req, const char *ser
             preferred[i] = '\0';
             ci_debug_printf(6, "Try load the error message on language:%s\n", preferred);
             template =
-            templateTryLoadText(req, service_name, page_name, preferred);
+            templateTryLoadText(req, service_name, page_name, preferred, user_table);
             if (template != NULL) {
                 return template;
             }
@@ -381,7 +395,7 @@ static txtTemplate_t *templateLoadText(const ci_request_t * req, const char *ser
     }
     ci_debug_printf(4, "templateLoadText: Accept-Language header not found or was empty!\n");
 
-    return templateTryLoadText(req, service_name, page_name, TEMPLATE_DEF_LANG);
+    return templateTryLoadText(req, service_name, page_name, TEMPLATE_DEF_LANG, user_table);
 }
 
 // Caller should release the returned buffer when they have finished with it.
@@ -411,9 +425,13 @@ ci_membuf_t *ci_txt_template_build_content(const ci_request_t *req, const char *
     }
 
     /*templateLoadText also locks the template*/
-    template = templateLoadText(req, SERVICE_NAME, TEMPLATE_NAME);
+    template = templateLoadText(req, SERVICE_NAME, TEMPLATE_NAME, user_table);
     if (template) {
-        rawContentBufSize = ci_format_text((ci_request_t *)req, template->data->buf, rawContentBuf, TEMPLATE_MEMBUF_SIZE, user_table);
+        /*The template may be compiled with an other user table*/
+        if (template->program && template->program_table == user_table)
+            rawContentBufSize = ci_format_program_text((ci_request_t *)req, template->program, rawContentBuf, TEMPLATE_MEMBUF_SIZE);
+        else
+            rawContentBufSize = ci_format_text((ci_request_t *)req, template->data->buf, rawContentBuf, TEMPLATE_MEMBUF_SIZE, user_table);
         rawContentBufSize -= 1; /*exclude the eos '\0' char*/
         if (template->LANGUAGE)
             ci_membuf_attr_add(content, "lang", template->LANGUAGE, strlen(template->LANGUAGE) + 1);
@@ -22,6 +22,7 @@
 #include "request.h"
 #include "request_util.h"
 #include "debug.h"
+#include "ci_threads.h"
 #include "txt_format.h"
 
 #include <sys/time.h>
@@ -259,6 +260,96 @@ struct ci_fmt_entry *check_tables(const char *var, struct ci_fmt_entry *u_table,
     return NULL;
 }
 
+/*
+  Caches the text of the %tl and %tg directives of a compiled format,
+  which changes only once per second.
+*/
+struct fmt_time_cache {
+    ci_thread_rwlock_t lock;
+    time_t time;
+    int len;
+    char text[128];
+};
+
+struct fmt_op {
+    const char *text;  /*A literal text if fmte is NULL*/
+    int text_len;
+    struct ci_fmt_entry *fmte;
+    unsigned int width;
+    int left_align;
+    const char *param;
+    struct fmt_time_cache *time_cache;
+};
+
+struct ci_fmt_program {
+    int ops_num;
+    int time_caches_num;
+    struct fmt_op *ops;
+    struct fmt_time_cache *time_caches;
+};
+
+static int format_time_cached(ci_request_t *req_data, struct ci_fmt_entry *fmte, const char *param, struct fmt_time_cache *cache, char *buf, int len)
+{
+    char text[sizeof(cache->text)];
+    int text_len;
+    time_t now = time(NULL);
+
+    ci_thread_rwlock_rdlock(&cache->lock);
+    if (cache->time == now) {
+        text_len = cache->len;
+        if (text_len > 0 && text_len <= len)
+            memcpy(buf, cache->text, text_len);
+        ci_thread_rwlock_unlock(&cache->lock);
+        /*Behave like strftime when the buffer is too small*/
+        return text_len <= len ? text_len : 0;
+    }
+    ci_thread_rwlock_unlock(&cache->lock);
+
+    text_len = fmte->format(req_data, text, sizeof(text), param);
+    ci_thread_rwlock_wrlock(&cache->lock);
+    cache->time = now;
+    cache->len = text_len;
+    if (text_len > 0)
+        memcpy(cache->text, text, text_len);
+    ci_thread_rwlock_unlock(&cache->lock);
+    if (text_len > len)
+        return 0;
+    if (text_len > 0)
+        memcpy(buf, text, text_len);
+    return text_len;
+}
+
+/*Formats a directive to b, and returns the number of the bytes written*/
+static int format_directive(ci_request_t *req_data, struct ci_fmt_entry *fmte, unsigned int width, int left_align, const char *param, struct fmt_time_cache *time_cache, char *b, int remains)
+{
+    int val_len, space;
+
+    if (width != 0)
+        space = width = (remains < width ? remains : width);
+    else
+        space = remains;
+
+    if (time_cache)
+        val_len = format_time_cached(req_data, fmte, param, time_cache, b, space);
+    else
+        val_len = fmte->format(req_data, b, space, param);
+    if (val_len <= 0) val_len = fmt_none(req_data, b, space, param);
+    if (val_len > space) val_len = space;
+
+    if (!width)
+        return val_len;
+
+    if (val_len < width) {
+        if (left_align)
+            memset(b + val_len, ' ', width - val_len);
+        else {
+            memmove(b + width - val_len, b, val_len);
+            memset(b, ' ', width - val_len);
+        }
+    }
+    return width;
+}
+
 int ci_format_text(
     ci_request_t *req_data,
     const char *fmt,
@@ -266,13 +357,12 @@ int ci_format_text(
     struct ci_fmt_entry *user_table)
 {
     const char *s;
-    char *b, *lb;
+    char *b;
     struct ci_fmt_entry *fmte;
-    int directive_len, val_len, remains, left_align, i;
-    unsigned int width, space = 0;
+    int directive_len, left_align, val_len, remains;
+    unsigned int width;
     char parameter[MAX_VARIABLE_SIZE];
 
-    lb = NULL;
     s = fmt;
     b = buffer;
     remains = len - 1;
@@ -281,43 +371,10 @@ int ci_format_text(
             fmte = check_tables(s, user_table, &directive_len,
                                 &width, &left_align, parameter);
             ci_debug_printf(7,"Width: %d, Parameter:%s\n", width, parameter);
-            if (width != 0)
-                space = width = (remains<width?remains:width);
-            else
-                space = remains;
             if (fmte != NULL) {
-                if (width) {
-                    if (left_align) {
-                        val_len = fmte->format(req_data, b, space, parameter);
-                        if (val_len <= 0) val_len = fmt_none(req_data, b, space, parameter);
-
-                        if (val_len > space) val_len = space;
-                        b += val_len;
-                        for (i = 0; i < width-val_len; i++) b[i]=' ';
-                        b += width-val_len;
-                    } else if ((lb = malloc((space+1)*sizeof(char))) != NULL) {
-                        val_len = fmte->format(req_data, lb, space, parameter);
-                        if (val_len <= 0) val_len = fmt_none(req_data, lb, space, parameter);
-
-                        if (val_len > space) val_len = space;
-                        for (i = 0; i < width-val_len; i++) b[i] = ' ';
-                        b += width-val_len;
-                        for (i = 0; i < val_len; i++) b[i] = lb[i];
-                        b += val_len;
-                        free(lb);
-                        lb = NULL;
-                    }
-                    /*else allocation failed! Just ignore?????*/
-
-                    remains -= width;
-                } else {
-                    val_len = fmte->format(req_data, b, space, parameter);
-                    if (val_len <= 0) val_len = fmt_none(req_data, b, space, parameter);
-
-                    if (val_len > space) val_len = space;
-                    b += val_len;
-                    remains -= val_len;
-                }
+                val_len = format_directive(req_data, fmte, width, left_align, parameter, NULL, b, remains);
+                b += val_len;
+                remains -= val_len;
                 s += directive_len;
             } else
                 *b++ = *s++, remains--;
@@ -328,6 +385,141 @@ int ci_format_text(
     return len-remains;
 }
 
+/*
+  Parses the format string. If the program is NULL just computes the
+  number of the operations and the memory required for the parameters.
+*/
+static void format_compile_ops(const char *fmt, struct ci_fmt_entry *user_table, ci_fmt_program_t *program, char *strings, int *ops_num, int *time_caches_num, size_t *strings_size)
+{
+    const char *s, *literal;
+    struct ci_fmt_entry *fmte;
+    struct fmt_op *op;
+    int directive_len, left_align;
+    unsigned int width;
+    size_t param_len;
+    char parameter[MAX_VARIABLE_SIZE];
+
+    *ops_num = *time_caches_num = 0;
+    *strings_size = 0;
+    s = literal = fmt;
+    while (*s) {
+        fmte = NULL;
+        if (*s == '%')
+            fmte = check_tables(s, user_table, &directive_len, &width, &left_align, parameter);
+        if (!fmte) {
+            s++;
+            continue;
+        }
+        if (s > literal) {
+            if (program) {
+                op = &program->ops[*ops_num];
+                memset(op, 0, sizeof(struct fmt_op));
+                op->text = literal;
+                op->text_len = s - literal;
+            }
+            (*ops_num)++;
+        }
+        param_len = strlen(parameter) + 1;
+        if (program) {
+            op = &program->ops[*ops_num];
+            op->text = NULL;
+            op->text_len = 0;
+            op->fmte = fmte;
+            op->width = width;
+            op->left_align = left_align;
+            op->param = strings + *strings_size;
+            memcpy(strings + *strings_size, parameter, param_len);
+            op->time_cache = NULL;
+            if (fmte->format == fmt_localtime || fmte->format == fmt_gmttime) {
+                op->time_cache = &program->time_caches[*time_caches_num];
+                ci_thread_rwlock_init(&op->time_cache->lock);
+                op->time_cache->time = 0;
+                op->time_cache->len = 0;
+            }
+        }
+        if (fmte->format == fmt_localtime || fmte->format == fmt_gmttime)
+            (*time_caches_num)++;
+        *strings_size += param_len;
+        (*ops_num)++;
+        s += directive_len;
+        literal = s;
+    }
+    if (s > literal) {
+        if (program) {
+            op = &program->ops[*ops_num];
+            memset(op, 0, sizeof(struct fmt_op));
+            op->text = literal;
+            op->text_len = s - literal;
+        }
+        (*ops_num)++;
+    }
+}
+
+ci_fmt_program_t *ci_format_compile(const char *fmt, struct ci_fmt_entry *user_table)
+{
+    ci_fmt_program_t *program;
+    int ops_num, time_caches_num;
+    size_t strings_size, fmt_size, size;
+    char *mem, *fmt_copy;
+
+    if (!fmt)
+        return NULL;
+
+    format_compile_ops(fmt, user_table, NULL, NULL, &ops_num, &time_caches_num, &strings_size);
+    fmt_size = strlen(fmt) + 1;
+    size = _CI_ALIGN(sizeof(ci_fmt_program_t)) +
+        _CI_ALIGN(ops_num * sizeof(struct fmt_op)) +
+        _CI_ALIGN(time_caches_num * sizeof(struct fmt_time_cache)) +
+        fmt_size + strings_size;
+    if (!(mem = malloc(size))) {
+        ci_debug_printf(1, "Error allocating memory to compile format '%s'\n", fmt);
+        return NULL;
+    }
+    program = (ci_fmt_program_t *)mem;
+    mem += _CI_ALIGN(sizeof(ci_fmt_program_t));
+    program->ops = (struct fmt_op *)mem;
+    mem += _CI_ALIGN(ops_num * sizeof(struct fmt_op));
+    program->time_caches = (struct fmt_time_cache *)mem;
+    mem += _CI_ALIGN(time_caches_num * sizeof(struct fmt_time_cache));
+    /*The literal text operations point to a copy of the format string*/
+    fmt_copy = mem;
+    memcpy(fmt_copy, fmt, fmt_size);
+    format_compile_ops(fmt_copy, user_table, program, fmt_copy + fmt_size, &program->ops_num, &program->time_caches_num, &strings_size);
+    return program;
+}
+
+int ci_format_program_text(ci_request_t *req_data, const ci_fmt_program_t *program, char *buffer, int len)
+{
+    const struct fmt_op *op, *end;
+    char *b;
+    int val_len, remains;
+
+    b = buffer;
+    remains = len - 1;
+    for (op = program->ops, end = program->ops + program->ops_num; op < end && remains > 0; op++) {
+        if (op->fmte)
+            val_len = format_directive(req_data, op->fmte, op->width, op->left_align, op->param, op->time_cache, b, remains);
+        else {
+            val_len = op->text_len < remains ? op->text_len : remains;
+            memcpy(b, op->text, val_len);
+        }
+        b += val_len;
+        remains -= val_len;
+    }
+    *b = '\0';
+    return len - remains;
+}
+
+void ci_format_program_release(ci_fmt_program_t *program)
+{
+    int i;
+    if (!program)
+        return;
+    for (i = 0; i < program->time_caches_num; i++)
+        ci_thread_rwlock_destroy(&program->time_caches[i].lock);
+    free(program);
+}
+
 
 /******************************************************************/
 
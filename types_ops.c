@@ -225,14 +225,6 @@ const ci_type_ops_t  ci_uint64_ops = {
 
 /*regular expresion operator definition  */
 #if defined(USE_REGEX)
-/*We only need the preg field which holds the compiled regular expression
-  but keep the uncompiled string too just for debuging reasons */
-struct ci_acl_regex {
-    char *str;
-    int flags;
-    ci_regex_t preg;
-};
-
 /*Parse the a regular expression in the form: /regexpression/flags
   where flags nothing or 'i'. Examples:
         /^\{[a-z| ]*\}/i
@@ -445,6 +437,24 @@ void ci_list_ipv4_to_ipv6();
 
 
 
+/*Builds the netmask of a network given in CIDR notation (eg 10.0.0.0/8)*/
+static int ip_prefix_netmask(int family, const char *str, ci_in_addr_t *netmask)
+{
+    unsigned char *m = (unsigned char *)netmask;
+    int bits = (family == AF_INET ? 32 : 128);
+    char *e;
+    long len;
+    int i;
+
+    len = strtol(str, &e, 10);
+    if (e == str || *e != '\0' || len < 0 || len > bits)
+        return 0;
+    ci_inaddr_zero(*netmask);
+    for (i = 0; i < bits / 8; i++, len -= 8)
+        m[i] = len >= 8 ? 0xFF : (len > 0 ? (0xFF << (8 - len)) & 0xFF : 0);
+    return 1;
+}
+
 void *ip_dup(const char *value,  ci_mem_allocator_t *allocator)
 {
     int socket_family, len;
@@ -480,7 +490,8 @@ void *ip_dup(const char *value,  ci_mem_allocator_t *allocator)
         strncpy(str_netmask, pstr+1, CI_IPLEN);
         str_netmask[CI_IPLEN] = '\0';
 
-        if (!ci_inet_aton(socket_family, str_netmask, &netmask)) {
+        if (!ip_prefix_netmask(socket_family, str_netmask, &netmask) &&
+                !ci_inet_aton(socket_family, str_netmask, &netmask)) {
             ci_debug_printf(1,"Invalid netmask in network %s definition\n", value);
             return NULL;
         }
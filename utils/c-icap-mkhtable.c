@@ -0,0 +1,197 @@
+#include "common.h"
+#include "c-icap.h"
+#include "array.h"
+#include "cfg_param.h"
+#include "debug.h"
+#include "htable.h"
+#include "util.h"
+
+#define MAXLINE 65535
+
+char *INFILE = NULL;
+char *TABLEPATH = NULL;
+int DUMP_MODE = 0;
+int INFO_MODE = 0;
+int VERSION_MODE = 0;
+int CONTINUE_ON_ERROR = 0;
+
+static struct ci_options_entry options[] = {
+    {"-V", NULL, &VERSION_MODE, ci_cfg_version, "Print version and exits"},
+    {"-VV", NULL, &VERSION_MODE, ci_cfg_build_info, "Print version and build informations and exits"},
+    {
+        "-d", "debug_level", &CI_DEBUG_LEVEL, ci_cfg_set_int,
+        "The debug level"
+    },
+    {
+        "-i", "in_file", &INFILE, ci_cfg_set_str,
+        "The input file to load key/value pairs"
+    },
+    {
+        "-o", "table_file", &TABLEPATH, ci_cfg_set_str,
+        "The hash table file to build (required)"
+    },
+    {
+        "-C", NULL, &CONTINUE_ON_ERROR, ci_cfg_enable,
+        "Do not abort on parse errors"
+    },
+    {
+        "--dump", NULL, &DUMP_MODE, ci_cfg_enable,
+        "Do not build the table just dump it to the screen"
+    },
+    {
+        "--info", NULL, &INFO_MODE, ci_cfg_enable,
+        "Print information about the table"
+    },
+    {NULL, NULL, NULL, NULL}
+};
+
+int info_table(ci_htable_t *table)
+{
+    const ci_htable_header_t *h = ci_htable_header(table);
+    printf("Hash table info\n"
+           "   Version: %u\n"
+           "   Rows: %llu\n"
+           "   Buckets: %llu\n"
+           "   Load factor: %.2f\n"
+           "   Strings pool size: %llu\n"
+           "   File size: %llu\n",
+           (unsigned)h->version,
+           (unsigned long long)h->rows, (unsigned long long)h->buckets_num,
+           (double)h->rows / (double)h->buckets_num,
+           (unsigned long long)h->pool_size, (unsigned long long)h->file_size);
+    return 1;
+}
+
+int dump_table(ci_htable_t *table)
+{
+    const char *key, *vals, *dup_vals;
+    uint64_t pos = 0;
+    int i, vals_num, dup_vals_num;
+
+    while ((key = ci_htable_next_row(table, &pos, &vals, &vals_num)) != NULL) {
+        /*Skip the duplicated keys, they are stored but not used*/
+        if (ci_htable_search(table, key, &dup_vals, &dup_vals_num) != key)
+            continue;
+        printf("%s :", key);
+        for (i = 0; i < vals_num; i++) {
+            printf("%s'%s'", (i > 0 ? "| " : ""), vals);
+            vals += strlen(vals) + 1;
+        }
+        printf("\n");
+    }
+    return 1;
+}
+
+int build_table(FILE *f)
+{
+    ci_htable_builder_t *builder;
+    char line[MAXLINE];
+    void *key;
+    size_t keysize;
+    ci_vector_t *values;
+    unsigned lines = 0, stored = 0, parse_fails = 0;
+    uint64_t duplicates = 0;
+    int ret, error = 0;
+
+    if (!(builder = ci_htable_builder_create(TABLEPATH))) {
+        ci_debug_printf(1, "Error creating hash table %s\n", TABLEPATH);
+        return 0;
+    }
+
+    while (!error && fgets(line, MAXLINE, f)) {
+        lines++;
+        line[MAXLINE-1] = '\0';
+        line[strcspn(line, "\r\n")] = '\0';
+        values = NULL;
+        if ((ret = ci_parse_key_mvalues(line, ':', ',', &ci_str_ops, &ci_str_ops, &key, &keysize, &values)) < 0) {
+            ci_debug_printf(1, "Error parsing line %u: %s\n", lines, line);
+            parse_fails++;
+            if (!CONTINUE_ON_ERROR)
+                error = 1;
+        } else if (key) {
+            if (ci_htable_builder_add(builder, (const char *)key, values ? (const char **)ci_vector_cast_to_voidvoid(values) : NULL))
+                stored++;
+            else
+                error = 1;
+        }
+        if (key)
+            ci_os_allocator->free(ci_os_allocator, key);
+        if (values)
+            ci_vector_destroy(values);
+    }
+
+    if (!error && !ci_htable_builder_finish(builder, &duplicates))
+        error = 1;
+    ci_htable_builder_destroy(builder);
+
+    ci_debug_printf(1, "Lines processed %u\n", lines);
+    ci_debug_printf(1, "Lines failed to parse %u\n", parse_fails);
+    ci_debug_printf(1, "Stored keys %u\n", stored);
+    ci_debug_printf(1, "Duplicated keys (ignored) %llu\n", (unsigned long long)duplicates);
+    if (error)
+        ci_debug_printf(1, "Error building hash table %s, the table is not updated\n", TABLEPATH);
+    return !error;
+}
+
+void log_errors(void *unused, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+}
+
+void vlog_errors(void *unused, const char *format, va_list ap)
+{
+    vfprintf(stderr, format, ap);
+}
+
+int main(int argc, char **argv)
+{
+    FILE *f = NULL;
+    ci_htable_t *table;
+    int ret;
+
+    CI_DEBUG_LEVEL = 1;
+    ci_mem_init();
+    ci_cfg_lib_init();
+
+    if (!ci_args_apply(argc, argv, options) || (!TABLEPATH && !VERSION_MODE)) {
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if (VERSION_MODE)
+        exit(0);
+
+#if ! defined(_WIN32)
+    __log_error = (void (*)(void *, const char *,...)) log_errors;     /*set c-icap library log  function */
+#else
+    __vlog_error = vlog_errors;        /*set c-icap library  log function for win32..... */
+#endif
+
+    if (INFO_MODE || DUMP_MODE) {
+        if (!(table = ci_htable_open(TABLEPATH))) {
+            ci_debug_printf(1, "Error opening hash table %s\n", TABLEPATH);
+            return -1;
+        }
+        if (INFO_MODE)
+            info_table(table);
+        else
+            dump_table(table);
+        ci_htable_close(table);
+        return 0;
+    }
+
+    if (!INFILE) {
+        ci_debug_printf(1, "\nError: You need to specify the input file ('-i file.txt')\n\n");
+        ci_args_usage(argv[0], options);
+        exit(-1);
+    }
+    if ((f = fopen(INFILE, "r")) == NULL) {
+        ci_debug_printf(1, "Error opening file: %s\n", INFILE);
+        return -1;
+    }
+    ret = build_table(f);
+    fclose(f);
+    return ret ? 0 : -1;
+}
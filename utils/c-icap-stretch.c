@@ -61,6 +61,7 @@ char *BASE_URL = NULL;
 static char *OUT_DIR = NULL;
 int OUT_FILES_NUM = 4096;
 time_t START_TIME = 0;
+long int REQUEST_BUFFER_SIZE = 0;
 int FILES_NUMBER = 0;
 char **FILES = NULL;
 
@@ -131,12 +132,20 @@ int print_stat(void *data, const char *label, int id, int gid, const ci_stat_t *
 static void print_stats()
 {
     time_t rtime;
+    ci_kbs_t in_bytes, out_bytes;
     time(&rtime);
     printf("Statistics:\n\tFiles used :%d\n\t Number of threads :%d\n",
            FILES_NUMBER, threadsnum);
     rtime = rtime - START_TIME;
     printf("\tRunning for %u seconds\n", (unsigned int) rtime);
+    printf("\tRequest buffers size: %d bytes\n", CI_REQUEST_BUFFER_SIZE);
     ci_stat_statistics_iterate(NULL, -1, print_stat);
+    if (rtime > 0) {
+        in_bytes = ci_stat_kbs_get(in_bytes_stats);
+        out_bytes = ci_stat_kbs_get(out_bytes_stats);
+        printf("\tThroughput: %" PRIu64 " Kbs/sec in, %" PRIu64 " Kbs/sec out\n",
+               ci_kbs_kilobytes(&in_bytes) / rtime, ci_kbs_kilobytes(&out_bytes) / rtime);
+    }
 }
 
 static void sigint_handler(int sig)
@@ -849,6 +858,10 @@ static struct ci_options_entry options[] = {
         "-d", "level", &USE_DEBUG_LEVEL, ci_cfg_set_int,
         "debug level info to stdout"
     },
+    {
+        "-B", "buffer-size", &REQUEST_BUFFER_SIZE, ci_cfg_size_long,
+        "the size of the buffers used to read and write ICAP data (default is 4096, max 262144)"
+    },
 //     {"-nopreview", NULL, &send_preview, ci_cfg_disable, "Do not send preview data"},
     {"-x", "xheader", &xheaders, add_xheader, "Include the 'xheader' in icap request headers"},
     {"-hx", "xheader", &http_xheaders, add_xheader, "Include the 'xheader' in http request headers"},
@@ -895,6 +908,14 @@ int main(int argc, char **argv)
     if (USE_DEBUG_LEVEL >= 0)
         CI_DEBUG_LEVEL = USE_DEBUG_LEVEL;
 
+    if (REQUEST_BUFFER_SIZE) {
+        if (REQUEST_BUFFER_SIZE < CI_REQUEST_MIN_BUFFER_SIZE || REQUEST_BUFFER_SIZE > CI_REQUEST_MAX_BUFFER_SIZE) {
+            ci_debug_printf(1, "The buffer size must be between %d and %d bytes\n", CI_REQUEST_MIN_BUFFER_SIZE, CI_REQUEST_MAX_BUFFER_SIZE);
+            exit(-1);
+        }
+        CI_REQUEST_BUFFER_SIZE = REQUEST_BUFFER_SIZE;
+    }
+
 #if ! defined(_WIN32)
     __log_error = (void (*)(void *, const char *,...)) log_errors;     /*set c-icap library log  function */
 #else